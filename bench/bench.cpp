@@ -0,0 +1,649 @@
+#include "../include/slowertext.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <random>
+#include <unistd.h>
+
+/*
+ * Microbenchmarks for the editor engines
+ * Built from the same objects as the editor (everything but main.o);
+ * prints a table and optionally writes the results as JSON so runs can
+ * be compared between releases.
+ */
+
+// Globals normally defined in main.cpp
+EditorConfig editor_config;
+Terminal terminal;
+WindowManager window_manager;
+BufferList buffer_list;
+SearchState search_state;
+CursorSet cursor_set;
+DiffView diff_view;
+ColumnView column_view;
+
+/**
+ * Set status message (rendered by the render benchmarks)
+ * @param msg Message to display
+ */
+void set_status_message(const std::string& msg) {
+    editor_config.status_msg = msg;
+    editor_config.status_msg_time = time(nullptr);
+}
+
+/**
+ * Timings of one benchmark
+ */
+struct BenchResult {
+    std::string name;                // Benchmark name, e.g. buffer.insert_char.random
+    std::string unit;                // Unit of samples (ns, us, ms)
+    std::vector<double> samples;     // One timing per operation
+    double bytes_per_sample;         // Bytes processed per sample, 0 if not a throughput test
+};
+
+/**
+ * Benchmark options
+ */
+struct BenchOptions {
+    std::string json_path;           // JSON output file, "-" for stdout
+    std::string filter;              // Only run benchmarks containing this text
+    std::string sink;                // Render sink: "null" or "pty"
+    long iterations;                 // Operations per buffer benchmark
+    long max_file_mb;                // Largest synthetic file
+};
+
+typedef std::chrono::steady_clock bench_clock;
+
+/**
+ * Elapsed time between two clock readings
+ * @param start Start time
+ * @param end End time
+ * @param unit Unit name (ns, us or ms)
+ * @return Elapsed time in that unit
+ */
+static double elapsed(bench_clock::time_point start, bench_clock::time_point end, const std::string& unit) {
+    double ns = std::chrono::duration<double, std::nano>(end - start).count();
+    return unit == "ns" ? ns : unit == "us" ? ns / 1e3 : ns / 1e6;
+}
+
+/**
+ * Nearest-rank percentile of sorted samples
+ * @param sorted Samples in ascending order
+ * @param percent Percentile (0-100)
+ * @return Sample value at the percentile
+ */
+static double percentile(const std::vector<double>& sorted, double percent) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    size_t rank = static_cast<size_t>(percent / 100.0 * static_cast<double>(sorted.size()) + 0.5);
+    rank = std::min(std::max(rank, static_cast<size_t>(1)), sorted.size());
+    return sorted[rank - 1];
+}
+
+/**
+ * Make a line of printable text with a pseudo-random length
+ * @param rng Random generator
+ * @param min_length Shortest line
+ * @param max_length Longest line
+ * @return Line text
+ */
+static std::string random_line(std::mt19937& rng, int min_length, int max_length) {
+    static const char alphabet[] = "abcdefghijklmnopqrstuvwxyz    ABCDEFGHIJ0123456789(){};=+-";
+    int length = min_length + static_cast<int>(rng() % static_cast<unsigned>(max_length - min_length + 1));
+    std::string line(static_cast<size_t>(length), ' ');
+    for (char& c : line) {
+        c = alphabet[rng() % (sizeof(alphabet) - 1)];
+    }
+    return line;
+}
+
+/**
+ * Fill a buffer with random lines
+ * @param buffer Buffer to fill
+ * @param count Number of lines
+ * @param rng Random generator
+ */
+static void fill_buffer(Buffer& buffer, int count, std::mt19937& rng) {
+    std::vector<Line> lines;
+    LineArena arena;
+    lines.reserve(static_cast<size_t>(count));
+    for (int i = 0; i < count; i++) {
+        std::string text = random_line(rng, 20, 100);
+        lines.push_back(arena.make(text.data(), text.size()));
+    }
+    buffer.assign_lines(std::move(arena), std::move(lines));
+}
+
+/**
+ * Buffer operations: random character inserts, typing on a long line,
+ * random inserts into a huge line, newline splits and line deletes at the
+ * top, middle and end of a large buffer
+ * @param options Benchmark options
+ * @param results Receives results
+ */
+static void bench_buffer(const BenchOptions& options, std::vector<BenchResult>& results) {
+    std::mt19937 rng(42);
+    long iterations = options.iterations;
+    // Line inserts and deletes shift the line array, so fewer of them are timed
+    long line_operations = std::max(1L, iterations / 5);
+
+    {
+        BenchResult result = {"buffer.insert_char.random", "ns", {}, 0.0};
+        Buffer buffer;
+        fill_buffer(buffer, 10000, rng);
+        for (long i = 0; i < iterations; i++) {
+            int y = static_cast<int>(rng() % static_cast<unsigned>(buffer.get_line_count()));
+            int x = static_cast<int>(rng() % (buffer.view_line(y).length() + 1));
+            auto start = bench_clock::now();
+            buffer.insert_char(x, y, 'x');
+            result.samples.push_back(elapsed(start, bench_clock::now(), result.unit));
+        }
+        results.push_back(result);
+    }
+
+    {
+        // Typing bursts in the middle of one 64 KB line, moving now and then
+        BenchResult result = {"buffer.insert_char.long_line", "ns", {}, 0.0};
+        Buffer buffer;
+        buffer.set_line(0, std::string(1 << 16, 'a'));
+        int x = 1 << 15;
+        for (long i = 0; i < iterations; i++) {
+            if (i % 64 == 0) {
+                x = static_cast<int>(rng() % (buffer.view_line(0).length() + 1));
+            }
+            auto start = bench_clock::now();
+            buffer.insert_char(x++, 0, 'x');
+            result.samples.push_back(elapsed(start, bench_clock::now(), result.unit));
+        }
+        results.push_back(result);
+    }
+
+    {
+        // Inserts at random columns of one 32 MB line, as in a minified file
+        BenchResult result = {"buffer.insert_char.huge_line", "ns", {}, 0.0};
+        Buffer buffer;
+        buffer.set_line(0, std::string(1 << 25, 'a'));
+        for (long i = 0; i < iterations; i++) {
+            int x = static_cast<int>(rng() % (buffer.view_line(0).length() + 1));
+            auto start = bench_clock::now();
+            buffer.insert_char(x, 0, 'x');
+            result.samples.push_back(elapsed(start, bench_clock::now(), result.unit));
+        }
+        results.push_back(result);
+    }
+
+    {
+        BenchResult result = {"buffer.insert_newline.random", "ns", {}, 0.0};
+        Buffer buffer;
+        fill_buffer(buffer, 10000, rng);
+        for (long i = 0; i < line_operations; i++) {
+            int y = static_cast<int>(rng() % static_cast<unsigned>(buffer.get_line_count()));
+            int x = static_cast<int>(rng() % (buffer.view_line(y).length() + 1));
+            auto start = bench_clock::now();
+            buffer.insert_newline(x, y);
+            result.samples.push_back(elapsed(start, bench_clock::now(), result.unit));
+        }
+        results.push_back(result);
+    }
+
+    {
+        // Line splits with 100k anchors spread over the buffer, all of which
+        // below the split move down a row
+        BenchResult result = {"buffer.insert_newline.anchors", "ns", {}, 0.0};
+        Buffer buffer;
+        fill_buffer(buffer, 10000, rng);
+        for (int i = 0; i < 100000; i++) {
+            int y = static_cast<int>(rng() % static_cast<unsigned>(buffer.get_line_count()));
+            buffer.add_anchor(static_cast<int>(rng() % 80), y);
+        }
+        for (long i = 0; i < line_operations; i++) {
+            int y = static_cast<int>(rng() % static_cast<unsigned>(buffer.get_line_count()));
+            int x = static_cast<int>(rng() % (buffer.view_line(y).length() + 1));
+            auto start = bench_clock::now();
+            buffer.insert_newline(x, y);
+            result.samples.push_back(elapsed(start, bench_clock::now(), result.unit));
+        }
+        results.push_back(result);
+    }
+
+    {
+        // One keystroke at 10k cursors spread over 100k lines: a single
+        // batched edit and undo record per key
+        BenchResult result = {"buffer.edit_at_cursors.10k", "us", {}, 0.0};
+        Buffer buffer;
+        fill_buffer(buffer, 100000, rng);
+        std::vector<Cursor> cursors;
+        for (int y = 0; y < buffer.get_line_count(); y += 10) {
+            cursors.push_back({0, y});
+        }
+        for (long i = 0; i < std::min(line_operations, 500L); i++) {
+            CursorEdit kind = (i % 4 == 3) ? CURSOR_BACKSPACE : CURSOR_INSERT;
+            auto start = bench_clock::now();
+            buffer.edit_at_cursors(cursors, kind, "x", false);
+            result.samples.push_back(elapsed(start, bench_clock::now(), result.unit));
+        }
+        results.push_back(result);
+    }
+
+    {
+        // Yank 1M lines and put them back in the middle: handles are
+        // shared with the register, no line text is copied
+        BenchResult yank_result = {"buffer.yank.1m_lines", "ms", {}, 0.0};
+        BenchResult put_result = {"buffer.put.1m_lines", "ms", {}, 0.0};
+        Buffer buffer;
+        fill_buffer(buffer, 1000000, rng);
+        Register text;
+        for (long i = 0; i < std::min(line_operations, 10L); i++) {
+            int count = buffer.get_line_count();
+            auto start = bench_clock::now();
+            buffer.yank(0, 0, 0, count - 1, SELECT_LINES, text);
+            auto yanked = bench_clock::now();
+            buffer.put(0, count / 2, text);
+            yank_result.samples.push_back(elapsed(start, yanked, yank_result.unit));
+            put_result.samples.push_back(elapsed(yanked, bench_clock::now(), put_result.unit));
+            buffer.delete_lines(count / 2, count);
+        }
+        results.push_back(yank_result);
+        results.push_back(put_result);
+    }
+
+    {
+        // Sort 1M lines and apply the order: keys are views into the lines
+        // and the rows are rearranged by handle
+        BenchResult result = {"buffer.sort.1m_lines", "ms", {}, 0.0};
+        Buffer buffer;
+        fill_buffer(buffer, 1000000, rng);
+        SortOptions options = {false, false, false, false, 0, 0};
+        std::vector<int> rows;
+        for (long i = 0; i < std::min(line_operations, 10L); i++) {
+            int count = buffer.get_line_count();
+            options.reverse = (i % 2 == 1);
+            auto start = bench_clock::now();
+            LineFilter::sort_rows(buffer, 0, count - 1, options, rows);
+            buffer.arrange_lines(0, count - 1, rows);
+            result.samples.push_back(elapsed(start, bench_clock::now(), result.unit));
+        }
+        results.push_back(result);
+    }
+
+    {
+        // Diff 1M lines against a copy with an edit every ~1000 lines, then
+        // refresh the diff after single-line edits
+        BenchResult full = {"buffer.diff.1m_lines", "ms", {}, 0.0};
+        BenchResult update = {"buffer.diff.update", "ms", {}, 0.0};
+        std::mt19937 copy_rng = rng;
+        auto ours = std::make_shared<Buffer>();
+        auto theirs = std::make_shared<Buffer>();
+        fill_buffer(*ours, 1000000, rng);
+        fill_buffer(*theirs, 1000000, copy_rng);
+        for (int y = 500; y < theirs->get_line_count(); y += 900 + static_cast<int>(rng() % 200)) {
+            theirs->replace_lines(y, static_cast<int>(rng() % 3), {random_line(rng, 20, 100)});
+        }
+        for (long i = 0; i < std::min(line_operations, 5L); i++) {
+            DiffView view;
+            auto start = bench_clock::now();
+            view.start(ours, theirs);
+            full.samples.push_back(elapsed(start, bench_clock::now(), full.unit));
+        }
+        DiffView view;
+        view.start(ours, theirs);
+        for (long i = 0; i < std::min(line_operations, 10L); i++) {
+            ours->insert_char(0, static_cast<int>(rng() % ours->get_line_count()), 'x');
+            auto start = bench_clock::now();
+            view.update();
+            update.samples.push_back(elapsed(start, bench_clock::now(), update.unit));
+        }
+        results.push_back(full);
+        results.push_back(update);
+    }
+
+    // Deletes run on a buffer that stays large so middle/top costs show
+    const char* positions[] = {"top", "middle", "end"};
+    for (const char* position : positions) {
+        BenchResult result = {std::string("buffer.delete_line.") + position, "ns", {}, 0.0};
+        Buffer buffer;
+        fill_buffer(buffer, static_cast<int>(line_operations) + 100000, rng);
+        for (long i = 0; i < line_operations; i++) {
+            int count = buffer.get_line_count();
+            int y = (position[0] == 't') ? 0 : (position[0] == 'm') ? count / 2 : count - 1;
+            auto start = bench_clock::now();
+            buffer.delete_line(y);
+            result.samples.push_back(elapsed(start, bench_clock::now(), result.unit));
+        }
+        results.push_back(result);
+    }
+}
+
+/**
+ * Write a synthetic text file
+ * @param path File to create
+ * @param bytes Approximate size
+ * @return True on success
+ */
+static bool write_synthetic_file(const std::string& path, size_t bytes) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    // Repeat a block of random lines; content variety does not matter here
+    std::mt19937 rng(7);
+    std::string block;
+    while (block.size() < (1u << 20)) {
+        block += random_line(rng, 0, 120);
+        block += '\n';
+    }
+    size_t written = 0;
+    bool ok = true;
+    while (ok && written < bytes) {
+        size_t chunk = std::min(block.size(), bytes - written);
+        ok = write(fd, block.data(), chunk) == static_cast<ssize_t>(chunk);
+        written += chunk;
+    }
+    return close(fd) == 0 && ok;
+}
+
+/**
+ * File load and save throughput on synthetic files from 1 MB up to
+ * the configured maximum (4 GB with --max-file-mb 4096)
+ * @param options Benchmark options
+ * @param results Receives results
+ */
+static void bench_files(const BenchOptions& options, std::vector<BenchResult>& results) {
+    const char* tmp = getenv("TMPDIR");
+    std::string dir_template = std::string(tmp ? tmp : "/tmp") + "/slowertext-bench-XXXXXX";
+    std::vector<char> dir_name(dir_template.begin(), dir_template.end());
+    dir_name.push_back('\0');
+    if (!mkdtemp(dir_name.data())) {
+        std::cerr << "bench: cannot create temporary directory\n";
+        return;
+    }
+    std::string dir(dir_name.data());
+
+    const long sizes_mb[] = {1, 16, 256, 1024, 4096};
+    for (long size_mb : sizes_mb) {
+        if (size_mb > options.max_file_mb) {
+            break;
+        }
+        size_t bytes = static_cast<size_t>(size_mb) << 20;
+        std::string source = dir + "/source.txt";
+        std::string target = dir + "/target.txt";
+        if (!write_synthetic_file(source, bytes)) {
+            std::cerr << "bench: cannot write " << size_mb << " MB file in " << dir << "\n";
+            break;
+        }
+
+        int repeats = size_mb <= 16 ? 10 : size_mb <= 256 ? 3 : 1;
+        std::string suffix = "." + std::to_string(size_mb) + "mb";
+        BenchResult load = {"file.load" + suffix, "ms", {}, static_cast<double>(bytes)};
+        BenchResult save = {"file.save" + suffix, "ms", {}, static_cast<double>(bytes)};
+
+        for (int i = 0; i < repeats; i++) {
+            Buffer buffer;
+            auto start = bench_clock::now();
+            FileManager::load_file(source, buffer);
+            load.samples.push_back(elapsed(start, bench_clock::now(), load.unit));
+
+            start = bench_clock::now();
+            FileManager::save_file(target, buffer);
+            save.samples.push_back(elapsed(start, bench_clock::now(), save.unit));
+        }
+        results.push_back(load);
+        results.push_back(save);
+        unlink(source.c_str());
+        unlink(target.c_str());
+    }
+    rmdir(dir.c_str());
+}
+
+/**
+ * Configuration parsing, using the same rc file lookup as the editor
+ * @param results Receives results
+ */
+static void bench_config(std::vector<BenchResult>& results) {
+    BenchResult result = {"config.load", "us", {}, 0.0};
+    for (int i = 0; i < 2000; i++) {
+        EditorConfig config;
+        auto start = bench_clock::now();
+        ConfigManager::load_config(config);
+        result.samples.push_back(elapsed(start, bench_clock::now(), result.unit));
+    }
+    results.push_back(result);
+}
+
+/**
+ * Open a pseudo terminal whose output is drained and discarded
+ * @param master Receives the master side
+ * @return Slave side descriptor, or -1 on failure
+ */
+static int open_pty_sink(int& master) {
+    master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+        return -1;
+    }
+    const char* name = ptsname(master);
+    return name ? open(name, O_WRONLY | O_NOCTTY) : -1;
+}
+
+/**
+ * Screen refresh cost: full redraws, scrolling one line per frame, and
+ * idle frames where nothing changed. Output goes to /dev/null or a pty.
+ * @param options Benchmark options
+ * @param results Receives results
+ */
+static void bench_render(const BenchOptions& options, std::vector<BenchResult>& results) {
+    std::mt19937 rng(11);
+    ConfigManager::load_config(editor_config);
+    editor_config.screen_rows = 48;
+    editor_config.screen_cols = 160;
+    editor_config.mode = COMMAND_MODE;
+    editor_config.cursor_x = 0;
+    editor_config.cursor_y = 0;
+    editor_config.row_offset = 0;
+    editor_config.col_offset = 0;
+    editor_config.filename = "bench.txt";
+    set_status_message("benchmark");
+
+    std::shared_ptr<Buffer> buffer = std::make_shared<Buffer>();
+    fill_buffer(*buffer, 100000, rng);
+    window_manager.init(buffer);
+
+    // Route frames to the sink; a pty is drained by a reader thread
+    int master = -1;
+    int sink = (options.sink == "pty") ? open_pty_sink(master) : open("/dev/null", O_WRONLY);
+    if (sink < 0) {
+        std::cerr << "bench: cannot open render sink " << options.sink << "\n";
+        return;
+    }
+    std::atomic<bool> draining(true);
+    std::thread drain;
+    if (master >= 0) {
+        drain = std::thread([master, &draining]() {
+            char discard[65536];
+            while (draining && read(master, discard, sizeof(discard)) > 0) {
+            }
+        });
+    }
+    fflush(stdout);
+    int saved_stdout = dup(STDOUT_FILENO);
+    dup2(sink, STDOUT_FILENO);
+
+    // folded scrolls a buffer where all but 10 rows of every 1000 are in
+    // closed folds, so each window shows several folds; columns pages
+    // through CSV rows laid out in columns, indexing every row it shows
+    const char* variants[] = {"full", "scroll", "idle", "folded", "columns"};
+    for (const char* variant : variants) {
+        BenchResult result = {std::string("render.refresh_screen.") + variant, "us", {}, 0.0};
+        bool folded = std::string(variant) == "folded";
+        bool columns = std::string(variant) == "columns";
+        if (folded) {
+            for (int y = 0; y + 1000 <= buffer->get_line_count(); y += 1000) {
+                buffer->add_fold(y + 5, y + 994);
+            }
+        }
+        if (columns) {
+            std::vector<std::string> rows;
+            for (int y = 0; y < 100000; y++) {
+                std::string row = std::to_string(y);
+                for (int field = 0; field < 12; field++) {
+                    row += ',' + random_line(rng, 1, 24);
+                }
+                rows.push_back(row);
+            }
+            buffer = std::make_shared<Buffer>();
+            buffer->replace_lines(0, 1, rows);
+            window_manager.init(buffer);
+            column_view.start(*buffer, ',');
+            while (!column_view.poll()) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+        editor_config.cursor_y = 0;
+        for (int frame = 0; frame < 2000; frame++) {
+            if (columns) {
+                int next = editor_config.cursor_y + editor_config.screen_rows;
+                editor_config.cursor_y = next < buffer->get_line_count() ? next : 0;
+            } else if (folded) {
+                int next = buffer->next_visible(editor_config.cursor_y);
+                editor_config.cursor_y = next < buffer->get_line_count() ? next : 0;
+            } else if (variant[0] == 'f') {
+                window_manager.invalidate();
+            } else if (variant[0] == 's') {
+                editor_config.cursor_y = std::min(editor_config.cursor_y + 1, buffer->get_line_count() - 1);
+            }
+            auto start = bench_clock::now();
+            Renderer::refresh_screen(editor_config);
+            result.samples.push_back(elapsed(start, bench_clock::now(), result.unit));
+        }
+        results.push_back(result);
+    }
+
+    column_view.clear();
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+    close(sink);
+    if (master >= 0) {
+        draining = false;
+        close(master);
+        drain.join();
+    }
+}
+
+/**
+ * Print results as a table
+ * @param out Destination stream
+ * @param results Benchmark results
+ */
+static void print_table(FILE* out, std::vector<BenchResult>& results) {
+    fprintf(out, "%-34s %8s %10s %10s %10s %10s %10s %5s %9s\n",
+           "benchmark", "samples", "mean", "p50", "p90", "p99", "max", "unit", "MB/s");
+    for (BenchResult& result : results) {
+        std::vector<double> sorted = result.samples;
+        std::sort(sorted.begin(), sorted.end());
+        double total = 0.0;
+        for (double sample : sorted) {
+            total += sample;
+        }
+        double mean = sorted.empty() ? 0.0 : total / static_cast<double>(sorted.size());
+        fprintf(out, "%-34s %8zu %10.2f %10.2f %10.2f %10.2f %10.2f %5s",
+               result.name.c_str(), sorted.size(), mean, percentile(sorted, 50), percentile(sorted, 90),
+               percentile(sorted, 99), sorted.empty() ? 0.0 : sorted.back(), result.unit.c_str());
+        if (result.bytes_per_sample > 0 && percentile(sorted, 50) > 0) {
+            // Throughput of the median run; file samples are in ms
+            fprintf(out, " %9.1f", result.bytes_per_sample / (1 << 20) / (percentile(sorted, 50) / 1e3));
+        }
+        fprintf(out, "\n");
+    }
+}
+
+/**
+ * Write results as JSON
+ * @param path Output file, "-" for stdout
+ * @param results Benchmark results
+ * @return True on success
+ */
+static bool write_json(const std::string& path, std::vector<BenchResult>& results) {
+    FILE* out = (path == "-") ? stdout : fopen(path.c_str(), "w");
+    if (!out) {
+        return false;
+    }
+
+    fprintf(out, "{\n  \"version\": 1,\n  \"timestamp\": %ld,\n  \"cpus\": %u,\n  \"results\": [\n",
+            static_cast<long>(time(nullptr)), std::thread::hardware_concurrency());
+    for (size_t i = 0; i < results.size(); i++) {
+        BenchResult& result = results[i];
+        std::vector<double> sorted = result.samples;
+        std::sort(sorted.begin(), sorted.end());
+        double total = 0.0;
+        for (double sample : sorted) {
+            total += sample;
+        }
+        fprintf(out, "    {\"name\": \"%s\", \"unit\": \"%s\", \"samples\": %zu, \"mean\": %.3f, "
+                "\"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f",
+                result.name.c_str(), result.unit.c_str(), sorted.size(),
+                sorted.empty() ? 0.0 : total / static_cast<double>(sorted.size()),
+                percentile(sorted, 50), percentile(sorted, 90), percentile(sorted, 99),
+                sorted.empty() ? 0.0 : sorted.back());
+        if (result.bytes_per_sample > 0) {
+            fprintf(out, ", \"bytes\": %.0f", result.bytes_per_sample);
+        }
+        fprintf(out, "}%s\n", i + 1 < results.size() ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+    return out == stdout || fclose(out) == 0;
+}
+
+/**
+ * Benchmark entry point
+ * Options: --json FILE, --filter TEXT, --iterations N, --max-file-mb N,
+ * --sink null|pty
+ */
+int main(int argc, char* argv[]) {
+    BenchOptions options = {"", "", "null", 100000, 256};
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "usage: slowertext-bench [--json FILE] [--filter TEXT] [--iterations N] "
+                         "[--max-file-mb N] [--sink null|pty]\n";
+            return 2;
+        }
+        std::string value = argv[++i];
+        if (arg == "--json") {
+            options.json_path = value;
+        } else if (arg == "--filter") {
+            options.filter = value;
+        } else if (arg == "--iterations") {
+            options.iterations = std::max(1L, std::atol(value.c_str()));
+        } else if (arg == "--max-file-mb") {
+            options.max_file_mb = std::atol(value.c_str());
+        } else if (arg == "--sink") {
+            options.sink = value;
+        } else {
+            std::cerr << "bench: unknown option " << arg << "\n";
+            return 2;
+        }
+    }
+
+    std::vector<BenchResult> results;
+    // A filter selects groups by prefix ("file" or "file.load" both run file benchmarks)
+    auto wanted = [&options](const std::string& group) {
+        return options.filter.compare(0, group.size(), group) == 0 || group.compare(0, options.filter.size(), options.filter) == 0;
+    };
+    if (wanted("buffer")) bench_buffer(options, results);
+    if (wanted("file")) bench_files(options, results);
+    if (wanted("config")) bench_config(results);
+    if (wanted("render")) bench_render(options, results);
+
+    // Keep stdout clean for JSON when it is written there
+    print_table(options.json_path == "-" ? stderr : stdout, results);
+    if (!options.json_path.empty() && !write_json(options.json_path, results)) {
+        std::cerr << "bench: cannot write " << options.json_path << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -12,6 +12,12 @@
 #include <csignal>
 #include <map>
 #include <ctime>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <cstdint>
 
 // ANSI escape codes for terminal control
 #define CLEAR_SCREEN "\033[2J"
@@ -55,10 +61,24 @@
  * Editor mode enumeration
  * INSERT_MODE: Normal text editing mode
  * COMMAND_MODE: Vi-like command mode for navigation and commands
+ * VISUAL_MODE: Selecting text from command mode
  */
 enum EditorMode {
     INSERT_MODE,
-    COMMAND_MODE
+    COMMAND_MODE,
+    VISUAL_MODE
+};
+
+/**
+ * Shape of a visual selection or of register text
+ * SELECT_CHARS: from one position to another
+ * SELECT_LINES: whole rows
+ * SELECT_BLOCK: the same columns on each row
+ */
+enum SelectionKind {
+    SELECT_CHARS,
+    SELECT_LINES,
+    SELECT_BLOCK
 };
 
 /**
@@ -75,7 +95,10 @@ struct EditorConfig {
     int col_offset;            // Horizontal scroll offset
     
     // Editor state
-    EditorMode mode;           // Current editor mode (INSERT or COMMAND)
+    EditorMode mode;           // Current editor mode (INSERT, COMMAND or VISUAL)
+    SelectionKind visual_kind; // Shape of the visual selection
+    int visual_x;              // Column where the visual selection started
+    int visual_y;              // Row where the visual selection started
     std::string filename;      // Currently opened file name
     bool modified;             // Whether the buffer has been modified
     bool quit;                 // Flag to exit the editor
@@ -101,16 +124,18 @@ struct EditorConfig {
     bool confirm_quit;         // Confirm before quitting with unsaved changes
     int auto_save_interval;    // Auto-save interval (unused)
     bool create_backups;       // Create backup files (unused)
-    int max_undo_levels;       // Maximum undo levels (unused)
+    int max_undo_levels;       // Maximum undo records per buffer
     bool word_wrap;            // Word wrap (unused)
     std::string default_extension; // Default file extension
     bool show_hidden_files;    // Show hidden files (unused)
     std::string default_encoding;  // Default text encoding (unused)
     std::string line_endings;  // Line ending style (unused)
-    int buffer_size;           // Buffer size (unused)
+    int buffer_size;           // Memory budget for open buffers in MB
     int refresh_rate;          // Screen refresh rate (unused)
     bool syntax_highlighting;  // Enable basic syntax highlighting
     bool debug_mode;           // Enable debug messages
+    bool trace_events;         // Record trace events in memory
+    std::string trace_file;    // Trace dump written at exit (empty = none)
     
     // Key bindings (stored as strings for configuration)
     std::string enter_insert;   // Key to enter insert mode
@@ -169,6 +194,590 @@ public:
      * @return Key code integer
      */
     static int parse_key_binding(const std::string& key);
+    
+    /**
+     * Get the path of the parsed-config snapshot for a config file
+     * @param config_path Configuration file path
+     * @return Snapshot path in the user cache directory
+     */
+    static std::string get_snapshot_path(const std::string& config_path);
+    
+    /**
+     * Watch the configuration file for changes with inotify
+     * @return True if the watch was set up
+     */
+    static bool watch_config();
+    
+    /**
+     * Reload the configuration if the watched file changed
+     * Never blocks; meant to be called from the idle loop
+     * @param config Editor configuration to update
+     * @return True if settings changed and the screen needs a refresh
+     */
+    static bool poll_changes(EditorConfig& config);
+    
+    /**
+     * Re-read the configuration file and apply what changed
+     * Only settings are replaced; cursor, mode and buffers are kept, and
+     * derived state (key table, render style, budgets) is recomputed.
+     * @param config Editor configuration to update
+     * @return Names of the settings that changed
+     */
+    static std::vector<std::string> reload_config(EditorConfig& config);
+};
+
+/**
+ * Startup phase timing for --startup-profile
+ * Each call to phase() closes the phase that started at the previous
+ * call (or at process start).
+ */
+class StartupProfile {
+public:
+    /**
+     * Start collecting phase timings
+     */
+    static void enable();
+    
+    /**
+     * End the current startup phase
+     * @param name Phase name, a string literal
+     */
+    static void phase(const char* name);
+    
+    /**
+     * Stop collecting; later phases are only traced
+     */
+    static void finish();
+    
+    /**
+     * Print the phase timings to stderr, once
+     */
+    static void report();
+};
+
+/**
+ * Line of text stored in its buffer's LineArena
+ * A plain handle: copying it does not copy the text. The buffer gives the
+ * bytes back to the arena when the line is replaced or leaves undo history.
+ * A line with text and no room is shared with a register: it is never
+ * written or given back, and editing it copies it first.
+ */
+struct Line {
+    char* text;                      // Bytes, not NUL-terminated; nullptr when empty
+    size_t count;                    // Length in bytes
+    size_t room;                     // Bytes allocated, 0 if shared
+
+    size_t size() const { return count; }
+    size_t length() const { return count; }
+    bool empty() const { return count == 0; }
+    const char* data() const { return text ? text : ""; }
+    const char* begin() const { return data(); }
+    const char* end() const { return data() + count; }
+    char operator[](size_t i) const { return text[i]; }
+    std::string str() const { return std::string(data(), count); }
+};
+
+/**
+ * Memory behind a line arena
+ * Freed when the arena and every register holding text from it are gone.
+ */
+struct ArenaStore {
+    std::vector<char*> slabs;        // Slab memory
+    std::vector<char*> large;        // Heap blocks over the largest class
+
+    ArenaStore() {}
+    ~ArenaStore();
+    ArenaStore(const ArenaStore&) = delete;
+    ArenaStore& operator=(const ArenaStore&) = delete;
+};
+
+/**
+ * Slab allocator for line text
+ * Text is bump-allocated from 1 MB slabs, so loading a file costs one
+ * allocation per slab instead of one per line, and freeing the arena
+ * frees every line at once. Released blocks go on free lists by size
+ * class for reuse; blocks over 64 KB come from the heap. An arena belongs
+ * to one buffer and is used by one thread at a time; only its store is
+ * shared, with registers.
+ */
+class LineArena {
+private:
+    std::shared_ptr<ArenaStore> store;  // Slabs and heap blocks, created on first use
+    std::vector<std::shared_ptr<ArenaStore>> kept;  // Stores of shared lines put into this arena
+    std::vector<char*> free_lists;   // Head of the free list per size class
+    char* next;                      // Bump pointer in the newest slab
+    char* limit;                     // End of the newest slab
+    size_t large_bytes;              // Bytes in heap blocks
+    size_t free_bytes;               // Bytes on free lists
+
+    char* allocate(size_t bytes, size_t& room);
+    void release(char* text, size_t room);
+
+public:
+    LineArena();
+    ~LineArena();
+    LineArena(LineArena&& other) noexcept;
+    LineArena& operator=(LineArena&& other) noexcept;
+    LineArena(const LineArena&) = delete;
+    LineArena& operator=(const LineArena&) = delete;
+
+    /**
+     * Create a line holding a copy of some text
+     * @param text Characters
+     * @param length Number of characters
+     * @return New line owned by this arena
+     */
+    Line make(const char* text, size_t length);
+
+    /**
+     * Give a line's bytes back; the line becomes empty
+     * @param line Line owned by this arena
+     */
+    void drop(Line& line);
+
+    /**
+     * Insert text into a line, moving it to a larger block if needed
+     * @param line Line owned by this arena
+     * @param pos Column, at most the line length
+     * @param text Characters to insert
+     * @param length Number of characters
+     */
+    void insert(Line& line, size_t pos, const char* text, size_t length);
+
+    /**
+     * Delete characters from a line in place, or from a copy if shared
+     * @param line Line owned by this arena
+     * @param pos First column
+     * @param length Number of characters
+     */
+    void erase(Line& line, size_t pos, size_t length);
+
+    /**
+     * Make a line read-only so handles to it can be shared
+     * Its block is not reused until the store is freed.
+     * @param line Line owned by this arena
+     */
+    void share(Line& line);
+
+    /**
+     * Get the stores lines of this arena may point into
+     * @param out Receives this arena's store and those it keeps alive
+     */
+    void shared_stores(std::vector<std::shared_ptr<ArenaStore>>& out);
+
+    /**
+     * Keep stores alive while shared lines from them are in this arena
+     * @param stores Stores of the lines put in
+     */
+    void keep(const std::vector<std::shared_ptr<ArenaStore>>& stores);
+
+    /**
+     * Get the memory held from the system
+     * @return Bytes in slabs and heap blocks
+     */
+    size_t footprint() const;
+
+    /**
+     * Get the memory sitting on free lists
+     * @return Released bytes not yet reused
+     */
+    size_t unused() const { return free_bytes; }
+};
+
+/**
+ * One step of an undo record
+ * Rows [line, line + count) replaced the saved lines; undoing swaps them back
+ */
+struct UndoChange {
+    int line;                        // First affected row
+    std::vector<Line> lines;         // Content replaced by the change, in the buffer's arena
+    int count;                       // Rows produced by the change
+};
+
+/**
+ * Undo record: a group of changes undone and redone together
+ */
+struct UndoRecord {
+    std::vector<UndoChange> changes; // Changes in the order applied
+    bool typing;                     // Single-line edit that typing may extend
+};
+
+/**
+ * Yanked or deleted text
+ * Pieces are read-only handles to buffer text, whole rows or parts of
+ * rows, and the stores keep that text alive after the buffer changes,
+ * compacts or closes; yanking and putting copy no text.
+ */
+struct Register {
+    SelectionKind kind;              // Lines, characters or a block
+    std::vector<Line> pieces;        // One piece per row
+    std::vector<std::shared_ptr<ArenaStore>> stores;  // Arenas holding the pieces
+};
+
+/**
+ * Replacement text for one line in a batch edit
+ */
+struct LineChange {
+    int line;                        // Row to replace
+    std::string text;                // New content (copied into the buffer)
+};
+
+/**
+ * Cursor position in a multi-cursor edit
+ */
+struct Cursor {
+    int x;                           // Column
+    int y;                           // Row
+};
+
+/**
+ * Keystroke applied at every cursor of a multi-cursor edit
+ */
+enum CursorEdit {
+    CURSOR_INSERT,                   // Insert text before the cursor
+    CURSOR_BACKSPACE,                // Delete the byte before the cursor
+    CURSOR_DELETE,                   // Delete the byte under the cursor
+    CURSOR_NEWLINE                   // Split the row at the cursor
+};
+
+/**
+ * Identity of a file version on disk
+ * Lets a long-lived process notice files changed behind its back.
+ */
+struct FileStamp {
+    long long mtime_sec;             // Modification time, seconds
+    long long mtime_nsec;            // Modification time, nanoseconds
+    long long size;                  // File size in bytes
+    unsigned long long inode;        // Inode number
+
+    bool operator==(const FileStamp& other) const {
+        return mtime_sec == other.mtime_sec && mtime_nsec == other.mtime_nsec && size == other.size &&
+               inode == other.inode;
+    }
+};
+
+/**
+ * Very long line stored as chunks
+ * A Fenwick tree over the chunk lengths finds the chunk holding a column
+ * and updates after an edit in O(log chunks), so edits and reads touch
+ * only the chunks involved whatever the line length. Columns are bytes
+ * throughout the editor, so the byte index is also the column index.
+ */
+class LineChunks {
+private:
+    std::vector<std::string> chunks; // Pieces of the line, none empty unless the line is
+    std::vector<size_t> tree;        // Fenwick tree of chunk lengths, 1-based
+    size_t total;                    // Line length
+
+    size_t locate(size_t& pos) const;  // Chunk holding pos; pos becomes the offset in it
+    void add(size_t chunk, size_t grow, size_t shrink);
+    void rebuild();                  // Recompute the tree after chunks were split or removed
+
+public:
+    LineChunks();
+
+    /**
+     * Split a line into chunks
+     * @param text Line text
+     * @param length Line length
+     */
+    void assign(const char* text, size_t length);
+
+    /**
+     * Join the chunks back into one line and empty this
+     * @return Line text
+     */
+    std::string take();
+
+    size_t length() const { return total; }
+    size_t capacity() const;         // Bytes allocated for the chunks
+    char at(size_t pos) const;
+
+    /**
+     * Append part of the line to a string
+     * @param out String to append to
+     * @param pos First column
+     * @param count Number of bytes
+     */
+    void append_to(std::string& out, size_t pos, size_t count) const;
+
+    /**
+     * Insert text, splitting the chunk if it grows too large
+     * @param pos Column, at most length()
+     * @param text Characters to insert
+     * @param count Number of characters
+     */
+    void insert(size_t pos, const char* text, size_t count);
+
+    /**
+     * Delete one character, dropping its chunk if it becomes empty
+     * @param pos Column, less than length()
+     */
+    void erase(size_t pos);
+};
+
+/**
+ * Read-only view of a buffer line
+ * The line being typed on is stored around an edit gap, so it is seen as
+ * two pieces; every other line has an empty back piece. A very long line
+ * being edited is stored as chunks instead.
+ */
+struct LineView {
+    const char* front;               // Text before the gap
+    size_t front_length;
+    const char* back;                // Text after the gap
+    size_t back_length;
+    const LineChunks* chunks;        // Chunked line, or nullptr
+
+    size_t length() const { return chunks ? chunks->length() : front_length + back_length; }
+    char operator[](size_t i) const {
+        return chunks ? chunks->at(i) : i < front_length ? front[i] : back[i - front_length];
+    }
+
+    /**
+     * Append part of the line to a string
+     * @param out String to append to
+     * @param pos First column
+     * @param count Number of bytes
+     */
+    void append_to(std::string& out, size_t pos, size_t count) const;
+};
+
+/**
+ * Positions that follow the text as it is edited
+ * Anchors are kept in a treap ordered by (row, col). Every node carries
+ * a pending row and column shift for its children, so an edit moves all
+ * anchors after it by splitting the tree at the edit point, shifting the
+ * right part at its root and merging again: O(log n) whatever the number
+ * of anchors. Anchors inside deleted text collapse to the deletion point.
+ * Marks and the jump list use it; any other feature that needs to keep a
+ * place in the text can add anchors of its own.
+ */
+class AnchorTree {
+private:
+    struct Node {
+        int row;
+        int col;
+        int row_shift;               // Pending shift of the children's rows
+        int col_shift;               // Pending shift of the children's columns
+        unsigned priority;           // Heap order, random
+        int left;
+        int right;
+        int parent;                  // -1 for the root, -2 for a free node
+    };
+
+    std::vector<Node> nodes;         // Node pool indexed by anchor id
+    std::vector<int> free_ids;       // Removed anchors, reused by add()
+    int root;
+    unsigned seed;                   // Priority generator state
+    int count;
+
+    void push(int t);                // Hand pending shifts down to the children
+    void shift(int t, int rows, int cols);
+    void collapse(int t, int row, int col);  // Move a whole subtree to one position
+    void split(int t, int row, int col, int& left, int& right);  // left gets keys < (row, col)
+    int merge(int left, int right);
+    void attach(int t, int parent);
+
+public:
+    AnchorTree();
+
+    /**
+     * Add an anchor
+     * @param row Row
+     * @param col Column
+     * @return Anchor id
+     */
+    int add(int row, int col);
+
+    /**
+     * Remove an anchor; its id may be reused
+     * @param id Anchor id
+     */
+    void remove(int id);
+
+    /**
+     * Get where an anchor is now
+     * @param id Anchor id
+     * @param row Receives the row
+     * @param col Receives the column
+     * @return False if there is no such anchor
+     */
+    bool position(int id, int& row, int& col) const;
+
+    int size() const { return count; }
+
+    /**
+     * Text was inserted within a row
+     * @param row Row
+     * @param col Insertion column; anchors at or after it move right
+     * @param length Bytes inserted
+     */
+    void insert_text(int row, int col, int length);
+
+    /**
+     * Text was deleted within a row
+     * @param row Row
+     * @param col First deleted column
+     * @param length Bytes deleted
+     */
+    void delete_text(int row, int col, int length);
+
+    /**
+     * A row was split in two at a column
+     * @param row Row
+     * @param col Split column; anchors at or after it move to the new row
+     */
+    void split_row(int row, int col);
+
+    /**
+     * The row after row was appended to row
+     * @param row Row that grew
+     * @param length Length of row before the join
+     */
+    void join_rows(int row, int length);
+
+    /**
+     * Rows were replaced by a different number of rows
+     * Anchors on rows that no longer exist move to the start of the row
+     * after the replacement.
+     * @param first First replaced row
+     * @param count Rows replaced
+     * @param produced Rows put in their place
+     */
+    void replace_rows(int first, int count, int produced);
+
+    /**
+     * Two neighbouring blocks of rows swapped places
+     * @param first First row of the upper block
+     * @param middle First row of the lower block
+     * @param end Row after the lower block
+     */
+    void swap_rows(int first, int middle, int end);
+};
+
+/**
+ * How a buffer's folds are made
+ * FOLD_MANUAL: folds are created with :fold
+ * FOLD_INDENT: each run of lines indented deeper than its surroundings
+ */
+enum FoldMethod {
+    FOLD_MANUAL,
+    FOLD_INDENT
+};
+
+/**
+ * Range of rows that can be collapsed to one screen row
+ */
+struct Fold {
+    int start;                       // First row
+    int end;                         // Last row (inclusive)
+    int level;                       // Nesting depth of indent folds, 0 for manual folds
+    bool closed;                     // Collapsed
+};
+
+/**
+ * Interval tree of folds
+ * A treap ordered by start row (outer folds first on a tie), where each
+ * node also keeps the largest end row, and the largest end row of a
+ * closed fold, found in its subtree. Finding the closed fold that hides
+ * a row is then O(log n) however long the folds are, which is what lets
+ * the renderer and cursor movement step over a collapsed range in one
+ * move. Folds nest but never cross. Row shifts after an edit are pending
+ * on subtree roots as in AnchorTree.
+ */
+class FoldTree {
+private:
+    struct Node {
+        Fold fold;
+        int shift;                   // Pending row shift of the children
+        int max_end;                 // Largest end in the subtree
+        int max_closed_end;          // Largest end of a closed fold in the subtree
+        unsigned priority;
+        int left;
+        int right;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<int> free_ids;
+    int root;
+    unsigned seed;
+    int count;
+
+    void push(int t);
+    void shift(int t, int rows);
+    void update(int t);              // Recompute the subtree maxima of a node
+    void split(int t, int start, int end, int& left, int& right);  // left gets folds ordered before (start, end)
+    int merge(int left, int right);
+    void release(int t);             // Free a whole subtree
+    void remap_ends(int t, int first, int count, int produced);
+    void collect(int t, int offset, int first, int last, std::vector<Fold>& out) const;
+    void set_closed(int t, bool closed);
+    bool find_closed(int t, int offset, int row, Fold& fold) const;
+
+public:
+    FoldTree();
+
+    /**
+     * Remove every fold
+     */
+    void clear();
+
+    int size() const { return count; }
+
+    /**
+     * Add a fold
+     * @param fold Fold to add; it must not cross an existing fold
+     */
+    void add(const Fold& fold);
+
+    /**
+     * Remove a fold
+     * @param start First row of the fold
+     * @param end Last row of the fold
+     * @return False if there is no such fold
+     */
+    bool remove(int start, int end);
+
+    /**
+     * Open or close a fold
+     * @param start First row of the fold
+     * @param end Last row of the fold
+     * @param closed New state
+     */
+    void set_state(int start, int end, bool closed);
+
+    /**
+     * Open or close every fold
+     * @param closed New state
+     */
+    void set_all(bool closed);
+
+    /**
+     * Find the outermost closed fold holding a row
+     * @param row Row
+     * @param fold Receives the fold
+     * @return False if the row is not in a closed fold
+     */
+    bool closed_at(int row, Fold& fold) const;
+
+    /**
+     * Get the folds that overlap a range of rows
+     * @param first First row
+     * @param last Last row
+     * @param out Receives the folds, outer folds before inner ones
+     */
+    void overlapping(int first, int last, std::vector<Fold>& out) const;
+
+    /**
+     * Rows were replaced by a different number of rows
+     * Folds after the edit move; folds around it grow or shrink, and
+     * folds left without rows are dropped.
+     * @param first First replaced row
+     * @param count Rows replaced
+     * @param produced Rows put in their place
+     */
+    void replace_rows(int first, int count, int produced);
 };
 
 /**
@@ -177,8 +786,48 @@ public:
  */
 class Buffer {
 private:
-    std::vector<std::string> lines;  // Text lines
+    std::vector<Line> lines;         // Text lines
+    mutable LineArena arena;         // Text of lines and undo history
     bool modified;                   // Modification flag
+    unsigned long version;           // Incremented on every change
+    std::string filename;            // File backing this buffer
+    std::vector<UndoRecord> undo_stack; // Undo history, newest last
+    std::vector<UndoRecord> redo_stack; // Undone records, newest last
+    int transaction_depth;           // Open begin_transaction() calls
+    bool transaction_recorded;       // Current transaction has a record
+    mutable FileStamp disk_stamp;    // File version the text was loaded from or saved to
+    
+    // Gap buffer for the line being typed on; readers of whole lines close it
+    mutable int gap_row;             // Row held in gap_text or row_chunks, -1 if none
+    mutable std::string gap_text;    // That row with a gap at [gap_start, gap_end)
+    mutable size_t gap_start;        // First byte of the gap, the edit point
+    mutable size_t gap_end;          // First byte after the gap
+    mutable bool row_chunked;        // Row is very long and held in row_chunks instead
+    mutable LineChunks row_chunks;
+    
+    AnchorTree anchors;              // Positions kept in step with edits
+    int marks[26];                   // Anchor of marks a-z, -1 if unset
+    std::vector<int> jumps;          // Anchors of the jump list, oldest first
+    size_t jump_index;               // Entry the next jump_back() leaves, jumps.size() at the end
+    
+    FoldTree folds;                  // Folds, kept in step with edits like anchors
+    FoldMethod fold_method;
+    int fold_width;                  // Columns per indent level for FOLD_INDENT
+    unsigned long fold_version;      // Incremented when folds change
+    
+    void begin_edit();               // Notify edit hook and bump version
+    void record(int line, std::vector<Line> old_lines, int count, bool typing);
+    void drop_lines(std::vector<Line>& old_lines);  // Give undo text back to the arena
+    void clear_redo();
+    void record_line_edit(int y);
+    int apply_undo(UndoRecord& record, bool reverse);
+    bool apply_spliced(UndoRecord& record, bool reverse, int& first_line);  // One pass over non-overlapping changes
+    void rows_replaced(int first, int count, int produced);  // Move anchors and folds after rows changed
+    void refold(int first, int last);  // Recompute indent folds around rows that changed
+    bool touches_indent(int y, size_t x) const;  // Edit at x may change the indent of row y
+    int indent_level(int y) const;   // Fold level of a row, -1 for a blank row
+    void open_gap(int y, size_t x, size_t room);  // Move the gap to (x, y) with room bytes free, unless chunked
+    void close_gap() const;          // Put the gap row back into lines
 
 public:
     /**
@@ -194,6 +843,15 @@ public:
      */
     void insert_char(int x, int y, char c);
     
+    /**
+     * Insert several characters at a position as one edit
+     * Used for tabs, indentation and pasted text
+     * @param x Column position
+     * @param y Row position
+     * @param text Characters to insert, without newlines
+     */
+    void insert_text(int x, int y, const std::string& text);
+    
     /**
      * Delete character at specified position
      * @param x Column position
@@ -214,6 +872,12 @@ public:
      */
     void delete_line(int y);
     
+    /**
+     * Append the next line to a line
+     * @param y Row position
+     */
+    void join_line(int y);
+    
     /**
      * Get text content of a line
      * @param y Row position
@@ -221,6 +885,13 @@ public:
      */
     std::string get_line(int y) const;
     
+    /**
+     * Get a line without copying it or closing the edit gap
+     * @param y Row position
+     * @return View of the line, empty if invalid row
+     */
+    LineView view_line(int y) const;
+    
     /**
      * Get total number of lines in buffer
      * @return Number of lines
@@ -253,32 +924,1574 @@ public:
     
     /**
      * Get reference to all lines for iteration
+     * Closes the edit gap, which costs a move of the rest of that line;
+     * per-keystroke paths use view_line() instead
      * @return Const reference to lines vector
      */
-    const std::vector<std::string>& get_lines() const;
-};
-
-/**
- * File operations manager
- * Handles loading and saving of files
- */
-class FileManager {
-public:
+    const std::vector<Line>& get_lines() const;
+    
     /**
-     * Load file content into buffer
-     * @param filename File to load
-     * @param buffer Buffer to populate
-     * @return True if successful
+     * Get change counter, used by windows to detect stale content
+     * @return Version number, incremented on every modification
      */
-    static bool load_file(const std::string& filename, Buffer& buffer);
+    unsigned long get_version() const;
     
     /**
-     * Save buffer content to file
-     * @param filename File to save to
-     * @param buffer Buffer to save
-     * @return True if successful
+     * Get name of the file backing this buffer
+     * @return Filename, empty for unnamed buffers
      */
-    static bool save_file(const std::string& filename, const Buffer& buffer);
+    const std::string& get_filename() const;
+    
+    /**
+     * Set name of the file backing this buffer
+     * @param name New filename
+     */
+    void set_filename(const std::string& name);
+    
+    /**
+     * Estimate heap memory held by the buffer content
+     * @return Approximate size in bytes
+     */
+    size_t memory_usage() const;
+    
+    /**
+     * Install a hook called before any buffer is modified
+     * Background readers use it to stop before the content changes
+     * @param hook Function receiving the buffer about to change
+     */
+    static void set_edit_hook(void (*hook)(const Buffer*));
+    
+    /**
+     * Replace all content with loaded lines, discarding undo history
+     * @param text_arena Arena holding the lines' text
+     * @param new_lines Lines to take ownership of
+     */
+    void assign_lines(LineArena&& text_arena, std::vector<Line>&& new_lines);
+    
+    /**
+     * Copy live text into a fresh arena if many blocks were released
+     * Called when idle; background readers of this buffer must be stopped
+     * @return True if the buffer was compacted
+     */
+    bool compact();
+    
+    /**
+     * Record the file version the text matches
+     * Const because saving a buffer does not change its content
+     * @param stamp Stamp of the file just loaded or saved
+     */
+    void set_disk_stamp(const FileStamp& stamp) const;
+    
+    /**
+     * Get the file version the text matches
+     * @return Stamp, all zero if never loaded or saved
+     */
+    const FileStamp& get_disk_stamp() const;
+    
+    /**
+     * Replace the content of many lines as one edit
+     * Text is copied into the buffer, recorded as a single undo step
+     * @param changes Replacements sorted by line
+     */
+    void apply_line_changes(std::vector<LineChange>& changes);
+    
+    /**
+     * Replace a range of lines with new lines as one edit
+     * @param first First row to replace
+     * @param count Number of rows to replace
+     * @param new_lines Replacement lines (may differ in count)
+     */
+    void replace_lines(int first, int count, std::vector<std::string> new_lines);
+    
+    /**
+     * Apply one keystroke at many cursors as one edit
+     * Cursors are sorted once, each changed row is rebuilt once and the
+     * keystroke is a single undo step. Backspace at the start of a row and
+     * Delete at its end do nothing for that cursor.
+     * @param cursors Positions, moved to where the keystroke leaves them (order is kept)
+     * @param kind Keystroke
+     * @param text Text inserted by CURSOR_INSERT
+     * @param keep_indent Whether CURSOR_NEWLINE indents new rows like the row split
+     */
+    void edit_at_cursors(std::vector<Cursor>& cursors, CursorEdit kind, const std::string& text, bool keep_indent);
+    
+    /**
+     * Copy a selection into a register without copying its text
+     * The rows it touches become shared, so a later edit of one of them
+     * copies that row first.
+     * @param first_x Column of the first position
+     * @param first_y Row of the first position
+     * @param last_x Column of the last position
+     * @param last_y Row of the last position
+     * @param kind Shape: characters include both positions, blocks take
+     *             the columns between them on each row
+     * @param out Receives the text
+     */
+    void yank(int first_x, int first_y, int last_x, int last_y, SelectionKind kind, Register& out);
+    
+    /**
+     * Delete a selection as one edit
+     * @param first_x Column of the first position
+     * @param first_y Row of the first position
+     * @param last_x Column of the last position
+     * @param last_y Row of the last position
+     * @param kind Shape, as for yank()
+     */
+    void delete_region(int first_x, int first_y, int last_x, int last_y, SelectionKind kind);
+    
+    /**
+     * Put register text into the buffer as one edit
+     * Lines go in as rows before row y, splicing the register's handles;
+     * characters and blocks are inserted at (x, y).
+     * @param x Column position
+     * @param y Row position, up to get_line_count() for lines
+     * @param text Register text
+     */
+    void put(int x, int y, const Register& text);
+    
+    /**
+     * Delete a range of lines with a single erase
+     * @param first First row
+     * @param count Number of rows
+     */
+    void delete_lines(int first, int count);
+    
+    /**
+     * Delete several runs of lines in one compaction pass
+     * @param runs Sorted, non-overlapping (first row, count) pairs
+     */
+    void delete_line_runs(const std::vector<std::pair<int, int>>& runs);
+    
+    /**
+     * Move a block of lines below another line
+     * @param first First row of the block
+     * @param last Last row of the block (inclusive)
+     * @param dest Row to place the block after, -1 for the top
+     */
+    void move_lines(int first, int last, int dest);
+
+    /**
+     * Reorder and thin a range of lines as one edit
+     * Kept lines share their text with the undo record, so none is copied
+     * @param first First row of the range
+     * @param last Last row of the range (inclusive)
+     * @param rows Rows of the range to keep, in their new order
+     */
+    void arrange_lines(int first, int last, const std::vector<int>& rows);
+
+    /**
+     * Start grouping edits into one undo record
+     * Transactions nest; the record closes with the outermost commit
+     */
+    void begin_transaction();
+    
+    /**
+     * Close a transaction opened with begin_transaction()
+     */
+    void commit_transaction();
+    
+    /**
+     * Undo the most recent record
+     * @param line Receives the first affected row
+     * @return False if there is nothing to undo
+     */
+    bool undo(int& line);
+    
+    /**
+     * Redo the most recently undone record
+     * @param line Receives the first affected row
+     * @return False if there is nothing to redo
+     */
+    bool redo(int& line);
+    
+    /**
+     * Set the maximum number of undo records kept per buffer
+     * @param levels Maximum records, 0 disables undo
+     */
+    static void set_undo_limit(int levels);
+    
+    /**
+     * Add an anchor, a position that moves with the text around it
+     * @param x Column position
+     * @param y Row position
+     * @return Anchor id
+     */
+    int add_anchor(int x, int y);
+    
+    /**
+     * Remove an anchor
+     * @param id Anchor id
+     */
+    void remove_anchor(int id);
+    
+    /**
+     * Get the position of an anchor, clamped to the current text
+     * @param id Anchor id
+     * @param x Receives the column
+     * @param y Receives the row
+     * @return False if there is no such anchor
+     */
+    bool get_anchor(int id, int& x, int& y) const;
+    
+    /**
+     * Set a named mark
+     * @param name Mark name, a-z
+     * @param x Column position
+     * @param y Row position
+     * @return False if the name is not a mark
+     */
+    bool set_mark(char name, int x, int y);
+    
+    /**
+     * Get the position of a named mark
+     * @param name Mark name, a-z
+     * @param x Receives the column
+     * @param y Receives the row
+     * @return False if the mark is not set
+     */
+    bool get_mark(char name, int& x, int& y) const;
+    
+    /**
+     * Remember a position before jumping away from it
+     * An older entry on the same row is dropped, and the list continues
+     * from the new entry.
+     * @param x Column position
+     * @param y Row position
+     */
+    void push_jump(int x, int y);
+    
+    /**
+     * Go to the previous jump list entry
+     * Leaving the end of the list first records the position left.
+     * @param x Current column, receives the entry's column
+     * @param y Current row, receives the entry's row
+     * @return False if there is no older entry
+     */
+    bool jump_back(int& x, int& y);
+    
+    /**
+     * Go to the next jump list entry
+     * @param x Receives the entry's column
+     * @param y Receives the entry's row
+     * @return False if there is no newer entry
+     */
+    bool jump_forward(int& x, int& y);
+    
+    /**
+     * Get the jump list
+     * @return Anchor ids, oldest first
+     */
+    const std::vector<int>& get_jumps() const;
+    
+    /**
+     * Get the jump list entry jump_back() would leave
+     * @return Index into get_jumps(), its size at the end of the list
+     */
+    size_t get_jump_index() const;
+    
+    /**
+     * Choose how folds are made, replacing the current folds
+     * Indent folds are built at once and then kept up to date by edits.
+     * @param method Fold method
+     * @param width Columns per indent level
+     */
+    void set_fold_method(FoldMethod method, int width);
+    
+    /**
+     * Get how folds are made
+     * @return Fold method
+     */
+    FoldMethod get_fold_method() const;
+    
+    /**
+     * Create a closed manual fold
+     * @param first First row
+     * @param last Last row
+     * @return False if the fold would cross another fold
+     */
+    bool add_fold(int first, int last);
+    
+    /**
+     * Delete the innermost manual fold holding a row
+     * @param y Row position
+     * @return False if there is none
+     */
+    bool delete_fold(int y);
+    
+    /**
+     * Remove every fold; indent folds come back with set_fold_method()
+     */
+    void clear_folds();
+    
+    /**
+     * Open the closed fold that hides a row, one level
+     * @param y Row position
+     * @return False if the row is not in a closed fold
+     */
+    bool open_fold(int y);
+    
+    /**
+     * Close the innermost open fold holding a row
+     * @param y Row position
+     * @return False if every fold holding the row is closed already
+     */
+    bool close_fold(int y);
+    
+    /**
+     * Open or close every fold overlapping a range of rows
+     * @param first First row
+     * @param last Last row
+     * @param closed New state
+     * @return Number of folds changed
+     */
+    int set_folds(int first, int last, bool closed);
+    
+    /**
+     * Open or close every fold
+     * @param closed New state
+     */
+    void set_all_folds(bool closed);
+    
+    /**
+     * Get number of folds
+     * @return Fold count
+     */
+    int fold_count() const;
+    
+    /**
+     * Find the outermost closed fold holding a row
+     * @param y Row position
+     * @param fold Receives the fold
+     * @return False if the row is visible
+     */
+    bool closed_fold(int y, Fold& fold) const;
+    
+    /**
+     * Get the row shown for a row: itself, or the first row of the closed
+     * fold that hides it
+     * @param y Row position
+     * @return Visible row
+     */
+    int visible_row(int y) const;
+    
+    /**
+     * Get the next row shown after a row, stepping over closed folds
+     * @param y Row position
+     * @return Next visible row, get_line_count() at the end
+     */
+    int next_visible(int y) const;
+    
+    /**
+     * Get the row shown before a row, stepping over closed folds
+     * @param y Row position
+     * @return Previous visible row, -1 at the top
+     */
+    int prev_visible(int y) const;
+    
+    /**
+     * Get fold counter, used by windows to redraw after folds change
+     * @return Version number
+     */
+    unsigned long get_fold_version() const;
+};
+
+/**
+ * Entry of the buffer list
+ * Tracks residency and LRU state of one open file
+ */
+struct BufferEntry {
+    std::shared_ptr<Buffer> buffer;  // Buffer object, kept while evicted
+    bool resident;                   // Content is loaded in memory
+    size_t memory;                   // Estimated bytes when resident
+    unsigned long last_used;         // LRU tick of last activation
+    int cursor_x;                    // Cursor column when last left
+    int cursor_y;                    // Cursor row when last left
+};
+
+/**
+ * Inputs a status line was drawn from
+ * The status line is only redrawn when one of these changes.
+ */
+struct StatusKey {
+    unsigned long version;           // Buffer version
+    size_t name_hash;                // Hash of the file name
+    bool modified;                   // Buffer modified flag
+    bool active;                     // Window has focus
+    EditorMode mode;                 // Editor mode
+    int cursor_x;                    // Cursor column (0 unless %c or %o used)
+    int cursor_y;                    // Cursor row
+    int cols;                        // Window width
+    size_t memory;                   // Buffer memory (0 unless %mem used)
+    unsigned long style;             // Status style generation
+
+    bool operator==(const StatusKey& other) const {
+        return version == other.version && name_hash == other.name_hash && modified == other.modified &&
+               active == other.active && mode == other.mode && cursor_x == other.cursor_x &&
+               cursor_y == other.cursor_y && cols == other.cols && memory == other.memory &&
+               style == other.style;
+    }
+};
+
+/**
+ * Viewport over a text buffer
+ * Each window has its own cursor and scroll state, while windows
+ * showing the same file share one Buffer instance
+ */
+struct Window {
+    std::shared_ptr<Buffer> buffer;  // Buffer shown in this window
+    int cursor_x;                    // Cursor column in buffer
+    int cursor_y;                    // Cursor row in buffer
+    int row_offset;                  // Vertical scroll offset
+    int col_offset;                  // Horizontal scroll offset
+    int cursor_row;                  // Screen row of the cursor in the window, set by scroll
+    int cursor_col;                  // Text column of the cursor before scrolling, set by scroll
+    
+    // Screen rectangle (status line sits on the row below the text rows)
+    int top;                         // First screen row
+    int left;                        // First screen column
+    int rows;                        // Number of text rows
+    int cols;                        // Number of columns
+    
+    // State of the last draw, used to skip unchanged viewports
+    bool dirty;                      // Force redraw on next refresh
+    unsigned long drawn_version;     // Buffer version when last drawn
+    int drawn_row_offset;            // Row offset when last drawn
+    int drawn_col_offset;            // Column offset when last drawn
+    int drawn_cursor_y;              // Cursor row when last drawn
+    unsigned long drawn_folds;       // Buffer fold version when last drawn
+    unsigned long drawn_search;      // Search generation when last drawn
+    unsigned long drawn_cursors;     // Extra cursor generation when last drawn
+    bool drawn_visual;               // A visual selection was drawn
+    unsigned long drawn_diff;        // Diff generation when last drawn
+    unsigned long drawn_columns;     // Column layout generation when last drawn
+    StatusKey drawn_status;          // Status line inputs when last drawn
+};
+
+/**
+ * Vertical separator between side-by-side windows
+ */
+struct WindowSeparator {
+    int top;                         // First screen row
+    int left;                        // Screen column
+    int rows;                        // Height in rows
+};
+
+/**
+ * Node of the window layout tree
+ * Leaves hold a window, inner nodes split their area in two
+ */
+struct LayoutNode {
+    enum Split { LEAF, HORIZONTAL, VERTICAL };
+    Split split;                         // Kind of node
+    Window* window;                      // Window for leaf nodes
+    std::unique_ptr<LayoutNode> first;   // Top or left child
+    std::unique_ptr<LayoutNode> second;  // Bottom or right child
+    LayoutNode* parent;                  // Parent node, null for root
+};
+
+/**
+ * Window manager class
+ * Owns all windows and the split layout of the screen
+ */
+class WindowManager {
+private:
+    std::vector<std::unique_ptr<Window>> windows;  // All open windows
+    std::unique_ptr<LayoutNode> root;              // Layout tree
+    Window* active;                                // Window with focus
+    std::vector<WindowSeparator> separators;       // Vertical separators
+    int layout_rows;                               // Rows of last layout
+    int layout_cols;                               // Columns of last layout
+    bool layout_changed;                           // Layout needs recomputing
+    
+    LayoutNode* find_leaf(LayoutNode* node, const Window* window) const;
+    void layout_node(LayoutNode* node, int top, int left, int rows, int cols);
+    Window* first_window(LayoutNode* node) const;
+    
+public:
+    /**
+     * Constructor - creates an empty manager
+     */
+    WindowManager();
+    
+    /**
+     * Create the initial full-screen window
+     * @param buffer Buffer to show
+     */
+    void init(std::shared_ptr<Buffer> buffer);
+    
+    /**
+     * Split the active window, the new window gets focus
+     * @param vertical True for side-by-side, false for stacked
+     * @return True if the split fit on screen
+     */
+    bool split(bool vertical);
+    
+    /**
+     * Close the active window
+     * @return False if it is the last window
+     */
+    bool close_active();
+    
+    /**
+     * Close every window except the active one
+     */
+    void only();
+    
+    /**
+     * Move focus to the next or previous window
+     * @param direction 1 for next, -1 for previous
+     */
+    void cycle(int direction);
+    
+    /**
+     * Move focus to a window
+     * @param window Window to focus, ignored if it is not open
+     */
+    void focus(Window* window);
+    
+    /**
+     * Copy cursor and scroll state from config into the active window
+     * @param config Editor configuration
+     */
+    void store_cursor(const EditorConfig& config);
+    
+    /**
+     * Copy cursor and scroll state of the active window into config
+     * The file name and modified flag follow the window's buffer, so
+     * every focus change shows and saves the right file.
+     * @param config Editor configuration
+     */
+    void load_cursor(EditorConfig& config) const;
+    
+    /**
+     * Recompute window rectangles if the screen size or layout changed
+     * @param rows Rows available for windows (text and status lines)
+     * @param cols Columns available for windows
+     * @return True if the layout changed and a full redraw is needed
+     */
+    bool update_layout(int rows, int cols);
+    
+    /**
+     * Force a full redraw on next refresh
+     */
+    void invalidate();
+    
+    /**
+     * Get the window with focus
+     * @return Active window
+     */
+    Window& get_active();
+    
+    /**
+     * Get all windows in creation order
+     * @return Const reference to windows
+     */
+    const std::vector<std::unique_ptr<Window>>& get_windows() const;
+    
+    /**
+     * Get vertical separators of the current layout
+     * @return Const reference to separators
+     */
+    const std::vector<WindowSeparator>& get_separators() const;
+};
+
+/**
+ * Buffer list class
+ * Owns all open buffers and keeps their resident size within a memory
+ * budget by evicting unmodified, hidden buffers to their on-disk form
+ */
+class BufferList {
+private:
+    std::vector<BufferEntry> entries;  // Open buffers in opening order
+    unsigned long tick;                // LRU clock
+    size_t budget;                     // Memory budget in bytes
+    
+    bool is_displayed(const Buffer* buffer) const;
+    bool materialize(BufferEntry& entry);
+    
+public:
+    /**
+     * Constructor - creates an empty list
+     */
+    BufferList();
+    
+    /**
+     * Set the memory budget for resident buffers
+     * @param bytes Budget in bytes
+     */
+    void set_budget(size_t bytes);
+    
+    /**
+     * Open several files, loading them in parallel threads
+     * Files that would exceed the budget are registered but loaded lazily
+     * @param filenames Files to open
+     * @return Number of files that exist on disk
+     */
+    int open_files(const std::vector<std::string>& filenames);
+    
+    /**
+     * Find or register a buffer for a file without loading it
+     * @param filename File to open, empty for an unnamed buffer
+     * @return Index of the buffer entry
+     */
+    int open(const std::string& filename);
+    
+    /**
+     * Show a buffer in a window, loading it from disk if evicted
+     * @param index Buffer entry index
+     * @param window Window to show the buffer in
+     * @param config Editor configuration (receives cursor and filename)
+     * @return True on success
+     */
+    bool activate(int index, Window& window, EditorConfig& config);
+    
+    /**
+     * Find the entry index of a buffer
+     * @param buffer Buffer to look up
+     * @return Entry index or -1
+     */
+    int index_of(const Buffer* buffer) const;
+    
+    /**
+     * Get number of open buffers
+     * @return Buffer count
+     */
+    int count() const;
+    
+    /**
+     * Get a buffer entry
+     * @param index Entry index
+     * @return Const reference to entry
+     */
+    const BufferEntry& get(int index) const;
+    
+    /**
+     * Evict least recently used buffers until within budget
+     */
+    void enforce_budget();
+    
+    /**
+     * Get estimated memory of all resident buffers
+     * @return Size in bytes
+     */
+    size_t resident_memory() const;
+    
+    /**
+     * Reload unmodified buffers whose file changed on disk
+     * Needed by the server, whose buffers outlive the clients editing
+     * the same files in between.
+     * @return Number of buffers reloaded
+     */
+    int refresh_stale();
+    
+    /**
+     * Compact the line arenas of resident buffers that need it
+     * Buffers being scanned by the search worker are skipped.
+     */
+    void compact_idle();
+    
+    /**
+     * Find a buffer with unsaved changes
+     * @return Entry index or -1
+     */
+    int first_modified() const;
+};
+
+/**
+ * Position of a search match
+ */
+struct SearchMatch {
+    int line;                        // Buffer row
+    int col;                         // Byte column
+};
+
+/**
+ * Search state class
+ * Finds literal patterns in a buffer; the full match list is built by a
+ * background thread in chunks so counts and highlights fill in while the
+ * editor stays responsive
+ */
+class SearchState {
+private:
+    std::string pattern;             // Current literal pattern
+    const Buffer* buffer;            // Buffer being scanned
+    std::thread worker;              // Background scanner
+    std::atomic<bool> cancel;        // Request worker to stop
+    std::atomic<bool> done;          // Worker scanned the whole buffer
+    std::atomic<unsigned long> generation; // Bumped when matches change
+    mutable std::mutex mutex;        // Guards matches
+    std::vector<SearchMatch> matches; // Sorted match list
+    bool stale;                      // Buffer changed since last scan
+    bool report;                     // Show match counts in message bar
+    unsigned long reported;          // Generation last reported
+    
+    void stop();
+    void scan(const Buffer* target, std::string needle);
+    
+public:
+    /**
+     * Constructor - creates an idle search
+     */
+    SearchState();
+    
+    /**
+     * Destructor - stops the background scan
+     */
+    ~SearchState();
+    
+    /**
+     * Find a literal needle in a byte range
+     * Uses an SSE2 first/last byte filter when available
+     * @param haystack Text to search
+     * @param length Length of text
+     * @param needle Pattern to find
+     * @param needle_length Length of pattern
+     * @return Offset of first match or std::string::npos
+     */
+    static size_t find_literal(const char* haystack, size_t length, const char* needle, size_t needle_length);
+    
+    /**
+     * Start a background scan for a pattern, replacing any previous one
+     * @param target Buffer to scan
+     * @param needle Literal pattern, empty clears the search
+     */
+    void start(const Buffer& target, const std::string& needle);
+    
+    /**
+     * Stop scanning and forget the pattern and matches
+     */
+    void clear();
+    
+    /**
+     * Edit hook: stop scanning before a buffer changes
+     * @param target Buffer about to change
+     */
+    void on_edit(const Buffer* target);
+    
+    /**
+     * Idle processing on the main thread
+     * Restarts scans invalidated by edits and reports progress
+     * @param config Editor configuration (cursor for match index)
+     * @return True if matches changed since the last call
+     */
+    bool poll(const EditorConfig& config);
+    
+    /**
+     * Synchronously find the next match from a position
+     * @param target Buffer to search
+     * @param needle Literal pattern
+     * @param line Start row, receives match row
+     * @param col Start column, receives match column
+     * @param forward Search direction
+     * @param max_lines Number of lines to examine, 0 for the whole buffer
+     * @return True if a match was found
+     */
+    static bool find_next(const Buffer& target, const std::string& needle, int& line, int& col,
+                          bool forward, int max_lines);
+    
+    /**
+     * Collect cached matches within a row range
+     * @param target Buffer being drawn
+     * @param first First row
+     * @param last Row after the last one
+     * @param out Receives matches in order
+     */
+    void visible_matches(const Buffer& target, int first, int last, std::vector<SearchMatch>& out) const;
+    
+    /**
+     * Build the match counter shown in the message bar
+     * @param line Cursor row
+     * @param col Cursor column
+     * @return Text such as "/foo [3/42]"
+     */
+    std::string describe(int line, int col) const;
+    
+    /**
+     * Show match counts in the message bar as the scan progresses
+     * @param enable Whether to report
+     */
+    void set_report(bool enable);
+    
+    /**
+     * Get the current pattern
+     * @return Pattern, empty if no search
+     */
+    const std::string& get_pattern() const;
+    
+    /**
+     * Check whether the worker may be reading a buffer
+     * @param target Buffer to check
+     * @return True while a scan of target runs
+     */
+    bool scanning(const Buffer* target) const;
+    
+    /**
+     * Check whether the matches are of a buffer
+     * @param target Buffer to check
+     * @return True if target is the searched buffer
+     */
+    bool active(const Buffer& target) const;
+    
+    /**
+     * Get the change counter of the match list
+     * @return Generation number
+     */
+    unsigned long get_generation() const;
+};
+
+/**
+ * Extra cursors for multi-cursor editing
+ * The primary cursor stays in the editor configuration; the extra ones
+ * are kept sorted for one buffer. An edit made other than through apply()
+ * (undo, ex commands) leaves them stale, and stale cursors are dropped.
+ */
+class CursorSet {
+private:
+    const Buffer* buffer;            // Buffer the cursors are in
+    unsigned long version;           // Buffer version they were placed at
+    unsigned long generation;        // Bumped when the cursors change
+    std::vector<Cursor> cursors;     // Extra cursors, sorted, no duplicates
+    std::vector<Cursor> batch;       // Primary and extra cursors of one keystroke
+    
+    void take(const Buffer& target);
+    void merge(const Cursor& primary);
+    
+public:
+    /**
+     * Constructor - starts with no extra cursors
+     */
+    CursorSet();
+    
+    /**
+     * Check whether a buffer has extra cursors
+     * @param target Buffer
+     * @return True if it has cursors that match its current text
+     */
+    bool active(const Buffer& target) const;
+    
+    /**
+     * Get the number of extra cursors in a buffer
+     * @param target Buffer
+     * @return Cursor count, 0 if none or stale
+     */
+    size_t count(const Buffer& target) const;
+    
+    /**
+     * Check for an extra cursor at a position
+     * @param target Buffer
+     * @param x Column
+     * @param y Row
+     * @return True if there is one
+     */
+    bool has(const Buffer& target, int x, int y) const;
+    
+    /**
+     * Add an extra cursor
+     * @param target Buffer
+     * @param x Column
+     * @param y Row
+     */
+    void add(const Buffer& target, int x, int y);
+    
+    /**
+     * Replace the extra cursors
+     * @param target Buffer
+     * @param positions New cursors, in any order
+     */
+    void set(const Buffer& target, std::vector<Cursor> positions);
+    
+    /**
+     * Remove every extra cursor
+     */
+    void clear();
+    
+    /**
+     * Apply one keystroke at the primary and every extra cursor
+     * @param config Editor configuration (primary cursor is updated)
+     * @param target Buffer
+     * @param kind Keystroke
+     * @param text Text inserted by CURSOR_INSERT
+     */
+    void apply(EditorConfig& config, Buffer& target, CursorEdit kind, const std::string& text);
+    
+    /**
+     * Move every extra cursor with an arrow key, within its row for left and right
+     * @param target Buffer
+     * @param key Arrow key code
+     */
+    void move(const Buffer& target, int key);
+    
+    /**
+     * Get the columns of the extra cursors on a row
+     * @param target Buffer being drawn
+     * @param row Row
+     * @param cols Receives the columns in order
+     */
+    void row_cursors(const Buffer& target, int row, std::vector<int>& cols) const;
+    
+    /**
+     * Get change counter, used by windows to redraw after cursors change
+     * @return Generation number
+     */
+    unsigned long get_generation() const;
+};
+
+/**
+ * Registers for yanked and deleted text
+ * " is the unnamed register that every yank and delete fills, 0 holds
+ * the last yank and a-z are named; A-Z append to a-z. Registers share
+ * their text, so filling several names with one yank costs no copy.
+ */
+class Registers {
+public:
+    /**
+     * Check for a register name
+     * @param name Character after "
+     * @return True for ", 0, a-z and A-Z
+     */
+    static bool valid(char name);
+    
+    /**
+     * Store yanked or deleted text
+     * Appending to a register adds the text as new rows, turning it into
+     * lines unless both are blocks.
+     * @param name Register named by the user, '"' for none
+     * @param text Text to store, moved from
+     * @param yank True for a yank, false for a delete
+     */
+    static void store(char name, Register&& text, bool yank);
+    
+    /**
+     * Get a register
+     * @param name Register name; A-Z read a-z
+     * @return Its text, or null if empty
+     */
+    static std::shared_ptr<const Register> get(char name);
+    
+    /**
+     * Describe the registers holding text
+     * @return Entries like "a 3L:text  0 1c:text", empty if none
+     */
+    static std::string describe();
+};
+
+/**
+ * Rows that differ between the two sides of a diff
+ * Side 0 is the buffer :diff was run in, side 1 what it is compared with
+ */
+struct DiffHunk {
+    int first[2];                    // First row on each side
+    int count[2];                    // Rows on each side, 0 where only the other side has lines
+};
+
+/**
+ * How a row takes part in a diff
+ */
+enum DiffRowKind {
+    DIFF_SAME,                       // Row is on both sides
+    DIFF_CHANGED,                    // Row is replaced by rows on the other side
+    DIFF_ADDED,                      // Row is only on side 0
+    DIFF_REMOVED                     // Row is only on side 1
+};
+
+/**
+ * Comparison of two buffers for :diff
+ * Lines are hashed on worker threads and compared by hash with a
+ * histogram diff. After an edit the edited side is rehashed, and only
+ * the hunks around the rows whose hashes changed are diffed again.
+ */
+class DiffView {
+private:
+    std::shared_ptr<Buffer> sides[2];  // Compared buffers, null when off
+    std::vector<uint64_t> hashes[2];   // Line hashes of each side
+    unsigned long versions[2];         // Buffer versions the hashes match
+    std::vector<DiffHunk> hunks;       // Differences in row order
+    unsigned long generation;          // Bumped when the hunks change
+
+    int side_of(const Buffer& buffer) const;
+    void refresh_side(int side);
+
+public:
+    /**
+     * Constructor - starts with no diff
+     */
+    DiffView();
+
+    /**
+     * Hash every line of a buffer on worker threads
+     * @param buffer Text buffer
+     * @param out Receives one hash per row
+     */
+    static void hash_lines(const Buffer& buffer, std::vector<uint64_t>& out);
+
+    /**
+     * Diff two ranges of line hashes
+     * @param a Hashes of side 0
+     * @param a_first First row of side 0
+     * @param a_end Row after the last of side 0
+     * @param b Hashes of side 1
+     * @param b_first First row of side 1
+     * @param b_end Row after the last of side 1
+     * @param out Receives the hunks in row order, appended
+     */
+    static void compare(const std::vector<uint64_t>& a, int a_first, int a_end,
+                        const std::vector<uint64_t>& b, int b_first, int b_end, std::vector<DiffHunk>& out);
+
+    /**
+     * Start comparing two buffers
+     * @param ours Side 0
+     * @param theirs Side 1
+     */
+    void start(std::shared_ptr<Buffer> ours, std::shared_ptr<Buffer> theirs);
+
+    /**
+     * Stop comparing and release both buffers
+     */
+    void stop();
+
+    /**
+     * Bring the hunks up to date with edits to either side
+     * @return True if the hunks changed
+     */
+    bool update();
+
+    /**
+     * Get a compared buffer
+     * @param side 0 or 1
+     * @return Buffer, null when no diff is shown
+     */
+    std::shared_ptr<Buffer> get_side(int side) const;
+
+    /**
+     * Get how a row takes part in the diff
+     * @param buffer Buffer showing the row
+     * @param row Buffer row
+     * @return DIFF_SAME if the buffer is not compared
+     */
+    DiffRowKind row_kind(const Buffer& buffer, int row) const;
+
+    /**
+     * Find the row on the other side matching a row
+     * Rows in a hunk map to the same offset into the other side's rows,
+     * clamped to the hunk
+     * @param buffer Buffer showing the row
+     * @param row Buffer row
+     * @return Row on the other side, or row itself if the buffer is not compared
+     */
+    int map_row(const Buffer& buffer, int row) const;
+
+    /**
+     * Find the next or previous hunk from a row
+     * @param buffer Buffer being moved in
+     * @param row Current row
+     * @param forward Search after instead of before the row
+     * @param target Receives the first row of the hunk
+     * @return False if there is none
+     */
+    bool next_change(const Buffer& buffer, int row, bool forward, int& target) const;
+
+    /**
+     * Get the hunks
+     * @return Hunks in row order
+     */
+    const std::vector<DiffHunk>& get_hunks() const;
+
+    /**
+     * Describe the differences
+     * @return Text like "3 changes: 4 lines added, 1 removed, 2 changed"
+     */
+    std::string describe() const;
+
+    /**
+     * Get a counter bumped whenever the hunks change
+     * @return Generation number
+     */
+    unsigned long get_generation() const;
+};
+
+/**
+ * Delimiter positions of one row, cached for drawing
+ */
+struct ColumnRow {
+    int row;                         // Buffer row, -1 when unused
+    unsigned long version;           // Buffer version the offsets match
+    std::vector<int> delimiters;     // Offsets of delimiters outside quotes
+};
+
+/**
+ * Column view of delimited (CSV/TSV) text
+ * Rows are drawn as aligned columns under a sticky header row. Column
+ * widths come from a sample of rows read by a background thread; the
+ * delimiters of a row are found when it is first drawn and cached, so
+ * no part of the buffer is parsed before it is shown. One buffer at a
+ * time is shown in columns.
+ */
+class ColumnView {
+private:
+    const Buffer* buffer;            // Buffer shown in columns, null when off
+    char delimiter;                  // Field delimiter
+    std::vector<int> widths;         // Column widths used for drawing
+    std::vector<ColumnRow> cache;    // Delimiters of recently drawn rows, by row
+    std::string scratch;             // Row text being indexed
+    std::thread worker;              // Background width sampler
+    std::atomic<bool> cancel;        // Request worker to stop
+    std::atomic<bool> ready;         // Worker published new widths
+    std::atomic<bool> done;          // Worker stopped reading the buffer
+    mutable std::mutex mutex;        // Guards sampled
+    std::vector<int> sampled;        // Widths published by the worker
+    bool stale;                      // Buffer changed since the last sample
+    unsigned long generation;        // Bumped when the layout changes
+
+    void stop();
+    void sample(const Buffer* target, char separator);
+    void start_sample();
+    int field_width(size_t field, int length) const;
+
+public:
+    /**
+     * Constructor - shows no buffer in columns
+     */
+    ColumnView();
+
+    /**
+     * Destructor - stops the background sampler
+     */
+    ~ColumnView();
+
+    /**
+     * Find the delimiters of a row outside double-quoted fields
+     * Sixteen bytes are compared at a time with SSE2 when available
+     * until the first quote; the rest is scanned byte by byte.
+     * @param text Row text
+     * @param length Row length
+     * @param separator Field delimiter
+     * @param out Receives the delimiter offsets
+     */
+    static void find_delimiters(const char* text, size_t length, char separator, std::vector<int>& out);
+
+    /**
+     * Find a field of a row
+     * @param text Row text
+     * @param length Row length
+     * @param separator Field delimiter
+     * @param field Field number from 1
+     * @param field_length Receives the field length
+     * @return Offset of the field, length if the row has fewer fields
+     */
+    static size_t find_field(const char* text, size_t length, char separator, int field, size_t& field_length);
+
+    /**
+     * Guess the delimiter of a buffer from its first row
+     * @param target Buffer to look at
+     * @return Tab, semicolon, pipe or comma, whichever occurs most
+     */
+    static char detect_delimiter(const Buffer& target);
+
+    /**
+     * Show a buffer in columns
+     * @param target Buffer to show
+     * @param separator Field delimiter
+     */
+    void start(const Buffer& target, char separator);
+
+    /**
+     * Stop showing columns
+     */
+    void clear();
+
+    /**
+     * Edit hook: stop sampling before a buffer changes
+     * @param target Buffer about to change
+     */
+    void on_edit(const Buffer* target);
+
+    /**
+     * Idle processing on the main thread
+     * Resamples after edits and takes up widths the worker published
+     * @return True if the layout changed
+     */
+    bool poll();
+
+    /**
+     * Check whether a buffer is shown in columns
+     * @param target Buffer to check
+     * @return True if it is
+     */
+    bool active(const Buffer& target) const;
+
+    /**
+     * Check whether the worker may be reading a buffer
+     * @param target Buffer to check
+     * @return True while a sample of target runs
+     */
+    bool scanning(const Buffer* target) const;
+
+    /**
+     * Get the field delimiter
+     * @return Delimiter character
+     */
+    char get_delimiter() const;
+
+    /**
+     * Get the delimiter offsets of a row, indexing it if not cached
+     * @param target Buffer shown in columns
+     * @param row Buffer row
+     * @return Offsets of delimiters outside quotes
+     */
+    const std::vector<int>& row_delimiters(const Buffer& target, int row);
+
+    /**
+     * Lay out a row as aligned columns
+     * Fields are padded or cut to their column width and followed by |;
+     * the last field is shown whole.
+     * @param target Buffer shown in columns
+     * @param row Buffer row
+     * @param out Receives the text to draw
+     */
+    void layout_row(const Buffer& target, int row, std::string& out);
+
+    /**
+     * Map a buffer column to its column in the laid out row
+     * @param target Buffer shown in columns
+     * @param row Buffer row
+     * @param col Buffer column
+     * @return Column in the text from layout_row
+     */
+    int display_col(const Buffer& target, int row, int col);
+
+    /**
+     * Find the field under a buffer column
+     * @param target Buffer shown in columns
+     * @param row Buffer row
+     * @param col Buffer column
+     * @return Field index from 0
+     */
+    int field_at(const Buffer& target, int row, int col);
+
+    /**
+     * Find where a field starts
+     * @param target Buffer shown in columns
+     * @param row Buffer row
+     * @param field Field index from 0
+     * @return Buffer column, -1 if the row has fewer fields
+     */
+    int field_start(const Buffer& target, int row, int field);
+
+    /**
+     * Get a counter bumped whenever the layout changes
+     * @return Generation number
+     */
+    unsigned long get_generation() const;
+};
+
+/**
+ * Parsed substitution command
+ */
+struct SubstitutePlan {
+    std::string pattern;             // Regex or literal pattern
+    std::string replacement;         // Replacement (regex format or literal text)
+    bool global;                     // Replace every match in a line
+    bool ignore_case;                // Case-insensitive matching
+    bool literal;                    // Pattern has no regex metacharacters
+};
+
+/**
+ * Outcome of a substitution run
+ */
+struct SubstituteResult {
+    long matched;                    // Number of matches replaced
+    long lines_changed;              // Number of lines changed
+    double elapsed_ms;               // Wall time in milliseconds
+    bool cancelled;                  // Stopped before committing
+};
+
+/**
+ * Substitution engine
+ * Runs :s over a line range on worker threads and commits the result
+ * as one buffer transaction
+ */
+class Substitution {
+public:
+    /**
+     * Parse s/pattern/replacement/flags
+     * @param command Command text starting at the 's'
+     * @param pattern Receives the pattern
+     * @param replacement Receives the replacement
+     * @param flags Receives the flags
+     * @return True if the command is well formed
+     */
+    static bool parse(const std::string& command, std::string& pattern,
+                      std::string& replacement, std::string& flags);
+    
+    /**
+     * Build a substitution plan from parsed command parts
+     * @param pattern Pattern text
+     * @param replacement Replacement text as typed
+     * @param flags Flags (g = all matches in line, i = ignore case)
+     * @return Plan ready for run()
+     */
+    static SubstitutePlan make_plan(const std::string& pattern, const std::string& replacement,
+                                    const std::string& flags);
+    
+    /**
+     * Run a substitution over a line range on worker threads
+     * @param buffer Buffer to modify
+     * @param first First row
+     * @param last Last row (inclusive)
+     * @param plan Parsed substitution
+     * @param should_cancel Polled while workers run, null to never cancel
+     * @return Counts and timing of the run
+     */
+    static SubstituteResult run(Buffer& buffer, int first, int last, const SubstitutePlan& plan,
+                                bool (*should_cancel)());
+    
+    /**
+     * Run a substitution over selected rows on worker threads
+     * @param buffer Buffer to modify
+     * @param rows Rows to visit in ascending order
+     * @param plan Parsed substitution
+     * @param should_cancel Polled while workers run, null to never cancel
+     * @return Counts and timing of the run
+     */
+    static SubstituteResult run_rows(Buffer& buffer, const std::vector<int>& rows, const SubstitutePlan& plan,
+                                     bool (*should_cancel)());
+
+private:
+    static SubstituteResult run_slices(Buffer& buffer, const std::vector<int>* rows, int first, int end,
+                                       const SubstitutePlan& plan, bool (*should_cancel)());
+};
+
+/**
+ * Parsed :sort options
+ */
+struct SortOptions {
+    bool numeric;                    // Compare the first number in the key (n)
+    bool reverse;                    // Largest key first (r, or :sort!)
+    bool ignore_case;                // Compare letters without case (i)
+    bool unique;                     // Keep only the first row of equal keys (u)
+    int key_field;                   // Field the key starts at (k N), 0 for the whole row
+    char delimiter;                  // With k N, the key is that delimited field only; 0 for blank-separated fields
+};
+
+/**
+ * Outcome of running an external filter
+ */
+struct FilterResult {
+    std::vector<std::string> output; // Lines the command wrote to stdout and stderr
+    int status;                      // Exit status, -1 if it could not run or was killed
+    double elapsed_ms;               // Wall time in milliseconds
+    bool cancelled;                  // Stopped before the command finished
+};
+
+/**
+ * Line range filters
+ * Orders rows for :sort with a parallel merge sort over views of the
+ * buffer's lines, finds :uniq duplicates and streams rows through
+ * external commands for :!
+ */
+class LineFilter {
+public:
+    /**
+     * Parse the options after :sort
+     * @param args Text after the command name
+     * @param options Receives the options
+     * @return False (after reporting) if an option is not recognized
+     */
+    static bool parse_sort(const std::string& args, SortOptions& options);
+
+    /**
+     * Order a range of rows on worker threads
+     * The sort is stable, so rows with equal keys keep their order
+     * @param buffer Text buffer
+     * @param first First row
+     * @param last Last row (inclusive)
+     * @param options Parsed options
+     * @param rows Receives the rows in sorted order, without duplicates for u
+     */
+    static void sort_rows(const Buffer& buffer, int first, int last, const SortOptions& options,
+                          std::vector<int>& rows);
+
+    /**
+     * Find the rows of a range that differ from the row above
+     * @param buffer Text buffer
+     * @param first First row
+     * @param last Last row (inclusive)
+     * @param rows Receives the rows to keep in ascending order
+     */
+    static void unique_rows(const Buffer& buffer, int first, int last, std::vector<int>& rows);
+
+    /**
+     * Run a shell command with a range of rows as its input
+     * Rows are written while the output is read, so large outputs
+     * cannot deadlock the pipes.
+     * @param command Command for /bin/sh -c
+     * @param buffer Text buffer
+     * @param first First row
+     * @param last Last row (inclusive), below first for no input
+     * @param should_cancel Polled while the command runs, null to never cancel
+     * @return Output lines and exit status
+     */
+    static FilterResult run(const std::string& command, const Buffer& buffer, int first, int last,
+                            bool (*should_cancel)());
+};
+
+/**
+ * Ex command engine
+ * Resolves line addresses and ranges (:10,20d, :%s, :.,$m0, :g/re/d)
+ * and runs each command as a single buffer transaction
+ */
+class ExCommand {
+public:
+    /**
+     * Execute an ex command line
+     * @param config Editor configuration (cursor is updated)
+     * @param buffer Text buffer
+     * @param command Command text without the leading ':'
+     * @return False if the text is not an ex command
+     */
+    static bool execute(EditorConfig& config, Buffer& buffer, const std::string& command);
+};
+
+/**
+ * Headless script runner
+ * Applies ex command or keystroke scripts to files with no terminal and
+ * no rendering, so batch jobs run at the speed of the buffer engine
+ */
+class ScriptRunner {
+public:
+    /**
+     * Run a script against files
+     * @param config Editor configuration
+     * @param script_path Script file, "-" for standard input
+     * @param keystrokes True if the script holds raw keystrokes rather than ex commands
+     * @param files Files to open as buffers
+     * @param output Destination for the result ("-" for stdout), empty to write back to the file
+     * @return Process exit status
+     */
+    static int run(EditorConfig& config, const std::string& script_path, bool keystrokes,
+                   const std::vector<std::string>& files, const std::string& output);
+};
+
+/**
+ * Keystroke session recording and replay
+ * Recording logs the raw bytes of every key with a timestamp and the
+ * window size; replay feeds them back through the normal key handling
+ * and rendering against a fake terminal and reports latency per key
+ */
+class Session {
+public:
+    /**
+     * Start logging keys to a session file
+     * @param path Session file to create
+     * @param files Files the editor was started with
+     * @return True if the file could be created
+     */
+    static bool start_recording(const std::string& path, const std::vector<std::string>& files);
+    
+    /**
+     * Check whether keys are being recorded
+     * @return True while recording
+     */
+    static bool is_recording();
+    
+    /**
+     * Log one key
+     * @param bytes Raw input bytes of the key
+     * @param rows Terminal rows
+     * @param cols Terminal columns
+     */
+    static void record_key(const std::string& bytes, int rows, int cols);
+    
+    /**
+     * Replay a recorded session and print latency statistics
+     * @param config Editor configuration
+     * @param path Session file
+     * @param files Files to open, empty to use the recorded ones
+     * @return Process exit status
+     */
+    static int replay(EditorConfig& config, const std::string& path, const std::vector<std::string>& files);
+};
+
+/**
+ * Editor server
+ * One long-lived process keeps buffers loaded between editing sessions.
+ * A client hands its terminal to the server over a Unix domain socket;
+ * the server edits on that terminal directly until the client quits or
+ * detaches, so nothing is loaded or parsed again on the next attach.
+ */
+class Server {
+public:
+    /**
+     * Get the path of the server socket
+     * $XDG_RUNTIME_DIR/slowertext.sock, or a private directory in /tmp
+     * @return Socket path, empty if no safe location exists
+     */
+    static std::string socket_path();
+    
+    /**
+     * Start the server in the background and serve clients until stopped
+     * @param config Editor configuration, already loaded
+     * @param filenames Files to load before the first client attaches
+     * @return Exit status
+     */
+    static int serve(EditorConfig& config, const std::vector<std::string>& filenames);
+    
+    /**
+     * Attach this terminal to the running server
+     * @param filenames Files to open as buffers
+     * @return Exit status
+     */
+    static int attach(const std::vector<std::string>& filenames);
+    
+    /**
+     * Ask the running server to exit
+     * Refused while a client is attached or a buffer has unsaved changes
+     * @return Exit status
+     */
+    static int stop();
+    
+    /**
+     * Check whether a client session is running in this process
+     * @return True inside a server session
+     */
+    static bool is_attached();
+};
+
+/**
+ * File operations manager
+ * Handles loading and saving of files
+ */
+class FileManager {
+public:
+    /**
+     * Load file content into buffer
+     * @param filename File to load
+     * @param buffer Buffer to populate
+     * @return True if successful
+     */
+    static bool load_file(const std::string& filename, Buffer& buffer);
+    
+    /**
+     * Save buffer content to file
+     * @param filename File to save to
+     * @param buffer Buffer to save
+     * @return True if successful
+     */
+    static bool save_file(const std::string& filename, const Buffer& buffer);
+    
+    /**
+     * Write buffer content to an open file descriptor
+     * @param fd Destination (a file, or stdout for headless output)
+     * @param buffer Buffer to write
+     * @return True if successful
+     */
+    static bool write_buffer(int fd, const Buffer& buffer);
+    
+    /**
+     * Discard saves instead of writing files
+     * @param enable True to pretend saves succeed without writing
+     */
+    static void set_dry_run(bool enable);
     
     /**
      * Check if file exists
@@ -286,6 +2499,14 @@ public:
      * @return True if file exists
      */
     static bool file_exists(const std::string& filename);
+    
+    /**
+     * Get the identity of the current version of a file
+     * @param filename File to check
+     * @param stamp Receives the stamp
+     * @return True if the file exists
+     */
+    static bool get_stamp(const std::string& filename, FileStamp& stamp);
 };
 
 /**
@@ -295,15 +2516,16 @@ public:
 class Terminal {
 private:
     struct termios orig_termios;  // Original terminal settings
+    bool raw_enabled;             // Raw mode is active and must be restored
 
 public:
     /**
-     * Constructor - enables raw mode
+     * Constructor - leaves the terminal untouched until raw mode is enabled
      */
     Terminal();
     
     /**
-     * Destructor - restores terminal settings
+     * Destructor - restores terminal settings if raw mode was enabled
      */
     ~Terminal();
     
@@ -317,6 +2539,11 @@ public:
      */
     void disable_raw_mode();
     
+    /**
+     * Forget raw mode without restoring, for a terminal that went away
+     */
+    void abandon_raw_mode();
+    
     /**
      * Get terminal window size
      * @param rows Pointer to store row count
@@ -354,6 +2581,13 @@ public:
  */
 class InputHandler {
 public:
+    /**
+     * Parse the configured key bindings into key codes
+     * Called at startup and whenever the configuration changes
+     * @param config Editor configuration
+     */
+    static void apply_config(const EditorConfig& config);
+    
     /**
      * Read a single key from input
      * @return Key code or -1 on error
@@ -374,6 +2608,92 @@ public:
      * @param command Command string to process
      */
     static void process_command(EditorConfig& config, Buffer& buffer, const std::string& command);
+    
+    /**
+     * Wait until input is available
+     * @param timeout_ms Maximum time to wait in milliseconds
+     * @return True if a key can be read without blocking
+     */
+    static bool wait_for_input(int timeout_ms);
+    
+    /**
+     * Run the interactive editor loop until the editor quits
+     * @param config Editor configuration
+     * @param idle Polled between keys (or nullptr); returns true when the
+     *             screen needs a refresh and may set config.quit to leave
+     */
+    static void run_loop(EditorConfig& config, bool (*idle)(EditorConfig& config));
+    
+    /**
+     * Check for a pending Escape key without blocking
+     * Used to cancel long-running commands; other pending input is dropped
+     * @return True if Escape was pressed
+     */
+    static bool escape_pressed();
+    
+    /**
+     * Feed keystrokes from memory instead of the terminal
+     * Used by headless scripts; wait_for_input() reports whether keys remain
+     * @param keys Key bytes, consumed by read_key()
+     */
+    static void set_script_input(const std::string& keys);
+};
+
+/**
+ * Piece of a compiled status line template
+ */
+struct StatusSegment {
+    enum Kind {
+        LITERAL,                     // Fixed text, including %enc and %eol
+        FILENAME,                    // %f
+        MODIFIED,                    // %modified
+        MODE,                        // %m
+        LINE,                        // %l cursor line
+        COLUMN,                      // %c cursor column
+        PERCENT,                     // %p percent through file
+        BYTE_OFFSET,                 // %o byte offset of the cursor
+        MEMORY                       // %mem buffer memory
+    };
+    Kind kind;
+    std::string text;                // Text of literal segments
+};
+
+/**
+ * Display settings resolved from the configuration
+ * Built once when the configuration is applied, so frames never look up
+ * color names or copy settings strings.
+ */
+struct RenderStyle {
+    std::string text_color;          // Escape code for text
+    std::string bg_color;            // Escape code for the background
+    std::string comment_color;       // Escape code for comment lines
+    std::string status_bar_color;    // Escape code for the active status bar
+    std::vector<StatusSegment> status_segments;  // Compiled status_format
+    bool status_uses_column;         // Template shows the cursor column or offset
+    bool status_uses_memory;         // Template shows buffer memory
+    int gutter;                      // Line number gutter width
+    bool show_tilde;                 // Mark empty lines with ~
+    bool highlight_current_line;     // Invert the cursor row
+    bool syntax_highlighting;        // Color comment lines
+};
+
+/**
+ * Per-frame view state passed through the renderer
+ * Small and allocation-free: screen size, mode, dirty flag and a pointer
+ * to the cached style. Cursor and scroll offsets live in each Window.
+ */
+struct ViewState {
+    int screen_rows;                 // Text rows (without status and message bars)
+    int screen_cols;                 // Screen columns
+    EditorMode mode;                 // Current editor mode
+    bool full_redraw;                // Layout changed, redraw every window
+    const RenderStyle* style;        // Display settings
+    const std::string* status_msg;   // Message bar text
+    time_t status_msg_time;          // When the message was set
+    const Window* visual_window;     // Window showing a visual selection, or null
+    SelectionKind visual_kind;       // Shape of the selection
+    int visual_x;                    // Column where the selection started
+    int visual_y;                    // Row where the selection started
 };
 
 /**
@@ -383,43 +2703,293 @@ public:
 class Renderer {
 public:
     /**
-     * Draw text rows on screen
+     * Resolve display settings from the configuration
+     * Called at startup and whenever the configuration changes
      * @param config Editor configuration
-     * @param buffer Text buffer
      */
-    static void draw_rows(const EditorConfig& config, const Buffer& buffer);
+    static void apply_config(const EditorConfig& config);
     
     /**
-     * Draw status bar
-     * @param config Editor configuration
-     * @param buffer Text buffer
+     * Draw text rows of a window into the frame
+     * @param frame Output frame
+     * @param view Frame view state
+     * @param window Window to draw
      */
-    static void draw_status_bar(const EditorConfig& config, const Buffer& buffer);
+    static void draw_rows(std::string& frame, const ViewState& view, const Window& window);
     
     /**
-     * Draw message bar
-     * @param config Editor configuration
+     * Draw status bar of a window into the frame
+     * @param frame Output frame
+     * @param view Frame view state
+     * @param window Window the status bar belongs to
+     * @param active Whether the window has focus
      */
-    static void draw_message_bar(const EditorConfig& config);
+    static void draw_status_bar(std::string& frame, const ViewState& view, const Window& window, bool active);
     
     /**
-     * Refresh entire screen
+     * Draw message bar into the frame
+     * @param frame Output frame
+     * @param view Frame view state
+     */
+    static void draw_message_bar(std::string& frame, const ViewState& view);
+    
+    /**
+     * Refresh screen, composing all windows into one frame
+     * Only windows whose content or scroll state changed are redrawn
      * @param config Editor configuration
-     * @param buffer Text buffer
      */
-    static void refresh_screen(const EditorConfig& config, const Buffer& buffer);
+    static void refresh_screen(const EditorConfig& config);
     
     /**
-     * Handle scrolling logic
-     * @param config Editor configuration (modified)
-     * @param buffer Text buffer
+     * Handle scrolling logic for a window
+     * @param window Window to scroll (modified)
+     */
+    static void scroll(Window& window);
+    
+    /**
+     * Send frames to another file descriptor (a fake terminal for replay)
+     * @param fd Destination, STDOUT_FILENO for the terminal
+     */
+    static void set_output(int fd);
+    
+    /**
+     * Get totals of frame output since startup
+     * @param writes Receives number of write calls
+     * @param bytes Receives number of bytes written
+     */
+    static void get_output_stats(unsigned long& writes, unsigned long& bytes);
+};
+
+/**
+ * Trace event identifiers
+ */
+enum TraceEvent {
+    TRACE_CONFIG_LOAD,               // Config file read (a: values, b: from snapshot, text: path)
+    TRACE_CONFIG_VALUE,              // Config line parsed (a: line number, text: line)
+    TRACE_CONFIG_ERROR,              // Invalid config value (text: key)
+    TRACE_FRAME,                     // Screen refresh (a: bytes written)
+    TRACE_KEY,                       // Keypress handled (a: key code)
+    TRACE_COMMAND,                   // Ex command (text: command)
+    TRACE_FILE_LOAD,                 // File loaded (a: lines, text: path)
+    TRACE_FILE_SAVE,                 // File saved (a: lines, text: path)
+    TRACE_SEARCH_SCAN,               // Background search scan (a: matches)
+    TRACE_SUBSTITUTE_SLICE,          // Substitution worker slice (a: first row, b: matches)
+    TRACE_STARTUP_PHASE,             // Startup phase (text: phase)
+    TRACE_BUFFER_COMPACT,            // Line arena compacted (a: bytes reclaimed)
+    TRACE_SORT_SLICE,                // Sort worker slice (a: first row, b: rows)
+    TRACE_FILTER,                    // External filter run (a: bytes written, b: bytes read, text: command)
+    TRACE_DIFF,                      // Diff of changed rows (a: rows compared on side 0, b: hunks found)
+    TRACE_COLUMN_SAMPLE,             // Column width sample (a: rows, b: columns)
+    TRACE_EVENT_COUNT
+};
+
+/**
+ * One trace record
+ * Timestamps are nanoseconds since the process started.
+ */
+struct TraceRecord {
+    unsigned long long timestamp;    // Start time
+    unsigned long long duration;     // Span length, 0 for instant events
+    long long a;                     // Event specific payload
+    long long b;                     // Event specific payload
+    unsigned int event;              // TraceEvent
+    unsigned int thread;             // Small per-thread id
+    char text[48];                   // Truncated, NUL-terminated text payload
+};
+
+/**
+ * Lock-free in-memory trace
+ * Records go into a fixed ring buffer that overwrites the oldest entries;
+ * any thread can record without locks or allocation. The ring is dumped
+ * as Chrome trace-event JSON (chrome://tracing, Perfetto) on :trace dump
+ * and at exit.
+ */
+class Trace {
+public:
+    /**
+     * Current trace timestamp
+     * @return Nanoseconds since the process started
+     */
+    static unsigned long long now();
+    
+    /**
+     * Record an event
+     * @param event Event identifier
+     * @param start Start timestamp from now()
+     * @param duration Span length in nanoseconds, 0 for an instant event
+     * @param a First payload value
+     * @param b Second payload value
+     * @param text Text payload or nullptr
+     */
+    static void record(TraceEvent event, unsigned long long start, unsigned long long duration,
+                       long long a = 0, long long b = 0, const char* text = nullptr);
+    
+    /**
+     * Record an instant event
+     * @param event Event identifier
+     * @param a First payload value
+     * @param b Second payload value
+     * @param text Text payload or nullptr
      */
-    static void scroll(EditorConfig& config, const Buffer& buffer);
+    static void instant(TraceEvent event, long long a = 0, long long b = 0, const char* text = nullptr);
+    
+    /**
+     * Enable or disable recording
+     * @param enabled Whether events are recorded
+     */
+    static void set_enabled(bool enabled);
+    
+    /**
+     * Check whether events are recorded
+     * @return True if enabled
+     */
+    static bool is_enabled();
+    
+    /**
+     * Drop all recorded events
+     */
+    static void clear();
+    
+    /**
+     * Write the recorded events as Chrome trace-event JSON
+     * @param path Output file
+     * @return Number of events written, -1 if the file could not be written
+     */
+    static long dump(const std::string& path);
+    
+    /**
+     * Dump the trace to a file when the process exits
+     * @param path Output file, empty to disable
+     */
+    static void set_exit_dump(const std::string& path);
+};
+
+/**
+ * Records the lifetime of a scope as a trace span
+ */
+class TraceSpan {
+private:
+    TraceEvent event;
+    unsigned long long start;
+    const char* text;
+
+public:
+    long long a;                     // Payload, may be set before the scope ends
+    long long b;                     // Payload, may be set before the scope ends
+
+    explicit TraceSpan(TraceEvent span_event, const char* span_text = nullptr)
+        : event(span_event), start(Trace::now()), text(span_text), a(0), b(0) {}
+    ~TraceSpan() { Trace::record(event, start, Trace::now() - start, a, b, text); }
+};
+
+#ifdef PERF_OVERLAY
+/**
+ * Hot-path timing slots shown in the performance overlay
+ */
+enum PerfSlot {
+    PERF_SCROLL,                     // Window scrolling
+    PERF_DRAW_ROWS,                  // Text rows of redrawn windows
+    PERF_STATUS_BAR,                 // Window status bars
+    PERF_FLUSH,                      // Writing the frame
+    PERF_FRAME,                      // Whole refresh_screen
+    PERF_KEYPRESS,                   // Handling one key
+    PERF_SLOT_COUNT
+};
+
+/**
+ * Performance overlay
+ * Collects per-frame timings, output and allocation counts and draws
+ * them on the top screen row. Only built with -DPERF_OVERLAY (make perf).
+ */
+class PerfMonitor {
+public:
+    /**
+     * Start timing a frame
+     */
+    static void begin_frame();
+    
+    /**
+     * Publish the timings of the frame that just finished
+     */
+    static void end_frame();
+    
+    /**
+     * Add time to a slot of the current frame
+     * @param slot Timing slot
+     * @param ns Elapsed nanoseconds
+     */
+    static void add_time(PerfSlot slot, long long ns);
+    
+    /**
+     * Show or hide the overlay
+     * @param visible Whether to draw the overlay
+     */
+    static void set_visible(bool visible);
+    
+    /**
+     * Check whether the overlay is shown
+     * @return True if visible
+     */
+    static bool is_visible();
+    
+    /**
+     * Draw the overlay for the previous frame into the frame
+     * @param frame Output frame
+     * @param view Frame view state
+     * @param buffer Buffer of the active window
+     */
+    static void draw_overlay(std::string& frame, const ViewState& view, const Buffer& buffer);
+};
+
+/**
+ * Adds the lifetime of a scope to a performance slot
+ */
+class PerfTimer {
+private:
+    PerfSlot slot;
+    std::chrono::steady_clock::time_point start;
+
+public:
+    explicit PerfTimer(PerfSlot timed_slot) : slot(timed_slot), start(std::chrono::steady_clock::now()) {}
+    ~PerfTimer() {
+        PerfMonitor::add_time(slot, std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count());
+    }
 };
 
+/**
+ * Times one frame and publishes its statistics when the scope ends
+ */
+class PerfFrame {
+private:
+    std::chrono::steady_clock::time_point start;
+
+public:
+    PerfFrame() : start(std::chrono::steady_clock::now()) { PerfMonitor::begin_frame(); }
+    ~PerfFrame() {
+        PerfMonitor::add_time(PERF_FRAME, std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count());
+        PerfMonitor::end_frame();
+    }
+};
+
+#define PERF_SCOPE(slot) PerfTimer perf_scope_timer(slot)
+#define PERF_FRAME_SCOPE() PerfFrame perf_frame_timer
+#else
+// Instrumentation compiles to nothing unless PERF_OVERLAY is defined
+#define PERF_SCOPE(slot)
+#define PERF_FRAME_SCOPE()
+#endif
+
 // Global instances
 extern EditorConfig editor_config;  // Global editor configuration
 extern Terminal terminal;           // Global terminal instance
+extern WindowManager window_manager; // Global window layout
+extern BufferList buffer_list;      // Global list of open buffers
+extern SearchState search_state;    // Global search state
+extern CursorSet cursor_set;        // Global extra cursors
+extern DiffView diff_view;          // Global buffer comparison
+extern ColumnView column_view;      // Global column layout of delimited text
 
 // Signal handlers and utility functions
 /**
@@ -0,0 +1,334 @@
+#include "../include/slowertext.h"
+
+/**
+ * AnchorTree constructor
+ * Starts empty with a fixed priority seed, so runs are reproducible
+ */
+AnchorTree::AnchorTree() : root(-1), seed(2463534242u), count(0) {
+}
+
+/**
+ * Hand a node's pending shifts down to its children
+ * @param t Node
+ */
+void AnchorTree::push(int t) {
+    Node& node = nodes[t];
+    if (node.row_shift != 0 || node.col_shift != 0) {
+        shift(node.left, node.row_shift, node.col_shift);
+        shift(node.right, node.row_shift, node.col_shift);
+        node.row_shift = 0;
+        node.col_shift = 0;
+    }
+}
+
+/**
+ * Shift every anchor of a subtree
+ * Only the root is updated now; its children follow when pushed
+ * @param t Subtree root, -1 for none
+ * @param rows Rows to add
+ * @param cols Columns to add
+ */
+void AnchorTree::shift(int t, int rows, int cols) {
+    if (t < 0 || (rows == 0 && cols == 0)) {
+        return;
+    }
+    Node& node = nodes[t];
+    node.row += rows;
+    node.col += cols;
+    node.row_shift += rows;
+    node.col_shift += cols;
+}
+
+/**
+ * Move every anchor of a subtree to one position
+ * Visits the whole subtree; used for anchors in deleted text, which are
+ * usually few
+ * @param t Subtree root, -1 for none
+ * @param row New row
+ * @param col New column
+ */
+void AnchorTree::collapse(int t, int row, int col) {
+    if (t < 0) {
+        return;
+    }
+    Node& node = nodes[t];
+    node.row = row;
+    node.col = col;
+    node.row_shift = 0;
+    node.col_shift = 0;
+    collapse(node.left, row, col);
+    collapse(node.right, row, col);
+}
+
+/**
+ * Split a subtree by position
+ * @param t Subtree root, -1 for none
+ * @param row Row of the split position
+ * @param col Column of the split position
+ * @param left Receives the anchors before (row, col)
+ * @param right Receives the anchors at or after (row, col)
+ */
+void AnchorTree::split(int t, int row, int col, int& left, int& right) {
+    if (t < 0) {
+        left = right = -1;
+        return;
+    }
+    push(t);
+    Node& node = nodes[t];
+    if (node.row < row || (node.row == row && node.col < col)) {
+        int rest = -1;
+        split(node.right, row, col, rest, right);
+        node.right = rest;
+        attach(rest, t);
+        left = t;
+    } else {
+        int rest = -1;
+        split(node.left, row, col, left, rest);
+        node.left = rest;
+        attach(rest, t);
+        right = t;
+    }
+    attach(left, -1);
+    attach(right, -1);
+}
+
+/**
+ * Merge two subtrees where every anchor of left comes first
+ * @param left Left subtree, -1 for none
+ * @param right Right subtree, -1 for none
+ * @return Root of the merged subtree
+ */
+int AnchorTree::merge(int left, int right) {
+    if (left < 0) {
+        return right;
+    }
+    if (right < 0) {
+        return left;
+    }
+    if (nodes[left].priority > nodes[right].priority) {
+        push(left);
+        int child = merge(nodes[left].right, right);
+        nodes[left].right = child;
+        attach(child, left);
+        return left;
+    }
+    push(right);
+    int child = merge(left, nodes[right].left);
+    nodes[right].left = child;
+    attach(child, right);
+    return right;
+}
+
+/**
+ * Set the parent link of a node
+ * @param t Node, -1 for none
+ * @param parent Parent node, -1 for a root
+ */
+void AnchorTree::attach(int t, int parent) {
+    if (t >= 0) {
+        nodes[t].parent = parent;
+    }
+}
+
+/**
+ * Add an anchor
+ * @param row Row
+ * @param col Column
+ * @return Anchor id
+ */
+int AnchorTree::add(int row, int col) {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    Node node = {row, col, 0, 0, seed, -1, -1, -1};
+    int id;
+    if (!free_ids.empty()) {
+        id = free_ids.back();
+        free_ids.pop_back();
+        nodes[id] = node;
+    } else {
+        id = static_cast<int>(nodes.size());
+        nodes.push_back(node);
+    }
+
+    int left = -1;
+    int right = -1;
+    split(root, row, col, left, right);
+    root = merge(merge(left, id), right);
+    attach(root, -1);
+    count++;
+    return id;
+}
+
+/**
+ * Remove an anchor; its id may be reused
+ * The shifts pending above the node are pushed down first, so its
+ * children keep their positions when they take its place.
+ * @param id Anchor id
+ */
+void AnchorTree::remove(int id) {
+    if (id < 0 || id >= static_cast<int>(nodes.size()) || nodes[id].parent == -2) {
+        return;
+    }
+    std::vector<int> path;
+    for (int t = id; t >= 0; t = nodes[t].parent) {
+        path.push_back(t);
+    }
+    for (size_t i = path.size(); i-- > 0;) {
+        push(path[i]);
+    }
+
+    int parent = nodes[id].parent;
+    int child = merge(nodes[id].left, nodes[id].right);
+    attach(child, parent);
+    if (parent < 0) {
+        root = child;
+    } else if (nodes[parent].left == id) {
+        nodes[parent].left = child;
+    } else {
+        nodes[parent].right = child;
+    }
+    nodes[id].parent = -2;
+    free_ids.push_back(id);
+    count--;
+}
+
+/**
+ * Get where an anchor is now
+ * Adds up the shifts still pending in the node's ancestors
+ * @param id Anchor id
+ * @param row Receives the row
+ * @param col Receives the column
+ * @return False if there is no such anchor
+ */
+bool AnchorTree::position(int id, int& row, int& col) const {
+    if (id < 0 || id >= static_cast<int>(nodes.size()) || nodes[id].parent == -2) {
+        return false;
+    }
+    row = nodes[id].row;
+    col = nodes[id].col;
+    for (int t = nodes[id].parent; t >= 0; t = nodes[t].parent) {
+        row += nodes[t].row_shift;
+        col += nodes[t].col_shift;
+    }
+    return true;
+}
+
+/**
+ * Text was inserted within a row
+ * @param row Row
+ * @param col Insertion column; anchors at or after it move right
+ * @param length Bytes inserted
+ */
+void AnchorTree::insert_text(int row, int col, int length) {
+    if (root < 0) {
+        return;
+    }
+    int before, moved, after;
+    split(root, row, col, before, moved);
+    split(moved, row + 1, 0, moved, after);
+    shift(moved, 0, length);
+    root = merge(before, merge(moved, after));
+    attach(root, -1);
+}
+
+/**
+ * Text was deleted within a row
+ * @param row Row
+ * @param col First deleted column
+ * @param length Bytes deleted
+ */
+void AnchorTree::delete_text(int row, int col, int length) {
+    if (root < 0) {
+        return;
+    }
+    int before, deleted, moved, after;
+    split(root, row, col, before, deleted);
+    split(deleted, row, col + length, deleted, moved);
+    split(moved, row + 1, 0, moved, after);
+    collapse(deleted, row, col);
+    shift(moved, 0, -length);
+    root = merge(merge(before, deleted), merge(moved, after));
+    attach(root, -1);
+}
+
+/**
+ * A row was split in two at a column
+ * @param row Row
+ * @param col Split column; anchors at or after it move to the new row
+ */
+void AnchorTree::split_row(int row, int col) {
+    if (root < 0) {
+        return;
+    }
+    int before, moved, after;
+    split(root, row, col, before, moved);
+    split(moved, row + 1, 0, moved, after);
+    shift(moved, 1, -col);
+    shift(after, 1, 0);
+    root = merge(before, merge(moved, after));
+    attach(root, -1);
+}
+
+/**
+ * The row after row was appended to row
+ * Anchors left past the end of row by earlier edits move to its end, so
+ * they stay ahead of the anchors joining them.
+ * @param row Row that grew
+ * @param length Length of row before the join
+ */
+void AnchorTree::join_rows(int row, int length) {
+    if (root < 0) {
+        return;
+    }
+    int before, beyond, moved, after;
+    split(root, row, length + 1, before, beyond);
+    split(beyond, row + 1, 0, beyond, moved);
+    split(moved, row + 2, 0, moved, after);
+    collapse(beyond, row, length);
+    shift(moved, -1, length);
+    shift(after, -1, 0);
+    root = merge(merge(before, beyond), merge(moved, after));
+    attach(root, -1);
+}
+
+/**
+ * Rows were replaced by a different number of rows
+ * Anchors on rows that no longer exist move to the start of the row
+ * after the replacement.
+ * @param first First replaced row
+ * @param count Rows replaced
+ * @param produced Rows put in their place
+ */
+void AnchorTree::replace_rows(int first, int count, int produced) {
+    if (root < 0 || count == produced) {
+        return;
+    }
+    int before, removed, after;
+    split(root, first + std::min(count, produced), 0, before, removed);
+    split(removed, first + count, 0, removed, after);
+    collapse(removed, first + produced, 0);
+    shift(after, produced - count, 0);
+    root = merge(merge(before, removed), after);
+    attach(root, -1);
+}
+
+/**
+ * Two neighbouring blocks of rows swapped places
+ * @param first First row of the upper block
+ * @param middle First row of the lower block
+ * @param end Row after the lower block
+ */
+void AnchorTree::swap_rows(int first, int middle, int end) {
+    if (root < 0) {
+        return;
+    }
+    int before, upper, lower, after;
+    split(root, first, 0, before, upper);
+    split(upper, middle, 0, upper, lower);
+    split(lower, end, 0, lower, after);
+    shift(upper, end - middle, 0);
+    shift(lower, first - middle, 0);
+    root = merge(merge(before, lower), merge(upper, after));
+    attach(root, -1);
+}
@@ -1,11 +1,440 @@
 #include "../include/slowertext.h"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <iterator>
+
+// Hook called before any buffer changes
+static void (*edit_hook)(const Buffer*) = nullptr;
+
+// Maximum undo records kept per buffer (max_undo_levels)
+static size_t undo_limit = 100;
+
+// Smallest amount the edit gap grows by; it also grows by an eighth of the
+// line, so refilling stays rare on very long lines
+static const size_t GAP_MIN = 64;
+
+// Shorter lines are cheaper to edit in place than to move into the gap
+static const size_t GAP_LINE_MIN = 1024;
+
+// Lines this long are edited as chunks, where moving the gap could cost
+// megabytes of copying per cursor jump
+static const size_t CHUNK_LINE_MIN = 256 * 1024;
+
+// Chunk size when a line is split; chunks split again at twice this
+static const size_t CHUNK_SIZE = 16 * 1024;
+
+// Line text comes from slabs of this size
+static const size_t SLAB_SIZE = 1 << 20;
+
+// Size classes: 16-byte steps up to 256 bytes, then powers of two up to
+// 64 KB; larger blocks come from the heap
+static const size_t SMALL_CLASSES = 16;
+static const size_t CLASS_COUNT = SMALL_CLASSES + 8;
+static const size_t LARGEST_CLASS = 65536;
+
+// Idle compaction waits until this much released text has piled up
+static const size_t COMPACT_MIN = 4 << 20;
+
+// Oldest jump list entries are forgotten beyond this many
+static const size_t MAX_JUMPS = 100;
+
+static const Line EMPTY_LINE = {nullptr, 0, 0};
+
+/**
+ * Get the size class for a block size
+ * @param bytes Requested size, at most LARGEST_CLASS
+ * @return Class index
+ */
+static size_t size_class(size_t bytes) {
+    if (bytes <= SMALL_CLASSES * 16) {
+        return bytes == 0 ? 0 : (bytes - 1) / 16;
+    }
+    size_t index = SMALL_CLASSES;
+    for (size_t size = 512; size < bytes; size *= 2) {
+        index++;
+    }
+    return index;
+}
+
+/**
+ * Get the block size of a size class
+ * @param index Class index
+ * @return Bytes per block
+ */
+static size_t class_size(size_t index) {
+    return index < SMALL_CLASSES ? (index + 1) * 16 : size_t(512) << (index - SMALL_CLASSES);
+}
+
+/**
+ * Order the corners of a selection and clamp its rows to the buffer
+ * Characters and lines order the two positions; a block orders its rows
+ * and its columns separately.
+ * @param first_x Column of one corner, receives the first column
+ * @param first_y Row of one corner, receives the first row
+ * @param last_x Column of the other corner, receives the last column
+ * @param last_y Row of the other corner, receives the last row
+ * @param kind Shape of the selection
+ * @param line_count Rows in the buffer
+ */
+static void order_region(int& first_x, int& first_y, int& last_x, int& last_y, SelectionKind kind, int line_count) {
+    if (kind == SELECT_BLOCK) {
+        if (first_x > last_x) {
+            std::swap(first_x, last_x);
+        }
+        if (first_y > last_y) {
+            std::swap(first_y, last_y);
+        }
+    } else if (first_y > last_y || (first_y == last_y && first_x > last_x)) {
+        std::swap(first_x, last_x);
+        std::swap(first_y, last_y);
+    }
+    first_y = std::max(0, std::min(first_y, line_count - 1));
+    last_y = std::max(0, std::min(last_y, line_count - 1));
+    first_x = std::max(first_x, 0);
+    last_x = std::max(last_x, 0);
+}
+
+ArenaStore::~ArenaStore() {
+    for (char* slab : slabs) {
+        ::operator delete(slab);
+    }
+    for (char* block : large) {
+        ::operator delete(block);
+    }
+}
+
+LineArena::LineArena()
+    : free_lists(CLASS_COUNT, nullptr), next(nullptr), limit(nullptr), large_bytes(0), free_bytes(0) {
+}
+
+LineArena::~LineArena() {
+}
+
+LineArena::LineArena(LineArena&& other) noexcept
+    : store(std::move(other.store)), kept(std::move(other.kept)), free_lists(std::move(other.free_lists)),
+      next(other.next), limit(other.limit), large_bytes(other.large_bytes), free_bytes(other.free_bytes) {
+    other.kept.clear();
+    other.free_lists.assign(CLASS_COUNT, nullptr);
+    other.next = other.limit = nullptr;
+    other.large_bytes = other.free_bytes = 0;
+}
+
+LineArena& LineArena::operator=(LineArena&& other) noexcept {
+    if (this != &other) {
+        LineArena old(std::move(*this));
+        store.swap(other.store);
+        kept.swap(other.kept);
+        free_lists.swap(other.free_lists);
+        std::swap(next, other.next);
+        std::swap(limit, other.limit);
+        std::swap(large_bytes, other.large_bytes);
+        std::swap(free_bytes, other.free_bytes);
+    }
+    return *this;
+}
+
+/**
+ * Get a block of at least the given size
+ * Reuses a released block of the same class, else bumps the slab pointer
+ * @param bytes Bytes needed, not zero
+ * @param room Receives the block size
+ * @return Block
+ */
+char* LineArena::allocate(size_t bytes, size_t& room) {
+    if (!store) {
+        store = std::make_shared<ArenaStore>();
+    }
+    if (bytes > LARGEST_CLASS) {
+        room = bytes;
+        char* block = static_cast<char*>(::operator new(bytes));
+        store->large.push_back(block);
+        large_bytes += bytes;
+        return block;
+    }
+
+    size_t index = size_class(bytes);
+    room = class_size(index);
+    char* block = free_lists[index];
+    if (block) {
+        memcpy(&free_lists[index], block, sizeof(char*));
+        free_bytes -= room;
+        return block;
+    }
+    if (static_cast<size_t>(limit - next) < room) {
+        // The rest of the old slab is too small for this class; it is left unused
+        next = static_cast<char*>(::operator new(SLAB_SIZE));
+        limit = next + SLAB_SIZE;
+        store->slabs.push_back(next);
+    }
+    block = next;
+    next += room;
+    return block;
+}
+
+/**
+ * Put a block on its class's free list
+ * @param text Block from allocate()
+ * @param room Its size
+ */
+void LineArena::release(char* text, size_t room) {
+    if (room > LARGEST_CLASS) {
+        std::vector<char*>& large = store->large;
+        std::vector<char*>::iterator found = std::find(large.begin(), large.end(), text);
+        if (found != large.end()) {
+            *found = large.back();
+            large.pop_back();
+            large_bytes -= room;
+            ::operator delete(text);
+        }
+        return;
+    }
+    size_t index = size_class(room);
+    memcpy(text, &free_lists[index], sizeof(char*));
+    free_lists[index] = text;
+    free_bytes += room;
+}
+
+Line LineArena::make(const char* text, size_t length) {
+    Line line = {nullptr, length, 0};
+    if (length > 0) {
+        line.text = allocate(length, line.room);
+        memcpy(line.text, text, length);
+    }
+    return line;
+}
+
+void LineArena::drop(Line& line) {
+    if (line.text && line.room > 0) {
+        release(line.text, line.room);
+    }
+    line.text = nullptr;
+    line.count = 0;
+    line.room = 0;
+}
+
+void LineArena::insert(Line& line, size_t pos, const char* text, size_t length) {
+    if (length == 0) {
+        return;
+    }
+    size_t needed = line.count + length;
+    if (needed <= line.room) {
+        memmove(line.text + pos + length, line.text + pos, line.count - pos);
+        memcpy(line.text + pos, text, length);
+        line.count = needed;
+        return;
+    }
+
+    // Move to a block with room to spare so typing does not move every key
+    Line grown = {nullptr, needed, 0};
+    grown.text = allocate(std::max(needed, line.room + line.room / 2), grown.room);
+    memcpy(grown.text, line.data(), pos);
+    memcpy(grown.text + pos, text, length);
+    memcpy(grown.text + pos + length, line.data() + pos, line.count - pos);
+    drop(line);
+    line = grown;
+}
+
+void LineArena::erase(Line& line, size_t pos, size_t length) {
+    if (line.room == 0 && length > 0) {
+        Line copy = {nullptr, line.count - length, 0};
+        if (copy.count > 0) {
+            copy.text = allocate(copy.count, copy.room);
+            memcpy(copy.text, line.text, pos);
+            memcpy(copy.text + pos, line.text + pos + length, line.count - pos - length);
+        }
+        line = copy;
+        return;
+    }
+    memmove(line.text + pos, line.text + pos + length, line.count - pos - length);
+    line.count -= length;
+}
+
+void LineArena::share(Line& line) {
+    line.room = 0;
+}
+
+void LineArena::shared_stores(std::vector<std::shared_ptr<ArenaStore>>& out) {
+    if (!store) {
+        store = std::make_shared<ArenaStore>();
+    }
+    out.push_back(store);
+    out.insert(out.end(), kept.begin(), kept.end());
+}
+
+void LineArena::keep(const std::vector<std::shared_ptr<ArenaStore>>& stores) {
+    for (const std::shared_ptr<ArenaStore>& other : stores) {
+        if (other != store && std::find(kept.begin(), kept.end(), other) == kept.end()) {
+            kept.push_back(other);
+        }
+    }
+}
+
+size_t LineArena::footprint() const {
+    return store ? store->slabs.size() * SLAB_SIZE + large_bytes : 0;
+}
+
+LineChunks::LineChunks() : total(0) {
+}
+
+void LineChunks::assign(const char* text, size_t length) {
+    chunks.clear();
+    for (size_t pos = 0; pos < length; pos += CHUNK_SIZE) {
+        chunks.push_back(std::string(text + pos, std::min(CHUNK_SIZE, length - pos)));
+    }
+    if (chunks.empty()) {
+        chunks.push_back("");
+    }
+    total = length;
+    rebuild();
+}
+
+std::string LineChunks::take() {
+    std::string line;
+    line.reserve(total);
+    for (const std::string& chunk : chunks) {
+        line += chunk;
+    }
+    chunks.clear();
+    tree.clear();
+    total = 0;
+    return line;
+}
+
+size_t LineChunks::capacity() const {
+    size_t bytes = tree.capacity() * sizeof(size_t);
+    for (const std::string& chunk : chunks) {
+        bytes += chunk.capacity();
+    }
+    return bytes;
+}
+
+char LineChunks::at(size_t pos) const {
+    size_t chunk = locate(pos);
+    return pos < chunks[chunk].size() ? chunks[chunk][pos] : '\0';
+}
+
+void LineChunks::append_to(std::string& out, size_t pos, size_t count) const {
+    if (count == 0) {
+        return;
+    }
+    for (size_t chunk = locate(pos); count > 0 && chunk < chunks.size(); chunk++) {
+        size_t part = std::min(count, chunks[chunk].size() - pos);
+        out.append(chunks[chunk].data() + pos, part);
+        count -= part;
+        pos = 0;
+    }
+}
+
+void LineChunks::insert(size_t pos, const char* text, size_t count) {
+    size_t chunk = locate(pos);
+    chunks[chunk].insert(pos, text, count);
+    total += count;
+    if (chunks[chunk].size() <= 2 * CHUNK_SIZE) {
+        add(chunk, count, 0);
+        return;
+    }
+
+    // Split the grown chunk into chunks of the usual size
+    std::string grown = std::move(chunks[chunk]);
+    std::vector<std::string> pieces;
+    for (size_t from = 0; from < grown.size(); from += CHUNK_SIZE) {
+        pieces.push_back(grown.substr(from, CHUNK_SIZE));
+    }
+    chunks[chunk] = std::move(pieces[0]);
+    chunks.insert(chunks.begin() + chunk + 1, std::make_move_iterator(pieces.begin() + 1),
+                  std::make_move_iterator(pieces.end()));
+    rebuild();
+}
+
+void LineChunks::erase(size_t pos) {
+    size_t chunk = locate(pos);
+    chunks[chunk].erase(pos, 1);
+    total--;
+    if (chunks[chunk].empty() && chunks.size() > 1) {
+        chunks.erase(chunks.begin() + chunk);
+        rebuild();
+    } else {
+        add(chunk, 0, 1);
+    }
+}
+
+/**
+ * Find the chunk holding a column
+ * The end of the line belongs to the last chunk.
+ * @param pos Column, receives the offset within the chunk
+ * @return Chunk index
+ */
+size_t LineChunks::locate(size_t& pos) const {
+    if (pos >= total) {
+        pos -= total - chunks.back().size();
+        return chunks.size() - 1;
+    }
+    size_t size = chunks.size();
+    size_t index = 0;
+    size_t step = 1;
+    while (step * 2 <= size) {
+        step *= 2;
+    }
+    for (; step > 0; step /= 2) {
+        if (index + step <= size && tree[index + step] <= pos) {
+            index += step;
+            pos -= tree[index];
+        }
+    }
+    return index;
+}
+
+void LineChunks::add(size_t chunk, size_t grow, size_t shrink) {
+    for (size_t i = chunk + 1; i < tree.size(); i += i & (~i + 1)) {
+        tree[i] = tree[i] + grow - shrink;
+    }
+}
+
+void LineChunks::rebuild() {
+    tree.assign(chunks.size() + 1, 0);
+    for (size_t i = 1; i < tree.size(); i++) {
+        tree[i] += chunks[i - 1].size();
+        size_t parent = i + (i & (~i + 1));
+        if (parent < tree.size()) {
+            tree[parent] += tree[i];
+        }
+    }
+}
+
+/**
+ * Append part of the line to a string
+ * @param out String to append to
+ * @param pos First column
+ * @param count Number of bytes
+ */
+void LineView::append_to(std::string& out, size_t pos, size_t count) const {
+    if (chunks) {
+        chunks->append_to(out, pos, count);
+        return;
+    }
+    if (pos < front_length) {
+        size_t part = std::min(count, front_length - pos);
+        out.append(front + pos, part);
+        pos += part;
+        count -= part;
+    }
+    if (count > 0) {
+        out.append(back + (pos - front_length), count);
+    }
+}
 
 /**
  * Buffer constructor
  * Initializes an empty buffer with one empty line
  */
-Buffer::Buffer() : modified(false) {
-    lines.push_back("");
+Buffer::Buffer()
+    : modified(false), version(0), transaction_depth(0), transaction_recorded(false),
+      gap_row(-1), gap_start(0), gap_end(0), row_chunked(false), jump_index(0),
+      fold_method(FOLD_MANUAL), fold_width(4), fold_version(0) {
+    memset(&disk_stamp, 0, sizeof(disk_stamp));
+    std::fill(marks, marks + 26, -1);
+    lines.push_back(EMPTY_LINE);
 }
 
 /**
@@ -15,18 +444,46 @@ Buffer::Buffer() : modified(false) {
  * @param c Character to insert
  */
 void Buffer::insert_char(int x, int y, char c) {
+    insert_text(x, y, std::string(1, c));
+}
+
+/**
+ * Insert several characters at the specified position as one edit
+ * The text goes into the edit gap, so typing at the same place costs no
+ * move of the rest of the line however long it is.
+ * @param x Column position (0-based), clamped to the line
+ * @param y Row position (0-based)
+ * @param text Characters to insert, without newlines
+ */
+void Buffer::insert_text(int x, int y, const std::string& text) {
     // Validate row bounds
-    if (y < 0 || y >= static_cast<int>(lines.size())) {
+    if (y < 0 || y >= static_cast<int>(lines.size()) || text.empty()) {
         return;
     }
     
     // Clamp column position to valid range
-    if (x < 0 || x > static_cast<int>(lines[y].length())) {
-        x = lines[y].length();
-    }
+    size_t length = view_line(y).length();
+    size_t at = (x < 0 || static_cast<size_t>(x) > length) ? length : static_cast<size_t>(x);
     
-    // Insert character and mark as modified
-    lines[y].insert(x, 1, c);
+    // Insert into the gap and mark as modified
+    bool reindent = fold_method == FOLD_INDENT && touches_indent(y, at);
+    begin_edit();
+    record_line_edit(y);
+    anchors.insert_text(y, static_cast<int>(at), static_cast<int>(text.size()));
+    if (y != gap_row && length < GAP_LINE_MIN) {
+        arena.insert(lines[y], at, text.data(), text.size());
+    } else {
+        open_gap(y, at, text.size());
+        if (row_chunked) {
+            row_chunks.insert(at, text.data(), text.size());
+        } else {
+            memcpy(&gap_text[gap_start], text.data(), text.size());
+            gap_start += text.size();
+        }
+    }
+    if (reindent) {
+        refold(y, y);
+    }
     modified = true;
 }
 
@@ -42,12 +499,29 @@ void Buffer::delete_char(int x, int y) {
     }
     
     // Validate column bounds
-    if (x < 0 || x >= static_cast<int>(lines[y].length())) {
+    size_t length = view_line(y).length();
+    if (x < 0 || static_cast<size_t>(x) >= length) {
         return;
     }
     
-    // Delete character and mark as modified
-    lines[y].erase(x, 1);
+    // Widen the gap over the character and mark as modified
+    bool reindent = fold_method == FOLD_INDENT && touches_indent(y, static_cast<size_t>(x));
+    begin_edit();
+    record_line_edit(y);
+    anchors.delete_text(y, x, 1);
+    if (y != gap_row && length < GAP_LINE_MIN) {
+        arena.erase(lines[y], static_cast<size_t>(x), 1);
+    } else {
+        open_gap(y, static_cast<size_t>(x), 0);
+        if (row_chunked) {
+            row_chunks.erase(static_cast<size_t>(x));
+        } else {
+            gap_end++;
+        }
+    }
+    if (reindent) {
+        refold(y, y);
+    }
     modified = true;
 }
 
@@ -58,22 +532,28 @@ void Buffer::delete_char(int x, int y) {
  * @param y Row position
  */
 void Buffer::insert_newline(int x, int y) {
+    close_gap();
     // Validate row bounds
     if (y < 0 || y >= static_cast<int>(lines.size())) {
         return;
     }
     
     // Clamp column position to valid range
-    if (x < 0 || x > static_cast<int>(lines[y].length())) {
-        x = lines[y].length();
-    }
+    const Line& old_line = lines[y];
+    size_t split = (x < 0 || static_cast<size_t>(x) > old_line.length()) ? old_line.length() : static_cast<size_t>(x);
     
-    // Split the line at the cursor position
-    std::string new_line = lines[y].substr(x);  // Text after cursor
-    lines[y] = lines[y].substr(0, x);           // Text before cursor
+    // Split the line at the cursor position; the old line goes to undo
+    begin_edit();
+    Line before = arena.make(old_line.data(), split);                                // Text before cursor
+    Line after = arena.make(old_line.data() + split, old_line.length() - split);     // Text after cursor
+    record(y, std::vector<Line>(1, old_line), 2, false);
+    lines[y] = before;
     
     // Insert the new line after current line
-    lines.insert(lines.begin() + y + 1, new_line);
+    lines.insert(lines.begin() + y + 1, after);
+    anchors.split_row(y, static_cast<int>(split));
+    folds.replace_rows(y + 1, 0, 1);
+    refold(y, y + 1);
     modified = true;
 }
 
@@ -82,22 +562,54 @@ void Buffer::insert_newline(int x, int y) {
  * @param y Row position to delete
  */
 void Buffer::delete_line(int y) {
+    close_gap();
     // Validate row bounds
     if (y < 0 || y >= static_cast<int>(lines.size())) {
         return;
     }
     
     // If more than one line, delete the specified line
+    begin_edit();
     if (lines.size() > 1) {
+        record(y, std::vector<Line>(1, lines[y]), 0, false);
         lines.erase(lines.begin() + y);
+        rows_replaced(y, 1, 0);
         modified = true;
     } else {
         // If only one line, clear it instead of deleting
-        lines[0] = "";
+        record(0, std::vector<Line>(1, lines[0]), 1, false);
+        lines[0] = EMPTY_LINE;
+        refold(0, 0);
         modified = true;
     }
 }
 
+/**
+ * Append the next line to a line
+ * Anchors on the next line keep their place in its text.
+ * @param y Row position
+ */
+void Buffer::join_line(int y) {
+    close_gap();
+    // Validate row bounds
+    if (y < 0 || y + 1 >= static_cast<int>(lines.size())) {
+        return;
+    }
+    
+    // Both lines go to undo as one change
+    begin_edit();
+    size_t length = lines[y].size();
+    Line joined = arena.make(lines[y].data(), length);
+    arena.insert(joined, length, lines[y + 1].data(), lines[y + 1].size());
+    record(y, std::vector<Line>(lines.begin() + y, lines.begin() + y + 2), 1, false);
+    lines[y] = joined;
+    lines.erase(lines.begin() + y + 1);
+    anchors.join_rows(y, static_cast<int>(length));
+    folds.replace_rows(y + 1, 1, 0);
+    refold(y, y);
+    modified = true;
+}
+
 /**
  * Get the content of a specific line
  * @param y Row position
@@ -107,7 +619,39 @@ std::string Buffer::get_line(int y) const {
     if (y < 0 || y >= static_cast<int>(lines.size())) {
         return "";
     }
-    return lines[y];
+    if (y != gap_row) {
+        return lines[y].str();
+    }
+    LineView view = view_line(y);
+    std::string line;
+    line.reserve(view.length());
+    view.append_to(line, 0, view.length());
+    return line;
+}
+
+/**
+ * Get a line without copying it or closing the edit gap
+ * The view is valid until the next edit or get_lines() call.
+ * @param y Row position
+ * @return View of the line, empty if invalid row
+ */
+LineView Buffer::view_line(int y) const {
+    LineView view = {"", 0, "", 0, nullptr};
+    if (y < 0 || y >= static_cast<int>(lines.size())) {
+        return view;
+    }
+    if (y == gap_row && row_chunked) {
+        view.chunks = &row_chunks;
+    } else if (y == gap_row) {
+        view.front = gap_text.data();
+        view.front_length = gap_start;
+        view.back = gap_text.data() + gap_end;
+        view.back_length = gap_text.size() - gap_end;
+    } else {
+        view.front = lines[y].data();
+        view.front_length = lines[y].size();
+    }
+    return view;
 }
 
 /**
@@ -125,18 +669,29 @@ int Buffer::get_line_count() const {
  * @param line New line content
  */
 void Buffer::set_line(int y, const std::string& line) {
+    close_gap();
     // Invalid row position
     if (y < 0) {
         return;
     }
     
     // Expand buffer with empty lines if necessary
-    while (y >= static_cast<int>(lines.size())) {
-        lines.push_back("");
+    begin_edit();
+    int old_size = static_cast<int>(lines.size());
+    if (y >= old_size) {
+        record(old_size, std::vector<Line>(), y - old_size + 1, false);
+        lines.resize(y + 1, EMPTY_LINE);
+    } else {
+        record(y, std::vector<Line>(1, lines[y]), 1, false);
     }
     
     // Set line content and mark as modified
-    lines[y] = line;
+    lines[y] = arena.make(line.data(), line.size());
+    if (y >= old_size) {
+        rows_replaced(old_size, 0, y - old_size + 1);
+    } else {
+        refold(y, y);
+    }
     modified = true;
 }
 
@@ -160,15 +715,1550 @@ void Buffer::set_modified(bool mod) {
  * Clear all buffer content and reset to single empty line
  */
 void Buffer::clear() {
-    lines.clear();
-    lines.push_back("");
+    begin_edit();
+    gap_row = -1;
+    std::string().swap(gap_text);
+    row_chunked = false;
+    row_chunks = LineChunks();
+    
+    // Swap with empty containers so evicted buffers release their storage
+    std::vector<Line>().swap(lines);
+    arena = LineArena();
+    lines.push_back(EMPTY_LINE);
     modified = false;
+    std::vector<UndoRecord>().swap(undo_stack);
+    std::vector<UndoRecord>().swap(redo_stack);
 }
 
 /**
  * Get const reference to all lines for read-only iteration
  * @return Const reference to lines vector
  */
-const std::vector<std::string>& Buffer::get_lines() const {
+const std::vector<Line>& Buffer::get_lines() const {
+    close_gap();
     return lines;
-}
\ No newline at end of file
+}
+
+/**
+ * Get the change counter of the buffer
+ * @return Version number, incremented on every modification
+ */
+unsigned long Buffer::get_version() const {
+    return version;
+}
+
+/**
+ * Get name of the file backing this buffer
+ * @return Filename, empty for unnamed buffers
+ */
+const std::string& Buffer::get_filename() const {
+    return filename;
+}
+
+/**
+ * Set name of the file backing this buffer
+ * @param name New filename
+ */
+void Buffer::set_filename(const std::string& name) {
+    filename = name;
+}
+
+/**
+ * Estimate heap memory held by the buffer content
+ * Counts line objects and the arena holding their text
+ * @return Approximate size in bytes
+ */
+size_t Buffer::memory_usage() const {
+    size_t total = lines.capacity() * sizeof(Line) + arena.footprint();
+    if (gap_row >= 0) {
+        total += (row_chunked ? row_chunks.capacity() : gap_text.capacity()) + 1;
+    }
+    return total;
+}
+
+/**
+ * Prepare for a modification
+ * Lets background readers stop first, then bumps the version
+ */
+void Buffer::begin_edit() {
+    if (edit_hook) {
+        edit_hook(this);
+    }
+    version++;
+}
+
+/**
+ * Install a hook called before any buffer is modified
+ * @param hook Function receiving the buffer about to change
+ */
+void Buffer::set_edit_hook(void (*hook)(const Buffer*)) {
+    edit_hook = hook;
+}
+
+/**
+ * Replace all content with loaded lines, discarding undo history
+ * The old arena is freed whole, without visiting its lines
+ * @param text_arena Arena holding the lines' text
+ * @param new_lines Lines to take ownership of
+ */
+void Buffer::assign_lines(LineArena&& text_arena, std::vector<Line>&& new_lines) {
+    begin_edit();
+    gap_row = -1;
+    gap_text.clear();
+    row_chunked = false;
+    row_chunks = LineChunks();
+    lines = std::move(new_lines);
+    arena = std::move(text_arena);
+    if (lines.empty()) {
+        lines.push_back(EMPTY_LINE);
+    }
+    if (fold_method == FOLD_INDENT) {
+        set_fold_method(FOLD_INDENT, fold_width);
+    }
+    std::vector<UndoRecord>().swap(undo_stack);
+    std::vector<UndoRecord>().swap(redo_stack);
+}
+
+/**
+ * Copy live text into a fresh arena if many blocks were released
+ * Lines and undo history are copied in order, which also packs the text
+ * of neighbouring lines together; the old slabs are then freed at once.
+ * Called when idle; background readers of this buffer must be stopped
+ * @return True if the buffer was compacted
+ */
+bool Buffer::compact() {
+    if (arena.unused() < COMPACT_MIN || arena.unused() * 2 < arena.footprint()) {
+        return false;
+    }
+    TraceSpan span(TRACE_BUFFER_COMPACT);
+    span.a = static_cast<long long>(arena.unused());
+    LineArena fresh;
+    for (Line& line : lines) {
+        line = fresh.make(line.data(), line.size());
+    }
+    std::vector<UndoRecord>* stacks[] = {&undo_stack, &redo_stack};
+    for (std::vector<UndoRecord>* stack : stacks) {
+        for (UndoRecord& entry : *stack) {
+            for (UndoChange& change : entry.changes) {
+                for (Line& line : change.lines) {
+                    line = fresh.make(line.data(), line.size());
+                }
+            }
+        }
+    }
+    arena = std::move(fresh);
+    return true;
+}
+
+/**
+ * Record the file version the text matches
+ * @param stamp Stamp of the file just loaded or saved
+ */
+void Buffer::set_disk_stamp(const FileStamp& stamp) const {
+    disk_stamp = stamp;
+}
+
+/**
+ * Get the file version the text matches
+ * @return Stamp, all zero if never loaded or saved
+ */
+const FileStamp& Buffer::get_disk_stamp() const {
+    return disk_stamp;
+}
+
+/**
+ * Replace the content of many lines as one edit
+ * Old text moves into a single undo record without copying, and
+ * the version is bumped once so windows redraw once
+ * @param changes Replacements sorted by line
+ */
+void Buffer::apply_line_changes(std::vector<LineChange>& changes) {
+    close_gap();
+    if (changes.empty()) {
+        return;
+    }
+
+    begin_edit();
+    begin_transaction();
+    for (LineChange& change : changes) {
+        if (change.line < 0 || change.line >= static_cast<int>(lines.size())) {
+            continue;
+        }
+        record(change.line, std::vector<Line>(1, lines[change.line]), 1, false);
+        lines[change.line] = arena.make(change.text.data(), change.text.size());
+        refold(change.line, change.line);
+    }
+    commit_transaction();
+    modified = true;
+}
+
+/**
+ * Replace a range of lines with new lines as one edit
+ * @param first First row to replace
+ * @param count Number of rows to replace
+ * @param new_lines Replacement lines (may differ in count)
+ */
+void Buffer::replace_lines(int first, int count, std::vector<std::string> new_lines) {
+    close_gap();
+    int size = static_cast<int>(lines.size());
+    if (first < 0 || first > size) {
+        return;
+    }
+    count = std::max(0, std::min(count, size - first));
+
+    begin_edit();
+    begin_transaction();
+    std::vector<Line> old_lines(lines.begin() + first, lines.begin() + first + count);
+    std::vector<Line> added;
+    added.reserve(new_lines.size());
+    for (const std::string& text : new_lines) {
+        added.push_back(arena.make(text.data(), text.size()));
+    }
+    int produced = static_cast<int>(added.size());
+    if (produced == count) {
+        std::copy(added.begin(), added.end(), lines.begin() + first);
+    } else {
+        lines.erase(lines.begin() + first, lines.begin() + first + count);
+        lines.insert(lines.begin() + first, added.begin(), added.end());
+    }
+    record(first, std::move(old_lines), produced, false);
+
+    // A buffer always holds at least one line
+    if (lines.empty()) {
+        lines.push_back(EMPTY_LINE);
+        record(0, std::vector<Line>(), 1, false);
+    }
+    rows_replaced(first, count, produced);
+    commit_transaction();
+    modified = true;
+}
+
+/**
+ * Apply one keystroke at many cursors as one edit
+ * Cursors are visited in position order and each row holding cursors is
+ * rebuilt from its pieces once; rows split by newlines are moved down in
+ * one pass from the bottom. Anchors and folds are shifted per cursor from
+ * the last one up, so the positions still to be visited stay valid.
+ * @param cursors Positions, moved to where the keystroke leaves them (order is kept)
+ * @param kind Keystroke
+ * @param text Text inserted by CURSOR_INSERT
+ * @param keep_indent Whether CURSOR_NEWLINE indents new rows like the row split
+ */
+void Buffer::edit_at_cursors(std::vector<Cursor>& cursors, CursorEdit kind, const std::string& text, bool keep_indent) {
+    close_gap();
+    if (cursors.empty() || (kind == CURSOR_INSERT && text.empty())) {
+        return;
+    }
+    int size = static_cast<int>(lines.size());
+    for (Cursor& cursor : cursors) {
+        cursor.y = std::max(0, std::min(cursor.y, size - 1));
+        cursor.x = std::max(0, std::min(cursor.x, static_cast<int>(lines[cursor.y].size())));
+    }
+    // Backspace at row starts and Delete at row ends change nothing
+    bool changes = (kind == CURSOR_INSERT || kind == CURSOR_NEWLINE);
+    for (size_t i = 0; !changes && i < cursors.size(); i++) {
+        const Cursor& cursor = cursors[i];
+        changes = (kind == CURSOR_BACKSPACE) ? cursor.x > 0 : cursor.x < static_cast<int>(lines[cursor.y].size());
+    }
+    if (!changes) {
+        return;
+    }
+    std::vector<size_t> order(cursors.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&cursors](size_t a, size_t b) {
+        return cursors[a].y != cursors[b].y ? cursors[a].y < cursors[b].y : cursors[a].x < cursors[b].x;
+    });
+
+    begin_edit();
+    begin_transaction();
+    for (size_t i = order.size(); i-- > 0;) {
+        const Cursor& cursor = cursors[order[i]];
+        if (i > 0 && cursors[order[i - 1]].y == cursor.y && cursors[order[i - 1]].x == cursor.x) {
+            continue;
+        }
+        int length = static_cast<int>(lines[cursor.y].size());
+        if (kind == CURSOR_INSERT) {
+            anchors.insert_text(cursor.y, cursor.x, static_cast<int>(text.size()));
+        } else if (kind == CURSOR_BACKSPACE && cursor.x > 0) {
+            anchors.delete_text(cursor.y, cursor.x - 1, 1);
+        } else if (kind == CURSOR_DELETE && cursor.x < length) {
+            anchors.delete_text(cursor.y, cursor.x, 1);
+        } else if (kind == CURSOR_NEWLINE) {
+            anchors.split_row(cursor.y, cursor.x);
+            folds.replace_rows(cursor.y + 1, 0, 1);
+        }
+    }
+
+    // Rows a newline split, as runs of pieces to put in place of each row
+    struct RowSplit {
+        int row;
+        size_t first;
+        size_t count;
+    };
+    std::vector<RowSplit> splits;
+    std::vector<Line> pieces;
+    std::string row_text;
+    int added = 0;
+    for (size_t i = 0; i < order.size();) {
+        int y = cursors[order[i]].y;
+        const Line& line = lines[y];
+        size_t length = line.size();
+        size_t copied = 0;
+        size_t first_piece = pieces.size();
+        Cursor previous = {-1, -1};
+        row_text.clear();
+        for (; i < order.size() && cursors[order[i]].y == y; i++) {
+            Cursor& cursor = cursors[order[i]];
+            if (cursor.x == previous.x) {
+                // Same position as the cursor before: same result
+                cursor = cursors[order[i - 1]];
+                continue;
+            }
+            previous = cursor;
+            size_t x = static_cast<size_t>(cursor.x);
+            if (kind == CURSOR_INSERT) {
+                row_text.append(line.data() + copied, x - copied);
+                row_text += text;
+                copied = x;
+            } else if (kind == CURSOR_BACKSPACE) {
+                if (x > 0) {
+                    row_text.append(line.data() + copied, x - 1 - copied);
+                    copied = x;
+                }
+            } else if (kind == CURSOR_DELETE) {
+                row_text.append(line.data() + copied, x - copied);
+                copied = std::min(x + 1, length);
+            } else {
+                row_text.append(line.data() + copied, x - copied);
+                copied = x;
+                pieces.push_back(arena.make(row_text.data(), row_text.size()));
+                size_t indent = 0;
+                while (keep_indent && indent < row_text.size() && (row_text[indent] == ' ' || row_text[indent] == '\t')) {
+                    indent++;
+                }
+                row_text.assign(indent, ' ');
+                anchors.insert_text(y + added + static_cast<int>(pieces.size() - first_piece), 0,
+                                    static_cast<int>(indent));
+                cursor.y = y + added + static_cast<int>(pieces.size() - first_piece);
+            }
+            cursor.x = static_cast<int>(row_text.size());
+        }
+        row_text.append(line.data() + copied, length - copied);
+
+        if (kind == CURSOR_NEWLINE) {
+            pieces.push_back(arena.make(row_text.data(), row_text.size()));
+            size_t count = pieces.size() - first_piece;
+            record(y + added, std::vector<Line>(1, lines[y]), static_cast<int>(count), false);
+            splits.push_back({y, first_piece, count});
+            added += static_cast<int>(count) - 1;
+        } else if (row_text.size() != length || memcmp(row_text.data(), line.data(), length) != 0) {
+            record(y, std::vector<Line>(1, lines[y]), 1, false);
+            lines[y] = arena.make(row_text.data(), row_text.size());
+            refold(y, y);
+        }
+    }
+
+    if (!splits.empty()) {
+        // Each row below a split moves down once
+        lines.resize(size + added, EMPTY_LINE);
+        int source_end = size;
+        int dest_end = size + added;
+        for (size_t r = splits.size(); r-- > 0;) {
+            const RowSplit& split = splits[r];
+            std::move_backward(lines.begin() + split.row + 1, lines.begin() + source_end, lines.begin() + dest_end);
+            dest_end -= source_end - split.row - 1;
+            dest_end -= static_cast<int>(split.count);
+            std::copy(pieces.begin() + split.first, pieces.begin() + split.first + split.count, lines.begin() + dest_end);
+            source_end = split.row;
+        }
+        refold(splits.front().row, splits.back().row + added);
+    }
+    commit_transaction();
+    modified = true;
+}
+
+/**
+ * Copy a selection into a register without copying its text
+ * Each row touched is made read-only and the register takes handles to it
+ * or to a part of it, plus the stores those handles point into; the cost
+ * is one handle per row however long the rows are.
+ * @param first_x Column of the first position
+ * @param first_y Row of the first position
+ * @param last_x Column of the last position
+ * @param last_y Row of the last position
+ * @param kind Shape of the selection
+ * @param out Receives the text
+ */
+void Buffer::yank(int first_x, int first_y, int last_x, int last_y, SelectionKind kind, Register& out) {
+    close_gap();
+    order_region(first_x, first_y, last_x, last_y, kind, static_cast<int>(lines.size()));
+    out.kind = kind;
+    out.pieces.clear();
+    out.pieces.reserve(last_y - first_y + 1);
+    out.stores.clear();
+    for (int y = first_y; y <= last_y; y++) {
+        Line& line = lines[y];
+        size_t start = 0;
+        size_t end = line.size();
+        if (kind == SELECT_BLOCK || (kind == SELECT_CHARS && y == first_y)) {
+            start = std::min(static_cast<size_t>(first_x), end);
+        }
+        if (kind == SELECT_BLOCK || (kind == SELECT_CHARS && y == last_y)) {
+            end = std::min(static_cast<size_t>(last_x) + 1, end);
+        }
+        Line piece = EMPTY_LINE;
+        if (start < end) {
+            arena.share(line);
+            piece.text = line.text + start;
+            piece.count = end - start;
+        }
+        out.pieces.push_back(piece);
+    }
+    arena.shared_stores(out.stores);
+}
+
+/**
+ * Delete a selection as one edit
+ * Lines are spliced out like :d. Characters join the text before the
+ * first position to the text after the last; a block rebuilds each row
+ * it cuts.
+ * @param first_x Column of the first position
+ * @param first_y Row of the first position
+ * @param last_x Column of the last position
+ * @param last_y Row of the last position
+ * @param kind Shape of the selection
+ */
+void Buffer::delete_region(int first_x, int first_y, int last_x, int last_y, SelectionKind kind) {
+    close_gap();
+    order_region(first_x, first_y, last_x, last_y, kind, static_cast<int>(lines.size()));
+    if (kind == SELECT_LINES) {
+        delete_lines(first_y, last_y - first_y + 1);
+        return;
+    }
+    // Nothing to delete when the selection starts past the text it covers
+    bool changes = (kind == SELECT_CHARS && (first_y != last_y || static_cast<size_t>(first_x) < lines[first_y].size()));
+    for (int y = first_y; kind == SELECT_BLOCK && !changes && y <= last_y; y++) {
+        changes = static_cast<size_t>(first_x) < lines[y].size();
+    }
+    if (!changes) {
+        return;
+    }
+
+    begin_edit();
+    begin_transaction();
+    std::string row_text;
+    if (kind == SELECT_CHARS) {
+        const Line& first = lines[first_y];
+        const Line& last = lines[last_y];
+        size_t start = std::min(static_cast<size_t>(first_x), first.size());
+        size_t end = std::min(static_cast<size_t>(last_x) + 1, last.size());
+        if (first_y == last_y) {
+            end = std::max(start, end);
+            anchors.delete_text(first_y, static_cast<int>(start), static_cast<int>(end - start));
+        } else {
+            anchors.delete_text(first_y, static_cast<int>(start), static_cast<int>(first.size() - start));
+            anchors.delete_text(last_y, 0, static_cast<int>(end));
+            anchors.replace_rows(first_y + 1, last_y - first_y - 1, 0);
+            anchors.join_rows(first_y, static_cast<int>(start));
+            folds.replace_rows(first_y + 1, last_y - first_y, 0);
+        }
+        row_text.assign(first.data(), start);
+        row_text.append(last.data() + end, last.size() - end);
+        std::vector<Line> old_lines(lines.begin() + first_y, lines.begin() + last_y + 1);
+        lines.erase(lines.begin() + first_y + 1, lines.begin() + last_y + 1);
+        lines[first_y] = arena.make(row_text.data(), row_text.size());
+        record(first_y, std::move(old_lines), 1, false);
+        refold(first_y, first_y);
+    } else {
+        for (int y = first_y; y <= last_y; y++) {
+            const Line& line = lines[y];
+            size_t start = std::min(static_cast<size_t>(first_x), line.size());
+            size_t end = std::min(static_cast<size_t>(last_x) + 1, line.size());
+            if (start >= end) {
+                continue;
+            }
+            anchors.delete_text(y, static_cast<int>(start), static_cast<int>(end - start));
+            row_text.assign(line.data(), start);
+            row_text.append(line.data() + end, line.size() - end);
+            record(y, std::vector<Line>(1, line), 1, false);
+            lines[y] = arena.make(row_text.data(), row_text.size());
+            refold(y, y);
+        }
+    }
+    commit_transaction();
+    modified = true;
+}
+
+/**
+ * Put register text into the buffer as one edit
+ * Lines are spliced in as the register's own handles, so putting a
+ * million rows moves handles and copies no text; the buffer keeps the
+ * register's stores alive from then on. Characters rebuild the row put
+ * into (and split it around any whole rows), a block rebuilds one row per
+ * piece, padding short rows with spaces and adding rows at the end.
+ * @param x Column position
+ * @param y Row position
+ * @param text Register text
+ */
+void Buffer::put(int x, int y, const Register& text) {
+    close_gap();
+    const std::vector<Line>& pieces = text.pieces;
+    int size = static_cast<int>(lines.size());
+    int count = static_cast<int>(pieces.size());
+    bool changes = (text.kind == SELECT_LINES && count > 0) || count > 1;
+    for (int i = 0; !changes && i < count; i++) {
+        changes = !pieces[i].empty();
+    }
+    if (!changes) {
+        return;
+    }
+    x = std::max(x, 0);
+    y = std::max(0, std::min(y, text.kind == SELECT_LINES ? size : size - 1));
+
+    begin_edit();
+    begin_transaction();
+    arena.keep(text.stores);
+    if (text.kind == SELECT_LINES) {
+        lines.insert(lines.begin() + y, pieces.begin(), pieces.end());
+        record(y, std::vector<Line>(), count, false);
+        rows_replaced(y, 0, count);
+    } else if (text.kind == SELECT_CHARS) {
+        const Line& line = lines[y];
+        size_t at = std::min(static_cast<size_t>(x), line.size());
+        const Line& head = pieces.front();
+        const Line& tail = pieces.back();
+        std::string row_text(line.data(), at);
+        if (count == 1) {
+            row_text.append(head.data(), head.size());
+            row_text.append(line.data() + at, line.size() - at);
+            anchors.insert_text(y, static_cast<int>(at), static_cast<int>(head.size()));
+            record(y, std::vector<Line>(1, line), 1, false);
+            lines[y] = arena.make(row_text.data(), row_text.size());
+            refold(y, y);
+        } else {
+            row_text.append(head.data(), head.size());
+            std::string last_text(tail.data(), tail.size());
+            last_text.append(line.data() + at, line.size() - at);
+            anchors.split_row(y, static_cast<int>(at));
+            anchors.insert_text(y + 1, 0, static_cast<int>(tail.size()));
+            anchors.replace_rows(y + 1, 0, count - 2);
+            folds.replace_rows(y + 1, 0, count - 1);
+            record(y, std::vector<Line>(1, line), count, false);
+            lines[y] = arena.make(row_text.data(), row_text.size());
+            lines.insert(lines.begin() + y + 1, count - 1, EMPTY_LINE);
+            std::copy(pieces.begin() + 1, pieces.end() - 1, lines.begin() + y + 1);
+            lines[y + count - 1] = arena.make(last_text.data(), last_text.size());
+            refold(y, y + count - 1);
+        }
+    } else {
+        int added = y + count - size;
+        if (added > 0) {
+            lines.resize(size + added, EMPTY_LINE);
+            record(size, std::vector<Line>(), added, false);
+            rows_replaced(size, 0, added);
+        }
+        std::string row_text;
+        for (int i = 0; i < count; i++) {
+            const Line& piece = pieces[i];
+            const Line& line = lines[y + i];
+            if (piece.empty()) {
+                continue;
+            }
+            size_t at = std::min(static_cast<size_t>(x), line.size());
+            row_text.assign(line.data(), at);
+            row_text.append(static_cast<size_t>(x) - at, ' ');
+            row_text.append(piece.data(), piece.size());
+            row_text.append(line.data() + at, line.size() - at);
+            anchors.insert_text(y + i, static_cast<int>(at), static_cast<int>(row_text.size() - line.size()));
+            record(y + i, std::vector<Line>(1, line), 1, false);
+            lines[y + i] = arena.make(row_text.data(), row_text.size());
+            refold(y + i, y + i);
+        }
+    }
+    commit_transaction();
+    modified = true;
+}
+
+/**
+ * Delete a range of lines with a single erase
+ * @param first First row
+ * @param count Number of rows
+ */
+void Buffer::delete_lines(int first, int count) {
+    delete_line_runs(std::vector<std::pair<int, int>>(1, std::make_pair(first, count)));
+}
+
+/**
+ * Delete several runs of lines in one compaction pass
+ * Kept lines are shifted down once. The undo record holds one change per
+ * run, so lines kept between runs are not copied.
+ * @param runs Sorted, non-overlapping (first row, count) pairs
+ */
+void Buffer::delete_line_runs(const std::vector<std::pair<int, int>>& runs) {
+    close_gap();
+    size_t size = lines.size();
+    if (runs.empty() || runs.front().first < 0 || static_cast<size_t>(runs.front().first) >= size) {
+        return;
+    }
+
+    begin_edit();
+    begin_transaction();
+    size_t span_start = static_cast<size_t>(runs.front().first);
+    size_t write = span_start;
+    size_t read = span_start;
+    std::vector<std::pair<int, int>> removed;
+
+    for (const std::pair<int, int>& run : runs) {
+        size_t start = static_cast<size_t>(run.first);
+        if (start < read || start >= size) {
+            continue;
+        }
+        size_t end = std::min(size, start + static_cast<size_t>(std::max(run.second, 0)));
+        removed.push_back(std::make_pair(run.first, static_cast<int>(end - start)));
+
+        // Kept lines are shifted into place; each run is its own change,
+        // at the row it starts on once the runs before it are gone
+        for (; read < start; read++) {
+            lines[write++] = lines[read];
+        }
+        record(static_cast<int>(write), std::vector<Line>(lines.begin() + start, lines.begin() + end), 0, false);
+        read = end;
+    }
+    int kept = static_cast<int>(write - span_start);
+    while (read < size) {
+        lines[write++] = lines[read++];
+    }
+    lines.resize(write);
+
+    // Later runs first, so each run's rows are still where runs gave them
+    for (size_t i = removed.size(); i-- > 0;) {
+        anchors.replace_rows(removed[i].first, removed[i].second, 0);
+        folds.replace_rows(removed[i].first, removed[i].second, 0);
+    }
+
+    // A buffer always holds at least one line
+    if (lines.empty()) {
+        lines.push_back(EMPTY_LINE);
+        record(0, std::vector<Line>(), 1, false);
+    }
+    refold(static_cast<int>(span_start), static_cast<int>(span_start) + kept - 1);
+    commit_transaction();
+    modified = true;
+}
+
+/**
+ * Move a block of lines below another line
+ * The block is rotated into place without copying other lines; the undo
+ * record stores the block once
+ * @param first First row of the block
+ * @param last Last row of the block (inclusive)
+ * @param dest Row to place the block after, -1 for the top
+ */
+void Buffer::move_lines(int first, int last, int dest) {
+    close_gap();
+    int size = static_cast<int>(lines.size());
+    if (first < 0 || last >= size || first > last || dest < -1 || dest >= size ||
+        (dest >= first - 1 && dest <= last)) {
+        return;
+    }
+
+    begin_edit();
+    begin_transaction();
+    int count = last - first + 1;
+    std::vector<Line> block;
+    block.reserve(count);
+    for (int y = first; y <= last; y++) {
+        block.push_back(arena.make(lines[y].data(), lines[y].size()));
+    }
+    record(first, std::move(block), 0, false);
+
+    if (dest > last) {
+        std::rotate(lines.begin() + first, lines.begin() + last + 1, lines.begin() + dest + 1);
+        record(dest - count + 1, std::vector<Line>(), count, false);
+        anchors.swap_rows(first, last + 1, dest + 1);
+
+        // Folds do not travel with the block; it is taken out and put back
+        folds.replace_rows(first, count, 0);
+        folds.replace_rows(dest - count + 1, 0, count);
+        refold(first, first - 1);
+        refold(dest - count + 1, dest);
+    } else {
+        std::rotate(lines.begin() + dest + 1, lines.begin() + first, lines.begin() + last + 1);
+        record(dest + 1, std::vector<Line>(), count, false);
+        anchors.swap_rows(dest + 1, first, last + 1);
+        folds.replace_rows(first, count, 0);
+        folds.replace_rows(dest + 1, 0, count);
+        refold(last + 1, last);
+        refold(dest + 1, dest + count);
+    }
+    commit_transaction();
+    modified = true;
+}
+
+/**
+ * Reorder and thin a range of lines as one edit
+ * Kept lines are shared, so the buffer and the undo record hold the same
+ * handles; only dropped lines are owned by the record alone. Anchors and
+ * folds in the range are treated as replaced, like :d followed by :put.
+ * @param first First row of the range
+ * @param last Last row of the range (inclusive)
+ * @param rows Rows of the range to keep, in their new order
+ */
+void Buffer::arrange_lines(int first, int last, const std::vector<int>& rows) {
+    close_gap();
+    int size = static_cast<int>(lines.size());
+    if (first < 0 || last >= size || first > last) {
+        return;
+    }
+
+    begin_edit();
+    begin_transaction();
+    int count = last - first + 1;
+    std::vector<Line> arranged;
+    arranged.reserve(rows.size());
+    for (int y : rows) {
+        if (y >= first && y <= last) {
+            arena.share(lines[y]);
+            arranged.push_back(lines[y]);
+        }
+    }
+    int produced = static_cast<int>(arranged.size());
+    std::vector<Line> old_lines(lines.begin() + first, lines.begin() + last + 1);
+    if (produced == count) {
+        std::copy(arranged.begin(), arranged.end(), lines.begin() + first);
+    } else {
+        lines.erase(lines.begin() + first, lines.begin() + last + 1);
+        lines.insert(lines.begin() + first, arranged.begin(), arranged.end());
+    }
+    record(first, std::move(old_lines), produced, false);
+
+    // A buffer always holds at least one line
+    if (lines.empty()) {
+        lines.push_back(EMPTY_LINE);
+        record(0, std::vector<Line>(), 1, false);
+    }
+    rows_replaced(first, count, produced);
+    commit_transaction();
+    modified = true;
+}
+
+/**
+ * Start grouping edits into one undo record
+ * Transactions nest; the record closes with the outermost commit
+ */
+void Buffer::begin_transaction() {
+    if (transaction_depth++ == 0) {
+        transaction_recorded = false;
+    }
+}
+
+/**
+ * Close a transaction opened with begin_transaction()
+ */
+void Buffer::commit_transaction() {
+    if (transaction_depth > 0) {
+        transaction_depth--;
+    }
+}
+
+/**
+ * Save the state replaced by an edit
+ * Inside a transaction changes join the open record. A single-line
+ * typing edit extends the previous typing record on the same line, so a
+ * burst of keystrokes is undone at once.
+ * @param line First affected row
+ * @param old_lines Content being replaced
+ * @param count Rows the edit produces
+ * @param typing Whether this is a character edit within one line
+ */
+void Buffer::record(int line, std::vector<Line> old_lines, int count, bool typing) {
+    clear_redo();
+    if (undo_limit == 0) {
+        drop_lines(old_lines);
+        return;
+    }
+
+    if (transaction_depth > 0 && transaction_recorded) {
+        undo_stack.back().changes.push_back({line, std::move(old_lines), count});
+        return;
+    }
+
+    UndoRecord entry;
+    entry.changes.push_back({line, std::move(old_lines), count});
+    entry.typing = typing && transaction_depth == 0;
+    undo_stack.push_back(std::move(entry));
+    transaction_recorded = (transaction_depth > 0);
+
+    if (undo_stack.size() > undo_limit) {
+        for (UndoChange& change : undo_stack.front().changes) {
+            drop_lines(change.lines);
+        }
+        undo_stack.erase(undo_stack.begin());
+    }
+}
+
+/**
+ * Give the text of saved lines back to the arena
+ * @param old_lines Lines leaving undo history, emptied
+ */
+void Buffer::drop_lines(std::vector<Line>& old_lines) {
+    for (Line& line : old_lines) {
+        arena.drop(line);
+    }
+    old_lines.clear();
+}
+
+/**
+ * Forget undone records after a new edit
+ */
+void Buffer::clear_redo() {
+    for (UndoRecord& entry : redo_stack) {
+        for (UndoChange& change : entry.changes) {
+            drop_lines(change.lines);
+        }
+    }
+    redo_stack.clear();
+}
+
+/**
+ * Record a character edit on one line
+ * Skips copying the line when the previous record already saved it
+ * @param y Row being edited
+ */
+void Buffer::record_line_edit(int y) {
+    if (undo_limit == 0) {
+        clear_redo();
+        return;
+    }
+    if (transaction_depth == 0 && !undo_stack.empty()) {
+        const UndoRecord& top = undo_stack.back();
+        if (top.typing && top.changes.size() == 1 &&
+            top.changes[0].line == y && top.changes[0].count == 1) {
+            clear_redo();
+            return;
+        }
+    }
+    std::string text = get_line(y);
+    record(y, std::vector<Line>(1, arena.make(text.data(), text.size())), 1, true);
+}
+
+/**
+ * Move the edit gap to a position, making sure it has room
+ * Moving within the gap row shifts only the text between the old and new
+ * position; taking a new row closes the gap on the old one first. A very
+ * long row is split into chunks instead and has no gap to move.
+ * @param y Row to edit
+ * @param x Column of the edit point
+ * @param room Bytes the gap must hold
+ */
+void Buffer::open_gap(int y, size_t x, size_t room) {
+    if (gap_row != y) {
+        close_gap();
+        if (lines[y].size() >= CHUNK_LINE_MIN) {
+            row_chunks.assign(lines[y].data(), lines[y].size());
+            arena.drop(lines[y]);
+            row_chunked = true;
+            gap_row = y;
+            return;
+        }
+        gap_text.assign(lines[y].data(), lines[y].size());
+        arena.drop(lines[y]);
+        gap_row = y;
+        gap_start = x;
+        gap_end = x;
+    } else if (row_chunked) {
+        return;
+    } else if (x < gap_start) {
+        size_t count = gap_start - x;
+        memmove(&gap_text[gap_end - count], &gap_text[x], count);
+        gap_start = x;
+        gap_end -= count;
+    } else if (x > gap_start) {
+        size_t count = x - gap_start;
+        memmove(&gap_text[gap_start], &gap_text[gap_end], count);
+        gap_start += count;
+        gap_end += count;
+    }
+
+    if (gap_end - gap_start < room) {
+        size_t grow = std::max(room, std::max(GAP_MIN, gap_text.size() / 8));
+        gap_text.insert(gap_end, grow, '\0');
+        gap_end += grow;
+    }
+}
+
+/**
+ * Put the gap or chunked row back into the line vector
+ * Only the representation changes, never the content, so readers of a
+ * const buffer may do this.
+ */
+void Buffer::close_gap() const {
+    if (gap_row < 0) {
+        return;
+    }
+    std::vector<Line>& rows = const_cast<std::vector<Line>&>(lines);
+    if (row_chunked) {
+        std::string text = row_chunks.take();
+        rows[gap_row] = arena.make(text.data(), text.size());
+        row_chunked = false;
+        gap_row = -1;
+        return;
+    }
+    gap_text.erase(gap_start, gap_end - gap_start);
+    rows[gap_row] = arena.make(gap_text.data(), gap_text.size());
+    if (gap_text.capacity() > 4 * GAP_LINE_MIN) {
+        std::string().swap(gap_text);
+    } else {
+        gap_text.clear();
+    }
+    gap_row = -1;
+}
+
+/**
+ * Swap the changes of a record with the current content
+ * Undo walks the changes backwards, redo forwards; afterwards the record
+ * holds what it replaced, so it can be applied in the other direction
+ * @param entry Record to apply
+ * @param reverse True for undo order
+ * @return First affected row
+ */
+int Buffer::apply_undo(UndoRecord& entry, bool reverse) {
+    close_gap();
+    begin_edit();
+    int first_line = -1;
+    int total = static_cast<int>(entry.changes.size());
+    if (apply_spliced(entry, reverse, first_line)) {
+        total = 0;
+    }
+
+    for (int i = 0; i < total; i++) {
+        UndoChange& change = entry.changes[reverse ? total - 1 - i : i];
+        int start = std::min(change.line, static_cast<int>(lines.size()));
+        int count = std::min(change.count, static_cast<int>(lines.size()) - start);
+
+        std::vector<Line> current(lines.begin() + start, lines.begin() + start + count);
+        int restored = static_cast<int>(change.lines.size());
+        if (restored == count) {
+            std::copy(change.lines.begin(), change.lines.end(), lines.begin() + start);
+        } else {
+            lines.erase(lines.begin() + start, lines.begin() + start + count);
+            lines.insert(lines.begin() + start, change.lines.begin(), change.lines.end());
+        }
+        rows_replaced(start, count, restored);
+        change.lines = std::move(current);
+        change.count = restored;
+        first_line = (first_line < 0) ? start : std::min(first_line, start);
+    }
+
+    if (lines.empty()) {
+        lines.push_back(EMPTY_LINE);
+    }
+    entry.typing = false;
+    modified = true;
+    return first_line;
+}
+
+/**
+ * Apply the changes of a record in one pass when none overlap
+ * Deleting runs records one change per run; splicing them back one at a
+ * time would shift every row after each run again. Applied in order, each
+ * change must lie wholly after the rows the previous one produced, or
+ * wholly before the previous one.
+ * @param entry Record to apply
+ * @param reverse True for undo order
+ * @param first_line Receives the first affected row
+ * @return False if the changes must be applied one at a time
+ */
+bool Buffer::apply_spliced(UndoRecord& entry, bool reverse, int& first_line) {
+    int total = static_cast<int>(entry.changes.size());
+    if (total < 2) {
+        return false;
+    }
+    std::vector<UndoChange*> order(total);
+    for (int i = 0; i < total; i++) {
+        order[i] = &entry.changes[reverse ? total - 1 - i : i];
+    }
+    bool ascending = true;
+    bool descending = true;
+    for (int i = 1; i < total; i++) {
+        ascending = ascending && order[i]->line >= order[i - 1]->line + static_cast<int>(order[i - 1]->lines.size());
+        descending = descending && order[i]->line + order[i]->count <= order[i - 1]->line;
+    }
+    if (!ascending && !descending) {
+        return false;
+    }
+
+    // Where each change starts among the rows before any is applied
+    std::vector<int> origin(total);
+    int shift = 0;
+    for (int i = 0; i < total; i++) {
+        origin[i] = order[i]->line - (ascending ? shift : 0);
+        shift += static_cast<int>(order[i]->lines.size()) - order[i]->count;
+    }
+    std::vector<int> steps(total);
+    for (int i = 0; i < total; i++) {
+        steps[i] = ascending ? i : total - 1 - i;
+    }
+    int read = 0;
+    for (int step : steps) {
+        if (origin[step] < read || origin[step] + order[step]->count > static_cast<int>(lines.size())) {
+            return false;
+        }
+        read = origin[step] + order[step]->count;
+    }
+
+    std::vector<Line> spliced;
+    spliced.reserve(lines.size() + shift);
+    std::vector<int> removed(total);
+    std::vector<int> placed(total);
+    read = 0;
+    for (int step : steps) {
+        UndoChange& change = *order[step];
+        spliced.insert(spliced.end(), lines.begin() + read, lines.begin() + origin[step]);
+        placed[step] = static_cast<int>(spliced.size());
+        spliced.insert(spliced.end(), change.lines.begin(), change.lines.end());
+        read = origin[step] + change.count;
+        removed[step] = change.count;
+        change.count = static_cast<int>(change.lines.size());
+        change.lines.assign(lines.begin() + origin[step], lines.begin() + read);
+    }
+    spliced.insert(spliced.end(), lines.begin() + read, lines.end());
+    lines.swap(spliced);
+
+    // Anchors and folds move change by change, as if applied one at a time
+    for (int i = 0; i < total; i++) {
+        anchors.replace_rows(order[i]->line, removed[i], order[i]->count);
+        folds.replace_rows(order[i]->line, removed[i], order[i]->count);
+        first_line = (first_line < 0) ? order[i]->line : std::min(first_line, order[i]->line);
+    }
+    for (int i = 0; i < total; i++) {
+        refold(placed[i], placed[i] + order[i]->count - 1);
+    }
+    return true;
+}
+
+/**
+ * Undo the most recent record
+ * @param line Receives the first affected row
+ * @return False if there is nothing to undo
+ */
+bool Buffer::undo(int& line) {
+    if (undo_stack.empty()) {
+        return false;
+    }
+    UndoRecord entry = std::move(undo_stack.back());
+    undo_stack.pop_back();
+    line = apply_undo(entry, true);
+    redo_stack.push_back(std::move(entry));
+    return true;
+}
+
+/**
+ * Redo the most recently undone record
+ * @param line Receives the first affected row
+ * @return False if there is nothing to redo
+ */
+bool Buffer::redo(int& line) {
+    if (redo_stack.empty()) {
+        return false;
+    }
+    UndoRecord entry = std::move(redo_stack.back());
+    redo_stack.pop_back();
+    line = apply_undo(entry, false);
+    undo_stack.push_back(std::move(entry));
+    return true;
+}
+
+/**
+ * Set the maximum number of undo records kept per buffer
+ * @param levels Maximum records, 0 disables undo
+ */
+void Buffer::set_undo_limit(int levels) {
+    undo_limit = levels > 0 ? static_cast<size_t>(levels) : 0;
+}
+/**
+ * Add an anchor, a position that moves with the text around it
+ * @param x Column position
+ * @param y Row position
+ * @return Anchor id
+ */
+int Buffer::add_anchor(int x, int y) {
+    return anchors.add(y, x);
+}
+
+/**
+ * Remove an anchor
+ * @param id Anchor id
+ */
+void Buffer::remove_anchor(int id) {
+    anchors.remove(id);
+}
+
+/**
+ * Get the position of an anchor, clamped to the current text
+ * Anchors are kept when the whole text is replaced, as on reload, so
+ * they may point past the end until read.
+ * @param id Anchor id
+ * @param x Receives the column
+ * @param y Receives the row
+ * @return False if there is no such anchor
+ */
+bool Buffer::get_anchor(int id, int& x, int& y) const {
+    int row = 0;
+    int col = 0;
+    if (!anchors.position(id, row, col)) {
+        return false;
+    }
+    y = std::max(0, std::min(row, static_cast<int>(lines.size()) - 1));
+    x = std::max(0, std::min(col, static_cast<int>(view_line(y).length())));
+    return true;
+}
+
+/**
+ * Set a named mark
+ * @param name Mark name, a-z
+ * @param x Column position
+ * @param y Row position
+ * @return False if the name is not a mark
+ */
+bool Buffer::set_mark(char name, int x, int y) {
+    if (name < 'a' || name > 'z') {
+        return false;
+    }
+    int& mark = marks[name - 'a'];
+    anchors.remove(mark);
+    mark = anchors.add(y, x);
+    return true;
+}
+
+/**
+ * Get the position of a named mark
+ * @param name Mark name, a-z
+ * @param x Receives the column
+ * @param y Receives the row
+ * @return False if the mark is not set
+ */
+bool Buffer::get_mark(char name, int& x, int& y) const {
+    if (name < 'a' || name > 'z') {
+        return false;
+    }
+    return get_anchor(marks[name - 'a'], x, y);
+}
+
+/**
+ * Remember a position before jumping away from it
+ * @param x Column position
+ * @param y Row position
+ */
+void Buffer::push_jump(int x, int y) {
+    // Keep one entry per row, the newest
+    for (size_t i = jumps.size(); i-- > 0;) {
+        int jump_x = 0;
+        int jump_y = 0;
+        if (get_anchor(jumps[i], jump_x, jump_y) && jump_y == y) {
+            anchors.remove(jumps[i]);
+            jumps.erase(jumps.begin() + i);
+        }
+    }
+    jumps.push_back(anchors.add(y, x));
+    if (jumps.size() > MAX_JUMPS) {
+        anchors.remove(jumps.front());
+        jumps.erase(jumps.begin());
+    }
+    jump_index = jumps.size();
+}
+
+/**
+ * Go to the previous jump list entry
+ * @param x Current column, receives the entry's column
+ * @param y Current row, receives the entry's row
+ * @return False if there is no older entry
+ */
+bool Buffer::jump_back(int& x, int& y) {
+    if (jump_index >= jumps.size()) {
+        // Record where we leave from so jump_forward() can come back
+        push_jump(x, y);
+        jump_index = jumps.size() - 1;
+    }
+    if (jump_index == 0) {
+        return false;
+    }
+    jump_index--;
+    return get_anchor(jumps[jump_index], x, y);
+}
+
+/**
+ * Go to the next jump list entry
+ * @param x Receives the entry's column
+ * @param y Receives the entry's row
+ * @return False if there is no newer entry
+ */
+bool Buffer::jump_forward(int& x, int& y) {
+    if (jump_index + 1 >= jumps.size()) {
+        return false;
+    }
+    jump_index++;
+    return get_anchor(jumps[jump_index], x, y);
+}
+
+/**
+ * Get the jump list
+ * @return Anchor ids, oldest first
+ */
+const std::vector<int>& Buffer::get_jumps() const {
+    return jumps;
+}
+
+/**
+ * Get the jump list entry jump_back() would leave
+ * @return Index into get_jumps(), its size at the end of the list
+ */
+size_t Buffer::get_jump_index() const {
+    return jump_index;
+}
+
+/**
+ * Move anchors and folds after rows were replaced
+ * @param first First replaced row
+ * @param count Rows replaced
+ * @param produced Rows put in their place
+ */
+void Buffer::rows_replaced(int first, int count, int produced) {
+    anchors.replace_rows(first, count, produced);
+    folds.replace_rows(first, count, produced);
+    refold(first, first + produced - 1);
+}
+
+/**
+ * Check whether an edit at a column may change a row's indent
+ * Typing after the first non-blank character cannot, so most keystrokes
+ * skip refolding.
+ * @param y Row position
+ * @param x Column of the edit
+ * @return True if the edit is within the leading whitespace
+ */
+bool Buffer::touches_indent(int y, size_t x) const {
+    LineView line = view_line(y);
+    size_t indent = 0;
+    while (indent < line.length() && (line[indent] == ' ' || line[indent] == '\t')) {
+        indent++;
+    }
+    return x <= indent;
+}
+
+/**
+ * Get the fold level of a row from its indent
+ * @param y Row position
+ * @return Indent width divided by fold_width, -1 for a blank row
+ */
+int Buffer::indent_level(int y) const {
+    LineView line = view_line(y);
+    int width = 0;
+    for (size_t i = 0; i < line.length(); i++) {
+        if (line[i] == ' ') {
+            width++;
+        } else if (line[i] == '\t') {
+            width += fold_width - width % fold_width;
+        } else {
+            return width / fold_width;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Recompute indent folds around rows that changed
+ * Indent folds are the maximal runs of rows at or above each level, so an
+ * edit can only split, join or resize the folds that reach the rows next
+ * to it. The window runs from the nearest non-blank row above the change
+ * to the nearest one below (blank rows take the lower level of those
+ * around them). Only the window's levels are read: the parts of old folds
+ * outside it are known to stay at their level, so a fold of any length
+ * is resized without reading its rows.
+ * @param first First changed row
+ * @param last Last changed row, first - 1 if rows were only removed
+ */
+void Buffer::refold(int first, int last) {
+    int line_count = static_cast<int>(lines.size());
+    if (fold_method != FOLD_INDENT || line_count == 0) {
+        return;
+    }
+    int lo = std::max(0, std::min(first - 1, line_count - 1));
+    while (lo > 0 && indent_level(lo) < 0) {
+        lo--;
+    }
+    int hi = std::max(lo, std::min(last + 1, line_count - 1));
+    while (hi < line_count - 1 && indent_level(hi) < 0) {
+        hi++;
+    }
+
+    // Levels of the window; blank rows take the lower of their neighbours
+    std::vector<int> levels(hi - lo + 1);
+    int above = 0;
+    for (int y = lo; y <= hi; y++) {
+        levels[y - lo] = indent_level(y);
+        if (levels[y - lo] >= 0) {
+            above = levels[y - lo];
+        } else {
+            levels[y - lo] = -1 - above;
+        }
+    }
+    int below = 0;
+    int deepest = 0;
+    for (int y = hi; y >= lo; y--) {
+        int& level = levels[y - lo];
+        if (level >= 0) {
+            below = level;
+        } else {
+            level = std::min(-1 - level, below);
+        }
+        deepest = std::max(deepest, level);
+    }
+
+    // Take out the folds reaching the window, keeping how far each level
+    // extended past it
+    std::vector<Fold> old_folds;
+    folds.overlapping(lo, hi, old_folds);
+    for (const Fold& fold : old_folds) {
+        folds.remove(fold.start, fold.end);
+        deepest = std::max(deepest, fold.level);
+    }
+    std::vector<int> reach_start(deepest + 1, INT_MAX);
+    std::vector<int> reach_end(deepest + 1, -1);
+    for (const Fold& fold : old_folds) {
+        reach_start[fold.level] = std::min(reach_start[fold.level], fold.start);
+        reach_end[fold.level] = std::max(reach_end[fold.level], fold.end);
+    }
+
+    // Rebuild each level's runs; a fold stays closed if it overlaps a
+    // closed fold it replaces
+    for (int level = 1; level <= deepest; level++) {
+        std::vector<std::pair<int, int>> runs;
+        int run = reach_start[level] < lo ? reach_start[level] : -1;
+        for (int y = lo; y <= hi; y++) {
+            if (levels[y - lo] >= level) {
+                if (run < 0) {
+                    run = y;
+                }
+            } else if (run >= 0) {
+                runs.push_back(std::make_pair(run, y - 1));
+                run = -1;
+            }
+        }
+        if (run >= 0) {
+            runs.push_back(std::make_pair(run, std::max(hi, reach_end[level])));
+        } else if (reach_end[level] > hi) {
+            runs.push_back(std::make_pair(hi + 1, reach_end[level]));
+        }
+        for (const std::pair<int, int>& span : runs) {
+            Fold fold = {span.first, span.second, level, false};
+            for (const Fold& old_fold : old_folds) {
+                if (old_fold.level == level && old_fold.closed && old_fold.start <= fold.end &&
+                    old_fold.end >= fold.start) {
+                    fold.closed = true;
+                }
+            }
+            folds.add(fold);
+        }
+    }
+    fold_version++;
+}
+
+/**
+ * Choose how folds are made, replacing the current folds
+ * @param method Fold method
+ * @param width Columns per indent level
+ */
+void Buffer::set_fold_method(FoldMethod method, int width) {
+    fold_method = method;
+    fold_width = std::max(1, width);
+    folds.clear();
+    fold_version++;
+    if (method == FOLD_INDENT) {
+        refold(0, static_cast<int>(lines.size()) - 1);
+    }
+}
+
+/**
+ * Get how folds are made
+ * @return Fold method
+ */
+FoldMethod Buffer::get_fold_method() const {
+    return fold_method;
+}
+
+/**
+ * Create a closed manual fold
+ * @param first First row
+ * @param last Last row
+ * @return False if the fold would cross another fold
+ */
+bool Buffer::add_fold(int first, int last) {
+    std::vector<Fold> around;
+    folds.overlapping(first, last, around);
+    for (const Fold& fold : around) {
+        bool outside = fold.start <= first && fold.end >= last;
+        bool inside = fold.start >= first && fold.end <= last;
+        if (!outside && !inside) {
+            return false;
+        }
+    }
+    Fold fold = {first, last, 0, true};
+    folds.add(fold);
+    fold_version++;
+    return true;
+}
+
+/**
+ * Delete the innermost manual fold holding a row
+ * @param y Row position
+ * @return False if there is none
+ */
+bool Buffer::delete_fold(int y) {
+    std::vector<Fold> around;
+    folds.overlapping(y, y, around);
+    for (size_t i = around.size(); i-- > 0;) {
+        if (around[i].level == 0) {
+            folds.remove(around[i].start, around[i].end);
+            fold_version++;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Remove every fold
+ */
+void Buffer::clear_folds() {
+    folds.clear();
+    fold_version++;
+}
+
+/**
+ * Open the closed fold that hides a row, one level
+ * @param y Row position
+ * @return False if the row is not in a closed fold
+ */
+bool Buffer::open_fold(int y) {
+    Fold fold;
+    if (!folds.closed_at(y, fold)) {
+        return false;
+    }
+    folds.set_state(fold.start, fold.end, false);
+    fold_version++;
+    return true;
+}
+
+/**
+ * Close the innermost open fold holding a row
+ * On a closed fold this closes the fold around it.
+ * @param y Row position
+ * @return False if every fold holding the row is closed already
+ */
+bool Buffer::close_fold(int y) {
+    std::vector<Fold> around;
+    folds.overlapping(y, y, around);
+    size_t target = around.size();
+    for (size_t i = 0; i < around.size(); i++) {
+        if (around[i].closed) {
+            break;
+        }
+        target = i;
+    }
+    if (target == around.size()) {
+        return false;
+    }
+    folds.set_state(around[target].start, around[target].end, true);
+    fold_version++;
+    return true;
+}
+
+/**
+ * Open or close every fold overlapping a range of rows
+ * @param first First row
+ * @param last Last row
+ * @param closed New state
+ * @return Number of folds changed
+ */
+int Buffer::set_folds(int first, int last, bool closed) {
+    std::vector<Fold> around;
+    folds.overlapping(first, last, around);
+    int changed = 0;
+    for (const Fold& fold : around) {
+        if (fold.closed != closed) {
+            folds.set_state(fold.start, fold.end, closed);
+            changed++;
+        }
+    }
+    fold_version++;
+    return changed;
+}
+
+/**
+ * Open or close every fold
+ * @param closed New state
+ */
+void Buffer::set_all_folds(bool closed) {
+    folds.set_all(closed);
+    fold_version++;
+}
+
+/**
+ * Get number of folds
+ * @return Fold count
+ */
+int Buffer::fold_count() const {
+    return folds.size();
+}
+
+/**
+ * Find the outermost closed fold holding a row
+ * @param y Row position
+ * @param fold Receives the fold
+ * @return False if the row is visible
+ */
+bool Buffer::closed_fold(int y, Fold& fold) const {
+    return folds.closed_at(y, fold);
+}
+
+/**
+ * Get the row shown for a row
+ * @param y Row position
+ * @return Visible row
+ */
+int Buffer::visible_row(int y) const {
+    Fold fold;
+    return folds.closed_at(y, fold) ? fold.start : y;
+}
+
+/**
+ * Get the next row shown after a row, stepping over closed folds
+ * @param y Row position
+ * @return Next visible row, get_line_count() at the end
+ */
+int Buffer::next_visible(int y) const {
+    Fold fold;
+    int next = folds.closed_at(y, fold) ? fold.end + 1 : y + 1;
+    return std::min(next, static_cast<int>(lines.size()));
+}
+
+/**
+ * Get the row shown before a row, stepping over closed folds
+ * @param y Row position
+ * @return Previous visible row, -1 at the top
+ */
+int Buffer::prev_visible(int y) const {
+    int previous = visible_row(y) - 1;
+    return previous < 0 ? -1 : visible_row(previous);
+}
+
+/**
+ * Get fold counter, used by windows to redraw after folds change
+ * @return Version number
+ */
+unsigned long Buffer::get_fold_version() const {
+    return fold_version;
+}
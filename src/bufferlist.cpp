@@ -0,0 +1,328 @@
+#include "../include/slowertext.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <sys/stat.h>
+
+/**
+ * BufferList constructor
+ * Default budget matches the default buffer_size setting
+ */
+BufferList::BufferList() : tick(0), budget(64UL * 1024 * 1024) {
+}
+
+/**
+ * Set the memory budget for resident buffers
+ * @param bytes Budget in bytes
+ */
+void BufferList::set_budget(size_t bytes) {
+    budget = bytes;
+}
+
+/**
+ * Find or register a buffer for a file without loading it
+ * @param filename File to open, empty for an unnamed buffer
+ * @return Index of the buffer entry
+ */
+int BufferList::open(const std::string& filename) {
+    // Reuse an existing buffer so every file is held only once
+    if (!filename.empty()) {
+        for (size_t i = 0; i < entries.size(); i++) {
+            if (entries[i].buffer->get_filename() == filename) {
+                return static_cast<int>(i);
+            }
+        }
+    }
+
+    BufferEntry entry;
+    entry.buffer = std::make_shared<Buffer>();
+    entry.buffer->set_filename(filename);
+    entry.resident = filename.empty();
+    entry.memory = 0;
+    entry.last_used = 0;
+    entry.cursor_x = 0;
+    entry.cursor_y = 0;
+    entries.push_back(entry);
+    return static_cast<int>(entries.size()) - 1;
+}
+
+/**
+ * Open several files, loading them in parallel threads
+ * Files are loaded in argument order while their estimated size fits the
+ * budget; the rest are registered and loaded on first activation
+ * @param filenames Files to open
+ * @return Number of files that exist on disk
+ */
+int BufferList::open_files(const std::vector<std::string>& filenames) {
+    std::vector<int> to_load;
+    size_t planned = resident_memory();
+    int existing = 0;
+
+    for (const std::string& filename : filenames) {
+        int index = open(filename);
+        struct stat st;
+        if (stat(filename.c_str(), &st) != 0) {
+            // New file, nothing to load
+            entries[index].resident = true;
+            continue;
+        }
+        existing++;
+
+        // Line objects roughly double the on-disk size
+        size_t estimate = static_cast<size_t>(st.st_size) * 2;
+        if (!entries[index].resident && (to_load.empty() || planned + estimate <= budget)) {
+            to_load.push_back(index);
+            planned += estimate;
+        }
+    }
+
+    // Load planned files on a pool of worker threads
+    unsigned int thread_count = std::thread::hardware_concurrency();
+    if (thread_count == 0) thread_count = 2;
+    if (thread_count > to_load.size()) thread_count = static_cast<unsigned int>(to_load.size());
+
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> workers;
+    for (unsigned int t = 0; t < thread_count; t++) {
+        workers.emplace_back([this, &to_load, &next]() {
+            for (;;) {
+                size_t i = next.fetch_add(1);
+                if (i >= to_load.size()) {
+                    break;
+                }
+                BufferEntry& entry = entries[to_load[i]];
+                entry.resident = FileManager::load_file(entry.buffer->get_filename(), *entry.buffer);
+                entry.memory = entry.resident ? entry.buffer->memory_usage() : 0;
+            }
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    return existing;
+}
+
+/**
+ * Check whether any window shows a buffer
+ * @param buffer Buffer to check
+ * @return True if displayed
+ */
+bool BufferList::is_displayed(const Buffer* buffer) const {
+    for (const auto& window : window_manager.get_windows()) {
+        if (window->buffer.get() == buffer) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Load an evicted buffer back from disk
+ * @param entry Buffer entry to materialize
+ * @return True if the buffer is resident afterwards
+ */
+bool BufferList::materialize(BufferEntry& entry) {
+    if (entry.resident) {
+        return true;
+    }
+
+    const std::string& filename = entry.buffer->get_filename();
+    if (FileManager::file_exists(filename)) {
+        if (!FileManager::load_file(filename, *entry.buffer)) {
+            return false;
+        }
+    } else {
+        entry.buffer->clear();
+    }
+    entry.resident = true;
+    entry.memory = entry.buffer->memory_usage();
+    return true;
+}
+
+/**
+ * Show a buffer in a window, loading it from disk if evicted
+ * @param index Buffer entry index
+ * @param window Window to show the buffer in
+ * @param config Editor configuration (receives cursor and filename)
+ * @return True on success
+ */
+bool BufferList::activate(int index, Window& window, EditorConfig& config) {
+    if (index < 0 || index >= static_cast<int>(entries.size())) {
+        return false;
+    }
+
+    BufferEntry& target = entries[index];
+    if (!materialize(target)) {
+        return false;
+    }
+
+    // Remember where we were in the buffer we are leaving
+    window_manager.store_cursor(config);
+    int previous = index_of(window.buffer.get());
+    if (previous >= 0) {
+        BufferEntry& old_entry = entries[previous];
+        old_entry.cursor_x = window.cursor_x;
+        old_entry.cursor_y = window.cursor_y;
+        old_entry.memory = old_entry.buffer->memory_usage();
+    }
+
+    if (window.buffer != target.buffer) {
+        window.buffer = target.buffer;
+        window.cursor_x = target.cursor_x;
+        window.cursor_y = target.cursor_y;
+        window.row_offset = 0;
+        window.col_offset = 0;
+        window.dirty = true;
+    }
+    target.last_used = ++tick;
+
+    window_manager.load_cursor(config);
+    config.filename = target.buffer->get_filename();
+    config.modified = target.buffer->is_modified();
+
+    enforce_budget();
+    return true;
+}
+
+/**
+ * Find the entry index of a buffer
+ * @param buffer Buffer to look up
+ * @return Entry index or -1
+ */
+int BufferList::index_of(const Buffer* buffer) const {
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (entries[i].buffer.get() == buffer) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+/**
+ * Get number of open buffers
+ * @return Buffer count
+ */
+int BufferList::count() const {
+    return static_cast<int>(entries.size());
+}
+
+/**
+ * Get a buffer entry
+ * @param index Entry index
+ * @return Const reference to entry
+ */
+const BufferEntry& BufferList::get(int index) const {
+    return entries[index];
+}
+
+/**
+ * Evict least recently used buffers until within budget
+ * Only resident, unmodified, named buffers not shown in any window are
+ * candidates, so eviction never loses edits
+ */
+void BufferList::enforce_budget() {
+    size_t total = resident_memory();
+    if (total <= budget) {
+        return;
+    }
+
+    std::vector<BufferEntry*> candidates;
+    for (BufferEntry& entry : entries) {
+        if (entry.resident && !entry.buffer->is_modified() &&
+            !entry.buffer->get_filename().empty() && !is_displayed(entry.buffer.get())) {
+            candidates.push_back(&entry);
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(),
+              [](const BufferEntry* a, const BufferEntry* b) { return a->last_used < b->last_used; });
+
+    for (BufferEntry* entry : candidates) {
+        if (total <= budget) {
+            break;
+        }
+        total -= std::min(total, entry->memory);
+        entry->buffer->clear();
+        entry->resident = false;
+        entry->memory = 0;
+    }
+}
+
+/**
+ * Get estimated memory of all resident buffers
+ * @return Size in bytes
+ */
+size_t BufferList::resident_memory() const {
+    size_t total = 0;
+    for (const BufferEntry& entry : entries) {
+        if (entry.resident) {
+            total += entry.memory;
+        }
+    }
+    return total;
+}
+
+/**
+ * Reload unmodified buffers whose file changed on disk
+ * Modified buffers are left alone so edits are never dropped; cursors
+ * past the new end of a reloaded buffer are pulled back in.
+ * @return Number of buffers reloaded
+ */
+int BufferList::refresh_stale() {
+    int reloaded = 0;
+    for (BufferEntry& entry : entries) {
+        Buffer& buffer = *entry.buffer;
+        FileStamp stamp;
+        if (!entry.resident || buffer.is_modified() || buffer.get_filename().empty() ||
+            !FileManager::get_stamp(buffer.get_filename(), stamp) || stamp == buffer.get_disk_stamp()) {
+            continue;
+        }
+        if (!FileManager::load_file(buffer.get_filename(), buffer)) {
+            continue;
+        }
+        entry.memory = buffer.memory_usage();
+        int last_row = buffer.get_line_count() - 1;
+        entry.cursor_y = std::min(entry.cursor_y, last_row);
+        entry.cursor_x = 0;
+        for (const auto& window : window_manager.get_windows()) {
+            if (window->buffer.get() == &buffer) {
+                window->cursor_y = std::min(window->cursor_y, last_row);
+                window->cursor_x = 0;
+                window->dirty = true;
+            }
+        }
+        reloaded++;
+    }
+    return reloaded;
+}
+
+/**
+ * Compact the line arenas of resident buffers that need it
+ * Compaction moves line text and does not go through the edit hook, so
+ * buffers the search or column worker is reading are left for a later
+ * idle tick.
+ */
+void BufferList::compact_idle() {
+    for (BufferEntry& entry : entries) {
+        if (!entry.resident || search_state.scanning(entry.buffer.get()) ||
+            column_view.scanning(entry.buffer.get())) {
+            continue;
+        }
+        if (entry.buffer->compact()) {
+            entry.memory = entry.buffer->memory_usage();
+        }
+    }
+}
+
+/**
+ * Find a buffer with unsaved changes
+ * @return Entry index or -1
+ */
+int BufferList::first_modified() const {
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (entries[i].buffer->is_modified()) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
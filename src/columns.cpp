@@ -0,0 +1,422 @@
+#include "../include/slowertext.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Rows always sampled from the top, where headers and short files are
+static const int SAMPLE_HEAD_ROWS = 1024;
+
+// Rows sampled in all; the rest are spread evenly over the buffer
+static const int SAMPLE_ROWS = 16384;
+
+// Widest a column is drawn; longer fields are cut
+static const int MAX_COLUMN_WIDTH = 40;
+
+// Rows whose delimiters are cached, enough for several screens
+static const int CACHED_ROWS = 256;
+
+/**
+ * Constructor - shows no buffer in columns
+ */
+ColumnView::ColumnView()
+    : buffer(nullptr), delimiter(','), cancel(false), ready(false), done(true), stale(false), generation(0) {
+}
+
+/**
+ * Destructor - stops the background sampler
+ */
+ColumnView::~ColumnView() {
+    stop();
+}
+
+/**
+ * Stop the background sampler and wait for it
+ */
+void ColumnView::stop() {
+    if (worker.joinable()) {
+        cancel = true;
+        worker.join();
+    }
+    cancel = false;
+}
+
+/**
+ * Find the delimiters of a row outside double-quoted fields
+ * Sixteen bytes are compared at a time with SSE2 when available until the
+ * first quote; the rest is scanned byte by byte, where "" inside quotes
+ * toggles twice and so stays quoted.
+ * @param text Row text
+ * @param length Row length
+ * @param separator Field delimiter
+ * @param out Receives the delimiter offsets
+ */
+void ColumnView::find_delimiters(const char* text, size_t length, char separator, std::vector<int>& out) {
+    out.clear();
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i delimiters = _mm_set1_epi8(separator);
+    const __m128i quotes = _mm_set1_epi8('"');
+    for (; i + 16 <= length; i += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(block, quotes)) != 0) {
+            break;
+        }
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, delimiters)));
+        while (mask != 0) {
+            out.push_back(static_cast<int>(i) + __builtin_ctz(mask));
+            mask &= mask - 1;
+        }
+    }
+#endif
+    bool quoted = false;
+    for (; i < length; i++) {
+        if (text[i] == '"') {
+            quoted = !quoted;
+        } else if (text[i] == separator && !quoted) {
+            out.push_back(static_cast<int>(i));
+        }
+    }
+}
+
+/**
+ * Find a field of a row
+ * Rows without quotes step from delimiter to delimiter with memchr.
+ * @param text Row text
+ * @param length Row length
+ * @param separator Field delimiter
+ * @param field Field number from 1
+ * @param field_length Receives the field length
+ * @return Offset of the field, length if the row has fewer fields
+ */
+size_t ColumnView::find_field(const char* text, size_t length, char separator, int field, size_t& field_length) {
+    size_t start = 0;
+    if (!memchr(text, '"', length)) {
+        for (int skipped = 1; skipped < field; skipped++) {
+            const char* found = static_cast<const char*>(memchr(text + start, separator, length - start));
+            if (!found) {
+                field_length = 0;
+                return length;
+            }
+            start = static_cast<size_t>(found - text) + 1;
+        }
+        const char* end = static_cast<const char*>(memchr(text + start, separator, length - start));
+        field_length = (end ? static_cast<size_t>(end - text) : length) - start;
+        return start;
+    }
+
+    int current = 1;
+    bool quoted = false;
+    for (size_t i = 0; i < length; i++) {
+        if (text[i] == '"') {
+            quoted = !quoted;
+        } else if (text[i] == separator && !quoted) {
+            if (current == field) {
+                field_length = i - start;
+                return start;
+            }
+            current++;
+            start = i + 1;
+        }
+    }
+    if (current == field) {
+        field_length = length - start;
+        return start;
+    }
+    field_length = 0;
+    return length;
+}
+
+/**
+ * Guess the delimiter of a buffer from its first row
+ * @param target Buffer to look at
+ * @return Tab, semicolon, pipe or comma, whichever occurs most
+ */
+char ColumnView::detect_delimiter(const Buffer& target) {
+    std::string header = target.get_line(0);
+    const char candidates[] = {',', '\t', ';', '|'};
+    char best = ',';
+    long best_count = 0;
+    for (char candidate : candidates) {
+        long count = std::count(header.begin(), header.end(), candidate);
+        if (count > best_count) {
+            best = candidate;
+            best_count = count;
+        }
+    }
+    return best;
+}
+
+/**
+ * Background sample of column widths
+ * Reads the first rows and then rows spread evenly over the buffer. The
+ * buffer is not modified meanwhile: the edit hook joins this thread first
+ * and idle compaction skips the buffer while scanning() holds.
+ * @param target Buffer to sample
+ * @param separator Field delimiter
+ */
+void ColumnView::sample(const Buffer* target, char separator) {
+    TraceSpan span(TRACE_COLUMN_SAMPLE);
+    const std::vector<Line>& lines = target->get_lines();
+    int line_count = static_cast<int>(lines.size());
+    int step = std::max(1, (line_count - SAMPLE_HEAD_ROWS) / (SAMPLE_ROWS - SAMPLE_HEAD_ROWS));
+    std::vector<int> found;
+    std::vector<int> delimiters;
+    int rows = 0;
+
+    for (int y = 0; y < line_count; y += (y < SAMPLE_HEAD_ROWS) ? 1 : step) {
+        if ((rows & 255) == 0 && cancel) {
+            done = true;
+            return;
+        }
+        const Line& line = lines[y];
+        find_delimiters(line.data(), line.size(), separator, delimiters);
+        int start = 0;
+        for (size_t field = 0; field <= delimiters.size(); field++) {
+            int end = field < delimiters.size() ? delimiters[field] : static_cast<int>(line.size());
+            if (found.size() <= field) {
+                found.push_back(0);
+            }
+            found[field] = std::max(found[field], std::min(end - start, MAX_COLUMN_WIDTH));
+            start = end + 1;
+        }
+        rows++;
+    }
+
+    span.a = rows;
+    span.b = static_cast<long long>(found.size());
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        sampled.swap(found);
+    }
+    ready = true;
+    done = true;
+}
+
+/**
+ * Start sampling the shown buffer on the worker thread
+ */
+void ColumnView::start_sample() {
+    stop();
+    stale = false;
+    ready = false;
+    // The worker reads the line vector, so fold in the edit gap here
+    buffer->get_lines();
+    done = false;
+    worker = std::thread(&ColumnView::sample, this, buffer, delimiter);
+}
+
+/**
+ * Show a buffer in columns
+ * Rows are drawn unaligned until the first sample is in.
+ * @param target Buffer to show
+ * @param separator Field delimiter
+ */
+void ColumnView::start(const Buffer& target, char separator) {
+    stop();
+    buffer = &target;
+    delimiter = separator;
+    widths.clear();
+    cache.assign(CACHED_ROWS, ColumnRow{-1, 0, std::vector<int>()});
+    generation++;
+    start_sample();
+}
+
+/**
+ * Stop showing columns
+ */
+void ColumnView::clear() {
+    stop();
+    buffer = nullptr;
+    widths.clear();
+    cache.clear();
+    stale = false;
+    ready = false;
+    generation++;
+}
+
+/**
+ * Edit hook: stop sampling before a buffer changes
+ * The current widths stay in use until the next sample replaces them
+ * @param target Buffer about to change
+ */
+void ColumnView::on_edit(const Buffer* target) {
+    if (target != buffer) {
+        return;
+    }
+    stop();
+    stale = true;
+}
+
+/**
+ * Idle processing on the main thread
+ * Resamples after edits and takes up widths the worker published
+ * @return True if the layout changed
+ */
+bool ColumnView::poll() {
+    if (stale && buffer) {
+        start_sample();
+    }
+    if (!ready) {
+        return false;
+    }
+    ready = false;
+    std::vector<int> published;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        published.swap(sampled);
+    }
+    if (published == widths) {
+        return false;
+    }
+    widths.swap(published);
+    generation++;
+    return true;
+}
+
+/**
+ * Check whether a buffer is shown in columns
+ * @param target Buffer to check
+ * @return True if it is
+ */
+bool ColumnView::active(const Buffer& target) const {
+    return buffer == &target;
+}
+
+/**
+ * Check whether the worker may be reading a buffer
+ * A finished worker that was not joined yet no longer reads.
+ * @param target Buffer to check
+ * @return True while a sample of target runs
+ */
+bool ColumnView::scanning(const Buffer* target) const {
+    return target == buffer && worker.joinable() && !done;
+}
+
+/**
+ * Get the field delimiter
+ * @return Delimiter character
+ */
+char ColumnView::get_delimiter() const {
+    return delimiter;
+}
+
+/**
+ * Get the delimiter offsets of a row, indexing it if not cached
+ * The cache holds one row per slot by row number; an edit anywhere
+ * changes the buffer version and so reindexes rows as they are drawn.
+ * @param target Buffer shown in columns
+ * @param row Buffer row
+ * @return Offsets of delimiters outside quotes
+ */
+const std::vector<int>& ColumnView::row_delimiters(const Buffer& target, int row) {
+    ColumnRow& slot = cache[static_cast<size_t>(row) % cache.size()];
+    if (slot.row != row || slot.version != target.get_version()) {
+        LineView line = target.view_line(row);
+        scratch.clear();
+        line.append_to(scratch, 0, line.length());
+        find_delimiters(scratch.data(), scratch.size(), delimiter, slot.delimiters);
+        slot.row = row;
+        slot.version = target.get_version();
+    }
+    return slot.delimiters;
+}
+
+/**
+ * Get the drawn width of a field
+ * @param field Field index from 0
+ * @param length Field length in the row
+ * @return Sampled width, or the field's own length past the sampled columns
+ */
+int ColumnView::field_width(size_t field, int length) const {
+    return field < widths.size() ? widths[field] : length;
+}
+
+/**
+ * Lay out a row as aligned columns
+ * Fields are padded or cut to their column width and followed by |;
+ * the last field is shown whole.
+ * @param target Buffer shown in columns
+ * @param row Buffer row
+ * @param out Receives the text to draw
+ */
+void ColumnView::layout_row(const Buffer& target, int row, std::string& out) {
+    const std::vector<int>& delimiters = row_delimiters(target, row);
+    LineView line = target.view_line(row);
+    out.clear();
+    int start = 0;
+    for (size_t field = 0; field < delimiters.size(); field++) {
+        int length = delimiters[field] - start;
+        int width = field_width(field, length);
+        line.append_to(out, start, std::min(length, width));
+        if (length < width) {
+            out.append(width - length, ' ');
+        }
+        out += '|';
+        start = delimiters[field] + 1;
+    }
+    line.append_to(out, start, line.length() - start);
+}
+
+/**
+ * Map a buffer column to its column in the laid out row
+ * Columns in the cut-off part of a field map to its last drawn column
+ * @param target Buffer shown in columns
+ * @param row Buffer row
+ * @param col Buffer column
+ * @return Column in the text from layout_row
+ */
+int ColumnView::display_col(const Buffer& target, int row, int col) {
+    const std::vector<int>& delimiters = row_delimiters(target, row);
+    int shown = 0;
+    int start = 0;
+    for (size_t field = 0; field < delimiters.size(); field++) {
+        int width = field_width(field, delimiters[field] - start);
+        if (col < delimiters[field]) {
+            return shown + std::min(col - start, std::max(width - 1, 0));
+        }
+        if (col == delimiters[field]) {
+            return shown + width;
+        }
+        shown += width + 1;
+        start = delimiters[field] + 1;
+    }
+    return shown + col - start;
+}
+
+/**
+ * Find the field under a buffer column
+ * @param target Buffer shown in columns
+ * @param row Buffer row
+ * @param col Buffer column
+ * @return Field index from 0
+ */
+int ColumnView::field_at(const Buffer& target, int row, int col) {
+    const std::vector<int>& delimiters = row_delimiters(target, row);
+    return static_cast<int>(std::lower_bound(delimiters.begin(), delimiters.end(), col) - delimiters.begin());
+}
+
+/**
+ * Find where a field starts
+ * @param target Buffer shown in columns
+ * @param row Buffer row
+ * @param field Field index from 0
+ * @return Buffer column, -1 if the row has fewer fields
+ */
+int ColumnView::field_start(const Buffer& target, int row, int field) {
+    const std::vector<int>& delimiters = row_delimiters(target, row);
+    if (field < 0 || field > static_cast<int>(delimiters.size())) {
+        return -1;
+    }
+    return field == 0 ? 0 : delimiters[field - 1] + 1;
+}
+
+/**
+ * Get a counter bumped whenever the layout changes
+ * @return Generation number
+ */
+unsigned long ColumnView::get_generation() const {
+    return generation;
+}
@@ -6,7 +6,186 @@
 #include <sys/types.h>
 #include <unistd.h>
 #include <algorithm>
+#include <cstring>
+#include <fcntl.h>
 #include <iostream>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+// Parsed-config snapshot format; bump SNAPSHOT_VERSION whenever parsing
+// rules change so old snapshots are ignored
+static const char SNAPSHOT_MAGIC[8] = {'S', 'T', 'X', 'S', 'N', 'A', 'P', '\0'};
+static const unsigned int SNAPSHOT_VERSION = 1;
+static const size_t SNAPSHOT_MAX_SIZE = 1 << 20;
+
+/**
+ * Identity of a config file; a snapshot is only used while it matches
+ */
+struct SnapshotKey {
+    long long mtime_sec;
+    long long mtime_nsec;
+    long long size;
+    unsigned long long inode;
+};
+
+/**
+ * FNV-1a hash
+ * @param data Bytes to hash
+ * @param length Number of bytes
+ * @return 64-bit hash
+ */
+static unsigned long long fnv1a(const char* data, size_t length) {
+    unsigned long long hash = 1469598103934665603ULL;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * Append a length-prefixed string to a snapshot
+ * @param out Snapshot bytes
+ * @param text String to append
+ */
+static void put_string(std::string& out, const std::string& text) {
+    unsigned int length = static_cast<unsigned int>(text.length());
+    out.append(reinterpret_cast<const char*>(&length), sizeof(length));
+    out += text;
+}
+
+/**
+ * Read a length-prefixed string from a snapshot
+ * @param data Snapshot bytes
+ * @param pos Read position, advanced past the string
+ * @param text Receives the string
+ * @return False if the string runs past the end
+ */
+static bool get_string(const std::string& data, size_t& pos, std::string& text) {
+    unsigned int length;
+    if (data.size() - pos < sizeof(length)) {
+        return false;
+    }
+    memcpy(&length, data.data() + pos, sizeof(length));
+    pos += sizeof(length);
+    if (data.size() - pos < length) {
+        return false;
+    }
+    text.assign(data, pos, length);
+    pos += length;
+    return true;
+}
+
+/**
+ * Load parsed config values from a snapshot
+ * The snapshot must have the right magic and version, name the same file
+ * with the same mtime, size and inode, and pass its checksum.
+ * @param config_path Configuration file path
+ * @param key Identity of the configuration file
+ * @param values Receives the parsed values
+ * @return True if a valid snapshot was loaded
+ */
+static bool load_snapshot(const std::string& config_path, const SnapshotKey& key,
+                          std::map<std::string, std::string>& values) {
+    int fd = open(ConfigManager::get_snapshot_path(config_path).c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    std::string data;
+    char block[4096];
+    ssize_t count;
+    while ((count = read(fd, block, sizeof(block))) > 0 && data.size() < SNAPSHOT_MAX_SIZE) {
+        data.append(block, static_cast<size_t>(count));
+    }
+    close(fd);
+
+    size_t header = sizeof(SNAPSHOT_MAGIC) + sizeof(SNAPSHOT_VERSION) + sizeof(SnapshotKey);
+    unsigned long long checksum;
+    if (count < 0 || data.size() < header + sizeof(checksum) ||
+        memcmp(data.data(), SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) {
+        return false;
+    }
+    size_t body = data.size() - sizeof(checksum);
+    memcpy(&checksum, data.data() + body, sizeof(checksum));
+    if (checksum != fnv1a(data.data(), body)) {
+        return false;
+    }
+
+    unsigned int version;
+    SnapshotKey stored;
+    size_t pos = sizeof(SNAPSHOT_MAGIC);
+    memcpy(&version, data.data() + pos, sizeof(version));
+    pos += sizeof(version);
+    memcpy(&stored, data.data() + pos, sizeof(stored));
+    pos += sizeof(stored);
+    if (version != SNAPSHOT_VERSION || memcmp(&stored, &key, sizeof(key)) != 0) {
+        return false;
+    }
+
+    std::string path;
+    if (!get_string(data, pos, path) || path != config_path) {
+        return false;
+    }
+    data.resize(body);
+    std::map<std::string, std::string> loaded;
+    while (pos < data.size()) {
+        std::string name;
+        std::string value;
+        if (!get_string(data, pos, name) || !get_string(data, pos, value)) {
+            return false;
+        }
+        loaded.emplace_hint(loaded.end(), std::move(name), std::move(value));
+    }
+    values.swap(loaded);
+    return true;
+}
+
+/**
+ * Create a directory and its parents
+ * @param path Directory path
+ */
+static void make_directories(const std::string& path) {
+    for (size_t slash = path.find('/', 1); slash != std::string::npos; slash = path.find('/', slash + 1)) {
+        mkdir(path.substr(0, slash).c_str(), 0700);
+    }
+    mkdir(path.c_str(), 0700);
+}
+
+/**
+ * Write parsed config values to a snapshot
+ * Written to a temporary file and renamed, so readers never see a
+ * partial snapshot. Failures are ignored; the file is parsed next time.
+ * @param config_path Configuration file path
+ * @param key Identity of the configuration file
+ * @param values Parsed values
+ */
+static void save_snapshot(const std::string& config_path, const SnapshotKey& key,
+                          const std::map<std::string, std::string>& values) {
+    std::string data(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    data.append(reinterpret_cast<const char*>(&SNAPSHOT_VERSION), sizeof(SNAPSHOT_VERSION));
+    data.append(reinterpret_cast<const char*>(&key), sizeof(key));
+    put_string(data, config_path);
+    for (const auto& pair : values) {
+        put_string(data, pair.first);
+        put_string(data, pair.second);
+    }
+    unsigned long long checksum = fnv1a(data.data(), data.size());
+    data.append(reinterpret_cast<const char*>(&checksum), sizeof(checksum));
+
+    std::string snapshot_path = ConfigManager::get_snapshot_path(config_path);
+    make_directories(snapshot_path.substr(0, snapshot_path.rfind('/')));
+    std::string temp_path = snapshot_path + "." + std::to_string(getpid());
+    int fd = open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        return;
+    }
+    bool written = write(fd, data.data(), data.size()) == static_cast<ssize_t>(data.size());
+    if (close(fd) == 0 && written) {
+        rename(temp_path.c_str(), snapshot_path.c_str());
+    } else {
+        unlink(temp_path.c_str());
+    }
+}
 
 /**
  * Load configuration from file and set defaults
@@ -38,6 +217,8 @@ void ConfigManager::load_config(EditorConfig& config) {
     config.refresh_rate = 16;
     config.syntax_highlighting = false;
     config.debug_mode = false;
+    config.trace_events = true;
+    config.trace_file = "";
     
     // Set default key bindings
     config.enter_insert = "ctrl+i";
@@ -52,50 +233,72 @@ void ConfigManager::load_config(EditorConfig& config) {
     
     // Try to load configuration file
     std::string config_path = get_config_path();
+    StartupProfile::phase("config path");
+    TraceSpan span(TRACE_CONFIG_LOAD, config_path.c_str());
     
-    if (config.debug_mode) {
-        std::cerr << "Debug: Attempting to load config from: " << config_path << std::endl;
-    }
-    
-    std::ifstream config_file(config_path);
-    
-    if (!config_file.is_open()) {
-        if (config.debug_mode) {
-            std::cerr << "Debug: Could not open config file: " << config_path << std::endl;
-            std::cerr << "Debug: Using default configuration values" << std::endl;
-        }
+    struct stat info;
+    if (stat(config_path.c_str(), &info) != 0) {
         return; // Use defaults if config file doesn't exist
     }
+    SnapshotKey key;
+    memset(&key, 0, sizeof(key));
+    key.mtime_sec = static_cast<long long>(info.st_mtim.tv_sec);
+    key.mtime_nsec = static_cast<long long>(info.st_mtim.tv_nsec);
+    key.size = static_cast<long long>(info.st_size);
+    key.inode = static_cast<unsigned long long>(info.st_ino);
     
-    if (config.debug_mode) {
-        std::cerr << "Debug: Successfully opened config file: " << config_path << std::endl;
-    }
-    
-    // Parse configuration file
+    // A snapshot of the same file version skips parsing
     std::map<std::string, std::string> config_values;
-    std::string line;
-    int line_number = 0;
-    
-    while (std::getline(config_file, line)) {
-        line_number++;
-        parse_config_line(line, config_values);
-        if (config.debug_mode && !line.empty() && line[0] != '#') {
-            std::cerr << "Debug: Parsed line " << line_number << ": " << line << std::endl;
+    if (load_snapshot(config_path, key, config_values)) {
+        span.b = 1;
+        StartupProfile::phase("config snapshot");
+    } else {
+        std::ifstream config_file(config_path);
+        if (!config_file.is_open()) {
+            return;
         }
+        
+        // Parse configuration file
+        std::string line;
+        int line_number = 0;
+        while (std::getline(config_file, line)) {
+            line_number++;
+            parse_config_line(line, config_values);
+            if (!line.empty() && line[0] != '#') {
+                Trace::instant(TRACE_CONFIG_VALUE, line_number, 0, line.c_str());
+            }
+        }
+        config_file.close();
+        StartupProfile::phase("config parse");
+        
+        save_snapshot(config_path, key, config_values);
+        StartupProfile::phase("config snapshot save");
     }
-    
-    config_file.close();
-    
-    if (config.debug_mode) {
-        std::cerr << "Debug: Found " << config_values.size() << " configuration values" << std::endl;
-    }
+    span.a = static_cast<long long>(config_values.size());
     
     apply_config_values(config, config_values);
-    
-    if (config.debug_mode) {
-        std::cerr << "Debug: Configuration applied successfully" << std::endl;
-        std::cerr << "Debug: Final tab_width = " << config.tab_width << std::endl;
+    StartupProfile::phase("config apply");
+}
+
+/**
+ * Get the path of the parsed-config snapshot for a config file
+ * Snapshots live in $XDG_CACHE_HOME/slowertext (or ~/.cache/slowertext),
+ * one per config path.
+ * @param config_path Configuration file path
+ * @return Snapshot path
+ */
+std::string ConfigManager::get_snapshot_path(const std::string& config_path) {
+    std::string cache_dir;
+    const char* xdg_cache = getenv("XDG_CACHE_HOME");
+    if (xdg_cache && xdg_cache[0] == '/') {
+        cache_dir = xdg_cache;
+    } else {
+        const char* home = getenv("HOME");
+        cache_dir = std::string(home ? home : "/tmp") + "/.cache";
     }
+    char name[32];
+    snprintf(name, sizeof(name), "/config-%016llx.snap", fnv1a(config_path.data(), config_path.size()));
+    return cache_dir + "/slowertext" + name;
 }
 
 /**
@@ -145,6 +348,240 @@ std::string ConfigManager::get_config_path() {
     return home_dir + "/.config/slowertext/slowertextrc";
 }
 
+// Config file watch; the directory is watched so editors that save by
+// renaming a new file over the old one are still seen
+static int watch_fd = -1;
+static int watch_descriptor = -1;
+static std::string watched_path;
+static std::string watched_name;
+
+/**
+ * Watch the configuration file for changes with inotify
+ * Replaces any previous watch, so it can be called again when the
+ * resolved path changes.
+ * @return True if the watch was set up
+ */
+bool ConfigManager::watch_config() {
+    if (watch_fd == -1) {
+        watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (watch_fd == -1) {
+            return false;
+        }
+    }
+    if (watch_descriptor != -1) {
+        inotify_rm_watch(watch_fd, watch_descriptor);
+        watch_descriptor = -1;
+    }
+
+    watched_path = get_config_path();
+    size_t slash = watched_path.rfind('/');
+    std::string directory = slash == std::string::npos ? "." : watched_path.substr(0, slash);
+    watched_name = slash == std::string::npos ? watched_path : watched_path.substr(slash + 1);
+    if (directory.empty()) {
+        directory = "/";
+    }
+    watch_descriptor = inotify_add_watch(watch_fd, directory.c_str(),
+                                         IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM);
+    return watch_descriptor != -1;
+}
+
+/**
+ * Reload the configuration if the watched file changed
+ * Never blocks; meant to be called from the idle loop. All pending
+ * events are drained first so a save that touches the file several
+ * times reloads once.
+ * @param config Editor configuration to update
+ * @return True if settings changed and the screen needs a refresh
+ */
+bool ConfigManager::poll_changes(EditorConfig& config) {
+    if (watch_fd == -1 || watch_descriptor == -1) {
+        return false;
+    }
+
+    alignas(struct inotify_event) char events[4096];
+    bool changed = false;
+    ssize_t length;
+    while ((length = read(watch_fd, events, sizeof(events))) > 0) {
+        for (ssize_t pos = 0; pos < length;) {
+            const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(events + pos);
+            if (event->len > 0 && watched_name == event->name) {
+                changed = true;
+            }
+            pos += static_cast<ssize_t>(sizeof(struct inotify_event) + event->len);
+        }
+    }
+    if (!changed) {
+        return false;
+    }
+
+    std::vector<std::string> names = reload_config(config);
+    if (get_config_path() != watched_path) {
+        watch_config();
+    }
+    if (names.empty()) {
+        return false;
+    }
+    std::string message = "Config reloaded: ";
+    for (size_t i = 0; i < names.size(); i++) {
+        message += (i ? ", " : "") + names[i];
+    }
+    set_status_message(message);
+    return true;
+}
+
+/**
+ * Settings compared on reload, by type
+ * Runtime state (cursor, mode, file name, status message) is never
+ * touched by a reload.
+ */
+struct BoolSetting {
+    const char* name;
+    bool EditorConfig::*field;
+};
+
+struct IntSetting {
+    const char* name;
+    int EditorConfig::*field;
+};
+
+struct StringSetting {
+    const char* name;
+    std::string EditorConfig::*field;
+};
+
+static const BoolSetting BOOL_SETTINGS[] = {
+    {"show_line_numbers", &EditorConfig::show_line_numbers},
+    {"auto_indent", &EditorConfig::auto_indent},
+    {"show_whitespace", &EditorConfig::show_whitespace},
+    {"show_tilde", &EditorConfig::show_tilde},
+    {"highlight_current_line", &EditorConfig::highlight_current_line},
+    {"confirm_quit", &EditorConfig::confirm_quit},
+    {"create_backups", &EditorConfig::create_backups},
+    {"word_wrap", &EditorConfig::word_wrap},
+    {"show_hidden_files", &EditorConfig::show_hidden_files},
+    {"syntax_highlighting", &EditorConfig::syntax_highlighting},
+    {"debug_mode", &EditorConfig::debug_mode},
+    {"trace_events", &EditorConfig::trace_events},
+};
+
+static const IntSetting INT_SETTINGS[] = {
+    {"tab_width", &EditorConfig::tab_width},
+    {"auto_save_interval", &EditorConfig::auto_save_interval},
+    {"max_undo_levels", &EditorConfig::max_undo_levels},
+    {"buffer_size", &EditorConfig::buffer_size},
+    {"refresh_rate", &EditorConfig::refresh_rate},
+};
+
+static const StringSetting STRING_SETTINGS[] = {
+    {"status_format", &EditorConfig::status_format},
+    {"text_color", &EditorConfig::text_color},
+    {"background_color", &EditorConfig::background_color},
+    {"status_bar_color", &EditorConfig::status_bar_color},
+    {"comment_color", &EditorConfig::comment_color},
+    {"default_extension", &EditorConfig::default_extension},
+    {"default_encoding", &EditorConfig::default_encoding},
+    {"line_endings", &EditorConfig::line_endings},
+    {"trace_file", &EditorConfig::trace_file},
+    {"enter_insert", &EditorConfig::enter_insert},
+    {"enter_command", &EditorConfig::enter_command},
+    {"save_file", &EditorConfig::save_file},
+    {"quit_editor", &EditorConfig::quit_editor},
+    {"force_quit", &EditorConfig::force_quit},
+    {"cursor_up", &EditorConfig::cursor_up},
+    {"cursor_down", &EditorConfig::cursor_down},
+    {"cursor_left", &EditorConfig::cursor_left},
+    {"cursor_right", &EditorConfig::cursor_right},
+};
+
+/**
+ * Copy a setting if it differs, recording its name
+ * @param config Configuration to update
+ * @param fresh Newly loaded configuration
+ * @param field Setting to compare
+ * @param name Setting name
+ * @param changed Names of changed settings
+ */
+template <typename T>
+static void update_setting(EditorConfig& config, const EditorConfig& fresh, T EditorConfig::*field,
+                           const char* name, std::vector<std::string>& changed) {
+    if (!(config.*field == fresh.*field)) {
+        config.*field = fresh.*field;
+        changed.push_back(name);
+    }
+}
+
+/**
+ * Check whether any of the named settings changed
+ * @param changed Names of changed settings
+ * @param names Settings of interest, nullptr-terminated
+ * @return True if one of them changed
+ */
+static bool any_changed(const std::vector<std::string>& changed, const char* const* names) {
+    for (; *names; names++) {
+        if (std::find(changed.begin(), changed.end(), *names) != changed.end()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Re-read the configuration file and apply what changed
+ * Only settings are replaced; cursor, mode and buffers are kept, and
+ * only the derived state depending on a changed setting is recomputed.
+ * @param config Editor configuration to update
+ * @return Names of the settings that changed
+ */
+std::vector<std::string> ConfigManager::reload_config(EditorConfig& config) {
+    EditorConfig fresh = config;
+    load_config(fresh);
+
+    std::vector<std::string> changed;
+    for (const BoolSetting& setting : BOOL_SETTINGS) {
+        update_setting(config, fresh, setting.field, setting.name, changed);
+    }
+    for (const IntSetting& setting : INT_SETTINGS) {
+        update_setting(config, fresh, setting.field, setting.name, changed);
+    }
+    for (const StringSetting& setting : STRING_SETTINGS) {
+        update_setting(config, fresh, setting.field, setting.name, changed);
+    }
+    if (changed.empty()) {
+        return changed;
+    }
+
+    static const char* const KEY_SETTINGS[] = {"enter_insert", "enter_command", "save_file",
+                                               "quit_editor", "force_quit", nullptr};
+    static const char* const STYLE_SETTINGS[] = {"show_line_numbers", "show_tilde", "highlight_current_line",
+                                                 "syntax_highlighting", "status_format", "text_color",
+                                                 "background_color", "status_bar_color", "comment_color",
+                                                 "default_encoding", "line_endings", nullptr};
+    static const char* const BUDGET_SETTINGS[] = {"buffer_size", nullptr};
+    static const char* const UNDO_SETTINGS[] = {"max_undo_levels", nullptr};
+    static const char* const TRACE_SETTINGS[] = {"trace_events", nullptr};
+    static const char* const TRACE_DUMP_SETTINGS[] = {"trace_file", nullptr};
+
+    if (any_changed(changed, KEY_SETTINGS)) {
+        InputHandler::apply_config(config);
+    }
+    if (any_changed(changed, STYLE_SETTINGS)) {
+        Renderer::apply_config(config);
+    }
+    if (any_changed(changed, BUDGET_SETTINGS)) {
+        buffer_list.set_budget(static_cast<size_t>(config.buffer_size) * 1024 * 1024);
+    }
+    if (any_changed(changed, UNDO_SETTINGS)) {
+        Buffer::set_undo_limit(config.max_undo_levels);
+    }
+    if (any_changed(changed, TRACE_SETTINGS)) {
+        Trace::set_enabled(config.trace_events);
+    }
+    if (any_changed(changed, TRACE_DUMP_SETTINGS) && !config.trace_file.empty()) {
+        Trace::set_exit_dump(config.trace_file);
+    }
+    return changed;
+}
+
 /**
  * Parse a single configuration line into key-value pairs
  * Ignores comments and empty lines
@@ -259,6 +696,10 @@ void ConfigManager::apply_config_values(EditorConfig& config, const std::map<std
                 config.syntax_highlighting = string_to_bool(value);
             } else if (key == "debug_mode") {
                 config.debug_mode = string_to_bool(value);
+            } else if (key == "trace_events") {
+                config.trace_events = string_to_bool(value);
+            } else if (key == "trace_file") {
+                config.trace_file = value;
             
             // Default mode setting
             } else if (key == "default_mode") {
@@ -290,12 +731,8 @@ void ConfigManager::apply_config_values(EditorConfig& config, const std::map<std
             }
             // Ignore unknown keys silently
         } catch (const std::exception& e) {
-            // Ignore invalid values silently to prevent crashes
-            // In debug mode, we could log these errors
-            if (config.debug_mode) {
-                std::cerr << "Debug: Error parsing config value for key '" 
-                         << key << "': " << e.what() << std::endl;
-            }
+            // Ignore invalid values to prevent crashes; the trace keeps them
+            Trace::instant(TRACE_CONFIG_ERROR, 0, 0, key.c_str());
         }
     }
 }
@@ -0,0 +1,208 @@
+#include "../include/slowertext.h"
+#include <algorithm>
+
+/**
+ * Order cursors by row, then column
+ * @param a First cursor
+ * @param b Second cursor
+ * @return True if a comes before b
+ */
+static bool cursor_before(const Cursor& a, const Cursor& b) {
+    return a.y != b.y ? a.y < b.y : a.x < b.x;
+}
+
+/**
+ * Check two cursors for the same position
+ * @param a First cursor
+ * @param b Second cursor
+ * @return True if equal
+ */
+static bool same_position(const Cursor& a, const Cursor& b) {
+    return a.x == b.x && a.y == b.y;
+}
+
+/**
+ * CursorSet constructor
+ */
+CursorSet::CursorSet() : buffer(nullptr), version(0), generation(0) {
+}
+
+/**
+ * Start placing cursors in a buffer, dropping stale ones
+ * @param target Buffer
+ */
+void CursorSet::take(const Buffer& target) {
+    if (!active(target)) {
+        cursors.clear();
+    }
+    buffer = &target;
+    version = target.get_version();
+    generation++;
+}
+
+/**
+ * Drop duplicate cursors and any cursor on the primary one
+ * Expects the cursors sorted.
+ * @param primary Primary cursor
+ */
+void CursorSet::merge(const Cursor& primary) {
+    cursors.erase(std::unique(cursors.begin(), cursors.end(), same_position), cursors.end());
+    std::vector<Cursor>::iterator at = std::lower_bound(cursors.begin(), cursors.end(), primary, cursor_before);
+    if (at != cursors.end() && same_position(*at, primary)) {
+        cursors.erase(at);
+    }
+}
+
+/**
+ * Check whether a buffer has extra cursors
+ * @param target Buffer
+ * @return True if it has cursors that match its current text
+ */
+bool CursorSet::active(const Buffer& target) const {
+    return buffer == &target && version == target.get_version() && !cursors.empty();
+}
+
+/**
+ * Get the number of extra cursors in a buffer
+ * @param target Buffer
+ * @return Cursor count, 0 if none or stale
+ */
+size_t CursorSet::count(const Buffer& target) const {
+    return active(target) ? cursors.size() : 0;
+}
+
+/**
+ * Check for an extra cursor at a position
+ * @param target Buffer
+ * @param x Column
+ * @param y Row
+ * @return True if there is one
+ */
+bool CursorSet::has(const Buffer& target, int x, int y) const {
+    if (!active(target)) {
+        return false;
+    }
+    Cursor position = {x, y};
+    return std::binary_search(cursors.begin(), cursors.end(), position, cursor_before);
+}
+
+/**
+ * Add an extra cursor
+ * @param target Buffer
+ * @param x Column
+ * @param y Row
+ */
+void CursorSet::add(const Buffer& target, int x, int y) {
+    take(target);
+    Cursor position = {x, y};
+    std::vector<Cursor>::iterator at = std::lower_bound(cursors.begin(), cursors.end(), position, cursor_before);
+    if (at == cursors.end() || !same_position(*at, position)) {
+        cursors.insert(at, position);
+    }
+}
+
+/**
+ * Replace the extra cursors
+ * @param target Buffer
+ * @param positions New cursors, in any order
+ */
+void CursorSet::set(const Buffer& target, std::vector<Cursor> positions) {
+    take(target);
+    cursors = std::move(positions);
+    std::sort(cursors.begin(), cursors.end(), cursor_before);
+    cursors.erase(std::unique(cursors.begin(), cursors.end(), same_position), cursors.end());
+}
+
+/**
+ * Remove every extra cursor
+ */
+void CursorSet::clear() {
+    if (!cursors.empty()) {
+        cursors.clear();
+        generation++;
+    }
+}
+
+/**
+ * Apply one keystroke at the primary and every extra cursor
+ * All cursors go to the buffer as one batch, so the keystroke is one
+ * edit and one undo step however many cursors there are. The batch keeps
+ * the cursor order, so the extra cursors stay sorted.
+ * @param config Editor configuration (primary cursor is updated)
+ * @param target Buffer
+ * @param kind Keystroke
+ * @param text Text inserted by CURSOR_INSERT
+ */
+void CursorSet::apply(EditorConfig& config, Buffer& target, CursorEdit kind, const std::string& text) {
+    batch.clear();
+    batch.push_back({config.cursor_x, config.cursor_y});
+    if (active(target)) {
+        batch.insert(batch.end(), cursors.begin(), cursors.end());
+    }
+    target.edit_at_cursors(batch, kind, text, config.auto_indent);
+
+    config.cursor_x = batch[0].x;
+    config.cursor_y = batch[0].y;
+    config.modified = target.is_modified();
+    cursors.assign(batch.begin() + 1, batch.end());
+    merge(batch[0]);
+    buffer = &target;
+    version = target.get_version();
+    generation++;
+}
+
+/**
+ * Move every extra cursor with an arrow key
+ * Up and down keep the column where the row allows; left and right stop
+ * at the ends of the row.
+ * @param target Buffer
+ * @param key Arrow key code
+ */
+void CursorSet::move(const Buffer& target, int key) {
+    if (!active(target)) {
+        return;
+    }
+    int last_row = target.get_line_count() - 1;
+    for (Cursor& cursor : cursors) {
+        if (key == ARROW_UP && cursor.y > 0) {
+            cursor.y--;
+        } else if (key == ARROW_DOWN && cursor.y < last_row) {
+            cursor.y++;
+        } else if (key == ARROW_LEFT && cursor.x > 0) {
+            cursor.x--;
+        } else if (key == ARROW_RIGHT) {
+            cursor.x++;
+        }
+        cursor.x = std::min(cursor.x, static_cast<int>(target.view_line(cursor.y).length()));
+    }
+    // Cursors stopped at the first or last row may now be out of order
+    std::sort(cursors.begin(), cursors.end(), cursor_before);
+    cursors.erase(std::unique(cursors.begin(), cursors.end(), same_position), cursors.end());
+    generation++;
+}
+
+/**
+ * Get the columns of the extra cursors on a row
+ * @param target Buffer being drawn
+ * @param row Row
+ * @param cols Receives the columns in order
+ */
+void CursorSet::row_cursors(const Buffer& target, int row, std::vector<int>& cols) const {
+    cols.clear();
+    if (!active(target)) {
+        return;
+    }
+    Cursor start = {0, row};
+    for (std::vector<Cursor>::const_iterator at = std::lower_bound(cursors.begin(), cursors.end(), start, cursor_before);
+         at != cursors.end() && at->y == row; ++at) {
+        cols.push_back(at->x);
+    }
+}
+
+/**
+ * Get change counter, used by windows to redraw after cursors change
+ * @return Generation number
+ */
+unsigned long CursorSet::get_generation() const {
+    return generation;
+}
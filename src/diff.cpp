@@ -0,0 +1,652 @@
+#include "../include/slowertext.h"
+#include <algorithm>
+#include <cstring>
+
+// Buffers smaller than this are hashed on the calling thread alone
+static const int MIN_LINES_PER_WORKER = 65536;
+
+// Lines occurring more often than this in a region are not used to split it
+static const int MAX_CHAIN = 64;
+
+// Edit cost after which a region of common lines is shown as one hunk
+static const int MYERS_MAX_COST = 1024;
+
+/**
+ * Hash the text of one line
+ * Eight bytes are mixed per step; the final mix spreads every bit over
+ * the low bits used to index the interning table.
+ * @param data Line text
+ * @param length Line length
+ * @return 64-bit hash
+ */
+static uint64_t hash_line(const char* data, size_t length) {
+    uint64_t hash = 0x9e3779b97f4a7c15ULL ^ length;
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 32;
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, data + i, length - i);
+    hash = (hash ^ tail) * 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 29;
+    hash *= 0x94d049bb133111ebULL;
+    return hash ^ (hash >> 32);
+}
+
+/**
+ * Lines of the two sides being diffed, as small ids
+ * Equal hashes get equal ids, so the diff compares and counts lines
+ * with plain array lookups
+ */
+struct DiffInput {
+    std::vector<int> a;              // Ids of side 0 rows
+    std::vector<int> b;              // Ids of side 1 rows
+    int a_base;                      // Buffer row of a[0]
+    int b_base;                      // Buffer row of b[0]
+    int ids;                         // Number of distinct ids
+};
+
+/**
+ * Map the hashes of two ranges to dense ids with an open-addressing table
+ * @param a Hashes of side 0
+ * @param a_first First row of side 0
+ * @param a_end Row after the last of side 0
+ * @param b Hashes of side 1
+ * @param b_first First row of side 1
+ * @param b_end Row after the last of side 1
+ * @param input Receives the ids
+ */
+static void intern_lines(const std::vector<uint64_t>& a, int a_first, int a_end,
+                         const std::vector<uint64_t>& b, int b_first, int b_end, DiffInput& input) {
+    size_t total = static_cast<size_t>(a_end - a_first) + static_cast<size_t>(b_end - b_first);
+    size_t slots = 16;
+    while (slots < total * 2) {
+        slots *= 2;
+    }
+    std::vector<uint64_t> keys(slots);
+    std::vector<int> ids(slots, -1);
+    size_t mask = slots - 1;
+    input.ids = 0;
+
+    auto intern = [&](uint64_t hash) {
+        size_t slot = static_cast<size_t>(hash) & mask;
+        while (ids[slot] >= 0 && keys[slot] != hash) {
+            slot = (slot + 1) & mask;
+        }
+        if (ids[slot] < 0) {
+            keys[slot] = hash;
+            ids[slot] = input.ids++;
+        }
+        return ids[slot];
+    };
+    input.a.resize(a_end - a_first);
+    input.b.resize(b_end - b_first);
+    for (int i = a_first; i < a_end; i++) {
+        input.a[i - a_first] = intern(a[i]);
+    }
+    for (int i = b_first; i < b_end; i++) {
+        input.b[i - b_first] = intern(b[i]);
+    }
+    input.a_base = a_first;
+    input.b_base = b_first;
+}
+
+/**
+ * Append a hunk, joining it to the previous one if they touch
+ * @param out Hunks
+ * @param input Diff input, for the row bases
+ * @param a First index on side 0
+ * @param a_count Rows on side 0
+ * @param b First index on side 1
+ * @param b_count Rows on side 1
+ */
+static void emit_hunk(std::vector<DiffHunk>& out, const DiffInput& input, int a, int a_count, int b, int b_count) {
+    if (a_count == 0 && b_count == 0) {
+        return;
+    }
+    a += input.a_base;
+    b += input.b_base;
+    if (!out.empty()) {
+        DiffHunk& last = out.back();
+        if (last.first[0] + last.count[0] == a && last.first[1] + last.count[1] == b) {
+            last.count[0] += a_count;
+            last.count[1] += b_count;
+            return;
+        }
+    }
+    DiffHunk hunk = {{a, b}, {a_count, b_count}};
+    out.push_back(hunk);
+}
+
+/**
+ * Diff a region with Myers' algorithm, giving up past an edit cost
+ * Used for regions whose common lines all repeat too often for the
+ * histogram diff to pick one.
+ * @param input Diff input
+ * @param a0 First index on side 0
+ * @param a1 Index after the last on side 0
+ * @param b0 First index on side 1
+ * @param b1 Index after the last on side 1
+ * @param out Receives the hunks
+ * @return False if the cost limit was reached (nothing is emitted)
+ */
+static bool myers_region(const DiffInput& input, int a0, int a1, int b0, int b1, std::vector<DiffHunk>& out) {
+    const int* a = input.a.data() + a0;
+    const int* b = input.b.data() + b0;
+    int n = a1 - a0;
+    int m = b1 - b0;
+    int max_cost = std::min(n + m, MYERS_MAX_COST);
+    int offset = max_cost + 1;
+    std::vector<int> v(2 * offset + 1, 0);
+    std::vector<std::vector<int>> trace;
+
+    int cost = -1;
+    for (int d = 0; d <= max_cost && cost < 0; d++) {
+        trace.push_back(v);
+        for (int k = -d; k <= d; k += 2) {
+            int x = (k == -d || (k != d && v[offset + k - 1] < v[offset + k + 1])) ? v[offset + k + 1]
+                                                                                   : v[offset + k - 1] + 1;
+            int y = x - k;
+            while (x < n && y < m && a[x] == b[y]) {
+                x++;
+                y++;
+            }
+            v[offset + k] = x;
+            if (x >= n && y >= m) {
+                cost = d;
+                break;
+            }
+        }
+    }
+    if (cost < 0) {
+        return false;
+    }
+
+    // Walk back through the saved frontiers, marking removed and added rows
+    std::vector<char> removed(n, 0);
+    std::vector<char> added(m, 0);
+    int x = n;
+    int y = m;
+    for (int d = cost; d > 0; d--) {
+        const std::vector<int>& previous = trace[d];
+        int k = x - y;
+        bool down = (k == -d || (k != d && previous[offset + k - 1] < previous[offset + k + 1]));
+        int prev_k = down ? k + 1 : k - 1;
+        int prev_x = previous[offset + prev_k];
+        int prev_y = prev_x - prev_k;
+        if (down) {
+            added[prev_y] = 1;
+        } else {
+            removed[prev_x] = 1;
+        }
+        x = prev_x;
+        y = prev_y;
+    }
+
+    int i = 0;
+    int j = 0;
+    while (i < n || j < m) {
+        if (i < n && j < m && !removed[i] && !added[j]) {
+            i++;
+            j++;
+            continue;
+        }
+        int start_i = i;
+        int start_j = j;
+        while ((i < n && removed[i]) || (j < m && added[j])) {
+            while (i < n && removed[i]) {
+                i++;
+            }
+            while (j < m && added[j]) {
+                j++;
+            }
+        }
+        emit_hunk(out, input, a0 + start_i, i - start_i, b0 + start_j, j - start_j);
+    }
+    return true;
+}
+
+/**
+ * Histogram diff of the interned lines
+ * A region is split around the longest run of common lines that contains
+ * its least repeated common line, and the pieces on either side are
+ * diffed the same way. Regions are kept on an explicit stack, left piece
+ * on top, so hunks come out in row order at any depth.
+ * @param input Diff input
+ * @param out Receives the hunks
+ */
+static void histogram_diff(const DiffInput& input, std::vector<DiffHunk>& out) {
+    struct Region {
+        int a0, a1, b0, b1;
+    };
+    const std::vector<int>& a = input.a;
+    const std::vector<int>& b = input.b;
+    std::vector<int> counts(input.ids, 0);
+    std::vector<int> heads(input.ids, -1);
+    std::vector<int> next(a.size(), -1);
+    std::vector<Region> stack;
+    stack.push_back({0, static_cast<int>(a.size()), 0, static_cast<int>(b.size())});
+
+    while (!stack.empty()) {
+        Region region = stack.back();
+        stack.pop_back();
+
+        // Common lines at either end need no search
+        while (region.a0 < region.a1 && region.b0 < region.b1 && a[region.a0] == b[region.b0]) {
+            region.a0++;
+            region.b0++;
+        }
+        while (region.a0 < region.a1 && region.b0 < region.b1 && a[region.a1 - 1] == b[region.b1 - 1]) {
+            region.a1--;
+            region.b1--;
+        }
+        if (region.a0 == region.a1 || region.b0 == region.b1) {
+            emit_hunk(out, input, region.a0, region.a1 - region.a0, region.b0, region.b1 - region.b0);
+            continue;
+        }
+
+        // Chain the side 0 rows of each line, first occurrence at the head
+        for (int i = region.a1 - 1; i >= region.a0; i--) {
+            next[i] = heads[a[i]];
+            heads[a[i]] = i;
+            counts[a[i]]++;
+        }
+
+        int best_count = MAX_CHAIN + 1;
+        int best_length = 0;
+        int best_a = 0;
+        int best_b = 0;
+        for (int j = region.b0; j < region.b1;) {
+            int count = counts[b[j]];
+            int step = j + 1;
+            if (count > 0 && count <= best_count) {
+                for (int i = heads[b[j]]; i >= 0; i = next[i]) {
+                    int start_a = i;
+                    int start_b = j;
+                    int end_a = i + 1;
+                    int end_b = j + 1;
+                    while (start_a > region.a0 && start_b > region.b0 && a[start_a - 1] == b[start_b - 1]) {
+                        start_a--;
+                        start_b--;
+                    }
+                    while (end_a < region.a1 && end_b < region.b1 && a[end_a] == b[end_b]) {
+                        end_a++;
+                        end_b++;
+                    }
+                    if (count < best_count || end_a - start_a > best_length) {
+                        best_count = count;
+                        best_length = end_a - start_a;
+                        best_a = start_a;
+                        best_b = start_b;
+                    }
+                    step = std::max(step, end_b);
+                }
+            }
+            j = step;
+        }
+        for (int i = region.a0; i < region.a1; i++) {
+            heads[a[i]] = -1;
+            counts[a[i]] = 0;
+        }
+
+        if (best_length == 0) {
+            if (!myers_region(input, region.a0, region.a1, region.b0, region.b1, out)) {
+                emit_hunk(out, input, region.a0, region.a1 - region.a0, region.b0, region.b1 - region.b0);
+            }
+            continue;
+        }
+        stack.push_back({best_a + best_length, region.a1, best_b + best_length, region.b1});
+        stack.push_back({region.a0, best_a, region.b0, best_b});
+    }
+}
+
+/**
+ * Constructor - starts with no diff
+ */
+DiffView::DiffView() : generation(0) {
+    versions[0] = versions[1] = 0;
+}
+
+/**
+ * Hash every line of a buffer on worker threads
+ * @param buffer Text buffer
+ * @param out Receives one hash per row
+ */
+void DiffView::hash_lines(const Buffer& buffer, std::vector<uint64_t>& out) {
+    const std::vector<Line>& lines = buffer.get_lines();
+    int total = static_cast<int>(lines.size());
+    out.resize(total);
+    int worker_count = static_cast<int>(std::thread::hardware_concurrency());
+    worker_count = std::max(1, std::min(worker_count, total / MIN_LINES_PER_WORKER));
+
+    auto hash_slice = [&](int w) {
+        int first = static_cast<int>(static_cast<long>(total) * w / worker_count);
+        int end = static_cast<int>(static_cast<long>(total) * (w + 1) / worker_count);
+        for (int y = first; y < end; y++) {
+            out[y] = hash_line(lines[y].data(), lines[y].size());
+        }
+    };
+    if (worker_count == 1) {
+        hash_slice(0);
+        return;
+    }
+    std::vector<std::thread> workers;
+    for (int w = 0; w < worker_count; w++) {
+        workers.emplace_back(hash_slice, w);
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+/**
+ * Diff two ranges of line hashes
+ * Lines are equal when their 64-bit hashes are; common rows at either
+ * end are skipped before the rest is interned and diffed.
+ * @param a Hashes of side 0
+ * @param a_first First row of side 0
+ * @param a_end Row after the last of side 0
+ * @param b Hashes of side 1
+ * @param b_first First row of side 1
+ * @param b_end Row after the last of side 1
+ * @param out Receives the hunks in row order, appended
+ */
+void DiffView::compare(const std::vector<uint64_t>& a, int a_first, int a_end,
+                       const std::vector<uint64_t>& b, int b_first, int b_end, std::vector<DiffHunk>& out) {
+    while (a_first < a_end && b_first < b_end && a[a_first] == b[b_first]) {
+        a_first++;
+        b_first++;
+    }
+    while (a_first < a_end && b_first < b_end && a[a_end - 1] == b[b_end - 1]) {
+        a_end--;
+        b_end--;
+    }
+    if (a_first == a_end && b_first == b_end) {
+        return;
+    }
+    TraceSpan span(TRACE_DIFF);
+    size_t before = out.size();
+    DiffInput input;
+    intern_lines(a, a_first, a_end, b, b_first, b_end, input);
+    histogram_diff(input, out);
+    span.a = a_end - a_first;
+    span.b = static_cast<long long>(out.size() - before);
+}
+
+/**
+ * Start comparing two buffers
+ * @param ours Side 0
+ * @param theirs Side 1
+ */
+void DiffView::start(std::shared_ptr<Buffer> ours, std::shared_ptr<Buffer> theirs) {
+    sides[0] = std::move(ours);
+    sides[1] = std::move(theirs);
+    for (int side = 0; side < 2; side++) {
+        hash_lines(*sides[side], hashes[side]);
+        versions[side] = sides[side]->get_version();
+    }
+    hunks.clear();
+    compare(hashes[0], 0, static_cast<int>(hashes[0].size()), hashes[1], 0, static_cast<int>(hashes[1].size()), hunks);
+    generation++;
+}
+
+/**
+ * Stop comparing and release both buffers
+ */
+void DiffView::stop() {
+    for (int side = 0; side < 2; side++) {
+        sides[side].reset();
+        hashes[side].clear();
+        hashes[side].shrink_to_fit();
+    }
+    hunks.clear();
+    generation++;
+}
+
+/**
+ * Find which side a buffer is
+ * @param buffer Buffer to look up
+ * @return 0 or 1, -1 if it is not compared
+ */
+int DiffView::side_of(const Buffer& buffer) const {
+    if (sides[0].get() == &buffer) {
+        return 0;
+    }
+    return sides[1].get() == &buffer ? 1 : -1;
+}
+
+/**
+ * Rehash one side after an edit and rediff around the change
+ * The rows whose hashes changed are found by trimming the hashes both
+ * versions share at either end. Hunks touching them are dropped and the
+ * span from the end of the previous hunk to the start of the next is
+ * diffed again; hunks after it only shift.
+ * @param side 0 or 1
+ */
+void DiffView::refresh_side(int side) {
+    int other = 1 - side;
+    std::vector<uint64_t> fresh;
+    hash_lines(*sides[side], fresh);
+    versions[side] = sides[side]->get_version();
+    std::vector<uint64_t>& old = hashes[side];
+    int old_count = static_cast<int>(old.size());
+    int new_count = static_cast<int>(fresh.size());
+    int prefix = 0;
+    while (prefix < old_count && prefix < new_count && old[prefix] == fresh[prefix]) {
+        prefix++;
+    }
+    int suffix = 0;
+    while (suffix < old_count - prefix && suffix < new_count - prefix &&
+           old[old_count - 1 - suffix] == fresh[new_count - 1 - suffix]) {
+        suffix++;
+    }
+    if (prefix == old_count && prefix == new_count) {
+        return;
+    }
+
+    // Hunks [touch_first, touch_end) touch the changed rows [low, high]
+    int low = prefix;
+    int high = old_count - suffix;
+    size_t touch_first = 0;
+    while (touch_first < hunks.size() && hunks[touch_first].first[side] + hunks[touch_first].count[side] < low) {
+        touch_first++;
+    }
+    size_t touch_end = touch_first;
+    while (touch_end < hunks.size() && hunks[touch_end].first[side] <= high) {
+        touch_end++;
+    }
+
+    // Widen to whole hunks and find the matching rows on the other side,
+    // which lie in common text or at hunk edges
+    int start = low;
+    int end = high;
+    int other_start = low;
+    int other_end = high;
+    if (touch_first > 0) {
+        const DiffHunk& before = hunks[touch_first - 1];
+        other_start = low - (before.first[side] + before.count[side]) + before.first[other] + before.count[other];
+    }
+    if (touch_first < touch_end) {
+        const DiffHunk& first_touched = hunks[touch_first];
+        if (first_touched.first[side] <= start) {
+            start = first_touched.first[side];
+            other_start = first_touched.first[other];
+        }
+        const DiffHunk& last_touched = hunks[touch_end - 1];
+        end = std::max(high, last_touched.first[side] + last_touched.count[side]);
+        other_end = end - (last_touched.first[side] + last_touched.count[side]) + last_touched.first[other] +
+                    last_touched.count[other];
+    } else {
+        other_end = other_start + (high - low);
+    }
+
+    int shift = new_count - old_count;
+    std::vector<DiffHunk> redone;
+    if (side == 0) {
+        compare(fresh, start, end + shift, hashes[other], other_start, other_end, redone);
+    } else {
+        compare(hashes[other], other_start, other_end, fresh, start, end + shift, redone);
+    }
+    for (size_t i = touch_end; i < hunks.size(); i++) {
+        hunks[i].first[side] += shift;
+    }
+    hunks.erase(hunks.begin() + touch_first, hunks.begin() + touch_end);
+    hunks.insert(hunks.begin() + touch_first, redone.begin(), redone.end());
+    old.swap(fresh);
+    generation++;
+}
+
+/**
+ * Bring the hunks up to date with edits to either side
+ * Side 0 is refreshed against the old side 1 first, so the hunks always
+ * describe the pair of versions being compared.
+ * @return True if the hunks changed
+ */
+bool DiffView::update() {
+    if (!sides[0]) {
+        return false;
+    }
+    unsigned long before = generation;
+    for (int side = 0; side < 2; side++) {
+        if (sides[side]->get_version() != versions[side]) {
+            refresh_side(side);
+        }
+    }
+    return generation != before;
+}
+
+/**
+ * Get a compared buffer
+ * @param side 0 or 1
+ * @return Buffer, null when no diff is shown
+ */
+std::shared_ptr<Buffer> DiffView::get_side(int side) const {
+    return sides[side];
+}
+
+/**
+ * Get how a row takes part in the diff
+ * @param buffer Buffer showing the row
+ * @param row Buffer row
+ * @return DIFF_SAME if the buffer is not compared
+ */
+DiffRowKind DiffView::row_kind(const Buffer& buffer, int row) const {
+    int side = side_of(buffer);
+    if (side < 0) {
+        return DIFF_SAME;
+    }
+    std::vector<DiffHunk>::const_iterator found =
+        std::upper_bound(hunks.begin(), hunks.end(), row,
+                         [side](int value, const DiffHunk& hunk) { return value < hunk.first[side]; });
+    if (found == hunks.begin()) {
+        return DIFF_SAME;
+    }
+    const DiffHunk& hunk = *(found - 1);
+    if (row >= hunk.first[side] + hunk.count[side]) {
+        return DIFF_SAME;
+    }
+    if (hunk.count[1 - side] > 0) {
+        return DIFF_CHANGED;
+    }
+    return side == 0 ? DIFF_ADDED : DIFF_REMOVED;
+}
+
+/**
+ * Find the row on the other side matching a row
+ * @param buffer Buffer showing the row
+ * @param row Buffer row
+ * @return Row on the other side, or row itself if the buffer is not compared
+ */
+int DiffView::map_row(const Buffer& buffer, int row) const {
+    int side = side_of(buffer);
+    if (side < 0) {
+        return row;
+    }
+    int other = 1 - side;
+    std::vector<DiffHunk>::const_iterator found =
+        std::upper_bound(hunks.begin(), hunks.end(), row,
+                         [side](int value, const DiffHunk& hunk) { return value < hunk.first[side]; });
+    if (found == hunks.begin()) {
+        return row;
+    }
+    const DiffHunk& hunk = *(found - 1);
+    int offset = row - hunk.first[side];
+    if (offset < hunk.count[side]) {
+        return hunk.first[other] + std::min(offset, std::max(hunk.count[other] - 1, 0));
+    }
+    return hunk.first[other] + hunk.count[other] + offset - hunk.count[side];
+}
+
+/**
+ * Find the next or previous hunk from a row
+ * @param buffer Buffer being moved in
+ * @param row Current row
+ * @param forward Search after instead of before the row
+ * @param target Receives the first row of the hunk
+ * @return False if there is none
+ */
+bool DiffView::next_change(const Buffer& buffer, int row, bool forward, int& target) const {
+    int side = side_of(buffer);
+    if (side < 0) {
+        return false;
+    }
+    int last_row = buffer.get_line_count() - 1;
+    if (forward) {
+        for (const DiffHunk& hunk : hunks) {
+            if (std::min(hunk.first[side], last_row) > row) {
+                target = std::min(hunk.first[side], last_row);
+                return true;
+            }
+        }
+        return false;
+    }
+    for (size_t i = hunks.size(); i-- > 0;) {
+        if (std::min(hunks[i].first[side], last_row) < row) {
+            target = std::min(hunks[i].first[side], last_row);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Get the hunks
+ * @return Hunks in row order
+ */
+const std::vector<DiffHunk>& DiffView::get_hunks() const {
+    return hunks;
+}
+
+/**
+ * Describe the differences
+ * Rows replacing rows count as changed, up to the smaller side of their hunk
+ * @return Text like "3 changes: 4 lines added, 1 removed, 2 changed"
+ */
+std::string DiffView::describe() const {
+    if (hunks.empty()) {
+        return "No differences";
+    }
+    long added = 0;
+    long removed = 0;
+    long changed = 0;
+    for (const DiffHunk& hunk : hunks) {
+        int common = std::min(hunk.count[0], hunk.count[1]);
+        changed += common;
+        added += hunk.count[0] - common;
+        removed += hunk.count[1] - common;
+    }
+    return std::to_string(hunks.size()) + (hunks.size() == 1 ? " change: " : " changes: ") +
+           std::to_string(added) + (added == 1 ? " line added, " : " lines added, ") +
+           std::to_string(removed) + " removed, " + std::to_string(changed) + " changed";
+}
+
+/**
+ * Get a counter bumped whenever the hunks change
+ * @return Generation number
+ */
+unsigned long DiffView::get_generation() const {
+    return generation;
+}
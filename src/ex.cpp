@@ -0,0 +1,860 @@
+#include "../include/slowertext.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <regex>
+
+/**
+ * Skip spaces in a command
+ * @param command Command text
+ * @param pos Position, advanced past spaces
+ */
+static void skip_spaces(const std::string& command, size_t& pos) {
+    while (pos < command.size() && command[pos] == ' ') {
+        pos++;
+    }
+}
+
+/**
+ * Check whether a command word is an accepted abbreviation
+ * @param word Word as typed
+ * @param full Full command name
+ * @param min_length Shortest accepted abbreviation
+ * @return True if word abbreviates full
+ */
+static bool abbreviates(const std::string& word, const char* full, size_t min_length) {
+    std::string name(full);
+    return word.size() >= min_length && word.size() <= name.size() && name.compare(0, word.size(), word) == 0;
+}
+
+/**
+ * Read text up to an unescaped delimiter
+ * @param command Command text
+ * @param pos Position after the opening delimiter, advanced past the closing one
+ * @param delimiter Delimiter character
+ * @return Text between the delimiters, escaped delimiters unescaped
+ */
+static std::string read_delimited(const std::string& command, size_t& pos, char delimiter) {
+    std::string text;
+    while (pos < command.size() && command[pos] != delimiter) {
+        if (command[pos] == '\\' && pos + 1 < command.size()) {
+            if (command[pos + 1] != delimiter) {
+                text += '\\';
+            }
+            pos++;
+        }
+        text += command[pos++];
+    }
+    if (pos < command.size()) {
+        pos++;
+    }
+    return text;
+}
+
+/**
+ * Parse one line address with optional +N/-N offsets
+ * Supports N, ., $, 'x (mark x), /pattern/ and ?pattern? (literal, like
+ * / search); an empty pattern reuses the last search
+ * @param command Command text
+ * @param pos Position, advanced past the address
+ * @param buffer Text buffer
+ * @param cursor Row that . and relative offsets refer to
+ * @param line Receives the row (0-based; address 0 gives -1)
+ * @param given Receives whether an address was present
+ * @return False if the address could not be resolved (message is set)
+ */
+static bool parse_address(const std::string& command, size_t& pos, const Buffer& buffer,
+                          int cursor, int& line, bool& given) {
+    given = false;
+    skip_spaces(command, pos);
+    if (pos >= command.size()) {
+        return true;
+    }
+
+    char c = command[pos];
+    if (isdigit(static_cast<unsigned char>(c))) {
+        long number = 0;
+        while (pos < command.size() && isdigit(static_cast<unsigned char>(command[pos]))) {
+            number = std::min(number * 10 + (command[pos++] - '0'), 1000000000L);
+        }
+        line = static_cast<int>(number) - 1;
+        given = true;
+    } else if (c == '.') {
+        line = cursor;
+        given = true;
+        pos++;
+    } else if (c == '$') {
+        line = buffer.get_line_count() - 1;
+        given = true;
+        pos++;
+    } else if (c == '\'') {
+        char name = pos + 1 < command.size() ? command[pos + 1] : ' ';
+        int col = 0;
+        if (!buffer.get_mark(name, col, line)) {
+            set_status_message(std::string("Error: Mark ") + name + " not set");
+            return false;
+        }
+        given = true;
+        pos += 2;
+    } else if (c == '/' || c == '?') {
+        pos++;
+        std::string pattern = read_delimited(command, pos, c);
+        if (pattern.empty()) {
+            pattern = search_state.get_pattern();
+        }
+        if (pattern.empty()) {
+            set_status_message("Error: No previous search pattern");
+            return false;
+        }
+
+        // Search starts on the line after (or before) the cursor line
+        bool forward = (c == '/');
+        int count = buffer.get_line_count();
+        int y = forward ? (cursor + 1) % count : (cursor - 1 + count) % count;
+        int x = forward ? -1 : static_cast<int>(buffer.get_lines()[y].size());
+        if (!SearchState::find_next(buffer, pattern, y, x, forward, 0)) {
+            set_status_message("Pattern not found: " + pattern);
+            return false;
+        }
+        line = y;
+        given = true;
+    }
+
+    // Offsets apply to the address, or to the cursor line if there is none
+    while (pos < command.size() && (command[pos] == '+' || command[pos] == '-')) {
+        int sign = (command[pos++] == '+') ? 1 : -1;
+        long amount = 0;
+        bool has_digits = false;
+        while (pos < command.size() && isdigit(static_cast<unsigned char>(command[pos]))) {
+            amount = std::min(amount * 10 + (command[pos++] - '0'), 1000000000L);
+            has_digits = true;
+        }
+        if (!given) {
+            line = cursor;
+            given = true;
+        }
+        line += sign * static_cast<int>(has_digits ? amount : 1);
+    }
+    return true;
+}
+
+/**
+ * Parse a line range: %, addr, or addr,addr (addr;addr moves . to the first)
+ * @param command Command text
+ * @param pos Position, advanced past the range
+ * @param buffer Text buffer
+ * @param cursor Cursor row
+ * @param first Receives the first row
+ * @param last Receives the last row (inclusive)
+ * @param addresses Receives the number of addresses given
+ * @return False if an address could not be resolved (message is set)
+ */
+static bool parse_range(const std::string& command, size_t& pos, const Buffer& buffer, int cursor,
+                        int& first, int& last, int& addresses) {
+    first = last = cursor;
+    addresses = 0;
+    skip_spaces(command, pos);
+
+    if (pos < command.size() && command[pos] == '%') {
+        pos++;
+        first = 0;
+        last = buffer.get_line_count() - 1;
+        addresses = 2;
+        return true;
+    }
+
+    int line = cursor;
+    bool given = false;
+    if (!parse_address(command, pos, buffer, cursor, line, given)) {
+        return false;
+    }
+    if (given) {
+        first = last = line;
+        addresses = 1;
+    }
+
+    while (pos < command.size() && (command[pos] == ',' || command[pos] == ';')) {
+        if (command[pos++] == ';') {
+            cursor = last;
+        }
+        first = last;
+        last = cursor;
+        if (!parse_address(command, pos, buffer, cursor, line, given)) {
+            return false;
+        }
+        if (given) {
+            last = line;
+        }
+        addresses = 2;
+    }
+    return true;
+}
+
+/**
+ * Check a range against the buffer, swapping a backwards range
+ * @param buffer Text buffer
+ * @param first First row, may be swapped
+ * @param last Last row, may be swapped
+ * @return False if the range is outside the buffer (message is set)
+ */
+static bool validate_range(const Buffer& buffer, int& first, int& last) {
+    if (first > last) {
+        std::swap(first, last);
+    }
+    if (first < 0 || last >= buffer.get_line_count()) {
+        set_status_message("Error: Invalid range");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Show the marks or the jump list in the message bar
+ * Entries read "a 12:5" (mark, line, column); the jump list marks the
+ * entry Ctrl-O would go to next with >.
+ * @param buffer Text buffer
+ * @param marks True for marks, false for jumps
+ */
+static void list_positions(const Buffer& buffer, bool marks) {
+    std::string listing;
+    int x = 0;
+    int y = 0;
+    if (marks) {
+        for (char name = 'a'; name <= 'z'; name++) {
+            if (buffer.get_mark(name, x, y)) {
+                listing += std::string(1, name) + " " + std::to_string(y + 1) + ":" + std::to_string(x + 1) + "  ";
+            }
+        }
+    } else {
+        const std::vector<int>& jumps = buffer.get_jumps();
+        for (size_t i = 0; i < jumps.size(); i++) {
+            if (buffer.get_anchor(jumps[i], x, y)) {
+                listing += (i + 1 == buffer.get_jump_index() ? ">" : "") + std::to_string(y + 1) + ":" +
+                           std::to_string(x + 1) + "  ";
+            }
+        }
+    }
+    set_status_message(listing.empty() ? (marks ? "No marks set" : "Jump list empty") : listing);
+}
+
+/**
+ * Describe a line count like "3 lines"
+ * @param count Number of lines
+ * @return Text for messages
+ */
+static std::string lines_text(long count) {
+    return std::to_string(count) + (count == 1 ? " line" : " lines");
+}
+
+/**
+ * Read an optional register name argument
+ * @param args Text after the command name
+ * @param name Receives the register, '"' if none is given
+ * @return False (after reporting) if the argument is not a register
+ */
+static bool parse_register(const std::string& args, char& name) {
+    size_t start = 0;
+    skip_spaces(args, start);
+    name = '"';
+    if (start == args.size()) {
+        return true;
+    }
+    if (start + 1 != args.size() || !Registers::valid(args[start])) {
+        set_status_message("Error: Registers are \", 0, a-z and A-Z");
+        return false;
+    }
+    name = args[start];
+    return true;
+}
+
+/**
+ * Run a substitution over a range or selected rows and report the outcome
+ * Escape cancels while the workers run, leaving the buffer untouched
+ * @param config Editor configuration
+ * @param buffer Text buffer
+ * @param body Command text starting at the 's'
+ * @param first First row
+ * @param last Last row (inclusive)
+ * @param rows Rows to restrict to (from :g), or null for the whole range
+ * @param default_pattern Pattern used when the command leaves it empty
+ */
+static void run_substitute(EditorConfig& config, Buffer& buffer, const std::string& body, int first, int last,
+                           const std::vector<int>* rows, const std::string& default_pattern) {
+    std::string pattern, replacement, flags;
+    // An empty pattern (s//x/) reuses the :g or search pattern
+    std::string text = body;
+    if (body.size() >= 3 && body[2] == body[1] && !default_pattern.empty()) {
+        text = body.substr(0, 2) + default_pattern + body.substr(2);
+    }
+    if (!Substitution::parse(text, pattern, replacement, flags)) {
+        set_status_message("Unknown command: " + body);
+        return;
+    }
+
+    SubstitutePlan plan = Substitution::make_plan(pattern, replacement, flags);
+    SubstituteResult result = rows ? Substitution::run_rows(buffer, *rows, plan, InputHandler::escape_pressed)
+                                   : Substitution::run(buffer, first, last, plan, InputHandler::escape_pressed);
+
+    char timing[32];
+    snprintf(timing, sizeof(timing), "%.1f ms", result.elapsed_ms);
+    if (result.cancelled) {
+        set_status_message("Substitution cancelled after " + std::string(timing));
+    } else if (result.matched == 0) {
+        set_status_message("Pattern not found: " + pattern + " (" + timing + ")");
+    } else {
+        set_status_message(std::to_string(result.matched) + " substitutions on " +
+                           lines_text(result.lines_changed) + " (" + timing + ")");
+    }
+    config.modified = buffer.is_modified();
+}
+
+/**
+ * Collect rows in a range that match (or do not match) a pattern
+ * @param buffer Text buffer
+ * @param first First row
+ * @param last Last row (inclusive)
+ * @param pattern Literal or regex pattern
+ * @param invert Collect non-matching rows instead
+ * @param rows Receives rows in ascending order
+ */
+static void collect_matching_rows(const Buffer& buffer, int first, int last, const std::string& pattern,
+                                  bool invert, std::vector<int>& rows) {
+    const std::vector<Line>& lines = buffer.get_lines();
+    SubstitutePlan plan = Substitution::make_plan(pattern, "", "");
+
+    if (plan.literal) {
+        for (int y = first; y <= last; y++) {
+            const Line& line = lines[y];
+            bool found = SearchState::find_literal(line.data(), line.size(), pattern.data(), pattern.size())
+                         != std::string::npos;
+            if (found != invert) {
+                rows.push_back(y);
+            }
+        }
+        return;
+    }
+
+    std::regex re(pattern, std::regex::ECMAScript | std::regex::optimize);
+    for (int y = first; y <= last; y++) {
+        if (std::regex_search(lines[y].begin(), lines[y].end(), re) != invert) {
+            rows.push_back(y);
+        }
+    }
+}
+
+/**
+ * Run :g/pattern/command or :v/pattern/command over a range
+ * The inner command runs once over all marked rows rather than once per
+ * line: d removes every marked row in one compaction pass and s
+ * substitutes on the marked rows in a single parallel run
+ * @param config Editor configuration
+ * @param buffer Text buffer
+ * @param args Text after the command name, starting at the delimiter
+ * @param first First row
+ * @param last Last row (inclusive)
+ * @param invert True for :v / :g!
+ */
+static void run_global(EditorConfig& config, Buffer& buffer, const std::string& args,
+                       int first, int last, bool invert) {
+    if (args.empty() || isalnum(static_cast<unsigned char>(args[0])) || args[0] == ' ' || args[0] == '\\') {
+        set_status_message("Error: Usage :g/pattern/command");
+        return;
+    }
+
+    size_t pos = 1;
+    std::string pattern = read_delimited(args, pos, args[0]);
+    if (pattern.empty()) {
+        pattern = search_state.get_pattern();
+    }
+    if (pattern.empty()) {
+        set_status_message("Error: No previous search pattern");
+        return;
+    }
+    skip_spaces(args, pos);
+    std::string inner = args.substr(pos);
+
+    auto started = std::chrono::steady_clock::now();
+    std::vector<int> rows;
+    collect_matching_rows(buffer, first, last, pattern, invert, rows);
+    if (rows.empty()) {
+        set_status_message("Pattern not found: " + pattern);
+        return;
+    }
+
+    if (inner == "d" || inner == "delete") {
+        // Merge marked rows into runs so each block is spliced out once
+        std::vector<std::pair<int, int>> runs;
+        for (int y : rows) {
+            if (!runs.empty() && runs.back().first + runs.back().second == y) {
+                runs.back().second++;
+            } else {
+                runs.push_back(std::make_pair(y, 1));
+            }
+        }
+        buffer.delete_line_runs(runs);
+
+        config.cursor_y = std::min(rows.front(), buffer.get_line_count() - 1);
+        config.cursor_x = 0;
+        config.modified = buffer.is_modified();
+        char timing[32];
+        snprintf(timing, sizeof(timing), "%.1f ms",
+                 std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count());
+        set_status_message(std::to_string(rows.size()) + " fewer lines (" + timing + ")");
+    } else if (inner.size() >= 2 && inner[0] == 's' && !isalnum(static_cast<unsigned char>(inner[1]))) {
+        run_substitute(config, buffer, inner, first, last, &rows, pattern);
+    } else {
+        set_status_message("Error: :g supports d and s commands");
+    }
+}
+
+/**
+ * Sort or deduplicate a range and report the outcome
+ * @param config Editor configuration
+ * @param buffer Text buffer
+ * @param first First row
+ * @param last Last row (inclusive)
+ * @param options Sort options, or null for :uniq
+ */
+static void arrange_range(EditorConfig& config, Buffer& buffer, int first, int last, const SortOptions* options) {
+    auto started = std::chrono::steady_clock::now();
+    std::vector<int> rows;
+    if (options) {
+        LineFilter::sort_rows(buffer, first, last, *options, rows);
+    } else {
+        LineFilter::unique_rows(buffer, first, last, rows);
+    }
+
+    // Rows already in order leave the buffer and undo history untouched
+    long count = last - first + 1;
+    long removed = count - static_cast<long>(rows.size());
+    bool in_order = true;
+    for (size_t i = 0; in_order && i < rows.size(); i++) {
+        in_order = (rows[i] == first + static_cast<int>(i));
+    }
+    if (!in_order || removed > 0) {
+        buffer.arrange_lines(first, last, rows);
+        config.cursor_y = first;
+        config.cursor_x = 0;
+        config.modified = buffer.is_modified();
+    }
+
+    char timing[32];
+    snprintf(timing, sizeof(timing), "%.1f ms",
+             std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count());
+    std::string message = options ? lines_text(count) + " sorted" : lines_text(count) + " checked";
+    if (removed > 0 || !options) {
+        message += ", " + std::to_string(removed) + (removed == 1 ? " duplicate" : " duplicates") + " removed";
+    }
+    set_status_message(message + " (" + timing + ")");
+}
+
+/**
+ * Run :!command over a range, or just show its output
+ * Escape cancels the command, leaving the buffer untouched. A command
+ * that fails leaves it untouched too, so a typo cannot replace the
+ * range with an error message.
+ * @param config Editor configuration
+ * @param buffer Text buffer
+ * @param command Shell command
+ * @param first First row
+ * @param last Last row (inclusive), below first to only show the output
+ */
+static void run_filter(EditorConfig& config, Buffer& buffer, const std::string& command, int first, int last) {
+    FilterResult result = LineFilter::run(command, buffer, first, last, InputHandler::escape_pressed);
+    char timing[32];
+    snprintf(timing, sizeof(timing), "%.1f ms", result.elapsed_ms);
+    std::string first_output = result.output.empty() ? "" : ": " + result.output.front();
+
+    if (result.cancelled) {
+        set_status_message("Filter cancelled after " + std::string(timing));
+    } else if (result.status != 0) {
+        set_status_message(result.status < 0 ? "Error: Cannot run " + command
+                                             : "Error: " + command + " exited with status " +
+                                                   std::to_string(result.status) + first_output);
+    } else if (first > last) {
+        std::string shown;
+        for (const std::string& line : result.output) {
+            shown += (shown.empty() ? "" : "  ") + line;
+        }
+        set_status_message(shown.empty() ? command + " finished (" + timing + ")" : shown);
+    } else {
+        long count = last - first + 1;
+        long produced = static_cast<long>(result.output.size());
+        buffer.replace_lines(first, static_cast<int>(count), std::move(result.output));
+        config.cursor_y = std::min(first, buffer.get_line_count() - 1);
+        config.cursor_x = 0;
+        config.modified = buffer.is_modified();
+        set_status_message(lines_text(count) + " filtered into " + lines_text(produced) + " (" + timing + ")");
+    }
+}
+
+/**
+ * Execute an ex command line
+ * Commands: [range] (go to line), [range]d, [range]m addr, [range]t addr,
+ * [range]j, [range]s/pat/rep/flags, [range]g/pat/cmd, [range]v/pat/cmd,
+ * [line]mark x (also k x), marks and jumps, [range]fold, [range]foldopen,
+ * [range]foldclose, foldmethod manual|indent, [range]cursors [/pat/],
+ * [range]y [x], [line]pu[!] [x] and registers; [range]d [x] also fills a register;
+ * [range]sort[!] [n] [r] [i] [u] [k N], [range]uniq and [range]!cmd.
+ * Each command is one buffer transaction and therefore one undo step.
+ * @param config Editor configuration (cursor is updated)
+ * @param buffer Text buffer
+ * @param command Command text without the leading ':'
+ * @return False if the text is not an ex command
+ */
+bool ExCommand::execute(EditorConfig& config, Buffer& buffer, const std::string& command) {
+    size_t pos = 0;
+    int first = 0;
+    int last = 0;
+    int addresses = 0;
+    if (!parse_range(command, pos, buffer, config.cursor_y, first, last, addresses)) {
+        return true;
+    }
+    skip_spaces(command, pos);
+
+    // Command name: a run of letters, with an optional ! for :g!
+    size_t name_start = pos;
+    while (pos < command.size() && isalpha(static_cast<unsigned char>(command[pos]))) {
+        pos++;
+    }
+    std::string name = command.substr(name_start, pos - name_start);
+    std::string args = command.substr(pos);
+
+    if (name.empty() && args.empty()) {
+        // A bare address moves the cursor to it
+        if (addresses == 0) {
+            return false;
+        }
+        buffer.push_jump(config.cursor_x, config.cursor_y);
+        config.cursor_y = std::max(0, std::min(last, buffer.get_line_count() - 1));
+        config.cursor_x = 0;
+        return true;
+    }
+
+    // :[range]!cmd replaces the range with the command's output; with no
+    // range the output is only shown
+    if (name.empty() && args[0] == '!') {
+        size_t start = 1;
+        skip_spaces(args, start);
+        if (start == args.size()) {
+            set_status_message("Error: Usage :[range]!command");
+            return true;
+        }
+        if (addresses > 0 && !validate_range(buffer, first, last)) {
+            return true;
+        }
+        run_filter(config, buffer, args.substr(start), first, addresses > 0 ? last : first - 1);
+        return true;
+    }
+
+    if (name == "marks" || name == "jumps") {
+        list_positions(buffer, name == "marks");
+        return true;
+    }
+
+    // :mark x, :k x and :kx set a mark at the start of the last line
+    if ((name == "mark" || name == "ma" || name == "k") || (name.size() == 2 && name[0] == 'k')) {
+        std::string mark = name.size() == 2 && name[0] == 'k' ? name.substr(1) : args;
+        size_t start = 0;
+        skip_spaces(mark, start);
+        if (start + 1 != mark.size() || mark[start] < 'a' || mark[start] > 'z') {
+            set_status_message("Error: Usage: [line]mark a-z");
+        } else if (validate_range(buffer, first, last)) {
+            buffer.set_mark(mark[start], 0, last);
+        }
+        return true;
+    }
+
+    if (abbreviates(name, "foldmethod", 5)) {
+        size_t start = 0;
+        skip_spaces(args, start);
+        std::string method = args.substr(start);
+        if (method.empty()) {
+            set_status_message(buffer.get_fold_method() == FOLD_INDENT ? "foldmethod=indent" : "foldmethod=manual");
+        } else if (method == "manual" || method == "indent") {
+            buffer.set_fold_method(method == "indent" ? FOLD_INDENT : FOLD_MANUAL, config.tab_width);
+            set_status_message("foldmethod=" + method + " (" + std::to_string(buffer.fold_count()) + " folds)");
+        } else {
+            set_status_message("Error: Usage: foldmethod manual|indent");
+        }
+        return true;
+    }
+
+    // :fold makes a closed manual fold; :foldopen and :foldclose act on
+    // every fold overlapping the range
+    bool is_fold = abbreviates(name, "fold", 2);
+    bool is_fold_open = abbreviates(name, "foldopen", 5);
+    bool is_fold_close = abbreviates(name, "foldclose", 5);
+    if (is_fold || is_fold_open || is_fold_close) {
+        if (!validate_range(buffer, first, last)) {
+            return true;
+        }
+        if (is_fold_open || is_fold_close) {
+            int changed = buffer.set_folds(first, last, is_fold_close);
+            set_status_message(std::to_string(changed) + (is_fold_close ? " folds closed" : " folds opened"));
+        } else if (buffer.get_fold_method() != FOLD_MANUAL) {
+            set_status_message("Error: Cannot create folds with foldmethod indent");
+        } else if (!buffer.add_fold(first, last)) {
+            set_status_message("Error: Fold would cross another fold");
+        } else {
+            config.cursor_y = first;
+            config.cursor_x = 0;
+        }
+        return true;
+    }
+
+    // :[range]cursors puts a cursor on each line at the cursor column;
+    // :[range]cursors /pat/ puts one on each match (whole buffer by default)
+    if (abbreviates(name, "cursors", 3)) {
+        size_t start = 0;
+        skip_spaces(args, start);
+        bool by_match = start < args.size();
+        std::string pattern;
+        if (by_match) {
+            size_t pattern_pos = start + 1;
+            pattern = read_delimited(args, pattern_pos, args[start]);
+            if (pattern.empty()) {
+                pattern = search_state.get_pattern();
+            }
+            if (pattern.empty()) {
+                set_status_message("Error: No previous search pattern");
+                return true;
+            }
+            if (addresses == 0) {
+                first = 0;
+                last = buffer.get_line_count() - 1;
+            }
+        }
+        if (!validate_range(buffer, first, last)) {
+            return true;
+        }
+        
+        std::vector<Cursor> positions;
+        const std::vector<Line>& lines = buffer.get_lines();
+        for (int y = first; y <= last; y++) {
+            const Line& line = lines[y];
+            if (!by_match) {
+                positions.push_back({std::min(config.cursor_x, static_cast<int>(line.size())), y});
+                continue;
+            }
+            size_t at = 0;
+            while (at + pattern.size() <= line.size()) {
+                size_t found = SearchState::find_literal(line.data() + at, line.size() - at,
+                                                         pattern.data(), pattern.size());
+                if (found == std::string::npos) {
+                    break;
+                }
+                positions.push_back({static_cast<int>(at + found), y});
+                at += found + pattern.size();
+            }
+        }
+        if (positions.empty()) {
+            set_status_message("Pattern not found: " + pattern);
+            return true;
+        }
+        config.cursor_x = positions.front().x;
+        config.cursor_y = positions.front().y;
+        buffer.set_folds(config.cursor_y, config.cursor_y, false);
+        set_status_message(std::to_string(positions.size()) + " cursors");
+        positions.erase(positions.begin());
+        cursor_set.set(buffer, std::move(positions));
+        return true;
+    }
+
+    if (abbreviates(name, "registers", 3)) {
+        std::string listing = Registers::describe();
+        set_status_message(listing.empty() ? "Registers empty" : listing);
+        return true;
+    }
+
+    // :[range]yank [x] shares the lines with the register, copying no text
+    if (abbreviates(name, "yank", 1)) {
+        char reg = '"';
+        if (!parse_register(args, reg) || !validate_range(buffer, first, last)) {
+            return true;
+        }
+        Register text;
+        buffer.yank(0, first, 0, last, SELECT_LINES, text);
+        Registers::store(reg, std::move(text), true);
+        set_status_message(lines_text(last - first + 1) + " yanked");
+        return true;
+    }
+
+    // :[line]put [x] puts a register as lines after the line, :put! before;
+    // :0put puts at the top
+    if (abbreviates(name, "put", 2)) {
+        bool above = !args.empty() && args[0] == '!';
+        char reg = '"';
+        if (!parse_register(above ? args.substr(1) : args, reg)) {
+            return true;
+        }
+        if (last < -1 || last >= buffer.get_line_count()) {
+            set_status_message("Error: Invalid range");
+            return true;
+        }
+        std::shared_ptr<const Register> text = Registers::get(reg);
+        if (!text || text->pieces.empty()) {
+            set_status_message(std::string("Error: Register ") + reg + " is empty");
+            return true;
+        }
+        int y = above ? std::max(last, 0) : last + 1;
+        if (text->kind == SELECT_LINES) {
+            buffer.put(0, y, *text);
+        } else {
+            Register rows = *text;
+            rows.kind = SELECT_LINES;
+            buffer.put(0, y, rows);
+        }
+        config.cursor_y = y;
+        config.cursor_x = 0;
+        config.modified = buffer.is_modified();
+        set_status_message(lines_text(static_cast<long>(text->pieces.size())) + " put");
+        return true;
+    }
+
+    // :[range]sort[!] [n] [r] [i] [u] [k N] and :[range]uniq rearrange rows
+    // without copying their text; with no range they cover the whole buffer,
+    // below the header row when it is shown in columns, where k N is column N
+    bool is_sort = abbreviates(name, "sort", 3);
+    if (is_sort || abbreviates(name, "uniq", 3)) {
+        SortOptions options = {false, false, false, false, 0, 0};
+        if (is_sort && !LineFilter::parse_sort(args, options)) {
+            return true;
+        }
+        bool columns = column_view.active(buffer);
+        if (columns) {
+            options.delimiter = column_view.get_delimiter();
+        }
+        size_t start = 0;
+        skip_spaces(args, start);
+        if (!is_sort && start != args.size()) {
+            set_status_message("Error: Usage :[range]uniq");
+            return true;
+        }
+        if (addresses == 0) {
+            first = (columns && buffer.get_line_count() > 1) ? 1 : 0;
+            last = buffer.get_line_count() - 1;
+        }
+        if (validate_range(buffer, first, last)) {
+            arrange_range(config, buffer, first, last, is_sort ? &options : nullptr);
+        }
+        return true;
+    }
+
+    // Substitution takes any punctuation as delimiter right after the s
+    if (!name.empty() && name[0] == 's' && name.size() == 1 && !args.empty()) {
+        if (!validate_range(buffer, first, last)) {
+            return true;
+        }
+        run_substitute(config, buffer, command.substr(name_start), first, last, nullptr,
+                       search_state.get_pattern());
+        return true;
+    }
+
+    if (name == "g" || name == "global" || name == "v" || name == "vglobal") {
+        bool invert = (name[0] == 'v');
+        if (name[0] == 'g' && !args.empty() && args[0] == '!') {
+            invert = true;
+            args = args.substr(1);
+        }
+        if (addresses == 0) {
+            first = 0;
+            last = buffer.get_line_count() - 1;
+        }
+        if (validate_range(buffer, first, last)) {
+            run_global(config, buffer, args, first, last, invert);
+        }
+        return true;
+    }
+
+    bool is_delete = abbreviates(name, "delete", 1);
+    bool is_move = abbreviates(name, "move", 1);
+    bool is_copy = (name == "t" || abbreviates(name, "copy", 2));
+    bool is_join = abbreviates(name, "join", 1);
+    if (!is_delete && !is_move && !is_copy && !is_join) {
+        return false;
+    }
+    if (!validate_range(buffer, first, last)) {
+        return true;
+    }
+
+    if (is_delete) {
+        char reg = '"';
+        if (!parse_register(args, reg)) {
+            return true;
+        }
+        // Like dd, the deleted lines go to the unnamed register too
+        Register text;
+        buffer.yank(0, first, 0, last, SELECT_LINES, text);
+        Registers::store(reg, std::move(text), false);
+        buffer.delete_lines(first, last - first + 1);
+        config.cursor_y = std::min(first, buffer.get_line_count() - 1);
+        config.cursor_x = 0;
+        set_status_message(lines_text(last - first + 1) + " deleted");
+    } else if (is_join) {
+        // A single address joins it with the next line
+        if (addresses < 2) {
+            last = std::min(first + 1, buffer.get_line_count() - 1);
+        }
+        if (first == last) {
+            return true;
+        }
+        const std::vector<Line>& lines = buffer.get_lines();
+        std::string joined = lines[first].str();
+        for (int y = first + 1; y <= last; y++) {
+            const Line& next = lines[y];
+            size_t start = 0;
+            while (start < next.size() && (next[start] == ' ' || next[start] == '\t')) {
+                start++;
+            }
+            if (start == next.size()) {
+                continue;
+            }
+            if (!joined.empty() && joined.back() != ' ') {
+                joined += ' ';
+            }
+            joined.append(next.data() + start, next.size() - start);
+        }
+        buffer.replace_lines(first, last - first + 1, std::vector<std::string>(1, joined));
+        config.cursor_y = first;
+        config.cursor_x = 0;
+    } else {
+        int dest = 0;
+        bool given = false;
+        size_t dest_pos = 0;
+        if (!parse_address(args, dest_pos, buffer, config.cursor_y, dest, given)) {
+            return true;
+        }
+        if (!given || dest < -1 || dest >= buffer.get_line_count()) {
+            set_status_message("Error: Invalid destination address");
+            return true;
+        }
+        int count = last - first + 1;
+
+        if (is_move) {
+            if (dest >= first && dest < last) {
+                set_status_message("Error: Cannot move a range into itself");
+                return true;
+            }
+            if (dest != first - 1 && dest != last) {
+                buffer.move_lines(first, last, dest);
+            }
+            config.cursor_y = (dest > last) ? dest : dest + count;
+            set_status_message(lines_text(count) + " moved");
+        } else {
+            const std::vector<Line>& lines = buffer.get_lines();
+            std::vector<std::string> block;
+            block.reserve(count);
+            for (int y = first; y <= last; y++) {
+                block.push_back(lines[y].str());
+            }
+            buffer.replace_lines(dest + 1, 0, std::move(block));
+            config.cursor_y = dest + count;
+            set_status_message(lines_text(count) + " copied");
+        }
+        config.cursor_x = 0;
+    }
+
+    config.modified = buffer.is_modified();
+    return true;
+}
@@ -1,42 +1,148 @@
 #include "../include/slowertext.h"
-#include <fstream>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
 #include <sys/stat.h>
 
+// Bytes read or written per system call
+static const size_t IO_BLOCK_SIZE = 1 << 20;
+
+// Saves are discarded (session replay must not touch files)
+static bool dry_run = false;
+
+/**
+ * Write a whole byte range, retrying partial writes
+ * @param fd Destination file descriptor
+ * @param data Bytes to write
+ * @param length Number of bytes
+ * @return True if everything was written
+ */
+static bool write_all(int fd, const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        length -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+/**
+ * Reserve the line vector from the line density of the first block
+ * Growing a vector of millions of lines by doubling would move every
+ * line several times and fault in the discarded arrays
+ * @param fd File being read
+ * @param start First block
+ * @param end End of the first block
+ * @param lines Line vector to reserve
+ */
+static void reserve_lines(int fd, const char* start, const char* end, std::vector<Line>& lines) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= end - start) {
+        return;
+    }
+    size_t newlines = 0;
+    for (const char* p = start; (p = static_cast<const char*>(memchr(p, '\n', end - p))) != nullptr; p++) {
+        newlines++;
+    }
+    if (newlines > 0) {
+        double per_byte = static_cast<double>(newlines) / static_cast<double>(end - start);
+        lines.reserve(static_cast<size_t>(per_byte * static_cast<double>(st.st_size) * 1.05) + 16);
+    }
+}
+
+/**
+ * Convert file status to a stamp
+ * @param info File status
+ * @return Stamp of that file version
+ */
+static FileStamp make_stamp(const struct stat& info) {
+    FileStamp stamp;
+    stamp.mtime_sec = static_cast<long long>(info.st_mtim.tv_sec);
+    stamp.mtime_nsec = static_cast<long long>(info.st_mtim.tv_nsec);
+    stamp.size = static_cast<long long>(info.st_size);
+    stamp.inode = static_cast<unsigned long long>(info.st_ino);
+    return stamp;
+}
+
 /**
  * Load file content into buffer
+ * The file is read in large blocks and split on newlines with memchr;
+ * a trailing newline does not produce an extra empty line. Line text is
+ * bump-allocated in a fresh arena that the buffer then takes over.
  * @param filename Path to file to load
  * @param buffer Buffer to populate with file content
  * @return True if file loaded successfully, false otherwise
  */
 bool FileManager::load_file(const std::string& filename, Buffer& buffer) {
-    std::ifstream file(filename);
-    if (!file.is_open()) {
+    TraceSpan span(TRACE_FILE_LOAD, filename.c_str());
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
         return false;
     }
 
-    // Clear existing buffer content
-    buffer.clear();
-    
-    std::string line;
-    bool first_line = true;
-
-    // Read file line by line
-    while (std::getline(file, line)) {
-        if (first_line) {
-            // Replace the default empty line with first file line
-            buffer.set_line(0, line);
-            first_line = false;
-        } else {
-            // Append subsequent lines
-            int line_count = buffer.get_line_count();
-            buffer.set_line(line_count, line);
+    // Stamp before reading so a write racing the load looks stale later
+    struct stat info;
+    FileStamp stamp;
+    memset(&stamp, 0, sizeof(stamp));
+    if (fstat(fd, &info) == 0) {
+        stamp = make_stamp(info);
+    }
+
+    std::vector<Line> lines;
+    LineArena arena;
+    std::vector<char> block(IO_BLOCK_SIZE);
+    std::string partial;  // Line continuing across block boundaries
+
+    for (;;) {
+        ssize_t count = read(fd, block.data(), block.size());
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            close(fd);
+            return false;
+        }
+        if (count == 0) {
+            break;
+        }
+
+        const char* start = block.data();
+        const char* end = start + count;
+        if (lines.empty() && partial.empty()) {
+            reserve_lines(fd, start, end, lines);
+        }
+        while (const char* newline = static_cast<const char*>(memchr(start, '\n', end - start))) {
+            if (partial.empty()) {
+                lines.push_back(arena.make(start, newline - start));
+            } else {
+                partial.append(start, newline - start);
+                lines.push_back(arena.make(partial.data(), partial.size()));
+                partial.clear();
+            }
+            start = newline + 1;
         }
+        partial.append(start, end - start);
+    }
+    close(fd);
+
+    if (!partial.empty()) {
+        lines.push_back(arena.make(partial.data(), partial.size()));
     }
 
-    file.close();
-    
+    // Replace buffer content in one step (no per-line undo records)
+    span.a = static_cast<long long>(lines.size());
+    buffer.assign_lines(std::move(arena), std::move(lines));
+
     // Mark buffer as unmodified since we just loaded from file
     buffer.set_modified(false);
+    buffer.set_disk_stamp(stamp);
     return true;
 }
 
@@ -50,24 +156,69 @@ bool FileManager::save_file(const std::string& filename, const Buffer& buffer) {
     if (filename.empty()) {
         return false;
     }
+    if (dry_run) {
+        return true;
+    }
 
-    std::ofstream file(filename);
-    if (!file.is_open()) {
+    TraceSpan span(TRACE_FILE_SAVE, filename.c_str());
+    span.a = buffer.get_line_count();
+    int fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
         return false;
     }
+    bool written = write_buffer(fd, buffer);
+    struct stat info;
+    if (written && fstat(fd, &info) == 0) {
+        buffer.set_disk_stamp(make_stamp(info));
+    }
+    return close(fd) == 0 && written;
+}
 
-    // Write all lines to file
+/**
+ * Write buffer content to an open file descriptor
+ * Lines are gathered into large blocks so output costs one system call
+ * per block; lines are separated by newlines with none after the last
+ * @param fd Destination file descriptor
+ * @param buffer Buffer containing content to write
+ * @return True if everything was written
+ */
+bool FileManager::write_buffer(int fd, const Buffer& buffer) {
     const auto& lines = buffer.get_lines();
+    std::string block;
+    block.reserve(IO_BLOCK_SIZE * 2);
+
     for (size_t i = 0; i < lines.size(); ++i) {
-        file << lines[i];
+        if (lines[i].size() >= IO_BLOCK_SIZE) {
+            // Very long lines go out directly instead of through the block
+            if (!write_all(fd, block.data(), block.size()) ||
+                !write_all(fd, lines[i].data(), lines[i].size())) {
+                return false;
+            }
+            block.clear();
+        } else {
+            block.append(lines[i].data(), lines[i].size());
+        }
+
         // Add newline after each line except the last one
         if (i < lines.size() - 1) {
-            file << '\n';
+            block += '\n';
+        }
+        if (block.size() >= IO_BLOCK_SIZE) {
+            if (!write_all(fd, block.data(), block.size())) {
+                return false;
+            }
+            block.clear();
         }
     }
+    return write_all(fd, block.data(), block.size());
+}
 
-    file.close();
-    return true;
+/**
+ * Discard saves instead of writing files
+ * @param enable True to pretend saves succeed without writing
+ */
+void FileManager::set_dry_run(bool enable) {
+    dry_run = enable;
 }
 
 /**
@@ -78,4 +229,19 @@ bool FileManager::save_file(const std::string& filename, const Buffer& buffer) {
 bool FileManager::file_exists(const std::string& filename) {
     struct stat buffer;
     return (stat(filename.c_str(), &buffer) == 0);
+}
+
+/**
+ * Get the identity of the current version of a file
+ * @param filename File to check
+ * @param stamp Receives the stamp
+ * @return True if the file exists
+ */
+bool FileManager::get_stamp(const std::string& filename, FileStamp& stamp) {
+    struct stat info;
+    if (stat(filename.c_str(), &info) != 0) {
+        return false;
+    }
+    stamp = make_stamp(info);
+    return true;
 }
\ No newline at end of file
@@ -0,0 +1,459 @@
+#include "../include/slowertext.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+
+// Ranges smaller than this are not worth splitting across threads
+static const int MIN_LINES_PER_WORKER = 16384;
+
+// Rows handed to one writev() call, two iovecs each
+static const int ROWS_PER_WRITE = 256;
+
+// Bytes read from the command per read() call
+static const size_t READ_CHUNK = 64 * 1024;
+
+/**
+ * Sort key of one row: a view into the line's text, never a copy
+ */
+struct SortEntry {
+    const char* key;                 // Start of the key within the line
+    size_t length;                   // Key length
+    uint64_t prefix;                 // First 8 key bytes, big-endian and case-folded for i
+    double number;                   // First number in the key, for n
+    bool has_number;                 // Whether the key holds a number
+    int row;                         // Row in the buffer
+};
+
+/**
+ * Strict weak order of sort entries under a set of options
+ */
+struct SortLess {
+    const SortOptions& options;
+
+    bool ascending(const SortEntry& a, const SortEntry& b) const {
+        if (options.numeric) {
+            // Rows without a number go first, as in vi
+            if (a.has_number != b.has_number) {
+                return b.has_number;
+            }
+            return a.has_number && a.number < b.number;
+        }
+        // Most pairs differ in the prefix, which needs no access to the text
+        if (a.prefix != b.prefix) {
+            return a.prefix < b.prefix;
+        }
+        size_t common = std::min(a.length, b.length);
+        if (common <= sizeof(uint64_t)) {
+            return a.length < b.length;
+        }
+        if (!options.ignore_case) {
+            int order = memcmp(a.key + sizeof(uint64_t), b.key + sizeof(uint64_t), common - sizeof(uint64_t));
+            return order != 0 ? order < 0 : a.length < b.length;
+        }
+        for (size_t i = sizeof(uint64_t); i < common; i++) {
+            int x = tolower(static_cast<unsigned char>(a.key[i]));
+            int y = tolower(static_cast<unsigned char>(b.key[i]));
+            if (x != y) {
+                return x < y;
+            }
+        }
+        return a.length < b.length;
+    }
+
+    bool operator()(const SortEntry& a, const SortEntry& b) const {
+        return options.reverse ? ascending(b, a) : ascending(a, b);
+    }
+};
+
+/**
+ * Build the sort key of a row
+ * @param line Row text
+ * @param row Row in the buffer
+ * @param options Parsed options
+ * @return Entry viewing the key
+ */
+static SortEntry make_entry(const Line& line, int row, const SortOptions& options) {
+    const char* text = line.data();
+    size_t length = line.size();
+    size_t start = 0;
+
+    // A delimited field N is the key on its own; a blank-separated field N
+    // starts after N-1 runs of non-blanks, leading blanks skipped
+    if (options.key_field > 0 && options.delimiter) {
+        size_t field_length = 0;
+        start = ColumnView::find_field(text, length, options.delimiter, options.key_field, field_length);
+        length = start + field_length;
+    } else if (options.key_field > 0) {
+        for (int field = 1;; field++) {
+            while (start < length && (text[start] == ' ' || text[start] == '\t')) {
+                start++;
+            }
+            if (field == options.key_field) {
+                break;
+            }
+            while (start < length && text[start] != ' ' && text[start] != '\t') {
+                start++;
+            }
+        }
+    }
+    SortEntry entry = {text + start, length - start, 0, 0.0, false, row};
+    for (size_t i = 0; i < sizeof(uint64_t); i++) {
+        unsigned char c = i < entry.length ? static_cast<unsigned char>(entry.key[i]) : 0;
+        if (options.ignore_case) {
+            c = static_cast<unsigned char>(tolower(c));
+        }
+        entry.prefix = (entry.prefix << 8) | c;
+    }
+
+    if (options.numeric) {
+        size_t i = 0;
+        while (i < entry.length && !isdigit(static_cast<unsigned char>(entry.key[i]))) {
+            i++;
+        }
+        if (i < entry.length) {
+            bool negative = (i > 0 && entry.key[i - 1] == '-');
+            double value = 0.0;
+            for (; i < entry.length && isdigit(static_cast<unsigned char>(entry.key[i])); i++) {
+                value = value * 10.0 + (entry.key[i] - '0');
+            }
+            if (i + 1 < entry.length && entry.key[i] == '.' && isdigit(static_cast<unsigned char>(entry.key[i + 1]))) {
+                double scale = 0.1;
+                for (i++; i < entry.length && isdigit(static_cast<unsigned char>(entry.key[i])); i++) {
+                    value += (entry.key[i] - '0') * scale;
+                    scale /= 10.0;
+                }
+            }
+            entry.number = negative ? -value : value;
+            entry.has_number = true;
+        }
+    }
+    return entry;
+}
+
+/**
+ * Run a task once per worker index, on threads when there is more than one
+ * @param count Number of workers
+ * @param task Callable taking the worker index
+ */
+template <typename Task>
+static void run_workers(int count, Task task) {
+    if (count == 1) {
+        task(0);
+        return;
+    }
+    std::vector<std::thread> workers;
+    for (int w = 0; w < count; w++) {
+        workers.emplace_back(task, w);
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+/**
+ * Parse the options after :sort
+ * A leading ! reverses the order; n, r, i and u may follow in any order,
+ * separated by spaces or not, and k N picks the key field
+ * @param args Text after the command name
+ * @param options Receives the options
+ * @return False (after reporting) if an option is not recognized
+ */
+bool LineFilter::parse_sort(const std::string& args, SortOptions& options) {
+    options = {false, false, false, false, 0, 0};
+    size_t pos = 0;
+    if (pos < args.size() && args[pos] == '!') {
+        options.reverse = true;
+        pos++;
+    }
+    while (pos < args.size()) {
+        char c = args[pos++];
+        if (c == ' ') {
+            continue;
+        } else if (c == 'n') {
+            options.numeric = true;
+        } else if (c == 'r') {
+            options.reverse = true;
+        } else if (c == 'i') {
+            options.ignore_case = true;
+        } else if (c == 'u') {
+            options.unique = true;
+        } else if (c == 'k') {
+            while (pos < args.size() && args[pos] == ' ') {
+                pos++;
+            }
+            long field = 0;
+            while (pos < args.size() && isdigit(static_cast<unsigned char>(args[pos]))) {
+                field = std::min(field * 10 + (args[pos++] - '0'), 1000000L);
+            }
+            if (field < 1) {
+                set_status_message("Error: k needs a field number from 1");
+                return false;
+            }
+            options.key_field = static_cast<int>(field);
+        } else {
+            set_status_message("Error: Sort options are n, r, i, u and k N");
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Order a range of rows on worker threads
+ * Each worker builds the keys of its slice and sorts it, then sorted
+ * runs are merged pairwise in parallel rounds between two arrays of
+ * entries. Entries point into the lines, so no text is copied.
+ * @param buffer Text buffer
+ * @param first First row
+ * @param last Last row (inclusive)
+ * @param options Parsed options
+ * @param rows Receives the rows in sorted order, without duplicates for u
+ */
+void LineFilter::sort_rows(const Buffer& buffer, int first, int last, const SortOptions& options,
+                           std::vector<int>& rows) {
+    rows.clear();
+    int total = last - first + 1;
+    if (total <= 0) {
+        return;
+    }
+    int worker_count = static_cast<int>(std::thread::hardware_concurrency());
+    worker_count = std::max(1, std::min(worker_count, total / MIN_LINES_PER_WORKER));
+
+    const std::vector<Line>& lines = buffer.get_lines();
+    SortLess less = {options};
+    std::vector<SortEntry> entries(total);
+    std::vector<SortEntry> merged(total);
+    std::vector<int> bounds;
+    for (int w = 0; w <= worker_count; w++) {
+        bounds.push_back(static_cast<int>(static_cast<long>(total) * w / worker_count));
+    }
+
+    run_workers(worker_count, [&](int w) {
+        TraceSpan span(TRACE_SORT_SLICE);
+        span.a = first + bounds[w];
+        span.b = bounds[w + 1] - bounds[w];
+        for (int i = bounds[w]; i < bounds[w + 1]; i++) {
+            entries[i] = make_entry(lines[first + i], first + i, options);
+        }
+        std::stable_sort(entries.begin() + bounds[w], entries.begin() + bounds[w + 1], less);
+    });
+
+    // std::merge takes from the left run on ties, which keeps the sort stable
+    while (bounds.size() > 2) {
+        int runs = static_cast<int>(bounds.size()) - 1;
+        run_workers((runs + 1) / 2, [&](int pair) {
+            int start = bounds[pair * 2];
+            int middle = bounds[std::min(pair * 2 + 1, runs)];
+            int end = bounds[std::min(pair * 2 + 2, runs)];
+            std::merge(entries.begin() + start, entries.begin() + middle, entries.begin() + middle,
+                       entries.begin() + end, merged.begin() + start, less);
+        });
+        entries.swap(merged);
+        std::vector<int> joined;
+        for (size_t i = 0; i < bounds.size(); i += 2) {
+            joined.push_back(bounds[i]);
+        }
+        if (joined.back() != total) {
+            joined.push_back(total);
+        }
+        bounds.swap(joined);
+    }
+
+    rows.reserve(total);
+    for (int i = 0; i < total; i++) {
+        if (options.unique && i > 0 && !less(entries[i - 1], entries[i]) && !less(entries[i], entries[i - 1])) {
+            continue;
+        }
+        rows.push_back(entries[i].row);
+    }
+}
+
+/**
+ * Find the rows of a range that differ from the row above
+ * @param buffer Text buffer
+ * @param first First row
+ * @param last Last row (inclusive)
+ * @param rows Receives the rows to keep in ascending order
+ */
+void LineFilter::unique_rows(const Buffer& buffer, int first, int last, std::vector<int>& rows) {
+    rows.clear();
+    const std::vector<Line>& lines = buffer.get_lines();
+    for (int y = first; y <= last; y++) {
+        if (y > first && lines[y].size() == lines[y - 1].size() &&
+            memcmp(lines[y].data(), lines[y - 1].data(), lines[y].size()) == 0) {
+            continue;
+        }
+        rows.push_back(y);
+    }
+}
+
+/**
+ * Run a shell command with a range of rows as its input
+ * One poll() loop writes rows straight from the buffer's lines with
+ * writev() and reads the output as it arrives, so neither pipe fills up
+ * while the other side waits and no temporary file is needed. stderr
+ * is merged into the output. Cancelling kills the command's process group.
+ * @param command Command for /bin/sh -c
+ * @param buffer Text buffer
+ * @param first First row
+ * @param last Last row (inclusive), below first for no input
+ * @param should_cancel Polled while the command runs, null to never cancel
+ * @return Output lines and exit status
+ */
+FilterResult LineFilter::run(const std::string& command, const Buffer& buffer, int first, int last,
+                             bool (*should_cancel)()) {
+    TraceSpan span(TRACE_FILTER, command.c_str());
+    auto started = std::chrono::steady_clock::now();
+    FilterResult result;
+    result.status = -1;
+    result.elapsed_ms = 0.0;
+    result.cancelled = false;
+
+    int to_child[2];
+    int from_child[2];
+    if (pipe2(to_child, O_CLOEXEC) != 0) {
+        return result;
+    }
+    if (pipe2(from_child, O_CLOEXEC) != 0) {
+        close(to_child[0]);
+        close(to_child[1]);
+        return result;
+    }
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        setpgid(0, 0);
+        dup2(to_child[0], STDIN_FILENO);
+        dup2(from_child[1], STDOUT_FILENO);
+        dup2(from_child[1], STDERR_FILENO);
+        execl("/bin/sh", "sh", "-c", command.c_str(), static_cast<char*>(nullptr));
+        _exit(127);
+    }
+    close(to_child[0]);
+    close(from_child[1]);
+    if (pid < 0) {
+        close(to_child[1]);
+        close(from_child[0]);
+        return result;
+    }
+    setpgid(pid, pid);
+
+    // A command that exits without reading its input must not kill the editor
+    struct sigaction ignore;
+    struct sigaction previous;
+    memset(&ignore, 0, sizeof(ignore));
+    ignore.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &ignore, &previous);
+
+    int write_fd = to_child[1];
+    int read_fd = from_child[0];
+    fcntl(write_fd, F_SETFL, fcntl(write_fd, F_GETFL) | O_NONBLOCK);
+    fcntl(read_fd, F_SETFL, fcntl(read_fd, F_GETFL) | O_NONBLOCK);
+    if (first > last) {
+        close(write_fd);
+        write_fd = -1;
+    }
+
+    const std::vector<Line>& lines = buffer.get_lines();
+    static const char newline = '\n';
+    int row = first;
+    size_t offset = 0;               // Bytes of the row (and its newline) already written
+    std::string output;
+    std::vector<char> chunk(READ_CHUNK);
+    struct iovec pieces[ROWS_PER_WRITE * 2];
+
+    while (read_fd >= 0) {
+        if (should_cancel && should_cancel()) {
+            kill(-pid, SIGTERM);
+            result.cancelled = true;
+            break;
+        }
+        struct pollfd fds[2];
+        int watched = 0;
+        fds[watched++] = {read_fd, POLLIN, 0};
+        if (write_fd >= 0) {
+            fds[watched++] = {write_fd, POLLOUT, 0};
+        }
+        if (poll(fds, watched, 20) < 0 && errno != EINTR) {
+            break;
+        }
+
+        if (write_fd >= 0 && fds[1].revents) {
+            int used = 0;
+            for (int y = row; y <= last && used < ROWS_PER_WRITE * 2; y++) {
+                size_t skip = (y == row) ? offset : 0;
+                if (skip < lines[y].size()) {
+                    pieces[used++] = {const_cast<char*>(lines[y].data() + skip), lines[y].size() - skip};
+                }
+                pieces[used++] = {const_cast<char*>(&newline), 1};
+            }
+            ssize_t written = writev(write_fd, pieces, used);
+            if (written < 0 && errno != EAGAIN && errno != EINTR) {
+                // The command stopped reading; keep collecting its output
+                close(write_fd);
+                write_fd = -1;
+            } else if (written > 0) {
+                span.a += written;
+                size_t left = static_cast<size_t>(written);
+                while (left > 0) {
+                    size_t rest = lines[row].size() + 1 - offset;
+                    if (left < rest) {
+                        offset += left;
+                        break;
+                    }
+                    left -= rest;
+                    row++;
+                    offset = 0;
+                }
+                if (row > last) {
+                    close(write_fd);
+                    write_fd = -1;
+                }
+            }
+        }
+
+        if (fds[0].revents) {
+            ssize_t got = read(read_fd, chunk.data(), chunk.size());
+            if (got > 0) {
+                output.append(chunk.data(), static_cast<size_t>(got));
+                span.b += got;
+            } else if (got == 0 || (errno != EAGAIN && errno != EINTR)) {
+                close(read_fd);
+                read_fd = -1;
+            }
+        }
+    }
+    if (write_fd >= 0) {
+        close(write_fd);
+    }
+    if (read_fd >= 0) {
+        close(read_fd);
+    }
+
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    sigaction(SIGPIPE, &previous, nullptr);
+    if (!result.cancelled && WIFEXITED(status)) {
+        result.status = WEXITSTATUS(status);
+    }
+
+    // A final newline ends the last line rather than starting an empty one
+    size_t start = 0;
+    while (start < output.size()) {
+        size_t end = output.find('\n', start);
+        if (end == std::string::npos) {
+            end = output.size();
+        }
+        result.output.push_back(output.substr(start, end - start));
+        start = end + 1;
+    }
+    result.elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+    return result;
+}
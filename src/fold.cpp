@@ -0,0 +1,372 @@
+#include "../include/slowertext.h"
+#include <algorithm>
+#include <climits>
+
+// Subtree maximum when the subtree has no closed fold; stays far below
+// any row when shifted
+static const int NO_ROW = INT_MIN / 2;
+
+/**
+ * Map the last row of a fold through a replacement of rows
+ * Rows that no longer exist map to the last row put in their place.
+ * @param row Row before the edit
+ * @param first First replaced row
+ * @param count Rows replaced
+ * @param produced Rows put in their place
+ * @return Row after the edit
+ */
+static int map_end(int row, int first, int count, int produced) {
+    if (row < first + std::min(count, produced)) {
+        return row;
+    }
+    if (row < first + count) {
+        return first + produced - 1;
+    }
+    return row + produced - count;
+}
+
+/**
+ * FoldTree constructor
+ */
+FoldTree::FoldTree() : root(-1), seed(2463534242u), count(0) {
+}
+
+/**
+ * Hand a node's pending shift down to its children
+ * @param t Node
+ */
+void FoldTree::push(int t) {
+    Node& node = nodes[t];
+    if (node.shift != 0) {
+        shift(node.left, node.shift);
+        shift(node.right, node.shift);
+        node.shift = 0;
+    }
+}
+
+/**
+ * Shift every fold of a subtree
+ * @param t Subtree root, -1 for none
+ * @param rows Rows to add
+ */
+void FoldTree::shift(int t, int rows) {
+    if (t < 0 || rows == 0) {
+        return;
+    }
+    Node& node = nodes[t];
+    node.fold.start += rows;
+    node.fold.end += rows;
+    node.max_end += rows;
+    node.max_closed_end += rows;
+    node.shift += rows;
+}
+
+/**
+ * Recompute the subtree maxima of a node from its children
+ * @param t Node
+ */
+void FoldTree::update(int t) {
+    Node& node = nodes[t];
+    node.max_end = node.fold.end;
+    node.max_closed_end = node.fold.closed ? node.fold.end : NO_ROW;
+    int children[] = {node.left, node.right};
+    for (int child : children) {
+        if (child >= 0) {
+            node.max_end = std::max(node.max_end, nodes[child].max_end + node.shift);
+            node.max_closed_end = std::max(node.max_closed_end, nodes[child].max_closed_end + node.shift);
+        }
+    }
+}
+
+/**
+ * Split a subtree by fold order
+ * @param t Subtree root, -1 for none
+ * @param start First row of the split key
+ * @param end Last row of the split key
+ * @param left Receives the folds ordered before (start, end)
+ * @param right Receives the others
+ */
+void FoldTree::split(int t, int start, int end, int& left, int& right) {
+    if (t < 0) {
+        left = right = -1;
+        return;
+    }
+    push(t);
+    Node& node = nodes[t];
+    if (node.fold.start < start || (node.fold.start == start && node.fold.end > end)) {
+        int rest = -1;
+        split(node.right, start, end, rest, right);
+        node.right = rest;
+        left = t;
+    } else {
+        int rest = -1;
+        split(node.left, start, end, left, rest);
+        node.left = rest;
+        right = t;
+    }
+    update(t);
+}
+
+/**
+ * Merge two subtrees where every fold of left is ordered first
+ * @param left Left subtree, -1 for none
+ * @param right Right subtree, -1 for none
+ * @return Root of the merged subtree
+ */
+int FoldTree::merge(int left, int right) {
+    if (left < 0) {
+        return right;
+    }
+    if (right < 0) {
+        return left;
+    }
+    if (nodes[left].priority > nodes[right].priority) {
+        push(left);
+        int child = merge(nodes[left].right, right);
+        nodes[left].right = child;
+        update(left);
+        return left;
+    }
+    push(right);
+    int child = merge(left, nodes[right].left);
+    nodes[right].left = child;
+    update(right);
+    return right;
+}
+
+/**
+ * Free every node of a subtree
+ * @param t Subtree root, -1 for none
+ */
+void FoldTree::release(int t) {
+    if (t < 0) {
+        return;
+    }
+    release(nodes[t].left);
+    release(nodes[t].right);
+    free_ids.push_back(t);
+    count--;
+}
+
+/**
+ * Move the last rows of folds that reach into replaced rows
+ * Only subtrees holding such a fold are visited; their first rows stay,
+ * so the order is kept.
+ * @param t Subtree root, -1 for none
+ * @param first First replaced row
+ * @param count Rows replaced
+ * @param produced Rows put in their place
+ */
+void FoldTree::remap_ends(int t, int first, int count, int produced) {
+    if (t < 0 || nodes[t].max_end < first) {
+        return;
+    }
+    push(t);
+    remap_ends(nodes[t].left, first, count, produced);
+    remap_ends(nodes[t].right, first, count, produced);
+    Fold& fold = nodes[t].fold;
+    if (fold.end >= first) {
+        fold.end = map_end(fold.end, first, count, produced);
+    }
+    update(t);
+}
+
+/**
+ * Append the folds of a subtree that overlap a range, in order
+ * @param t Subtree root, -1 for none
+ * @param offset Shift pending above the subtree
+ * @param first First row of the range
+ * @param last Last row of the range
+ * @param out Receives the folds
+ */
+void FoldTree::collect(int t, int offset, int first, int last, std::vector<Fold>& out) const {
+    if (t < 0 || nodes[t].max_end + offset < first) {
+        return;
+    }
+    const Node& node = nodes[t];
+    collect(node.left, offset + node.shift, first, last, out);
+    if (node.fold.start + offset > last) {
+        return;
+    }
+    if (node.fold.end + offset >= first) {
+        Fold fold = node.fold;
+        fold.start += offset;
+        fold.end += offset;
+        out.push_back(fold);
+    }
+    collect(node.right, offset + node.shift, first, last, out);
+}
+
+/**
+ * Open or close every fold of a subtree
+ * @param t Subtree root, -1 for none
+ * @param closed New state
+ */
+void FoldTree::set_closed(int t, bool closed) {
+    if (t < 0) {
+        return;
+    }
+    nodes[t].fold.closed = closed;
+    set_closed(nodes[t].left, closed);
+    set_closed(nodes[t].right, closed);
+    update(t);
+}
+
+/**
+ * Find the first closed fold in order that holds a row
+ * Subtrees whose closed folds all end above the row are skipped.
+ * @param t Subtree root, -1 for none
+ * @param offset Shift pending above the subtree
+ * @param row Row
+ * @param fold Receives the fold
+ * @return True if found
+ */
+bool FoldTree::find_closed(int t, int offset, int row, Fold& fold) const {
+    if (t < 0 || nodes[t].max_closed_end + offset < row) {
+        return false;
+    }
+    const Node& node = nodes[t];
+    if (find_closed(node.left, offset + node.shift, row, fold)) {
+        return true;
+    }
+    if (node.fold.start + offset > row) {
+        return false;
+    }
+    if (node.fold.closed && node.fold.end + offset >= row) {
+        fold = node.fold;
+        fold.start += offset;
+        fold.end += offset;
+        return true;
+    }
+    return find_closed(node.right, offset + node.shift, row, fold);
+}
+
+/**
+ * Remove every fold
+ */
+void FoldTree::clear() {
+    nodes.clear();
+    free_ids.clear();
+    root = -1;
+    count = 0;
+}
+
+/**
+ * Add a fold
+ * @param fold Fold to add; it must not cross an existing fold
+ */
+void FoldTree::add(const Fold& fold) {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    Node node = {fold, 0, 0, 0, seed, -1, -1};
+    int id;
+    if (!free_ids.empty()) {
+        id = free_ids.back();
+        free_ids.pop_back();
+        nodes[id] = node;
+    } else {
+        id = static_cast<int>(nodes.size());
+        nodes.push_back(node);
+    }
+    update(id);
+
+    int left = -1;
+    int right = -1;
+    split(root, fold.start, fold.end, left, right);
+    root = merge(merge(left, id), right);
+    count++;
+}
+
+/**
+ * Remove a fold
+ * @param start First row of the fold
+ * @param end Last row of the fold
+ * @return False if there is no such fold
+ */
+bool FoldTree::remove(int start, int end) {
+    int before, match, after;
+    split(root, start, end, before, match);
+    split(match, start, end - 1, match, after);
+    bool found = (match >= 0);
+    release(match);
+    root = merge(before, after);
+    return found;
+}
+
+/**
+ * Open or close a fold
+ * @param start First row of the fold
+ * @param end Last row of the fold
+ * @param closed New state
+ */
+void FoldTree::set_state(int start, int end, bool closed) {
+    int before, match, after;
+    split(root, start, end, before, match);
+    split(match, start, end - 1, match, after);
+    set_closed(match, closed);
+    root = merge(before, merge(match, after));
+}
+
+/**
+ * Open or close every fold
+ * @param closed New state
+ */
+void FoldTree::set_all(bool closed) {
+    set_closed(root, closed);
+}
+
+/**
+ * Find the outermost closed fold holding a row
+ * Folds never cross, so the first in order is the outermost.
+ * @param row Row
+ * @param fold Receives the fold
+ * @return False if the row is not in a closed fold
+ */
+bool FoldTree::closed_at(int row, Fold& fold) const {
+    return find_closed(root, 0, row, fold);
+}
+
+/**
+ * Get the folds that overlap a range of rows
+ * @param first First row
+ * @param last Last row
+ * @param out Receives the folds, outer folds before inner ones
+ */
+void FoldTree::overlapping(int first, int last, std::vector<Fold>& out) const {
+    out.clear();
+    collect(root, 0, first, last, out);
+}
+
+/**
+ * Rows were replaced by a different number of rows
+ * Folds starting after the replaced rows are shifted at their subtree
+ * root; only folds reaching into the replaced rows are visited.
+ * @param first First replaced row
+ * @param count Rows replaced
+ * @param produced Rows put in their place
+ */
+void FoldTree::replace_rows(int first, int count, int produced) {
+    if (root < 0 || count == produced) {
+        return;
+    }
+    int kept = std::min(count, produced);
+    int before, removed, after;
+    split(root, first + kept, INT_MAX, before, removed);
+    split(removed, first + count, INT_MAX, removed, after);
+    shift(after, produced - count);
+    remap_ends(before, first, count, produced);
+
+    // Folds starting on a row that is gone now start after the new rows
+    std::vector<Fold> moved;
+    collect(removed, 0, 0, INT_MAX, moved);
+    release(removed);
+    root = merge(before, after);
+    for (Fold& fold : moved) {
+        fold.start = first + produced;
+        fold.end = map_end(fold.end, first, count, produced);
+        if (fold.end >= fold.start) {
+            add(fold);
+        }
+    }
+}
@@ -2,21 +2,61 @@
 #include <cerrno>
 #include <unistd.h>
 #include <iostream>
+#include <poll.h>
+#include <algorithm>
 
 // Forward declaration for status message function
 extern void set_status_message(const std::string& msg);
 
+// Keystrokes fed from a script instead of the terminal (headless mode)
+static bool script_input = false;
+static std::string script_keys;
+static size_t script_pos = 0;
+
+// Bytes consumed by the key being read, kept for session recording
+static std::string key_bytes;
+
+/**
+ * Read one byte of input from the script or the terminal
+ * @param c Receives the byte
+ * @return 1 on success, 0 if nothing is available, -1 on error
+ */
+static int read_input_byte(char* c) {
+    if (script_input) {
+        if (script_pos >= script_keys.size()) {
+            return 0;
+        }
+        *c = script_keys[script_pos++];
+        return 1;
+    }
+    int nread = static_cast<int>(read(STDIN_FILENO, c, 1));
+    if (nread == 1 && Session::is_recording()) {
+        key_bytes += *c;
+    }
+    return nread;
+}
+
+/**
+ * Feed keystrokes from memory instead of the terminal
+ * @param keys Key bytes, consumed by read_key()
+ */
+void InputHandler::set_script_input(const std::string& keys) {
+    script_input = true;
+    script_keys = keys;
+    script_pos = 0;
+}
+
 /**
  * Read a single key from input with escape sequence handling
  * @return Key code or -1 on error
  */
-int InputHandler::read_key() {
+static int decode_key() {
     int nread;
     char c;
     
     // Read single character with error handling
-    while ((nread = read(STDIN_FILENO, &c, 1)) != 1) {
-        if (nread == -1 && errno != EAGAIN) {
+    while ((nread = read_input_byte(&c)) != 1) {
+        if ((nread == -1 && errno != EAGAIN) || (nread == 0 && script_input)) {
             set_status_message("Error: Failed to read input");
             return -1;
         }
@@ -24,14 +64,18 @@ int InputHandler::read_key() {
 
     // Handle escape sequences for special keys
     if (c == ESC_KEY) {
+        // Scripted keys have no timing, so only ESC [ starts a sequence
+        if (script_input && (script_pos >= script_keys.size() || script_keys[script_pos] != '[')) {
+            return ESC_KEY;
+        }
         char seq[3];
-        if (read(STDIN_FILENO, &seq[0], 1) != 1) return ESC_KEY;
-        if (read(STDIN_FILENO, &seq[1], 1) != 1) return ESC_KEY;
+        if (read_input_byte(&seq[0]) != 1) return ESC_KEY;
+        if (read_input_byte(&seq[1]) != 1) return ESC_KEY;
 
         if (seq[0] == '[') {
             // Handle numbered escape sequences
             if (seq[1] >= '0' && seq[1] <= '9') {
-                if (read(STDIN_FILENO, &seq[2], 1) != 1) return ESC_KEY;
+                if (read_input_byte(&seq[2]) != 1) return ESC_KEY;
                 if (seq[2] == '~') {
                     switch (seq[1]) {
                         case '3': return DELETE_KEY;
@@ -54,46 +98,140 @@ int InputHandler::read_key() {
     return static_cast<unsigned char>(c);
 }
 
+/**
+ * Read a single key from input
+ * When a session is being recorded, the raw bytes of the key are logged
+ * @return Key code or -1 on error
+ */
+int InputHandler::read_key() {
+    key_bytes.clear();
+    int key = decode_key();
+    if (!key_bytes.empty()) {
+        Session::record_key(key_bytes, editor_config.screen_rows + 2, editor_config.screen_cols);
+    }
+    return key;
+}
+
+/**
+ * Wait until input is available
+ * Lets the main loop do idle work such as showing search progress
+ * @param timeout_ms Maximum time to wait in milliseconds
+ * @return True if a key can be read without blocking
+ */
+bool InputHandler::wait_for_input(int timeout_ms) {
+    if (script_input) {
+        return script_pos < script_keys.size();
+    }
+    struct pollfd pfd;
+    pfd.fd = STDIN_FILENO;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    return poll(&pfd, 1, timeout_ms) > 0;
+}
+
+/**
+ * Run the interactive editor loop until the editor quits
+ * The idle hook also runs when input arrives, so a server notices a
+ * client that went away even while its terminal keeps reporting input.
+ * @param config Editor configuration
+ * @param idle Polled between keys (or nullptr); returns true when the
+ *             screen needs a refresh and may set config.quit to leave
+ */
+void InputHandler::run_loop(EditorConfig& config, bool (*idle)(EditorConfig& config)) {
+    static bool first_frame = true;
+    while (!config.quit) {
+        Renderer::refresh_screen(config);
+        if (first_frame) {
+            StartupProfile::phase("first frame");
+            StartupProfile::finish();
+            first_frame = false;
+        }
+
+        // Redraw as background work makes progress or the config changes
+        bool input = false;
+        while (!input) {
+            input = wait_for_input(100);
+            bool redraw = idle && idle(config);
+            if (config.quit) {
+                return;
+            }
+            if (!input) {
+                bool search_progress = search_state.poll(config);
+                bool columns_changed = column_view.poll();
+                bool config_changed = ConfigManager::poll_changes(config);
+                buffer_list.compact_idle();
+                if (redraw || search_progress || columns_changed || config_changed) {
+                    Renderer::refresh_screen(config);
+                }
+            }
+        }
+        PERF_SCOPE(PERF_KEYPRESS);
+        process_keypress(config, *window_manager.get_active().buffer);
+    }
+}
+
+/**
+ * Check for a pending Escape key without blocking
+ * Used to cancel long-running commands; other pending input is dropped
+ * @return True if Escape was pressed
+ */
+bool InputHandler::escape_pressed() {
+    // Scripted keys are commands, not interruptions
+    if (script_input) {
+        return false;
+    }
+    while (wait_for_input(0)) {
+        char c;
+        if (read(STDIN_FILENO, &c, 1) != 1) {
+            break;
+        }
+        if (c == ESC_KEY) {
+            return true;
+        }
+    }
+    return false;
+}
+
 /**
  * Handle cursor movement in both modes
+ * Up and down step over closed folds as one line.
  * @param config Editor configuration
  * @param buffer Text buffer
  * @param key Key code for movement
  */
 void handle_cursor_movement(EditorConfig& config, Buffer& buffer, int key) {
     if (key == ARROW_UP) {
-        if (config.cursor_y > 0) {
-            config.cursor_y--;
+        if (buffer.prev_visible(config.cursor_y) >= 0) {
+            config.cursor_y = buffer.prev_visible(config.cursor_y);
             // Adjust cursor x to fit within new line length
-            std::string line = buffer.get_line(config.cursor_y);
-            if (config.cursor_x > static_cast<int>(line.length())) {
-                config.cursor_x = static_cast<int>(line.length());
+            int length = static_cast<int>(buffer.view_line(config.cursor_y).length());
+            if (config.cursor_x > length) {
+                config.cursor_x = length;
             }
         }
     } else if (key == ARROW_DOWN) {
-        if (config.cursor_y < buffer.get_line_count() - 1) {
-            config.cursor_y++;
+        if (buffer.next_visible(config.cursor_y) < buffer.get_line_count()) {
+            config.cursor_y = buffer.next_visible(config.cursor_y);
             // Adjust cursor x to fit within new line length
-            std::string line = buffer.get_line(config.cursor_y);
-            if (config.cursor_x > static_cast<int>(line.length())) {
-                config.cursor_x = static_cast<int>(line.length());
+            int length = static_cast<int>(buffer.view_line(config.cursor_y).length());
+            if (config.cursor_x > length) {
+                config.cursor_x = length;
             }
         }
     } else if (key == ARROW_LEFT) {
         if (config.cursor_x > 0) {
             config.cursor_x--;
-        } else if (config.cursor_y > 0) {
+        } else if (buffer.prev_visible(config.cursor_y) >= 0) {
             // Move to end of previous line
-            config.cursor_y--;
-            config.cursor_x = static_cast<int>(buffer.get_line(config.cursor_y).length());
+            config.cursor_y = buffer.prev_visible(config.cursor_y);
+            config.cursor_x = static_cast<int>(buffer.view_line(config.cursor_y).length());
         }
     } else if (key == ARROW_RIGHT) {
-        std::string current_line = buffer.get_line(config.cursor_y);
-        if (config.cursor_x < static_cast<int>(current_line.length())) {
+        if (config.cursor_x < static_cast<int>(buffer.view_line(config.cursor_y).length())) {
             config.cursor_x++;
-        } else if (config.cursor_y < buffer.get_line_count() - 1) {
+        } else if (buffer.next_visible(config.cursor_y) < buffer.get_line_count()) {
             // Move to beginning of next line
-            config.cursor_y++;
+            config.cursor_y = buffer.next_visible(config.cursor_y);
             config.cursor_x = 0;
         }
     }
@@ -108,7 +246,7 @@ void handle_backspace(EditorConfig& config, Buffer& buffer) {
     try {
         if (config.cursor_x > 0) {
             // Get current line for smart tab deletion
-            std::string current_line = buffer.get_line(config.cursor_y);
+            LineView current_line = buffer.view_line(config.cursor_y);
             
             // Smart tab deletion: check if we can delete a full tab width
             bool can_delete_tab = false;
@@ -159,12 +297,8 @@ void handle_backspace(EditorConfig& config, Buffer& buffer) {
             }
         } else if (config.cursor_y > 0) {
             // Join with previous line (backspace at beginning of line)
-            std::string current_line = buffer.get_line(config.cursor_y);
-            std::string prev_line = buffer.get_line(config.cursor_y - 1);
-            
-            config.cursor_x = static_cast<int>(prev_line.length());
-            buffer.set_line(config.cursor_y - 1, prev_line + current_line);
-            buffer.delete_line(config.cursor_y);
+            config.cursor_x = static_cast<int>(buffer.view_line(config.cursor_y - 1).length());
+            buffer.join_line(config.cursor_y - 1);
             config.cursor_y--;
         }
         config.modified = buffer.is_modified();
@@ -180,15 +314,12 @@ void handle_backspace(EditorConfig& config, Buffer& buffer) {
  */
 void handle_delete(EditorConfig& config, Buffer& buffer) {
     try {
-        std::string current_line = buffer.get_line(config.cursor_y);
-        if (config.cursor_x < static_cast<int>(current_line.length())) {
+        if (config.cursor_x < static_cast<int>(buffer.view_line(config.cursor_y).length())) {
             // Delete character at cursor position
             buffer.delete_char(config.cursor_x, config.cursor_y);
         } else if (config.cursor_y < buffer.get_line_count() - 1) {
             // Join with next line
-            std::string next_line = buffer.get_line(config.cursor_y + 1);
-            buffer.set_line(config.cursor_y, current_line + next_line);
-            buffer.delete_line(config.cursor_y + 1);
+            buffer.join_line(config.cursor_y);
         }
         config.modified = buffer.is_modified();
     } catch (const std::exception& e) {
@@ -203,6 +334,7 @@ void handle_delete(EditorConfig& config, Buffer& buffer) {
  */
 void handle_enter(EditorConfig& config, Buffer& buffer) {
     try {
+        buffer.begin_transaction();
         buffer.insert_newline(config.cursor_x, config.cursor_y);
         config.cursor_y++;
         config.cursor_x = 0;
@@ -216,13 +348,13 @@ void handle_enter(EditorConfig& config, Buffer& buffer) {
                 indent++;
             }
             // Insert indentation spaces
-            for (int i = 0; i < indent; i++) {
-                buffer.insert_char(config.cursor_x, config.cursor_y, ' ');
-                config.cursor_x++;
-            }
+            buffer.insert_text(config.cursor_x, config.cursor_y, std::string(indent, ' '));
+            config.cursor_x += indent;
         }
+        buffer.commit_transaction();
         config.modified = buffer.is_modified();
     } catch (const std::exception& e) {
+        buffer.commit_transaction();
         set_status_message("Error inserting newline: " + std::string(e.what()));
     }
 }
@@ -234,11 +366,9 @@ void handle_enter(EditorConfig& config, Buffer& buffer) {
  */
 void handle_tab(EditorConfig& config, Buffer& buffer) {
     try {
-        // Insert exactly tab_width spaces for Tab key
-        for (int i = 0; i < config.tab_width; i++) {
-            buffer.insert_char(config.cursor_x, config.cursor_y, ' ');
-            config.cursor_x++;
-        }
+        // Insert exactly tab_width spaces for Tab key, as one edit
+        buffer.insert_text(config.cursor_x, config.cursor_y, std::string(config.tab_width, ' '));
+        config.cursor_x += config.tab_width;
         config.modified = buffer.is_modified();
         
         if (config.debug_mode) {
@@ -255,16 +385,18 @@ void handle_tab(EditorConfig& config, Buffer& buffer) {
  * @param buffer Text buffer
  */
 void handle_save(EditorConfig& config, Buffer& buffer) {
-    if (config.filename.empty()) {
+    // The buffer's own name, so the target cannot drift from what is written
+    const std::string& filename = buffer.get_filename();
+    if (filename.empty()) {
         set_status_message("Error: No filename specified");
         return;
     }
     
     try {
-        if (FileManager::save_file(config.filename, buffer)) {
+        if (FileManager::save_file(filename, buffer)) {
             buffer.set_modified(false);
             config.modified = false;
-            set_status_message("File saved: " + config.filename);
+            set_status_message("File saved: " + filename);
         } else {
             set_status_message("Error: Could not save file");
         }
@@ -282,20 +414,794 @@ void handle_save(EditorConfig& config, Buffer& buffer) {
 void handle_quit(EditorConfig& config, Buffer& buffer, bool force = false) {
     if (!force && config.confirm_quit && buffer.is_modified()) {
         set_status_message("File modified. Use force quit or save first");
+        return;
+    }
+    
+    // Other open buffers may hold unsaved changes too
+    int modified_index = buffer_list.first_modified();
+    if (!force && config.confirm_quit && modified_index >= 0) {
+        const std::string& name = buffer_list.get(modified_index).buffer->get_filename();
+        set_status_message("Buffer " + std::to_string(modified_index + 1) + " (" +
+                           (name.empty() ? "[No Name]" : name) + ") modified. Use force quit or save first");
+        return;
+    }
+    config.quit = true;
+}
+
+/**
+ * Switch the active window to another buffer
+ * @param config Editor configuration
+ * @param index Buffer list index
+ */
+void handle_switch_buffer(EditorConfig& config, int index) {
+    if (!buffer_list.activate(index, window_manager.get_active(), config)) {
+        set_status_message("Error: Could not load buffer " + std::to_string(index + 1));
+        return;
+    }
+    const std::string& name = config.filename.empty() ? "[No Name]" : config.filename;
+    set_status_message("Buffer " + std::to_string(index + 1) + "/" +
+                       std::to_string(buffer_list.count()) + ": " + name);
+}
+
+/**
+ * Undo or redo the last change and move the cursor to it
+ * @param config Editor configuration
+ * @param buffer Text buffer
+ * @param redo True to redo instead of undo
+ */
+void handle_undo(EditorConfig& config, Buffer& buffer, bool redo) {
+    int line = 0;
+    bool done = redo ? buffer.redo(line) : buffer.undo(line);
+    if (!done) {
+        set_status_message(redo ? "Already at newest change" : "Already at oldest change");
+        return;
+    }
+    config.cursor_y = std::min(line, buffer.get_line_count() - 1);
+    config.cursor_x = 0;
+    config.modified = buffer.is_modified();
+    set_status_message(redo ? "Redo" : "Undo");
+}
+
+/**
+ * Handle :trace [on|off|clear|dump [file]]
+ * @param config Editor configuration
+ * @param args Arguments after "trace"
+ */
+void handle_trace(EditorConfig& config, const std::string& args) {
+    if (args.empty()) {
+        set_status_message(std::string("Tracing is ") + (Trace::is_enabled() ? "on" : "off"));
+    } else if (args == "on" || args == "off") {
+        Trace::set_enabled(args == "on");
+        set_status_message("Tracing " + args);
+    } else if (args == "clear") {
+        Trace::clear();
+        set_status_message("Trace cleared");
+    } else if (args == "dump" || args.substr(0, 5) == "dump ") {
+        std::string path = args.length() > 5 ? args.substr(5) : config.trace_file;
+        if (path.empty()) {
+            path = "slowertext-trace.json";
+        }
+        long events = Trace::dump(path);
+        if (events < 0) {
+            set_status_message("Error: Cannot write trace to " + path);
+        } else {
+            set_status_message("Wrote " + std::to_string(events) + " trace events to " + path);
+        }
+    } else {
+        set_status_message("Error: Usage: trace on|off|clear|dump [file]");
+    }
+}
+
+/**
+ * Handle :diffoff
+ * Windows showing a copy of a file read by :diff are closed; windows
+ * showing open buffers stay.
+ * @param config Editor configuration
+ */
+void handle_diffoff(EditorConfig& config) {
+    std::shared_ptr<Buffer> ours = diff_view.get_side(0);
+    std::shared_ptr<Buffer> theirs = diff_view.get_side(1);
+    if (!theirs) {
+        set_status_message("Error: No diff shown");
+        return;
+    }
+    diff_view.stop();
+    window_manager.store_cursor(config);
+    if (buffer_list.index_of(theirs.get()) < 0) {
+        Window* keep = &window_manager.get_active();
+        if (keep->buffer == theirs) {
+            keep = nullptr;
+        }
+        bool closing = true;
+        while (closing) {
+            closing = false;
+            for (const auto& window : window_manager.get_windows()) {
+                if (window->buffer != theirs) {
+                    continue;
+                }
+                window_manager.focus(window.get());
+                if (!window_manager.close_active()) {
+                    // The last window shows the copy itself
+                    window->buffer = ours;
+                    window->dirty = true;
+                    break;
+                }
+                closing = true;
+                break;
+            }
+        }
+        if (keep) {
+            window_manager.focus(keep);
+        }
+
+        // The copy goes away with this function; nothing may still read it
+        if (search_state.active(*theirs)) {
+            search_state.clear();
+        }
+        if (column_view.active(*theirs)) {
+            column_view.clear();
+        }
+        if (cursor_set.active(*theirs)) {
+            cursor_set.clear();
+        }
+    }
+    window_manager.load_cursor(config);
+    set_status_message("Diff off");
+}
+
+/**
+ * Handle :diff [file]
+ * The active window splits: the left window keeps the buffer and the
+ * right one shows what it is compared with, a fresh copy of the file on
+ * disk or the named file's buffer.
+ * @param config Editor configuration
+ * @param buffer Text buffer
+ * @param filename File to compare with, empty for the buffer's own file
+ */
+void handle_diff(EditorConfig& config, Buffer& buffer, const std::string& filename) {
+    std::string name = filename.empty() ? buffer.get_filename() : filename;
+    if (name.empty()) {
+        set_status_message("Error: No file name");
+        return;
+    }
+    if (!FileManager::file_exists(name)) {
+        set_status_message("Error: Cannot read " + name);
+        return;
+    }
+    int index = -1;
+    std::shared_ptr<Buffer> theirs;
+    if (filename.empty()) {
+        theirs = std::make_shared<Buffer>();
+        theirs->set_filename(name);
+        if (!FileManager::load_file(name, *theirs)) {
+            set_status_message("Error: Cannot read " + name);
+            return;
+        }
+    } else {
+        index = buffer_list.open(name);
+        if (buffer_list.get(index).buffer.get() == &buffer) {
+            set_status_message("Error: " + name + " is the current buffer");
+            return;
+        }
+    }
+    if (diff_view.get_side(0)) {
+        handle_diffoff(config);
+    }
+    
+    // The window being split becomes the right one
+    window_manager.store_cursor(config);
+    Window* right = &window_manager.get_active();
+    std::shared_ptr<Buffer> ours = right->buffer;
+    if (!window_manager.split(true)) {
+        set_status_message("Error: Not enough room to split window");
+        return;
+    }
+    Window* left = &window_manager.get_active();
+    if (theirs) {
+        right->buffer = theirs;
+        right->cursor_x = 0;
+        right->col_offset = 0;
+        right->dirty = true;
+    } else {
+        window_manager.focus(right);
+        if (!buffer_list.activate(index, *right, config)) {
+            window_manager.close_active();
+            window_manager.focus(left);
+            window_manager.load_cursor(config);
+            set_status_message("Error: Cannot read " + name);
+            return;
+        }
+        theirs = right->buffer;
+        window_manager.focus(left);
+    }
+    window_manager.load_cursor(config);
+    
+    auto started = std::chrono::steady_clock::now();
+    diff_view.start(ours, theirs);
+    double elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+    char timing[32];
+    snprintf(timing, sizeof(timing), " (%.1f ms)", elapsed_ms);
+    set_status_message(diff_view.describe() + timing);
+}
+
+/**
+ * Get the header of a column of delimited text
+ * @param buffer Text buffer shown in columns
+ * @param field Field index from 0
+ * @return Text of the field in the first row, empty if there is none
+ */
+static std::string column_name(Buffer& buffer, int field) {
+    int start = column_view.field_start(buffer, 0, field);
+    if (start < 0) {
+        return "";
+    }
+    const std::vector<int>& delimiters = column_view.row_delimiters(buffer, 0);
+    std::string header = buffer.get_line(0);
+    size_t end = field < static_cast<int>(delimiters.size()) ? static_cast<size_t>(delimiters[field]) : header.size();
+    return header.substr(start, end - start);
+}
+
+/**
+ * Move the cursor to a column of delimited text and name it
+ * @param config Editor configuration
+ * @param buffer Text buffer shown in columns
+ * @param field Field index from 0
+ * @return False if the cursor row has no such field
+ */
+static bool go_to_column(EditorConfig& config, Buffer& buffer, int field) {
+    int col = column_view.field_start(buffer, config.cursor_y, field);
+    if (col < 0) {
+        return false;
+    }
+    config.cursor_x = col;
+    std::string name = column_name(buffer, field);
+    set_status_message("Column " + std::to_string(field + 1) + (name.empty() ? "" : ": " + name));
+    return true;
+}
+
+/**
+ * Handle :csv [delimiter|tab|off]
+ * Without a delimiter the most frequent of , tab ; and | in the first
+ * row is used.
+ * @param config Editor configuration
+ * @param buffer Text buffer
+ * @param args Arguments after "csv"
+ */
+void handle_csv(EditorConfig& config, Buffer& buffer, const std::string& args) {
+    char separator = 0;
+    if (args == "off") {
+        if (!column_view.active(buffer)) {
+            set_status_message("Error: Columns are not shown");
+            return;
+        }
+        column_view.clear();
+    } else if (args.empty()) {
+        separator = ColumnView::detect_delimiter(buffer);
+    } else if (args == "tab" || args == "\\t") {
+        separator = '\t';
+    } else if (args.size() == 1 && args[0] != '"') {
+        separator = args[0];
+    } else {
+        set_status_message("Error: Usage: csv [delimiter|tab|off]");
+        return;
+    }
+    
+    // Horizontal scroll counts laid out columns in one mode and buffer
+    // columns in the other
+    for (const auto& window : window_manager.get_windows()) {
+        if (window->buffer.get() == &buffer) {
+            window->col_offset = 0;
+        }
+    }
+    config.col_offset = 0;
+    if (!separator) {
+        set_status_message("Columns off");
+        return;
+    }
+    column_view.start(buffer, separator);
+    int fields = static_cast<int>(column_view.row_delimiters(buffer, 0).size()) + 1;
+    set_status_message("Columns split on " + (separator == '\t' ? std::string("tab") : "'" + std::string(1, separator) + "'") +
+                       ", " + std::to_string(fields) + " in the header");
+}
+
+/**
+ * Handle :col [N|name]
+ * Goes to column N (from 1) or to the column headed name in the cursor
+ * row; without an argument names the column under the cursor.
+ * @param config Editor configuration
+ * @param buffer Text buffer
+ * @param args Arguments after "col"
+ */
+void handle_column(EditorConfig& config, Buffer& buffer, const std::string& args) {
+    if (!column_view.active(buffer)) {
+        set_status_message("Error: Columns are not shown (use :csv)");
+        return;
+    }
+    int field = -1;
+    if (args.empty()) {
+        field = column_view.field_at(buffer, config.cursor_y, config.cursor_x);
+        std::string name = column_name(buffer, field);
+        set_status_message("Column " + std::to_string(field + 1) + " of " +
+                           std::to_string(column_view.row_delimiters(buffer, config.cursor_y).size() + 1) +
+                           (name.empty() ? "" : ": " + name));
+        return;
+    }
+    if (args.find_first_not_of("0123456789") == std::string::npos && args.size() < 9) {
+        field = std::stoi(args) - 1;
+    } else {
+        int count = static_cast<int>(column_view.row_delimiters(buffer, 0).size()) + 1;
+        for (int i = 0; i < count && field < 0; i++) {
+            if (column_name(buffer, i) == args) {
+                field = i;
+            }
+        }
+        if (field < 0) {
+            set_status_message("Error: No column named " + args);
+            return;
+        }
+    }
+    if (!go_to_column(config, buffer, field)) {
+        set_status_message("Error: Row has no column " + args);
+    }
+}
+
+/**
+ * Handle the key after ] or [
+ * ]c / [c go to the next / previous diff hunk and ]f / [f to the next /
+ * previous field of delimited text.
+ * @param config Editor configuration
+ * @param buffer Text buffer
+ * @param prefix The ] or [ key
+ * @param c Motion key
+ */
+void handle_bracket_key(EditorConfig& config, Buffer& buffer, int prefix, int c) {
+    bool forward = (prefix == ']');
+    if (c == 'f') {
+        if (!column_view.active(buffer)) {
+            set_status_message("Error: Columns are not shown (use :csv)");
+            return;
+        }
+        int field = column_view.field_at(buffer, config.cursor_y, config.cursor_x) + (forward ? 1 : -1);
+        if (!go_to_column(config, buffer, field)) {
+            set_status_message(forward ? "No later field" : "No earlier field");
+        }
+        return;
+    }
+    if (c != 'c') {
+        set_status_message(c == ESC_KEY ? "" : "Error: Use ]c, [c, ]f or [f");
+        return;
+    }
+    int target = 0;
+    if (!diff_view.next_change(buffer, config.cursor_y, forward, target)) {
+        set_status_message(forward ? "No later change" : "No earlier change");
+        return;
+    }
+    buffer.push_jump(config.cursor_x, config.cursor_y);
+    buffer.set_folds(target, target, false);
+    config.cursor_x = 0;
+    config.cursor_y = target;
+}
+
+/**
+ * Handle the key after m (set mark) or ' and ` (go to mark)
+ * ' goes to the first non-blank of the mark's line, ` to its column.
+ * @param config Editor configuration
+ * @param buffer Text buffer
+ * @param prefix The m, ' or ` key
+ * @param c Mark name key
+ */
+void handle_mark_key(EditorConfig& config, Buffer& buffer, int prefix, int c) {
+    if (c < 'a' || c > 'z') {
+        set_status_message(c == ESC_KEY ? "" : "Error: Marks are a-z");
+        return;
+    }
+    char name = static_cast<char>(c);
+    if (prefix == 'm') {
+        buffer.set_mark(name, config.cursor_x, config.cursor_y);
+        set_status_message(std::string("Mark ") + name + " set");
+        return;
+    }
+    
+    int x = 0;
+    int y = 0;
+    if (!buffer.get_mark(name, x, y)) {
+        set_status_message(std::string("Error: Mark ") + name + " not set");
+        return;
+    }
+    if (prefix == '\'') {
+        LineView line = buffer.view_line(y);
+        x = 0;
+        while (static_cast<size_t>(x) < line.length() && (line[x] == ' ' || line[x] == '\t')) {
+            x++;
+        }
+    }
+    buffer.push_jump(config.cursor_x, config.cursor_y);
+    buffer.set_folds(y, y, false);
+    config.cursor_x = x;
+    config.cursor_y = y;
+}
+
+/**
+ * Move the cursor through the jump list
+ * @param config Editor configuration
+ * @param buffer Text buffer
+ * @param back True for older entries
+ */
+void handle_jump(EditorConfig& config, Buffer& buffer, bool back) {
+    int x = config.cursor_x;
+    int y = config.cursor_y;
+    bool moved = back ? buffer.jump_back(x, y) : buffer.jump_forward(x, y);
+    if (!moved) {
+        set_status_message(back ? "At oldest jump" : "At newest jump");
+        return;
+    }
+    buffer.set_folds(y, y, false);
+    config.cursor_x = x;
+    config.cursor_y = y;
+}
+
+/**
+ * Handle the key after z (fold commands)
+ * za toggles, zo opens, zc closes the fold at the cursor; zR opens and
+ * zM closes every fold; zd deletes the manual fold at the cursor and zE
+ * every fold.
+ * @param config Editor configuration
+ * @param buffer Text buffer
+ * @param c Fold command key
+ */
+void handle_fold_key(EditorConfig& config, Buffer& buffer, int c) {
+    Fold fold;
+    bool done = true;
+    if (c == 'a') {
+        done = buffer.closed_fold(config.cursor_y, fold) ? buffer.open_fold(config.cursor_y)
+                                                        : buffer.close_fold(config.cursor_y);
+    } else if (c == 'o') {
+        done = buffer.open_fold(config.cursor_y);
+    } else if (c == 'c') {
+        done = buffer.close_fold(config.cursor_y);
+    } else if (c == 'R') {
+        buffer.set_all_folds(false);
+    } else if (c == 'M') {
+        buffer.set_all_folds(true);
+    } else if (c == 'd' || c == 'E') {
+        if (buffer.get_fold_method() != FOLD_MANUAL) {
+            set_status_message("Error: Cannot delete folds with foldmethod indent");
+            return;
+        }
+        if (c == 'E') {
+            buffer.clear_folds();
+        } else {
+            done = buffer.delete_fold(config.cursor_y);
+        }
+    } else {
+        set_status_message(c == ESC_KEY ? "" : "Error: Unknown fold command");
+        return;
+    }
+    if (!done) {
+        set_status_message("No fold found");
+        return;
+    }
+    
+    // Closing a fold moves the cursor to its first line
+    if (buffer.closed_fold(config.cursor_y, fold)) {
+        config.cursor_y = fold.start;
+        config.cursor_x = 0;
+    }
+}
+
+/**
+ * Handle an editing key while extra cursors are active
+ * The key is applied at the primary and every extra cursor as one edit.
+ * @param config Editor configuration
+ * @param buffer Text buffer
+ * @param c Key code
+ * @return False if the key does not edit or move
+ */
+bool handle_cursors_key(EditorConfig& config, Buffer& buffer, int c) {
+    if (c == '\t') {
+        cursor_set.apply(config, buffer, CURSOR_INSERT, std::string(config.tab_width, ' '));
+    } else if (c == '\r' || c == '\n') {
+        cursor_set.apply(config, buffer, CURSOR_NEWLINE, "");
+    } else if (c == BACKSPACE_KEY || c == 127 || c == 8 || c == CTRL_KEY('h')) {
+        cursor_set.apply(config, buffer, CURSOR_BACKSPACE, "");
+    } else if (c == DELETE_KEY) {
+        cursor_set.apply(config, buffer, CURSOR_DELETE, "");
+    } else if (c == ARROW_UP || c == ARROW_DOWN || c == ARROW_LEFT || c == ARROW_RIGHT) {
+        handle_cursor_movement(config, buffer, c);
+        cursor_set.move(buffer, c);
+    } else if (c >= 32 && c <= 255) {
+        cursor_set.apply(config, buffer, CURSOR_INSERT, std::string(1, static_cast<char>(c)));
     } else {
-        config.quit = true;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Add a cursor at the next match of the last search
+ * The primary cursor leaves an extra cursor behind and moves to the match.
+ * @param config Editor configuration
+ * @param buffer Text buffer
+ */
+void handle_add_cursor(EditorConfig& config, Buffer& buffer) {
+    const std::string& pattern = search_state.get_pattern();
+    if (pattern.empty()) {
+        set_status_message("No previous search");
+        return;
     }
+    int line = config.cursor_y;
+    int col = config.cursor_x;
+    if (!SearchState::find_next(buffer, pattern, line, col, true, 0) ||
+        (line == config.cursor_y && col == config.cursor_x) || cursor_set.has(buffer, col, line)) {
+        set_status_message("Every match has a cursor");
+        return;
+    }
+    cursor_set.add(buffer, config.cursor_x, config.cursor_y);
+    buffer.set_folds(line, line, false);
+    config.cursor_y = line;
+    config.cursor_x = col;
+    set_status_message(std::to_string(cursor_set.count(buffer) + 1) + " cursors");
 }
 
 /**
- * Check if a key matches a configured key binding
- * @param key The pressed key
- * @param binding_key The configured key binding
- * @return True if they match
+ * Describe register text for messages, like "3 lines" or "block of 2 lines"
+ * @param text Register text
+ * @return Description
  */
-bool key_matches_binding(int key, const std::string& binding_key) {
-    int parsed_key = ConfigManager::parse_key_binding(binding_key);
-    return key == parsed_key;
+static std::string describe_register(const Register& text) {
+    size_t rows = text.pieces.size();
+    std::string lines = std::to_string(rows) + (rows == 1 ? " line" : " lines");
+    if (text.kind == SELECT_BLOCK) {
+        return "block of " + lines;
+    }
+    if (text.kind == SELECT_CHARS && rows == 1) {
+        size_t count = text.pieces[0].size();
+        return std::to_string(count) + (count == 1 ? " character" : " characters");
+    }
+    return lines;
+}
+
+/**
+ * Start visual mode, or change the shape of the selection
+ * Pressing the key of the current shape again leaves visual mode.
+ * @param config Editor configuration
+ * @param kind Shape chosen by v, V or Ctrl-V
+ */
+void handle_visual_start(EditorConfig& config, SelectionKind kind) {
+    static const char* names[] = {"Visual mode", "Visual line mode", "Visual block mode"};
+    if (config.mode == VISUAL_MODE && config.visual_kind == kind) {
+        config.mode = COMMAND_MODE;
+        set_status_message("");
+        return;
+    }
+    if (config.mode != VISUAL_MODE) {
+        config.visual_x = config.cursor_x;
+        config.visual_y = config.cursor_y;
+    }
+    config.mode = VISUAL_MODE;
+    config.visual_kind = kind;
+    set_status_message(names[kind]);
+}
+
+/**
+ * Handle a key in visual mode
+ * Arrows extend the selection from where it started to the cursor and o
+ * jumps to its other end; y yanks it and d or x delete it into a
+ * register, leaving the cursor at its start. Escape cancels.
+ * @param config Editor configuration
+ * @param buffer Text buffer
+ * @param c Key code
+ * @param name Register chosen with ", '"' for none
+ */
+void handle_visual_key(EditorConfig& config, Buffer& buffer, int c, char name) {
+    if (c == ARROW_UP || c == ARROW_DOWN || c == ARROW_LEFT || c == ARROW_RIGHT) {
+        handle_cursor_movement(config, buffer, c);
+        return;
+    }
+    if (c == 'v' || c == 'V' || c == CTRL_KEY('v')) {
+        handle_visual_start(config, c == 'v' ? SELECT_CHARS : (c == 'V' ? SELECT_LINES : SELECT_BLOCK));
+        return;
+    }
+    if (c == 'o') {
+        std::swap(config.visual_x, config.cursor_x);
+        std::swap(config.visual_y, config.cursor_y);
+        return;
+    }
+    if (c == ESC_KEY) {
+        config.mode = COMMAND_MODE;
+        set_status_message("");
+        return;
+    }
+    if (c != 'y' && c != 'd' && c != 'x') {
+        set_status_message("Invalid visual mode key");
+        return;
+    }
+    
+    // The selection's first corner, where the cursor is left
+    int first_x = std::min(config.visual_x, config.cursor_x);
+    int first_y = std::min(config.visual_y, config.cursor_y);
+    if (config.visual_kind != SELECT_BLOCK && config.visual_y != config.cursor_y) {
+        first_x = (config.visual_y < config.cursor_y) ? config.visual_x : config.cursor_x;
+    }
+    if (config.visual_kind == SELECT_LINES) {
+        first_x = 0;
+    }
+    
+    Register text;
+    buffer.yank(config.visual_x, config.visual_y, config.cursor_x, config.cursor_y, config.visual_kind, text);
+    std::string description = describe_register(text);
+    if (c == 'y') {
+        Registers::store(name, std::move(text), true);
+        set_status_message(description + " yanked");
+    } else {
+        buffer.delete_region(config.visual_x, config.visual_y, config.cursor_x, config.cursor_y, config.visual_kind);
+        Registers::store(name, std::move(text), false);
+        config.modified = buffer.is_modified();
+        set_status_message(description + " deleted");
+    }
+    config.mode = COMMAND_MODE;
+    config.cursor_y = std::min(first_y, buffer.get_line_count() - 1);
+    config.cursor_x = first_x;
+}
+
+/**
+ * Put a register after or before the cursor (p and P)
+ * Lines go below or above the cursor row, characters and blocks after
+ * or at the cursor column.
+ * @param config Editor configuration
+ * @param buffer Text buffer
+ * @param name Register chosen with ", '"' for none
+ * @param after True for p, false for P
+ */
+void handle_put(EditorConfig& config, Buffer& buffer, char name, bool after) {
+    std::shared_ptr<const Register> text = Registers::get(name);
+    if (!text || text->pieces.empty()) {
+        set_status_message(std::string("Error: Register ") + name + " is empty");
+        return;
+    }
+    if (text->kind == SELECT_LINES) {
+        int y = after ? buffer.next_visible(config.cursor_y) : config.cursor_y;
+        buffer.put(0, y, *text);
+        config.cursor_y = y;
+        config.cursor_x = 0;
+    } else {
+        int x = config.cursor_x;
+        if (after && x < static_cast<int>(buffer.view_line(config.cursor_y).length())) {
+            x++;
+        }
+        buffer.put(x, config.cursor_y, *text);
+        config.cursor_x = x;
+    }
+    config.modified = buffer.is_modified();
+    if (text->pieces.size() > 1) {
+        set_status_message(describe_register(*text) + " put");
+    }
+}
+
+// Incremental search prompt state
+static bool in_search_input = false;
+static bool search_forward = true;
+static int search_origin_x = 0;
+static int search_origin_y = 0;
+static std::string search_pattern;
+
+// Lines examined synchronously per keystroke before leaving the rest
+// of the work to the background scan
+static const int SEARCH_SYNC_LINES = 200000;
+
+/**
+ * Move the cursor to the next match of the current search
+ * @param config Editor configuration
+ * @param buffer Text buffer
+ * @param forward Search direction
+ */
+void handle_search_next(EditorConfig& config, Buffer& buffer, bool forward) {
+    const std::string& pattern = search_state.get_pattern();
+    if (pattern.empty()) {
+        set_status_message("No previous search");
+        return;
+    }
+    
+    int line = config.cursor_y;
+    int col = config.cursor_x;
+    if (SearchState::find_next(buffer, pattern, line, col, forward, 0)) {
+        buffer.push_jump(config.cursor_x, config.cursor_y);
+        buffer.set_folds(line, line, false);
+        config.cursor_y = line;
+        config.cursor_x = col;
+        search_state.set_report(true);
+        set_status_message(search_state.describe(line, col));
+    } else {
+        set_status_message("Pattern not found: " + pattern);
+    }
+}
+
+/**
+ * Handle a key typed at the search prompt
+ * Each change of the pattern jumps to the first match from where the
+ * search started and restarts the background scan for all matches
+ * @param config Editor configuration
+ * @param buffer Text buffer
+ * @param c Key code
+ */
+void handle_search_input(EditorConfig& config, Buffer& buffer, int c) {
+    const char prompt = search_forward ? '/' : '?';
+    
+    if (c == '\r' || c == '\n') {
+        // Accept: stay on the match and keep highlights
+        in_search_input = false;
+        if (!search_pattern.empty()) {
+            buffer.push_jump(search_origin_x, search_origin_y);
+        }
+        search_state.set_report(true);
+        set_status_message(search_pattern.empty() ? "" :
+                           search_state.describe(config.cursor_y, config.cursor_x));
+        return;
+    }
+    
+    if (c == ESC_KEY) {
+        // Cancel: restore cursor and drop highlights
+        in_search_input = false;
+        config.cursor_x = search_origin_x;
+        config.cursor_y = search_origin_y;
+        search_state.clear();
+        set_status_message("");
+        return;
+    }
+    
+    if (c == BACKSPACE_KEY || c == 127 || c == 8) {
+        if (search_pattern.empty()) {
+            return;
+        }
+        search_pattern.pop_back();
+    } else if (c >= 32 && c <= 126) {
+        search_pattern += static_cast<char>(c);
+    } else {
+        return;
+    }
+    
+    search_state.start(buffer, search_pattern);
+    config.cursor_x = search_origin_x;
+    config.cursor_y = search_origin_y;
+    
+    int line = search_origin_y;
+    int col = search_origin_x;
+    if (!search_pattern.empty() &&
+        SearchState::find_next(buffer, search_pattern, line, col, search_forward, SEARCH_SYNC_LINES)) {
+        buffer.set_folds(line, line, false);
+        config.cursor_y = line;
+        config.cursor_x = col;
+    }
+    set_status_message(std::string(1, prompt) + search_pattern);
+}
+
+/**
+ * Key codes of the configured bindings
+ * Parsed once per configuration instead of on every keypress.
+ */
+struct KeyTable {
+    int enter_insert;
+    int enter_command;
+    int save_file;
+    int quit_editor;
+    int force_quit;
+};
+
+static KeyTable key_table;
+static bool key_table_applied = false;
+
+/**
+ * Parse the configured key bindings into key codes
+ * Called at startup and whenever the configuration changes
+ * @param config Editor configuration
+ */
+void InputHandler::apply_config(const EditorConfig& config) {
+    key_table.enter_insert = ConfigManager::parse_key_binding(config.enter_insert);
+    key_table.enter_command = ConfigManager::parse_key_binding(config.enter_command);
+    key_table.save_file = ConfigManager::parse_key_binding(config.save_file);
+    key_table.quit_editor = ConfigManager::parse_key_binding(config.quit_editor);
+    key_table.force_quit = ConfigManager::parse_key_binding(config.force_quit);
+    key_table_applied = true;
 }
 
 /**
@@ -307,6 +1213,11 @@ bool key_matches_binding(int key, const std::string& binding_key) {
 void InputHandler::process_keypress(EditorConfig& config, Buffer& buffer) {
     static std::string command_buffer = "";
     static bool in_command_input = false;
+    static int mark_prefix = 0;  // m, ' or ` waiting for a mark name
+    static bool fold_prefix = false;  // z waiting for a fold command
+    static bool register_prefix = false;  // " waiting for a register name
+    static int bracket_prefix = 0;  // ] or [ waiting for c or f
+    static char register_name = '"';  // Register for the next yank, delete or put
     
     try {
         int c = read_key();
@@ -314,34 +1225,44 @@ void InputHandler::process_keypress(EditorConfig& config, Buffer& buffer) {
             set_status_message("Error: Invalid key input");
             return;
         }
+        TraceSpan span(TRACE_KEY);
+        span.a = c;
+        if (!key_table_applied) {
+            apply_config(config);
+        }
 
         // Handle keys based on current mode
         if (config.mode == INSERT_MODE) {
             // INSERT MODE HANDLING
             
             // Check for mode switching to command mode first
-            if (key_matches_binding(c, config.enter_command)) {
+            if (c == key_table.enter_command) {
                 config.mode = COMMAND_MODE;
                 set_status_message("Command mode");
                 return;
             }
             
             // Check for save/quit operations
-            if (key_matches_binding(c, config.save_file)) {
+            if (c == key_table.save_file) {
                 handle_save(config, buffer);
                 return;
             }
             
-            if (key_matches_binding(c, config.quit_editor)) {
+            if (c == key_table.quit_editor) {
                 handle_quit(config, buffer);
                 return;
             }
             
-            if (key_matches_binding(c, config.force_quit)) {
+            if (c == key_table.force_quit) {
                 handle_quit(config, buffer, true);
                 return;
             }
             
+            // With extra cursors, editing keys apply at every cursor at once
+            if (cursor_set.active(buffer) && handle_cursors_key(config, buffer, c)) {
+                return;
+            }
+            
             // Handle special keys with higher priority than key bindings
             if (c == '\t') {
                 // Tab key always inserts spaces in insert mode
@@ -371,7 +1292,7 @@ void InputHandler::process_keypress(EditorConfig& config, Buffer& buffer) {
             }
             
             // Check for insert mode key binding (but not if it conflicts with tab)
-            if (key_matches_binding(c, config.enter_insert) && c != '\t') {
+            if (c == key_table.enter_insert && c != '\t') {
                 set_status_message("Already in Insert mode");
                 return;
             }
@@ -409,30 +1330,47 @@ void InputHandler::process_keypress(EditorConfig& config, Buffer& buffer) {
         } else if (config.mode == COMMAND_MODE) {
             // COMMAND MODE HANDLING
             
-            if (key_matches_binding(c, config.enter_insert)) {
-                config.mode = INSERT_MODE;
-                set_status_message("Insert mode");
+            if (in_search_input) {
+                handle_search_input(config, buffer, c);
                 return;
             }
             
-            if (c == ':') {
-                in_command_input = true;
-                command_buffer = "";
+            if (mark_prefix != 0) {
+                handle_mark_key(config, buffer, mark_prefix, c);
+                mark_prefix = 0;
                 return;
             }
             
-            if (key_matches_binding(c, config.quit_editor)) {
-                handle_quit(config, buffer);
+            if (fold_prefix) {
+                handle_fold_key(config, buffer, c);
+                fold_prefix = false;
                 return;
             }
             
-            if (key_matches_binding(c, config.force_quit)) {
-                handle_quit(config, buffer, true);
+            if (bracket_prefix != 0) {
+                handle_bracket_key(config, buffer, bracket_prefix, c);
+                bracket_prefix = 0;
                 return;
             }
             
+            if (register_prefix) {
+                register_prefix = false;
+                if (c < 256 && Registers::valid(static_cast<char>(c))) {
+                    register_name = static_cast<char>(c);
+                    set_status_message(std::string("\"") + register_name);
+                } else {
+                    set_status_message(c == ESC_KEY ? "" : "Error: Registers are \", 0, a-z and A-Z");
+                }
+                return;
+            }
+            
+            // A register applies to the next command only
+            char register_used = register_name;
+            register_name = '"';
+            
             if (in_command_input) {
-                // Handle command input
+                // Handle command input before any key bindings so that
+                // commands may contain ':' and other bound characters
                 if (c == '\r' || c == '\n') {
                     in_command_input = false;
                     try {
@@ -440,15 +1378,80 @@ void InputHandler::process_keypress(EditorConfig& config, Buffer& buffer) {
                     } catch (const std::exception& e) {
                         set_status_message("Error processing command: " + std::string(e.what()));
                     }
+                } else if (c == ESC_KEY) {
+                    in_command_input = false;
+                    set_status_message("");
                 } else if ((c == BACKSPACE_KEY || c == 127 || c == 8) && !command_buffer.empty()) {
                     command_buffer.pop_back();
                 } else if (c >= 32 && c <= 126) {
                     // Accept printable ASCII characters for commands
                     command_buffer += static_cast<char>(c);
                 }
+            } else if (c == key_table.enter_insert) {
+                config.mode = INSERT_MODE;
+                set_status_message("Insert mode");
+                return;
+            } else if (c == ':') {
+                in_command_input = true;
+                command_buffer = "";
+            } else if (c == '/' || c == '?') {
+                // Start incremental search from the cursor
+                in_search_input = true;
+                search_forward = (c == '/');
+                search_origin_x = config.cursor_x;
+                search_origin_y = config.cursor_y;
+                search_pattern = "";
+                search_state.clear();
+                set_status_message(std::string(1, static_cast<char>(c)));
+                return;
+            } else if (c == key_table.quit_editor) {
+                handle_quit(config, buffer);
+                return;
+            } else if (c == key_table.force_quit) {
+                handle_quit(config, buffer, true);
+                return;
+            } else if (c == 'u' || c == CTRL_KEY('r')) {
+                // Undo / redo last change
+                handle_undo(config, buffer, c == CTRL_KEY('r'));
+            } else if (c == 'n' || c == 'N') {
+                // Repeat last search, N reverses direction
+                handle_search_next(config, buffer, (c == 'n') == search_forward);
+            } else if (c == 'm' || c == '\'' || c == '`') {
+                // Set or go to a mark named by the next key
+                mark_prefix = c;
+            } else if (c == 'z') {
+                // Fold command named by the next key
+                fold_prefix = true;
+            } else if (c == ']' || c == '[') {
+                // Next / previous diff hunk (]c / [c) or field (]f / [f)
+                bracket_prefix = c;
+            } else if (c == CTRL_KEY('o') || c == CTRL_KEY('p')) {
+                // Older / newer position in the jump list
+                handle_jump(config, buffer, c == CTRL_KEY('o'));
+            } else if (c == CTRL_KEY('n')) {
+                // Add a cursor at the next search match
+                handle_add_cursor(config, buffer);
+            } else if (c == '"') {
+                // Register named by the next key
+                register_prefix = true;
+            } else if (c == 'v' || c == 'V' || c == CTRL_KEY('v')) {
+                // Select characters, lines or a block
+                handle_visual_start(config, c == 'v' ? SELECT_CHARS : (c == 'V' ? SELECT_LINES : SELECT_BLOCK));
+            } else if (c == 'p' || c == 'P') {
+                // Put a register after / before the cursor
+                handle_put(config, buffer, register_used, c == 'p');
+            } else if (c == ESC_KEY && cursor_set.active(buffer)) {
+                cursor_set.clear();
+                set_status_message("Extra cursors removed");
             } else if (c == ARROW_UP || c == ARROW_DOWN || c == ARROW_LEFT || c == ARROW_RIGHT) {
-                // Allow cursor movement in command mode
+                // Allow cursor movement in command mode, extra cursors too
                 handle_cursor_movement(config, buffer, c);
+                cursor_set.move(buffer, c);
+            } else if (c == CTRL_KEY('w')) {
+                // Move focus to the next window
+                window_manager.store_cursor(config);
+                window_manager.cycle(1);
+                window_manager.load_cursor(config);
             } else {
                 if (config.debug_mode) {
                     set_status_message("Command mode key: " + std::to_string(c));
@@ -456,6 +1459,32 @@ void InputHandler::process_keypress(EditorConfig& config, Buffer& buffer) {
                     set_status_message("Invalid command mode key");
                 }
             }
+        } else if (config.mode == VISUAL_MODE) {
+            // VISUAL MODE HANDLING
+            
+            if (register_prefix) {
+                register_prefix = false;
+                if (c < 256 && Registers::valid(static_cast<char>(c))) {
+                    register_name = static_cast<char>(c);
+                } else {
+                    set_status_message(c == ESC_KEY ? "" : "Error: Registers are \", 0, a-z and A-Z");
+                }
+                return;
+            }
+            
+            if (c == '"') {
+                register_prefix = true;
+            } else if (c == ':') {
+                // Ex command over the selected lines
+                int first = std::min(config.visual_y, config.cursor_y);
+                int last = std::max(config.visual_y, config.cursor_y);
+                config.mode = COMMAND_MODE;
+                in_command_input = true;
+                command_buffer = std::to_string(first + 1) + "," + std::to_string(last + 1);
+            } else {
+                handle_visual_key(config, buffer, c, register_name);
+                register_name = '"';
+            }
         }
 
         // Update status message for command input
@@ -475,6 +1504,7 @@ void InputHandler::process_keypress(EditorConfig& config, Buffer& buffer) {
  * @param command Command string to process
  */
 void InputHandler::process_command(EditorConfig& config, Buffer& buffer, const std::string& command) {
+    TraceSpan span(TRACE_COMMAND, command.c_str());
     try {
         if (command == "q") {
             // Quit command
@@ -487,14 +1517,15 @@ void InputHandler::process_command(EditorConfig& config, Buffer& buffer, const s
             handle_save(config, buffer);
         } else if (command == "wq" || command == "sq") {
             // Save and quit command
-            if (config.filename.empty()) {
+            if (buffer.get_filename().empty()) {
                 set_status_message("Error: No filename specified");
                 return;
             }
-            if (FileManager::save_file(config.filename, buffer)) {
+            if (FileManager::save_file(buffer.get_filename(), buffer)) {
                 buffer.set_modified(false);
                 config.modified = false;
-                config.quit = true;
+                // Other buffers may still hold unsaved changes
+                handle_quit(config, buffer);
             } else {
                 set_status_message("Error: Could not save file");
             }
@@ -507,13 +1538,107 @@ void InputHandler::process_command(EditorConfig& config, Buffer& buffer, const s
             }
             if (FileManager::save_file(filename, buffer)) {
                 config.filename = filename;
+                buffer.set_filename(filename);
                 buffer.set_modified(false);
                 config.modified = false;
                 set_status_message("File saved as: " + filename);
             } else {
                 set_status_message("Error: Could not save file as " + filename);
             }
-        } else {
+        } else if (command == "split" || command == "sp" || command == "vsplit" || command == "vs") {
+            // Split the active window, both views share the buffer
+            bool vertical = (command[0] == 'v');
+            window_manager.store_cursor(config);
+            if (window_manager.split(vertical)) {
+                window_manager.load_cursor(config);
+            } else {
+                set_status_message("Error: Not enough room to split window");
+            }
+        } else if (command == "close" || command == "clo") {
+            // Close the active window
+            window_manager.store_cursor(config);
+            if (window_manager.close_active()) {
+                window_manager.load_cursor(config);
+            } else {
+                set_status_message("Error: Cannot close last window");
+            }
+        } else if (command.substr(0, 2) == "e " && command.length() > 2) {
+            // Edit a file in the active window, reusing an open buffer
+            std::string filename = command.substr(2);
+            handle_switch_buffer(config, buffer_list.open(filename));
+        } else if (command == "bn" || command == "bp") {
+            // Cycle through open buffers
+            int count = buffer_list.count();
+            int current = buffer_list.index_of(&buffer);
+            int step = (command == "bn") ? 1 : -1;
+            handle_switch_buffer(config, ((current + step) % count + count) % count);
+        } else if (command.substr(0, 2) == "b " && command.length() > 2) {
+            // Switch to buffer by number
+            const char* digits = command.c_str() + 2;
+            char* end = nullptr;
+            errno = 0;
+            long parsed = strtol(digits, &end, 10);
+            if (end == digits || *end != '\0' || errno == ERANGE) {
+                set_status_message("Error: Usage: :b N");
+                return;
+            }
+            if (parsed < 1 || parsed > buffer_list.count()) {
+                set_status_message("Error: No buffer " + std::to_string(parsed));
+                return;
+            }
+            handle_switch_buffer(config, static_cast<int>(parsed) - 1);
+        } else if (command == "ls" || command == "buffers") {
+            // List open buffers: % marks current, * modified, - evicted
+            std::string listing;
+            for (int i = 0; i < buffer_list.count(); i++) {
+                const BufferEntry& entry = buffer_list.get(i);
+                const std::string& name = entry.buffer->get_filename();
+                listing += std::to_string(i + 1);
+                listing += (entry.buffer.get() == &buffer) ? "%" : "";
+                listing += entry.buffer->is_modified() ? "*" : "";
+                listing += entry.resident ? "" : "-";
+                listing += ":" + (name.empty() ? std::string("[No Name]") : name) + " ";
+            }
+            listing += "(" + std::to_string(buffer_list.resident_memory() / 1024) + " KB resident)";
+            set_status_message(listing);
+        } else if (command == "u" || command == "undo") {
+            handle_undo(config, buffer, false);
+        } else if (command == "redo") {
+            handle_undo(config, buffer, true);
+        } else if (command == "diff" || command.substr(0, 5) == "diff ") {
+            // Compare with the file on disk or another file
+            handle_diff(config, buffer, command.length() > 5 ? command.substr(5) : "");
+        } else if (command == "diffoff") {
+            handle_diffoff(config);
+        } else if (command == "csv" || command.substr(0, 4) == "csv ") {
+            // Show delimited text in aligned columns
+            handle_csv(config, buffer, command.length() > 4 ? command.substr(4) : "");
+        } else if (command == "col" || command.substr(0, 4) == "col ") {
+            handle_column(config, buffer, command.length() > 4 ? command.substr(4) : "");
+        } else if (command == "only" || command == "on") {
+            // Keep only the active window
+            window_manager.store_cursor(config);
+            window_manager.only();
+        } else if (command == "trace" || command.substr(0, 6) == "trace ") {
+            handle_trace(config, command.length() > 6 ? command.substr(6) : "");
+        } else if (command == "perf") {
+#ifdef PERF_OVERLAY
+            // Toggle the overlay; hiding it repaints the text underneath
+            PerfMonitor::set_visible(!PerfMonitor::is_visible());
+            window_manager.invalidate();
+            set_status_message(PerfMonitor::is_visible() ? "Performance overlay on" : "Performance overlay off");
+#else
+            set_status_message("Error: Performance overlay not built in (use make perf)");
+#endif
+        } else if (command == "detach") {
+            // Leave the server with every buffer, saved or not, kept warm
+            if (Server::is_attached()) {
+                config.quit = true;
+            } else {
+                set_status_message("Error: Not attached to a server");
+            }
+        } else if (!ExCommand::execute(config, buffer, command)) {
+            // Ranges, line numbers, :d, :m, :t, :j, :s, :g and marks
             set_status_message("Unknown command: " + command);
         }
     } catch (const std::exception& e) {
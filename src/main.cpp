@@ -4,6 +4,12 @@
 // Global instances
 EditorConfig editor_config;
 Terminal terminal;
+WindowManager window_manager;
+BufferList buffer_list;
+SearchState search_state;
+CursorSet cursor_set;
+DiffView diff_view;
+ColumnView column_view;
 
 /**
  * Handle window resize signal (SIGWINCH)
@@ -17,8 +23,14 @@ void handle_sigwinch(int sig) {
 
 /**
  * Cleanup resources and restore terminal state before exit
+ * Runs once; later calls (such as the atexit handler) do nothing
  */
 void cleanup_and_exit() {
+    static bool cleaned = false;
+    if (cleaned) {
+        return;
+    }
+    cleaned = true;
     terminal.clear_screen();
     terminal.set_cursor_position(0, 0);
     terminal.show_cursor();
@@ -26,8 +38,9 @@ void cleanup_and_exit() {
 
 /**
  * Initialize editor configuration and terminal settings
+ * @param interactive False for headless scripts, which never touch the terminal
  */
-void init_editor() {
+void init_editor(bool interactive) {
     // Initialize cursor and scroll positions
     editor_config.cursor_x = 0;
     editor_config.cursor_y = 0;
@@ -36,6 +49,9 @@ void init_editor() {
     
     // Initialize editor state
     editor_config.mode = INSERT_MODE; // Will be overridden by config if specified
+    editor_config.visual_kind = SELECT_CHARS;
+    editor_config.visual_x = 0;
+    editor_config.visual_y = 0;
     editor_config.filename = "";
     editor_config.modified = false;
     editor_config.quit = false;
@@ -44,26 +60,30 @@ void init_editor() {
 
     // Load configuration from RC file
     ConfigManager::load_config(editor_config);
+
+    // Tracing replaces debug output, which would draw over the editor
+    Trace::set_enabled(editor_config.trace_events);
+    if (!editor_config.trace_file.empty()) {
+        Trace::set_exit_dump(editor_config.trace_file);
+    }
     
-    // Debug output to verify configuration loading
-    if (editor_config.debug_mode) {
-        std::cerr << "Debug: Configuration loaded successfully\n";
-        std::cerr << "Debug: tab_width = " << editor_config.tab_width << "\n";
-        std::cerr << "Debug: show_line_numbers = " << (editor_config.show_line_numbers ? "true" : "false") << "\n";
-        std::cerr << "Debug: auto_indent = " << (editor_config.auto_indent ? "true" : "false") << "\n";
-        std::cerr << "Debug: text_color = " << editor_config.text_color << "\n";
-        std::cerr << "Debug: background_color = " << editor_config.background_color << "\n";
-        std::cerr << "Debug: syntax_highlighting = " << (editor_config.syntax_highlighting ? "true" : "false") << "\n";
-        std::cerr << "Press any key to continue...\n";
-        getchar();
+    if (!interactive) {
+        // Nominal size for commands that page or scroll
+        editor_config.screen_rows = 24;
+        editor_config.screen_cols = 80;
+        return;
     }
 
+    terminal.enable_raw_mode();
+    StartupProfile::phase("terminal raw mode");
+
     // Get terminal dimensions
     if (terminal.get_window_size(&editor_config.screen_rows, &editor_config.screen_cols) == -1) {
         std::cerr << "Error: Unable to get terminal size\n";
         exit(1);
     }
     editor_config.screen_rows -= 2; // Reserve space for status and message bars
+    StartupProfile::phase("terminal size");
 
     // Set up signal handler for window resize
     signal(SIGWINCH, handle_sigwinch);
@@ -85,16 +105,102 @@ void set_status_message(const std::string& msg) {
  * Main application entry point
  */
 int main(int argc, char* argv[]) {
-    Buffer buffer;
-    
+    // Options: -s <ex script> or -k <keystroke script> run headless,
+    // -o <file> (or - for stdout) receives the scripted result,
+    // --record <log> logs keys, --replay <log> replays them headless,
+    // --startup-profile reports time spent in each startup phase,
+    // --daemon starts a server, --attach opens files in it, --daemon-stop ends it
+    std::vector<std::string> filenames;
+    std::string script_path;
+    std::string output_path;
+    std::string record_path;
+    std::string replay_path;
+    bool keystrokes = false;
+    bool daemon = false;
+    bool attach = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--startup-profile") {
+            StartupProfile::enable();
+        } else if (arg == "--daemon") {
+            daemon = true;
+        } else if (arg == "--attach") {
+            attach = true;
+        } else if (arg == "--daemon-stop") {
+            return Server::stop();
+        } else if ((arg == "--record" || arg == "--replay") && i + 1 < argc) {
+            (arg == "--record" ? record_path : replay_path) = argv[++i];
+        } else if ((arg == "-s" || arg == "-k" || arg == "-o") && i + 1 < argc) {
+            if (arg == "-o") {
+                output_path = argv[++i];
+            } else {
+                keystrokes = (arg == "-k");
+                script_path = argv[++i];
+            }
+        } else {
+            filenames.push_back(arg);
+        }
+    }
+    if (attach) {
+        // The client loads nothing; the server already has it all
+        return Server::attach(filenames);
+    }
+    bool headless = daemon || !script_path.empty() || !replay_path.empty();
+    StartupProfile::phase("process start");
+
     try {
         // Initialize editor
-        init_editor();
+        init_editor(!headless);
+        Buffer::set_edit_hook([](const Buffer* buffer) {
+            search_state.on_edit(buffer);
+            column_view.on_edit(buffer);
+        });
+        buffer_list.set_budget(static_cast<size_t>(editor_config.buffer_size) * 1024 * 1024);
+        Buffer::set_undo_limit(editor_config.max_undo_levels);
+
+        if (daemon) {
+            return Server::serve(editor_config, filenames);
+        }
+        if (!replay_path.empty()) {
+            int status = Session::replay(editor_config, replay_path, filenames);
+            StartupProfile::phase("replay");
+            StartupProfile::report();
+            return status;
+        }
+        if (headless) {
+            // Ex scripts cannot be undone interactively; skip keeping old
+            // text. Keystroke scripts keep undo for their own u and Ctrl-R.
+            if (!keystrokes) {
+                Buffer::set_undo_limit(0);
+            }
+            int status = ScriptRunner::run(editor_config, script_path, keystrokes, filenames, output_path);
+            StartupProfile::phase("script");
+            StartupProfile::report();
+            return status;
+        }
+        if (!record_path.empty() && !Session::start_recording(record_path, filenames)) {
+            cleanup_and_exit();
+            std::cerr << "Error: Cannot record session to " << record_path << "\n";
+            return 1;
+        }
+        
+        // Load files specified as command line arguments
+        int existing = 0;
+        if (!filenames.empty()) {
+            existing = buffer_list.open_files(filenames);
+        } else {
+            buffer_list.open("");
+        }
+        window_manager.init(buffer_list.get(0).buffer);
+        buffer_list.activate(0, window_manager.get_active(), editor_config);
+        StartupProfile::phase("open files");
+        ConfigManager::watch_config();
         
-        // Load file if specified as command line argument
-        if (argc >= 2) {
-            editor_config.filename = argv[1];
-            if (!FileManager::load_file(editor_config.filename, buffer)) {
+        if (filenames.size() > 1) {
+            set_status_message("Opened " + std::to_string(filenames.size()) + " files (" +
+                               std::to_string(existing) + " from disk)");
+        } else if (filenames.size() == 1) {
+            if (existing == 0) {
                 set_status_message("New file: " + editor_config.filename);
             } else {
                 set_status_message("Loaded: " + editor_config.filename);
@@ -104,18 +210,23 @@ int main(int argc, char* argv[]) {
             set_status_message("SlowerText Editor - Tab width: " + std::to_string(editor_config.tab_width) + " spaces");
         }
 
-        // Main editor loop
-        while (!editor_config.quit) {
-            Renderer::refresh_screen(editor_config, buffer);
-            InputHandler::process_keypress(editor_config, buffer);
-        }
+#ifdef PERF_OVERLAY
+        // Debug mode starts with the performance overlay shown
+        PerfMonitor::set_visible(editor_config.debug_mode);
+#endif
+
+        InputHandler::run_loop(editor_config, nullptr);
         
-        // Clean exit
+        // Clean exit; the profile is printed on the restored terminal
         cleanup_and_exit();
+        terminal.disable_raw_mode();
+        StartupProfile::report();
         
     } catch (const std::exception& e) {
         // Handle any exceptions and cleanup
-        cleanup_and_exit();
+        if (!headless) {
+            cleanup_and_exit();
+        }
         std::cerr << "Error: " << e.what() << "\n";
         return 1;
     }
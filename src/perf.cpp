@@ -0,0 +1,179 @@
+#include "../include/slowertext.h"
+
+#ifdef PERF_OVERLAY
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <new>
+
+/*
+ * Every heap allocation in the process goes through these, so the overlay
+ * can report allocations per frame without a profiler attached.
+ */
+static std::atomic<unsigned long> allocation_count(0);
+
+void* operator new(size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    void* pointer = malloc(size ? size : 1);
+    if (!pointer) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* pointer) noexcept {
+    free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+    free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+    free(pointer);
+}
+
+void operator delete[](void* pointer, size_t) noexcept {
+    free(pointer);
+}
+
+// Width of the overlay box in columns
+static const int OVERLAY_WIDTH = 44;
+
+// Timings of the frame being built and of the last finished one
+static long long current_ns[PERF_SLOT_COUNT];
+static long long last_ns[PERF_SLOT_COUNT];
+static unsigned long frame_start_allocations = 0;
+static unsigned long last_allocations = 0;
+static unsigned long frame_start_writes = 0;
+static unsigned long frame_start_bytes = 0;
+static unsigned long last_writes = 0;
+static unsigned long last_bytes = 0;
+static bool visible = false;
+
+// Buffer memory is O(lines) to measure, so it is sampled sparingly
+static const Buffer* measured_buffer = nullptr;
+static unsigned long measured_version = 0;
+static time_t measured_time = 0;
+static size_t measured_memory = 0;
+
+/**
+ * Start timing a frame
+ */
+void PerfMonitor::begin_frame() {
+    for (int slot = 0; slot < PERF_SLOT_COUNT; slot++) {
+        if (slot != PERF_KEYPRESS) {
+            current_ns[slot] = 0;
+        }
+    }
+    frame_start_allocations = allocation_count.load(std::memory_order_relaxed);
+    Renderer::get_output_stats(frame_start_writes, frame_start_bytes);
+}
+
+/**
+ * Publish the timings of the frame that just finished
+ * The overlay drawn in a frame shows the frame before it, since a frame
+ * cannot report its own flush.
+ */
+void PerfMonitor::end_frame() {
+    for (int slot = 0; slot < PERF_SLOT_COUNT; slot++) {
+        if (slot != PERF_KEYPRESS) {
+            last_ns[slot] = current_ns[slot];
+        }
+    }
+    last_allocations = allocation_count.load(std::memory_order_relaxed) - frame_start_allocations;
+    unsigned long writes = 0;
+    unsigned long bytes = 0;
+    Renderer::get_output_stats(writes, bytes);
+    last_writes = writes - frame_start_writes;
+    last_bytes = bytes - frame_start_bytes;
+}
+
+/**
+ * Add time to a slot of the current frame
+ * Keypress time belongs to no frame and replaces the previous key's.
+ * @param slot Timing slot
+ * @param ns Elapsed nanoseconds
+ */
+void PerfMonitor::add_time(PerfSlot slot, long long ns) {
+    if (slot == PERF_KEYPRESS) {
+        last_ns[slot] = ns;
+    } else {
+        current_ns[slot] += ns;
+    }
+}
+
+/**
+ * Show or hide the overlay
+ * @param show Whether to draw the overlay
+ */
+void PerfMonitor::set_visible(bool show) {
+    visible = show;
+}
+
+/**
+ * Check whether the overlay is shown
+ * @return True if visible
+ */
+bool PerfMonitor::is_visible() {
+    return visible;
+}
+
+/**
+ * Format one overlay line padded to the overlay width
+ * @param frame Output frame
+ * @param left Screen column of the overlay
+ * @param row Screen row
+ * @param text Line content
+ */
+static void append_overlay_line(std::string& frame, int left, int row, const char* text) {
+    char position[32];
+    snprintf(position, sizeof(position), "\x1b[%d;%dH", row + 1, left + 1);
+    frame += position;
+    frame += "\x1b[7m";
+    size_t length = std::min(strlen(text), static_cast<size_t>(OVERLAY_WIDTH));
+    frame.append(text, length);
+    frame.append(OVERLAY_WIDTH - length, ' ');
+    frame += COLOR_RESET;
+}
+
+/**
+ * Draw the overlay for the previous frame into the frame
+ * Drawn over the top right corner of the text area; the window under it
+ * is redrawn when the overlay is hidden.
+ * @param frame Output frame
+ * @param view Frame view state
+ * @param buffer Buffer of the active window
+ */
+void PerfMonitor::draw_overlay(std::string& frame, const ViewState& view, const Buffer& buffer) {
+    if (!visible || view.screen_cols < OVERLAY_WIDTH || view.screen_rows < 4) {
+        return;
+    }
+
+    time_t now = time(nullptr);
+    bool edited = buffer.get_version() != measured_version && now != measured_time;
+    if (&buffer != measured_buffer || edited) {
+        measured_memory = buffer.memory_usage();
+        measured_buffer = &buffer;
+        measured_version = buffer.get_version();
+        measured_time = now;
+    }
+
+    auto us = [](long long ns) { return static_cast<double>(ns) / 1000.0; };
+    int left = view.screen_cols - OVERLAY_WIDTH;
+    char text[96];
+    snprintf(text, sizeof(text), " frame %8.1fus  key %8.1fus", us(last_ns[PERF_FRAME]), us(last_ns[PERF_KEYPRESS]));
+    append_overlay_line(frame, left, 0, text);
+    snprintf(text, sizeof(text), " scroll %6.1f rows %7.1f bar %6.1f", us(last_ns[PERF_SCROLL]),
+             us(last_ns[PERF_DRAW_ROWS]), us(last_ns[PERF_STATUS_BAR]));
+    append_overlay_line(frame, left, 1, text);
+    snprintf(text, sizeof(text), " flush %7.1fus  writes %lu  bytes %lu", us(last_ns[PERF_FLUSH]), last_writes, last_bytes);
+    append_overlay_line(frame, left, 2, text);
+    snprintf(text, sizeof(text), " allocs %lu  buffer %zu KB", last_allocations, measured_memory / 1024);
+    append_overlay_line(frame, left, 3, text);
+}
+#endif
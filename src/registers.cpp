@@ -0,0 +1,104 @@
+#include "../include/slowertext.h"
+#include <cctype>
+
+// Slots: the unnamed register, 0 and a-z
+static const int SLOT_COUNT = 28;
+static std::shared_ptr<const Register> slots[SLOT_COUNT];
+
+// Characters of the first row shown per register by describe()
+static const size_t PREVIEW_LENGTH = 12;
+
+/**
+ * Get the slot of a register name
+ * @param name Register name
+ * @return Slot index, -1 if not a register
+ */
+static int slot_of(char name) {
+    if (name == '"') {
+        return 0;
+    }
+    if (name == '0') {
+        return 1;
+    }
+    if (name >= 'a' && name <= 'z') {
+        return 2 + (name - 'a');
+    }
+    if (name >= 'A' && name <= 'Z') {
+        return 2 + (name - 'A');
+    }
+    return -1;
+}
+
+/**
+ * Check for a register name
+ * @param name Character after "
+ * @return True for ", 0, a-z and A-Z
+ */
+bool Registers::valid(char name) {
+    return slot_of(name) >= 0;
+}
+
+/**
+ * Store yanked or deleted text
+ * Every name given the text shares one copy of its handles.
+ * @param name Register named by the user, '"' for none
+ * @param text Text to store, moved from
+ * @param yank True for a yank, false for a delete
+ */
+void Registers::store(char name, Register&& text, bool yank) {
+    int slot = slot_of(name);
+    if (slot < 0) {
+        slot = 0;
+    }
+    std::shared_ptr<const Register>& target = slots[slot];
+    if (name >= 'A' && name <= 'Z' && target) {
+        std::shared_ptr<Register> joined = std::make_shared<Register>(*target);
+        if (joined->kind != SELECT_BLOCK || text.kind != SELECT_BLOCK) {
+            joined->kind = SELECT_LINES;
+        }
+        joined->pieces.insert(joined->pieces.end(), text.pieces.begin(), text.pieces.end());
+        joined->stores.insert(joined->stores.end(), text.stores.begin(), text.stores.end());
+        target = joined;
+    } else {
+        target = std::make_shared<const Register>(std::move(text));
+    }
+    slots[0] = target;
+    if (yank && slot == 0) {
+        slots[1] = target;
+    }
+}
+
+/**
+ * Get a register
+ * @param name Register name; A-Z read a-z
+ * @return Its text, or null if empty
+ */
+std::shared_ptr<const Register> Registers::get(char name) {
+    int slot = slot_of(name);
+    return slot < 0 ? nullptr : slots[slot];
+}
+
+/**
+ * Describe the registers holding text
+ * Each entry is the name, the row count with L for lines, c for
+ * characters or b for a block, and the start of the first row.
+ * @return Entries like "a 3L:text  0 1c:text", empty if none
+ */
+std::string Registers::describe() {
+    static const char names[] = "\"0abcdefghijklmnopqrstuvwxyz";
+    static const char kinds[] = {'c', 'L', 'b'};
+    std::string listing;
+    for (int slot = 0; slot < SLOT_COUNT; slot++) {
+        const std::shared_ptr<const Register>& text = slots[slot];
+        if (!text || text->pieces.empty()) {
+            continue;
+        }
+        const Line& first = text->pieces.front();
+        listing += std::string(1, names[slot]) + " " + std::to_string(text->pieces.size()) + kinds[text->kind] + ":";
+        for (size_t i = 0; i < first.size() && i < PREVIEW_LENGTH; i++) {
+            listing += isprint(static_cast<unsigned char>(first[i])) ? first[i] : '?';
+        }
+        listing += "  ";
+    }
+    return listing;
+}
@@ -1,6 +1,12 @@
 #include "../include/slowertext.h"
 #include <cstring>
 #include <ctime>
+#include <algorithm>
+
+// Destination of composed frames and counters of what was written
+static int output_fd = STDOUT_FILENO;
+static unsigned long output_writes = 0;
+static unsigned long output_bytes = 0;
 
 /**
  * Convert color name to ANSI escape code
@@ -28,237 +34,923 @@ std::string get_color_code(const std::string& color) {
 }
 
 /**
- * Draw text rows on the screen
- * Handles line numbers, syntax highlighting, and current line highlighting
+ * Append a cursor positioning sequence to the frame
+ * @param frame Output frame
+ * @param x Column position (0-based)
+ * @param y Row position (0-based)
+ */
+static void append_cursor_position(std::string& frame, int x, int y) {
+    char buf[32];
+    int len = snprintf(buf, sizeof(buf), "\x1b[%d;%dH", y + 1, x + 1);
+    frame.append(buf, len);
+}
+
+// Display settings resolved by apply_config
+static RenderStyle render_style;
+static bool style_applied = false;
+static unsigned long status_generation = 0;  // Bumped when only the status style changes
+
+// Storage reused across frames so drawing does not allocate
+static std::string frame_buffer;
+static std::vector<SearchMatch> visible;
+static std::vector<SearchMatch> segment_matches;
+
+// Buffer row on each screen row of the window being drawn, and the last
+// row of the closed fold shown there (-1 for a plain line)
+static std::vector<int> shown_rows;
+static std::vector<int> fold_ends;
+
+// Columns of the extra cursors on the row being drawn
+static std::vector<int> cursor_cols;
+
+// Row laid out in columns, kept for the overlays drawn over it
+static std::string column_text;
+
+/**
+ * Compile a status format into segments
+ * Placeholders: %f file name, %modified '*' when modified, %m mode,
+ * %l line, %c column, %p percent through file, %o byte offset,
+ * %enc encoding, %eol line endings, %mem buffer memory, %% a percent
+ * sign. Settings that only change with the configuration are folded
+ * into literal text.
  * @param config Editor configuration
- * @param buffer Text buffer to display
+ * @param style Style receiving the segments
+ */
+static void compile_status_format(const EditorConfig& config, RenderStyle& style) {
+    struct Placeholder {
+        const char* name;
+        StatusSegment::Kind kind;
+    };
+    // Longer names first so %modified and %mem are not read as %m
+    static const Placeholder PLACEHOLDERS[] = {
+        {"%modified", StatusSegment::MODIFIED}, {"%mem", StatusSegment::MEMORY},
+        {"%enc", StatusSegment::LITERAL}, {"%eol", StatusSegment::LITERAL},
+        {"%f", StatusSegment::FILENAME}, {"%m", StatusSegment::MODE},
+        {"%l", StatusSegment::LINE}, {"%c", StatusSegment::COLUMN},
+        {"%p", StatusSegment::PERCENT}, {"%o", StatusSegment::BYTE_OFFSET},
+        {"%%", StatusSegment::LITERAL},
+    };
+
+    const std::string& format = config.status_format;
+    std::vector<StatusSegment>& segments = style.status_segments;
+    segments.clear();
+    auto add_literal = [&segments](const std::string& text) {
+        if (text.empty()) {
+            return;
+        }
+        if (!segments.empty() && segments.back().kind == StatusSegment::LITERAL) {
+            segments.back().text += text;
+        } else {
+            segments.push_back({StatusSegment::LITERAL, text});
+        }
+    };
+
+    size_t pos = 0;
+    while (pos < format.length()) {
+        size_t next = format.find('%', pos);
+        if (next == std::string::npos) {
+            next = format.length();
+        }
+        add_literal(format.substr(pos, next - pos));
+        pos = next;
+        if (pos >= format.length()) {
+            break;
+        }
+
+        const Placeholder* found = nullptr;
+        for (const Placeholder& placeholder : PLACEHOLDERS) {
+            if (format.compare(pos, strlen(placeholder.name), placeholder.name) == 0) {
+                found = &placeholder;
+                break;
+            }
+        }
+        if (!found) {
+            add_literal("%");
+            pos++;
+            continue;
+        }
+
+        std::string name = found->name;
+        if (name == "%enc") {
+            add_literal(config.default_encoding);
+        } else if (name == "%eol") {
+            add_literal(config.line_endings);
+        } else if (name == "%%") {
+            add_literal("%");
+        } else {
+            segments.push_back({found->kind, ""});
+        }
+        pos += name.length();
+    }
+
+    style.status_uses_column = false;
+    style.status_uses_memory = false;
+    for (const StatusSegment& segment : segments) {
+        style.status_uses_column |= segment.kind == StatusSegment::COLUMN || segment.kind == StatusSegment::BYTE_OFFSET;
+        style.status_uses_memory |= segment.kind == StatusSegment::MEMORY;
+    }
+}
+
+/**
+ * Check whether two compiled status templates are the same
+ * @param a First segment list
+ * @param b Second segment list
+ * @return True if equal
+ */
+static bool same_segments(const std::vector<StatusSegment>& a, const std::vector<StatusSegment>& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].kind != b[i].kind || a[i].text != b[i].text) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Resolve display settings from the configuration
+ * Called at startup and whenever the configuration changes. Only what the
+ * change affects is redrawn: text rows when colors or row decorations
+ * change, status bars alone when only the status line changes.
+ * @param config Editor configuration
+ */
+void Renderer::apply_config(const EditorConfig& config) {
+    RenderStyle style;
+    style.text_color = get_color_code(config.text_color);
+    style.bg_color = get_color_code("bg_" + config.background_color);
+    style.comment_color = get_color_code(config.comment_color);
+    style.status_bar_color = get_color_code("bg_" + config.status_bar_color);
+    compile_status_format(config, style);
+    style.gutter = config.show_line_numbers ? 5 : 0;
+    style.show_tilde = config.show_tilde;
+    style.highlight_current_line = config.highlight_current_line;
+    style.syntax_highlighting = config.syntax_highlighting;
+
+    bool rows_changed = !style_applied || style.text_color != render_style.text_color ||
+                        style.bg_color != render_style.bg_color || style.comment_color != render_style.comment_color ||
+                        style.gutter != render_style.gutter || style.show_tilde != render_style.show_tilde ||
+                        style.highlight_current_line != render_style.highlight_current_line ||
+                        style.syntax_highlighting != render_style.syntax_highlighting;
+    bool status_changed = style.status_bar_color != render_style.status_bar_color ||
+                          !same_segments(style.status_segments, render_style.status_segments);
+
+    render_style = std::move(style);
+    style_applied = true;
+    if (rows_changed) {
+        window_manager.invalidate();
+    } else if (status_changed) {
+        status_generation++;
+    }
+}
+
+/**
+ * Get the background marking a row of a diff
+ * @param kind How the row takes part in the diff
+ * @return Escape code, null for rows on both sides
+ */
+static const char* diff_background(DiffRowKind kind) {
+    switch (kind) {
+        case DIFF_CHANGED: return BG_BLUE;
+        case DIFF_ADDED: return BG_GREEN;
+        case DIFF_REMOVED: return BG_RED;
+        default: return nullptr;
+    }
+}
+
+/**
+ * Get the columns of a row inside the visual selection
+ * The selection runs from where it started to the window's cursor. The
+ * end of each selected row counts as a column, so empty rows show too.
+ * @param view Frame view state
+ * @param window Window showing the selection
+ * @param row Buffer row
+ * @param start Receives the first selected column
+ * @param end Receives the column after the last selected one
+ * @return False if the row is not selected
+ */
+static bool selected_columns(const ViewState& view, const Window& window, int row, int& start, int& end) {
+    int first_x = view.visual_x;
+    int first_y = view.visual_y;
+    int last_x = window.cursor_x;
+    int last_y = window.cursor_y;
+    if (first_y > last_y || (first_y == last_y && first_x > last_x)) {
+        std::swap(first_x, last_x);
+        std::swap(first_y, last_y);
+    }
+    if (row < first_y || row > last_y) {
+        return false;
+    }
+    int length = static_cast<int>(window.buffer->view_line(row).length());
+    start = 0;
+    end = length + 1;
+    if (view.visual_kind == SELECT_BLOCK) {
+        start = std::min(first_x, last_x);
+        end = std::max(first_x, last_x) + 1;
+    } else if (view.visual_kind == SELECT_CHARS) {
+        if (row == first_y) {
+            start = first_x;
+        }
+        if (row == last_y) {
+            end = std::min(last_x + 1, length + 1);
+        }
+    }
+    return start < end;
+}
+
+/**
+ * Draw text rows of a window into the frame
+ * Handles line numbers, syntax highlighting, and current line highlighting
+ * @param frame Output frame
+ * @param view Frame view state
+ * @param window Window to draw
  */
-void Renderer::draw_rows(const EditorConfig& config, const Buffer& buffer) {
-    std::string text_color = get_color_code(config.text_color);
-    std::string bg_color = get_color_code("bg_" + config.background_color);
-    std::string comment_color = get_color_code(config.comment_color);
+void Renderer::draw_rows(std::string& frame, const ViewState& view, const Window& window) {
+    const RenderStyle& style = *view.style;
+    const Buffer& buffer = *window.buffer;
+    int line_count = buffer.get_line_count();
+    
+    // Windows touching the right edge can clear instead of padding
+    bool clear_to_eol = (window.left + window.cols >= view.screen_cols);
+    int gutter = style.gutter;
+    if (gutter > window.cols) gutter = window.cols;
+    int text_cols = window.cols - gutter;
     
-    for (int y = 0; y < config.screen_rows; y++) {
-        int file_row = y + config.row_offset;
+    // Map screen rows to buffer rows; a closed fold takes one screen row
+    // and is stepped over in one tree lookup however long it is
+    shown_rows.clear();
+    fold_ends.clear();
+    int row = window.row_offset;
+    for (int y = 0; y < window.rows; y++) {
+        Fold fold;
+        bool folded = row < line_count && buffer.closed_fold(row, fold);
+        shown_rows.push_back(row);
+        fold_ends.push_back(folded ? fold.end : -1);
+        row = folded ? fold.end + 1 : row + 1;
+    }
+    
+    // Delimited text keeps its header row on the first screen row, over
+    // the row at the scroll offset (scroll keeps the cursor off it)
+    bool columns = column_view.active(buffer);
+    if (columns && window.row_offset > 0 && window.rows > 1) {
+        shown_rows[0] = 0;
+        fold_ends[0] = -1;
+    }
+    
+    // Search matches come from the cached match list, not a rescan; rows
+    // hidden in folds are left out
+    visible.clear();
+    for (int y = 0; y < window.rows;) {
+        if (fold_ends[y] >= 0 || shown_rows[y] >= line_count) {
+            y++;
+            continue;
+        }
+        int first = shown_rows[y];
+        do {
+            y++;
+        } while (y < window.rows && fold_ends[y] < 0 && shown_rows[y] < line_count && shown_rows[y] == shown_rows[y - 1] + 1);
+        search_state.visible_matches(buffer, first, shown_rows[y - 1] + 1, segment_matches);
+        visible.insert(visible.end(), segment_matches.begin(), segment_matches.end());
+    }
+    int match_length = static_cast<int>(search_state.get_pattern().length());
+    size_t next_match = 0;
+    
+    for (int y = 0; y < window.rows; y++) {
+        int file_row = shown_rows[y];
+        int used = 0;
+        
+        append_cursor_position(frame, window.left, window.top + y);
         
-        // Apply background color and highlight current line if enabled
-        if (config.highlight_current_line && file_row == config.cursor_y) {
-            write(STDOUT_FILENO, "\x1b[7m", 4); // Invert colors for current line
+        // Apply background color and highlight current line if enabled;
+        // rows in a diff hunk take the hunk's background instead
+        bool current_line = style.highlight_current_line && file_row == window.cursor_y;
+        const char* diff_bg = (file_row < line_count) ? diff_background(diff_view.row_kind(buffer, file_row)) : nullptr;
+        const char* row_bg = diff_bg ? diff_bg : style.bg_color.c_str();
+        if (current_line) {
+            frame += "\x1b[7m"; // Invert colors for current line
         } else {
-            write(STDOUT_FILENO, bg_color.c_str(), bg_color.length());
+            frame += row_bg;
         }
         
         // Draw line numbers if enabled
-        if (config.show_line_numbers) {
+        if (gutter > 0) {
             char line_num[16];
-            if (file_row < buffer.get_line_count()) {
+            if (file_row < line_count) {
                 snprintf(line_num, sizeof(line_num), "%4d ", file_row + 1);
             } else {
                 snprintf(line_num, sizeof(line_num), "     ");
             }
-            write(STDOUT_FILENO, line_num, strlen(line_num));
+            frame.append(line_num, gutter);
+            used += gutter;
         }
         
         // Draw line content or tilde for empty lines
-        if (file_row >= buffer.get_line_count()) {
+        if (file_row >= line_count) {
             // Line is beyond buffer content
-            if (config.show_tilde) {
-                write(STDOUT_FILENO, text_color.c_str(), text_color.length());
-                write(STDOUT_FILENO, "~", 1);
+            if (style.show_tilde && used < window.cols) {
+                frame += style.text_color;
+                frame += "~";
+                used++;
+            }
+        } else if (fold_ends[y] >= 0) {
+            // Closed fold: line count and the first line without its indent
+            LineView line = buffer.view_line(file_row);
+            size_t start = 0;
+            while (start < line.length() && (line[start] == ' ' || line[start] == '\t')) {
+                start++;
+            }
+            int hidden = fold_ends[y] - file_row + 1;
+            std::string summary = "+--" + std::to_string(hidden) + (hidden == 1 ? " line: " : " lines: ");
+            line.append_to(summary, start, std::min(line.length() - start, static_cast<size_t>(text_cols)));
+            int len = std::min(static_cast<int>(summary.size()), text_cols);
+            frame += COLOR_CYAN;
+            frame.append(summary, 0, len);
+            used += len;
+        } else if (columns) {
+            // Fields padded to their column widths; the header is bold
+            column_view.layout_row(buffer, file_row, column_text);
+            const char* weight = (file_row == 0) ? "\x1b[1m" : "";
+            int pos = window.col_offset;
+            int end = std::min(static_cast<int>(column_text.size()), window.col_offset + text_cols);
+            frame += weight;
+            frame += style.text_color;
+            while (next_match < visible.size() && visible[next_match].line < file_row) {
+                next_match++;
+            }
+            for (; next_match < visible.size() && visible[next_match].line == file_row; next_match++) {
+                int col = visible[next_match].col;
+                int match_start = std::max(column_view.display_col(buffer, file_row, col), pos);
+                int match_end = std::min(column_view.display_col(buffer, file_row, col + match_length - 1) + 1, end);
+                if (match_start >= match_end) {
+                    continue;
+                }
+                frame.append(column_text, pos, match_start - pos);
+                frame += BG_YELLOW COLOR_BLACK;
+                frame.append(column_text, match_start, match_end - match_start);
+                frame += COLOR_RESET;
+                frame += current_line ? "\x1b[7m" : row_bg;
+                frame += weight;
+                frame += style.text_color;
+                pos = match_end;
             }
+            if (pos < end) {
+                frame.append(column_text, pos, end - pos);
+            }
+            used += std::max(end - window.col_offset, 0);
         } else {
-            // Get line content and apply horizontal scrolling
-            std::string line = buffer.get_line(file_row);
-            int len = static_cast<int>(line.length()) - config.col_offset;
+            // Apply horizontal scrolling to the line in place
+            LineView line = buffer.view_line(file_row);
+            int len = static_cast<int>(line.length()) - window.col_offset;
             if (len < 0) len = 0;
-            if (len > config.screen_cols) len = config.screen_cols;
+            if (len > text_cols) len = text_cols;
             
             if (len > 0) {
                 // Apply basic syntax highlighting for comments
-                if (config.syntax_highlighting && 
-                    (line.find("#") == 0 || line.find("//") == 0)) {
-                    write(STDOUT_FILENO, comment_color.c_str(), comment_color.length());
-                } else {
-                    write(STDOUT_FILENO, text_color.c_str(), text_color.length());
-                }
+                const std::string& line_color = (style.syntax_highlighting &&
+                    line.length() > 0 &&
+                    (line[0] == '#' || (line.length() > 1 && line[0] == '/' && line[1] == '/'))) ? style.comment_color : style.text_color;
+                frame += line_color;
                 
-                // Write visible portion of line
-                write(STDOUT_FILENO, line.c_str() + config.col_offset, len);
+                // Write visible portion of line, marking search matches
+                int pos = window.col_offset;
+                int end = window.col_offset + len;
+                while (next_match < visible.size() && visible[next_match].line < file_row) {
+                    next_match++;
+                }
+                for (; next_match < visible.size() && visible[next_match].line == file_row; next_match++) {
+                    int match_start = std::max(visible[next_match].col, pos);
+                    int match_end = std::min(visible[next_match].col + match_length, end);
+                    if (match_start >= match_end) {
+                        continue;
+                    }
+                    line.append_to(frame, pos, match_start - pos);
+                    frame += BG_YELLOW COLOR_BLACK;
+                    line.append_to(frame, match_start, match_end - match_start);
+                    frame += COLOR_RESET;
+                    if (current_line) {
+                        frame += "\x1b[7m";
+                    } else {
+                        frame += row_bg;
+                    }
+                    frame += line_color;
+                    pos = match_end;
+                }
+                line.append_to(frame, pos, end - pos);
+                used += len;
             }
             
             // Show tilde for empty lines if enabled
-            if (line.empty() && config.show_tilde) {
-                write(STDOUT_FILENO, text_color.c_str(), text_color.length());
-                write(STDOUT_FILENO, "~", 1);
+            if (line.length() == 0 && style.show_tilde && used < window.cols) {
+                frame += style.text_color;
+                frame += "~";
+                used++;
+            }
+        }
+
+        // Reset colors and clear the rest of the window row, keeping a
+        // diff background to the edge
+        frame += COLOR_RESET;
+        if (diff_bg && !current_line) {
+            frame += diff_bg;
+        }
+        if (clear_to_eol) {
+            frame += CLEAR_LINE;
+        } else if (used < window.cols) {
+            frame.append(window.cols - used, ' ');
+        }
+        if (diff_bg && !current_line) {
+            frame += COLOR_RESET;
+        }
+        
+        // Extra cursors are drawn over the finished row
+        if (file_row < line_count && fold_ends[y] < 0) {
+            cursor_set.row_cursors(buffer, file_row, cursor_cols);
+            LineView line = buffer.view_line(file_row);
+            for (int col : cursor_cols) {
+                int shown_col = columns ? column_view.display_col(buffer, file_row, col) : col;
+                int screen_col = shown_col - window.col_offset;
+                if (screen_col < 0 || screen_col >= text_cols) {
+                    continue;
+                }
+                append_cursor_position(frame, window.left + gutter + screen_col, window.top + y);
+                frame += BG_WHITE COLOR_BLACK;
+                if (columns) {
+                    frame += static_cast<size_t>(shown_col) < column_text.size() ? column_text[shown_col] : ' ';
+                } else {
+                    frame += static_cast<size_t>(col) < line.length() ? line[col] : ' ';
+                }
+                frame += COLOR_RESET;
+            }
+        }
+        
+        // So is the visual selection, in reverse video
+        int select_start = 0;
+        int select_end = 0;
+        if (file_row < line_count && fold_ends[y] < 0 && &window == view.visual_window &&
+            selected_columns(view, window, file_row, select_start, select_end)) {
+            LineView line = buffer.view_line(file_row);
+            int length = static_cast<int>(line.length());
+            if (columns) {
+                select_end = column_view.display_col(buffer, file_row, select_end - 1) + 1;
+                select_start = column_view.display_col(buffer, file_row, select_start);
+                length = static_cast<int>(column_text.size());
+            }
+            select_start = std::max(select_start, window.col_offset);
+            select_end = std::min(select_end, window.col_offset + text_cols);
+            if (select_start < select_end) {
+                append_cursor_position(frame, window.left + gutter + select_start - window.col_offset, window.top + y);
+                frame += "\x1b[7m";
+                int shown = std::min(select_end, length);
+                if (select_start < shown && columns) {
+                    frame.append(column_text, select_start, shown - select_start);
+                } else if (select_start < shown) {
+                    line.append_to(frame, select_start, shown - select_start);
+                }
+                frame.append(select_end - std::max(select_start, shown), ' ');
+                frame += COLOR_RESET;
             }
         }
+    }
+}
+
+/**
+ * Append text to a status bar, clipped to its remaining width
+ * @param frame Output frame
+ * @param text Text to append
+ * @param length Text length
+ * @param room Columns left, reduced by what was appended
+ */
+static void append_clipped(std::string& frame, const char* text, size_t length, int& room) {
+    size_t count = std::min(length, static_cast<size_t>(std::max(room, 0)));
+    frame.append(text, count);
+    room -= static_cast<int>(count);
+}
 
-        // Reset colors and clear to end of line
-        write(STDOUT_FILENO, COLOR_RESET, 4);
-        write(STDOUT_FILENO, CLEAR_LINE, 3);
-        write(STDOUT_FILENO, "\r\n", 2);
+// Byte offset of the last row asked for, advanced line by line while the
+// buffer is unchanged and recomputed from the top after an edit
+static const Buffer* offset_buffer = nullptr;
+static unsigned long offset_version = 0;
+static int offset_row = 0;
+static size_t offset_bytes = 0;
+
+/**
+ * Get the byte offset of the start of a row
+ * @param buffer Buffer
+ * @param row Row index
+ * @return Bytes before the row, counting one newline per line
+ */
+static size_t row_byte_offset(const Buffer& buffer, int row) {
+    if (&buffer != offset_buffer || buffer.get_version() != offset_version) {
+        offset_buffer = &buffer;
+        offset_version = buffer.get_version();
+        offset_row = 0;
+        offset_bytes = 0;
     }
+    for (; offset_row < row; offset_row++) {
+        offset_bytes += buffer.view_line(offset_row).length() + 1;
+    }
+    for (; offset_row > row; offset_row--) {
+        offset_bytes -= buffer.view_line(offset_row - 1).length() + 1;
+    }
+    return offset_bytes;
 }
 
+// Buffer memory is O(lines) to measure, so it is refreshed at most once
+// per second while the buffer changes
+static const Buffer* memory_buffer = nullptr;
+static unsigned long memory_version = 0;
+static time_t memory_time = 0;
+static size_t memory_bytes = 0;
+
 /**
- * Draw status bar showing file info and editor mode
- * @param config Editor configuration
- * @param buffer Text buffer
+ * Get the memory held by a buffer, sampled sparingly
+ * @param buffer Buffer
+ * @return Estimated bytes
  */
-void Renderer::draw_status_bar(const EditorConfig& config, const Buffer& buffer) {
-    // Set status bar background color
-    std::string status_color = get_color_code("bg_" + config.status_bar_color);
-    write(STDOUT_FILENO, status_color.c_str(), status_color.length());
-    
-    char status[256];
-    char rstatus[80];
-    
-    // Prepare status components
-    std::string mode_str = (config.mode == INSERT_MODE) ? "INSERT" : "COMMAND";
-    std::string filename = config.filename.empty() ? "[No Name]" : config.filename;
-    std::string modified_indicator = config.modified ? "*" : "";
-    
-    // Process status format string with variable substitution
-    std::string format = config.status_format;
-    size_t pos = 0;
-    
-    // Replace %f with filename
-    while ((pos = format.find("%f", pos)) != std::string::npos) {
-        format.replace(pos, 2, filename);
-        pos += filename.length();
+static size_t sampled_memory(const Buffer& buffer) {
+    time_t now = time(nullptr);
+    bool edited = buffer.get_version() != memory_version && now != memory_time;
+    if (&buffer != memory_buffer || edited) {
+        memory_bytes = buffer.memory_usage();
+        memory_buffer = &buffer;
+        memory_version = buffer.get_version();
+        memory_time = now;
     }
+    return memory_bytes;
+}
+
+/**
+ * Collect the inputs of a window's status line
+ * @param view Frame view state
+ * @param window Window the status bar belongs to
+ * @param active Whether the window has focus
+ * @return Status line inputs
+ */
+static StatusKey status_key(const ViewState& view, const Window& window, bool active) {
+    const Buffer& buffer = *window.buffer;
+    StatusKey key;
+    key.version = buffer.get_version();
+    key.name_hash = std::hash<std::string>()(buffer.get_filename());
+    key.modified = buffer.is_modified();
+    key.active = active;
+    key.mode = view.mode;
+    key.cursor_x = view.style->status_uses_column ? window.cursor_x : 0;
+    key.cursor_y = window.cursor_y;
+    key.cols = window.cols;
+    key.memory = view.style->status_uses_memory ? sampled_memory(buffer) : 0;
+    key.style = status_generation;
+    return key;
+}
+
+/**
+ * Draw status bar of a window from the compiled status template
+ * @param frame Output frame
+ * @param view Frame view state
+ * @param window Window the status bar belongs to
+ * @param active Whether the window has focus
+ */
+void Renderer::draw_status_bar(std::string& frame, const ViewState& view, const Window& window, bool active) {
+    const RenderStyle& style = *view.style;
+    const Buffer& buffer = *window.buffer;
+    const std::string& name = buffer.get_filename();
+
+    append_cursor_position(frame, window.left, window.top + window.rows);
     
-    // Replace %modified with modification indicator
-    pos = 0;
-    while ((pos = format.find("%modified", pos)) != std::string::npos) {
-        format.replace(pos, 9, modified_indicator);
-        pos += modified_indicator.length();
+    // Set status bar background color, inactive windows are shown inverted
+    if (active) {
+        frame += style.status_bar_color;
+    } else {
+        frame += "\x1b[7m";
     }
     
-    // Replace %m with mode
-    pos = 0;
-    while ((pos = format.find("%m", pos)) != std::string::npos) {
-        format.replace(pos, 2, mode_str);
-        pos += mode_str.length();
+    int room = window.cols;
+    int line_count = buffer.get_line_count();
+    char number[32];
+    for (const StatusSegment& segment : style.status_segments) {
+        if (room <= 0) {
+            break;
+        }
+        int length = 0;
+        switch (segment.kind) {
+        case StatusSegment::LITERAL:
+            append_clipped(frame, segment.text.data(), segment.text.length(), room);
+            break;
+        case StatusSegment::FILENAME:
+            if (name.empty()) {
+                append_clipped(frame, "[No Name]", 9, room);
+            } else {
+                append_clipped(frame, name.data(), name.length(), room);
+            }
+            break;
+        case StatusSegment::MODIFIED:
+            append_clipped(frame, "*", buffer.is_modified() ? 1 : 0, room);
+            break;
+        case StatusSegment::MODE:
+            if (view.mode == INSERT_MODE) {
+                append_clipped(frame, "INSERT", 6, room);
+            } else if (view.mode == VISUAL_MODE) {
+                append_clipped(frame, "VISUAL", 6, room);
+            } else {
+                append_clipped(frame, "COMMAND", 7, room);
+            }
+            break;
+        case StatusSegment::LINE:
+            length = snprintf(number, sizeof(number), "%d", window.cursor_y + 1);
+            break;
+        case StatusSegment::COLUMN:
+            length = snprintf(number, sizeof(number), "%d", window.cursor_x + 1);
+            break;
+        case StatusSegment::PERCENT:
+            length = snprintf(number, sizeof(number), "%d%%",
+                              static_cast<int>(100LL * (window.cursor_y + 1) / std::max(line_count, 1)));
+            break;
+        case StatusSegment::BYTE_OFFSET:
+            length = snprintf(number, sizeof(number), "%zu", row_byte_offset(buffer, window.cursor_y) + window.cursor_x);
+            break;
+        case StatusSegment::MEMORY: {
+            size_t memory = sampled_memory(buffer);
+            if (memory >= 10 * 1024 * 1024) {
+                length = snprintf(number, sizeof(number), "%zuM", memory / (1024 * 1024));
+            } else {
+                length = snprintf(number, sizeof(number), "%zuK", memory / 1024);
+            }
+            break;
+        }
+        }
+        if (length > 0) {
+            append_clipped(frame, number, static_cast<size_t>(length), room);
+        }
     }
     
-    // Format left side of status bar
-    int len = snprintf(status, sizeof(status), "%.240s", format.c_str());
-    
     // Format right side with cursor position
-    int rlen = snprintf(rstatus, sizeof(rstatus), "%d/%d", 
-                       config.cursor_y + 1, buffer.get_line_count());
-    
-    // Ensure status doesn't exceed screen width
-    if (len > config.screen_cols) len = config.screen_cols;
-    write(STDOUT_FILENO, status, len);
+    char rstatus[32];
+    int rlen = snprintf(rstatus, sizeof(rstatus), "%d/%d", window.cursor_y + 1, line_count);
     
     // Fill middle with spaces and add right-aligned position info
-    while (len < config.screen_cols) {
-        if (config.screen_cols - len == rlen) {
-            write(STDOUT_FILENO, rstatus, rlen);
-            break;
-        } else {
-            write(STDOUT_FILENO, " ", 1);
-            len++;
-        }
+    if (room >= rlen) {
+        frame.append(room - rlen, ' ');
+        frame.append(rstatus, rlen);
+    } else if (room > 0) {
+        frame.append(room, ' ');
     }
     
-    // Reset colors and add newline
-    write(STDOUT_FILENO, COLOR_RESET, 4);
-    write(STDOUT_FILENO, "\r\n", 2);
+    // Reset colors
+    frame += COLOR_RESET;
 }
 
 /**
  * Draw message bar at bottom of screen
  * Shows status messages with timeout
- * @param config Editor configuration
+ * @param frame Output frame
+ * @param view Frame view state
  */
-void Renderer::draw_message_bar(const EditorConfig& config) {
-    write(STDOUT_FILENO, CLEAR_LINE, 3);
+void Renderer::draw_message_bar(std::string& frame, const ViewState& view) {
+    append_cursor_position(frame, 0, view.screen_rows + 1);
+    frame += CLEAR_LINE;
     
-    int msglen = static_cast<int>(config.status_msg.length());
-    if (msglen > config.screen_cols) msglen = config.screen_cols;
+    int msglen = static_cast<int>(view.status_msg->length());
+    if (msglen > view.screen_cols) msglen = view.screen_cols;
     
     // Show message only if it's recent (within 5 seconds)
-    if (msglen && time(nullptr) - config.status_msg_time < 5) {
-        write(STDOUT_FILENO, config.status_msg.c_str(), msglen);
+    if (msglen && time(nullptr) - view.status_msg_time < 5) {
+        frame.append(view.status_msg->c_str(), msglen);
     }
 }
 
 /**
- * Refresh entire screen
- * Orchestrates drawing of all screen elements
+ * Check whether a window must be redrawn
+ * @param view Frame view state
+ * @param window Window to check
+ * @return True if content, scroll or highlighted row changed, or a visual
+ *         selection is or was shown (it follows the cursor)
+ */
+static bool window_needs_redraw(const ViewState& view, const Window& window) {
+    return view.full_redraw ||
+           window.dirty ||
+           window.drawn_visual || &window == view.visual_window ||
+           window.drawn_version != window.buffer->get_version() ||
+           window.drawn_row_offset != window.row_offset ||
+           window.drawn_col_offset != window.col_offset ||
+           window.drawn_folds != window.buffer->get_fold_version() ||
+           window.drawn_cursors != cursor_set.get_generation() ||
+           window.drawn_search != search_state.get_generation() ||
+           window.drawn_diff != diff_view.get_generation() ||
+           window.drawn_columns != column_view.get_generation() ||
+           (view.style->highlight_current_line && window.drawn_cursor_y != window.cursor_y);
+}
+
+/**
+ * Refresh screen
+ * Composes all windows, separators and bars into one frame and writes it
+ * with a single write; unchanged windows are skipped. The frame buffer
+ * and match list keep their capacity, so steady-state frames do not
+ * allocate.
  * @param config Editor configuration
- * @param buffer Text buffer
  */
-void Renderer::refresh_screen(const EditorConfig& config, const Buffer& buffer) {
-    // Create mutable copy for scroll calculations
-    EditorConfig mutable_config = config;
-    scroll(mutable_config, buffer);
+void Renderer::refresh_screen(const EditorConfig& config) {
+    PERF_FRAME_SCOPE();
+    TraceSpan span(TRACE_FRAME);
+    if (!style_applied) {
+        apply_config(config);
+    }
+
+    // Active window follows the cursor kept in the editor configuration
+    window_manager.store_cursor(config);
+    ViewState view;
+    view.screen_rows = config.screen_rows;
+    view.screen_cols = config.screen_cols;
+    view.mode = config.mode;
+    view.full_redraw = window_manager.update_layout(config.screen_rows + 1, config.screen_cols);
+    view.style = &render_style;
+    view.status_msg = &config.status_msg;
+    view.status_msg_time = config.status_msg_time;
+    Window& active = window_manager.get_active();
+    view.visual_window = (config.mode == VISUAL_MODE) ? &active : nullptr;
+    view.visual_kind = config.visual_kind;
+    view.visual_x = config.visual_x;
+    view.visual_y = config.visual_y;
+    
+    std::string& frame = frame_buffer;
+    frame.clear();
+    frame.reserve(static_cast<size_t>(config.screen_rows + 2) * (config.screen_cols + 16));
     
     // Hide cursor during refresh to prevent flicker
-    terminal.hide_cursor();
-    terminal.set_cursor_position(0, 0);
+    frame += CURSOR_HIDE;
     
-    // Set background color
-    std::string bg_color = get_color_code("bg_" + config.background_color);
-    write(STDOUT_FILENO, bg_color.c_str(), bg_color.length());
+    // Diff hunks follow edits made since the last frame, and windows
+    // showing the other side of the diff scroll with the active one
+    diff_view.update();
+    if (diff_view.get_side(0) == active.buffer || diff_view.get_side(1) == active.buffer) {
+        scroll(active);
+        std::shared_ptr<Buffer> other = diff_view.get_side(diff_view.get_side(0) == active.buffer ? 1 : 0);
+        for (const auto& window_ptr : window_manager.get_windows()) {
+            if (window_ptr->buffer == other) {
+                window_ptr->row_offset = diff_view.map_row(*active.buffer, active.row_offset);
+                window_ptr->cursor_y = diff_view.map_row(*active.buffer, active.cursor_y);
+            }
+        }
+    }
     
-    // Draw all screen elements
-    draw_rows(mutable_config, buffer);
-    draw_status_bar(mutable_config, buffer);
-    draw_message_bar(mutable_config);
+    // Draw windows whose content or view changed, and status bars whose
+    // inputs changed
+    for (const auto& window_ptr : window_manager.get_windows()) {
+        Window& window = *window_ptr;
+        {
+            PERF_SCOPE(PERF_SCROLL);
+            scroll(window);
+        }
+        bool window_active = (&window == &active);
+        bool redraw_status = view.full_redraw || window.dirty;
+        if (window_needs_redraw(view, window)) {
+            {
+                PERF_SCOPE(PERF_DRAW_ROWS);
+                draw_rows(frame, view, window);
+            }
+            window.dirty = false;
+            window.drawn_version = window.buffer->get_version();
+            window.drawn_row_offset = window.row_offset;
+            window.drawn_col_offset = window.col_offset;
+            window.drawn_cursor_y = window.cursor_y;
+            window.drawn_folds = window.buffer->get_fold_version();
+            window.drawn_cursors = cursor_set.get_generation();
+            window.drawn_visual = (&window == view.visual_window);
+            window.drawn_search = search_state.get_generation();
+            window.drawn_diff = diff_view.get_generation();
+            window.drawn_columns = column_view.get_generation();
+        }
+        {
+            PERF_SCOPE(PERF_STATUS_BAR);
+            StatusKey status = status_key(view, window, window_active);
+            if (redraw_status || !(status == window.drawn_status)) {
+                draw_status_bar(frame, view, window, window_active);
+                window.drawn_status = status;
+            }
+        }
+    }
+    
+    // Separators between side-by-side windows only change with the layout
+    if (view.full_redraw) {
+        for (const WindowSeparator& separator : window_manager.get_separators()) {
+            for (int row = 0; row < separator.rows; row++) {
+                append_cursor_position(frame, separator.left, separator.top + row);
+                frame += "\x1b[7m|" COLOR_RESET;
+            }
+        }
+    }
+    
+#ifdef PERF_OVERLAY
+    PerfMonitor::draw_overlay(frame, view, *active.buffer);
+#endif
+    draw_message_bar(frame, view);
     
-    // Position cursor and show it
-    int cursor_screen_x = (mutable_config.cursor_x - mutable_config.col_offset) + 
-                         (config.show_line_numbers ? 5 : 0);
-    int cursor_screen_y = (mutable_config.cursor_y - mutable_config.row_offset);
+    // Position cursor in the active window and show it
+    int cursor_screen_x = active.left + (active.cursor_col - active.col_offset) + render_style.gutter;
+    int cursor_screen_y = active.top + active.cursor_row;
+    append_cursor_position(frame, cursor_screen_x, cursor_screen_y);
+    frame += CURSOR_SHOW;
     
-    terminal.set_cursor_position(cursor_screen_x, cursor_screen_y);
-    terminal.show_cursor();
+    // Write the composed frame in one go
+    {
+        PERF_SCOPE(PERF_FLUSH);
+        size_t written = 0;
+        while (written < frame.size()) {
+            ssize_t n = write(output_fd, frame.data() + written, frame.size() - written);
+            output_writes++;
+            if (n <= 0) break;
+            written += static_cast<size_t>(n);
+        }
+        output_bytes += written;
+        span.a = static_cast<long long>(written);
+    }
     
-    // Update global config with scroll offsets
-    editor_config.row_offset = mutable_config.row_offset;
-    editor_config.col_offset = mutable_config.col_offset;
+    // Update global config with scroll offsets and the cursor row, which
+    // moves to the first row of a fold closed over it
+    editor_config.cursor_y = active.cursor_y;
+    editor_config.row_offset = active.row_offset;
+    editor_config.col_offset = active.col_offset;
 }
 
 /**
- * Handle scrolling logic to keep cursor visible
- * @param config Editor configuration (modified with new scroll offsets)
- * @param buffer Text buffer
+ * Handle scrolling logic to keep cursor visible in a window
+ * @param window Window to scroll (modified with new scroll offsets)
  */
-void Renderer::scroll(EditorConfig& config, const Buffer& buffer) {
-    // Ensure cursor stays within buffer bounds
-    if (config.cursor_y >= buffer.get_line_count()) {
-        config.cursor_y = buffer.get_line_count() - 1;
+void Renderer::scroll(Window& window) {
+    const Buffer& buffer = *window.buffer;
+    
+    // Ensure cursor stays within buffer bounds, on a visible row
+    if (window.cursor_y >= buffer.get_line_count()) {
+        window.cursor_y = buffer.get_line_count() - 1;
     }
-    if (config.cursor_y < 0) {
-        config.cursor_y = 0;
+    if (window.cursor_y < 0) {
+        window.cursor_y = 0;
     }
+    window.cursor_y = buffer.visible_row(window.cursor_y);
     
     // Ensure cursor x position is valid for current line
-    int line_length = static_cast<int>(buffer.get_line(config.cursor_y).length());
-    if (config.cursor_x > line_length) {
-        config.cursor_x = line_length;
+    int line_length = static_cast<int>(buffer.view_line(window.cursor_y).length());
+    if (window.cursor_x > line_length) {
+        window.cursor_x = line_length;
     }
-    if (config.cursor_x < 0) {
-        config.cursor_x = 0;
+    if (window.cursor_x < 0) {
+        window.cursor_x = 0;
     }
 
-    // Adjust vertical scroll offset
-    if (config.cursor_y < config.row_offset) {
-        config.row_offset = config.cursor_y;
+    // Text area excludes the line number gutter
+    int text_cols = window.cols - render_style.gutter;
+    if (text_cols < 1) text_cols = 1;
+    int text_rows = window.rows > 0 ? window.rows : 1;
+
+    // Adjust vertical scroll offset, counting screen rows rather than
+    // buffer rows so closed folds take one row each
+    window.row_offset = buffer.visible_row(std::max(0, std::min(window.row_offset, buffer.get_line_count() - 1)));
+    if (window.cursor_y < window.row_offset) {
+        window.row_offset = window.cursor_y;
+    }
+    int screen_row = 0;
+    for (int row = window.row_offset; row < window.cursor_y && screen_row < text_rows; screen_row++) {
+        row = buffer.next_visible(row);
     }
-    if (config.cursor_y >= config.row_offset + config.screen_rows) {
-        config.row_offset = config.cursor_y - config.screen_rows + 1;
+    if (screen_row >= text_rows) {
+        // Cursor is below the window: put it on the last row
+        window.row_offset = window.cursor_y;
+        for (screen_row = 0; screen_row < text_rows - 1 && window.row_offset > 0; screen_row++) {
+            window.row_offset = buffer.prev_visible(window.row_offset);
+        }
     }
     
-    // Adjust horizontal scroll offset
-    if (config.cursor_x < config.col_offset) {
-        config.col_offset = config.cursor_x;
+    // The sticky header of delimited text covers the row at the offset
+    bool columns = column_view.active(buffer);
+    if (columns && screen_row == 0 && window.row_offset > 0 && text_rows > 1) {
+        window.row_offset = buffer.prev_visible(window.row_offset);
+        screen_row = 1;
     }
-    if (config.cursor_x >= config.col_offset + config.screen_cols) {
-        config.col_offset = config.cursor_x - config.screen_cols + 1;
+    window.cursor_row = screen_row;
+    
+    // Adjust horizontal scroll offset, in laid out columns for delimited text
+    window.cursor_col = columns ? column_view.display_col(buffer, window.cursor_y, window.cursor_x) : window.cursor_x;
+    if (window.cursor_col < window.col_offset) {
+        window.col_offset = window.cursor_col;
+    }
+    if (window.cursor_col >= window.col_offset + text_cols) {
+        window.col_offset = window.cursor_col - text_cols + 1;
     }
-}
\ No newline at end of file
+}
+
+/**
+ * Send frames to another file descriptor
+ * @param fd Destination, STDOUT_FILENO for the terminal
+ */
+void Renderer::set_output(int fd) {
+    output_fd = fd;
+}
+
+/**
+ * Get totals of frame output since startup
+ * @param writes Receives number of write calls
+ * @param bytes Receives number of bytes written
+ */
+void Renderer::get_output_stats(unsigned long& writes, unsigned long& bytes) {
+    writes = output_writes;
+    bytes = output_bytes;
+}
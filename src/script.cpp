@@ -0,0 +1,139 @@
+#include "../include/slowertext.h"
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unistd.h>
+
+/**
+ * Check whether a status message reports a failure
+ * @param message Status message set by a command
+ * @return True for errors that should be reported on stderr
+ */
+static bool is_error_message(const std::string& message) {
+    return message.compare(0, 5, "Error") == 0 ||
+           message.compare(0, 15, "Unknown command") == 0 ||
+           message.compare(0, 14, "Critical error") == 0;
+}
+
+/**
+ * Read a whole script file, "-" for standard input
+ * @param path Script path
+ * @param text Receives the script
+ * @return True if the script could be read
+ */
+static bool read_script(const std::string& path, std::string& text) {
+    std::ostringstream content;
+    if (path == "-") {
+        content << std::cin.rdbuf();
+    } else {
+        std::ifstream file(path, std::ios::binary);
+        if (!file.is_open()) {
+            return false;
+        }
+        content << file.rdbuf();
+    }
+    text = content.str();
+    return true;
+}
+
+/**
+ * Run a script against files
+ * Ex scripts hold one command per line (a leading ':' is optional, lines
+ * starting with '"' are comments); keystroke scripts are fed byte by byte
+ * to the same key handling as the terminal. Nothing is rendered and the
+ * terminal is never touched. Unless the script quits by itself, the
+ * active buffer is then written to the output, or saved back to its file
+ * if it was modified.
+ * @param config Editor configuration
+ * @param script_path Script file, "-" for standard input
+ * @param keystrokes True if the script holds raw keystrokes rather than ex commands
+ * @param files Files to open as buffers
+ * @param output Destination for the result ("-" for stdout), empty to write back to the file
+ * @return Process exit status
+ */
+int ScriptRunner::run(EditorConfig& config, const std::string& script_path, bool keystrokes,
+                      const std::vector<std::string>& files, const std::string& output) {
+    std::string script;
+    if (!read_script(script_path, script)) {
+        std::cerr << "slowertext: cannot read script " << script_path << "\n";
+        return 2;
+    }
+
+    if (files.empty()) {
+        buffer_list.open("");
+    } else {
+        buffer_list.open_files(files);
+    }
+    window_manager.init(buffer_list.get(0).buffer);
+    if (!buffer_list.activate(0, window_manager.get_active(), config)) {
+        std::cerr << "slowertext: cannot load " << files[0] << "\n";
+        return 2;
+    }
+
+    auto started = std::chrono::steady_clock::now();
+    int errors = 0;
+    long steps = 0;
+
+    if (keystrokes) {
+        InputHandler::set_script_input(script);
+        while (!config.quit && InputHandler::wait_for_input(0)) {
+            config.status_msg.clear();
+            // Nothing is drawn, but splits still need window sizes
+            window_manager.update_layout(config.screen_rows + 1, config.screen_cols);
+            InputHandler::process_keypress(config, *window_manager.get_active().buffer);
+            steps++;
+            if (is_error_message(config.status_msg)) {
+                std::cerr << script_path << ": key " << steps << ": " << config.status_msg << "\n";
+                errors++;
+            }
+        }
+    } else {
+        std::istringstream lines(script);
+        std::string command;
+        int line_number = 0;
+        while (!config.quit && std::getline(lines, command)) {
+            line_number++;
+            if (!command.empty() && command.back() == '\r') {
+                command.pop_back();
+            }
+            size_t start = command.find_first_not_of(" \t:");
+            if (start == std::string::npos || command[start] == '"') {
+                continue;
+            }
+
+            config.status_msg.clear();
+            window_manager.update_layout(config.screen_rows + 1, config.screen_cols);
+            InputHandler::process_command(config, *window_manager.get_active().buffer, command.substr(start));
+            steps++;
+            if (is_error_message(config.status_msg)) {
+                std::cerr << script_path << ":" << line_number << ": " << config.status_msg << "\n";
+                errors++;
+            }
+        }
+    }
+
+    // Write the result unless the script ended the session itself
+    if (!config.quit) {
+        Buffer& buffer = *window_manager.get_active().buffer;
+        bool written = true;
+        if (output == "-") {
+            written = FileManager::write_buffer(STDOUT_FILENO, buffer);
+        } else if (!output.empty()) {
+            written = FileManager::save_file(output, buffer);
+        } else if (buffer.is_modified()) {
+            written = FileManager::save_file(buffer.get_filename(), buffer);
+        }
+        if (!written) {
+            std::cerr << "slowertext: cannot write " << (output.empty() ? buffer.get_filename() : output) << "\n";
+            return 2;
+        }
+    }
+
+    if (config.debug_mode) {
+        double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+        std::cerr << "slowertext: " << steps << (keystrokes ? " keys" : " commands") << " in "
+                  << elapsed << " ms, " << errors << " errors\n";
+    }
+    return errors > 0 ? 1 : 0;
+}
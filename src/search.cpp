@@ -0,0 +1,377 @@
+#include "../include/slowertext.h"
+#include <algorithm>
+#include <cstring>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Lines handed to the match list per background chunk
+static const int SCAN_CHUNK_LINES = 65536;
+
+/**
+ * SearchState constructor
+ */
+SearchState::SearchState()
+    : buffer(nullptr), cancel(false), done(true), generation(0),
+      stale(false), report(false), reported(0) {
+}
+
+/**
+ * SearchState destructor
+ * Joins the background scanner before members go away
+ */
+SearchState::~SearchState() {
+    stop();
+}
+
+/**
+ * Find a literal needle in a byte range
+ * With SSE2, 16 candidate positions are tested at once by comparing the
+ * first and last needle bytes; only positions where both match are
+ * verified with memcmp. Without SSE2, memchr finds first-byte candidates.
+ * @param haystack Text to search
+ * @param length Length of text
+ * @param needle Pattern to find
+ * @param needle_length Length of pattern
+ * @return Offset of first match or std::string::npos
+ */
+size_t SearchState::find_literal(const char* haystack, size_t length, const char* needle, size_t needle_length) {
+    if (needle_length == 0 || needle_length > length) {
+        return std::string::npos;
+    }
+    if (needle_length == 1) {
+        const void* hit = memchr(haystack, needle[0], length);
+        return hit ? static_cast<const char*>(hit) - haystack : std::string::npos;
+    }
+
+    size_t last_start = length - needle_length;  // Last valid match offset
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[needle_length - 1]);
+
+    // Both 16-byte loads must stay inside the haystack
+    while (i + 16 <= last_start + 1) {
+        __m128i block_first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(haystack + i));
+        __m128i block_last = _mm_loadu_si128(reinterpret_cast<const __m128i*>(haystack + i + needle_length - 1));
+        unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(first, block_first), _mm_cmpeq_epi8(last, block_last))));
+
+        while (mask != 0) {
+            unsigned int bit = static_cast<unsigned int>(__builtin_ctz(mask));
+            if (memcmp(haystack + i + bit + 1, needle + 1, needle_length - 2) == 0) {
+                return i + bit;
+            }
+            mask &= mask - 1;
+        }
+        i += 16;
+    }
+#endif
+
+    // Scalar tail (or whole range without SSE2)
+    while (i <= last_start) {
+        const void* hit = memchr(haystack + i, needle[0], last_start - i + 1);
+        if (!hit) {
+            break;
+        }
+        size_t pos = static_cast<const char*>(hit) - haystack;
+        if (haystack[pos + needle_length - 1] == needle[needle_length - 1] &&
+            memcmp(haystack + pos + 1, needle + 1, needle_length - 2) == 0) {
+            return pos;
+        }
+        i = pos + 1;
+    }
+    return std::string::npos;
+}
+
+/**
+ * Stop the background scanner and wait for it
+ */
+void SearchState::stop() {
+    if (worker.joinable()) {
+        cancel = true;
+        worker.join();
+    }
+    cancel = false;
+}
+
+/**
+ * Background scan of the whole buffer
+ * Matches are collected per chunk and published under the mutex, so
+ * counts and highlights grow while the scan runs. The buffer is not
+ * modified meanwhile: the edit hook joins this thread first.
+ * @param target Buffer to scan
+ * @param needle Literal pattern
+ */
+void SearchState::scan(const Buffer* target, std::string needle) {
+    TraceSpan span(TRACE_SEARCH_SCAN);
+    const std::vector<Line>& lines = target->get_lines();
+    int line_count = static_cast<int>(lines.size());
+    std::vector<SearchMatch> chunk;
+
+    for (int start = 0; start < line_count && !cancel; start += SCAN_CHUNK_LINES) {
+        int end = std::min(line_count, start + SCAN_CHUNK_LINES);
+        chunk.clear();
+        for (int y = start; y < end; y++) {
+            if ((y & 1023) == 0 && cancel) {
+                return;
+            }
+            const Line& line = lines[y];
+            size_t from = 0;
+            while (from + needle.size() <= line.size()) {
+                size_t pos = find_literal(line.data() + from, line.size() - from, needle.data(), needle.size());
+                if (pos == std::string::npos) {
+                    break;
+                }
+                chunk.push_back({y, static_cast<int>(from + pos)});
+                from += pos + needle.size();
+            }
+        }
+
+        if (!chunk.empty()) {
+            std::lock_guard<std::mutex> lock(mutex);
+            matches.insert(matches.end(), chunk.begin(), chunk.end());
+            generation++;
+            span.a += static_cast<long long>(chunk.size());
+        }
+    }
+
+    if (!cancel) {
+        done = true;
+        generation++;
+    }
+}
+
+/**
+ * Start a background scan for a pattern, replacing any previous one
+ * @param target Buffer to scan
+ * @param needle Literal pattern, empty clears the search
+ */
+void SearchState::start(const Buffer& target, const std::string& needle) {
+    stop();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        matches.clear();
+    }
+    generation++;
+    pattern = needle;
+    buffer = &target;
+    stale = false;
+    done = needle.empty();
+
+    if (!needle.empty()) {
+        // The worker reads the line vector, so fold in the edit gap here
+        target.get_lines();
+        worker = std::thread(&SearchState::scan, this, buffer, needle);
+    }
+}
+
+/**
+ * Stop scanning and forget the pattern and matches
+ */
+void SearchState::clear() {
+    stop();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        matches.clear();
+    }
+    generation++;
+    pattern.clear();
+    buffer = nullptr;
+    stale = false;
+    done = true;
+    report = false;
+}
+
+/**
+ * Edit hook: stop scanning before a buffer changes
+ * The cached matches become stale and are rebuilt on the next idle tick
+ * @param target Buffer about to change
+ */
+void SearchState::on_edit(const Buffer* target) {
+    if (target != buffer || pattern.empty()) {
+        return;
+    }
+    stop();
+    if (!stale) {
+        std::lock_guard<std::mutex> lock(mutex);
+        matches.clear();
+        stale = true;
+        generation++;
+    }
+}
+
+/**
+ * Idle processing on the main thread
+ * Restarts scans invalidated by edits and reports progress
+ * @param config Editor configuration (cursor for match index)
+ * @return True if matches changed since the last call
+ */
+bool SearchState::poll(const EditorConfig& config) {
+    if (stale && buffer && !pattern.empty()) {
+        start(*buffer, pattern);
+    }
+
+    unsigned long current = generation;
+    if (current == reported) {
+        return false;
+    }
+    reported = current;
+    if (report && !pattern.empty()) {
+        set_status_message(describe(config.cursor_y, config.cursor_x));
+    }
+    return true;
+}
+
+/**
+ * Synchronously find the next match from a position
+ * Searching wraps around the end (or start) of the buffer
+ * @param target Buffer to search
+ * @param needle Literal pattern
+ * @param line Start row, receives match row
+ * @param col Start column, receives match column
+ * @param forward Search direction
+ * @param max_lines Number of lines to examine, 0 for the whole buffer
+ * @return True if a match was found
+ */
+bool SearchState::find_next(const Buffer& target, const std::string& needle, int& line, int& col,
+                            bool forward, int max_lines) {
+    if (needle.empty()) {
+        return false;
+    }
+    const std::vector<Line>& lines = target.get_lines();
+    int line_count = static_cast<int>(lines.size());
+    int limit = (max_lines > 0 && max_lines < line_count + 1) ? max_lines : line_count + 1;
+
+    for (int step = 0; step < limit; step++) {
+        int y = forward ? (line + step) % line_count : ((line - step) % line_count + line_count) % line_count;
+        const Line& text = lines[y];
+
+        if (forward) {
+            // First visit starts after the cursor, the wrapped visit covers the rest
+            size_t from = (step == 0) ? static_cast<size_t>(col) + 1 : 0;
+            if (from > text.size()) {
+                continue;
+            }
+            size_t pos = find_literal(text.data() + from, text.size() - from, needle.data(), needle.size());
+            if (pos != std::string::npos) {
+                line = y;
+                col = static_cast<int>(from + pos);
+                return true;
+            }
+        } else {
+            // Last match strictly before the cursor column
+            size_t end = (step == 0) ? static_cast<size_t>(std::max(col, 0)) : text.size();
+            if (step == 0 && end == 0) {
+                continue;
+            }
+            end = std::min(end + needle.size() - 1, text.size());
+            size_t from = 0;
+            int found = -1;
+            while (from + needle.size() <= end) {
+                size_t pos = find_literal(text.data() + from, end - from, needle.data(), needle.size());
+                if (pos == std::string::npos) {
+                    break;
+                }
+                found = static_cast<int>(from + pos);
+                from += pos + 1;
+            }
+            if (found >= 0) {
+                line = y;
+                col = found;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/**
+ * Collect cached matches within a row range
+ * @param target Buffer being drawn
+ * @param first First row
+ * @param last Row after the last one
+ * @param out Receives matches in order
+ */
+void SearchState::visible_matches(const Buffer& target, int first, int last, std::vector<SearchMatch>& out) const {
+    out.clear();
+    if (&target != buffer || pattern.empty()) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = std::lower_bound(matches.begin(), matches.end(), first,
+                               [](const SearchMatch& match, int row) { return match.line < row; });
+    for (; it != matches.end() && it->line < last; ++it) {
+        out.push_back(*it);
+    }
+}
+
+/**
+ * Build the match counter shown in the message bar
+ * A trailing + means the background scan is still running
+ * @param line Cursor row
+ * @param col Cursor column
+ * @return Text such as "/foo [3/42]"
+ */
+std::string SearchState::describe(int line, int col) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::string text = "/" + pattern + " [";
+
+    auto it = std::lower_bound(matches.begin(), matches.end(), SearchMatch{line, col},
+                               [](const SearchMatch& a, const SearchMatch& b) {
+                                   return a.line < b.line || (a.line == b.line && a.col < b.col);
+                               });
+    if (it != matches.end() && it->line == line && it->col == col) {
+        text += std::to_string(it - matches.begin() + 1);
+    } else {
+        text += "?";
+    }
+    text += "/" + std::to_string(matches.size()) + (done ? "]" : "+]");
+    return text;
+}
+
+/**
+ * Show match counts in the message bar as the scan progresses
+ * @param enable Whether to report
+ */
+void SearchState::set_report(bool enable) {
+    report = enable;
+    reported = 0;
+}
+
+/**
+ * Get the current pattern
+ * @return Pattern, empty if no search
+ */
+const std::string& SearchState::get_pattern() const {
+    return pattern;
+}
+
+/**
+ * Check whether the worker may be reading a buffer
+ * A finished worker that was not joined yet no longer reads.
+ * @param target Buffer to check
+ * @return True while a scan of target runs
+ */
+bool SearchState::scanning(const Buffer* target) const {
+    return target == buffer && worker.joinable() && !done;
+}
+
+/**
+ * Check whether the matches are of a buffer
+ * @param target Buffer to check
+ * @return True if target is the searched buffer
+ */
+bool SearchState::active(const Buffer& target) const {
+    return buffer == &target;
+}
+
+/**
+ * Get the change counter of the match list
+ * @return Generation number
+ */
+unsigned long SearchState::get_generation() const {
+    return generation;
+}
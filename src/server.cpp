@@ -0,0 +1,649 @@
+#include "../include/slowertext.h"
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+/*
+ * Wire protocol. A client sends one request header; an attach carries
+ * the client's terminal (stdin and stdout) as SCM_RIGHTS and is followed
+ * by the NUL-terminated absolute paths of the files to open. While
+ * attached the client only sends CLIENT_RESIZE bytes. The server answers
+ * every request with a single reply byte.
+ */
+struct ServerRequest {
+    char magic[4];                   // REQUEST_MAGIC
+    unsigned int command;            // ServerCommand
+    unsigned int length;             // Bytes of file names that follow
+};
+
+enum ServerCommand {
+    SERVER_ATTACH = 1,
+    SERVER_STOP = 2
+};
+
+static const char REQUEST_MAGIC[4] = {'S', 'T', 'X', '1'};
+static const unsigned int MAX_REQUEST_LENGTH = 1 << 20;
+static const int REQUEST_TIMEOUT_MS = 500;   // Longest wait for a request before dropping the client
+static const char REPLY_DONE = 'D';     // Session ended
+static const char REPLY_BUSY = 'B';     // Another client is attached
+static const char REPLY_STOPPED = 'S';  // Server is exiting
+static const char REPLY_MODIFIED = 'M'; // Stop refused: unsaved buffers
+static const char REPLY_ERROR = 'E';    // Malformed request
+static const char CLIENT_RESIZE = 'W';  // Client terminal was resized
+
+// Server state while a client is attached
+static int listen_fd = -1;
+static int session_fd = -1;
+static bool windows_ready = false;
+
+// Client state
+static volatile sig_atomic_t resize_pending = 0;
+
+/**
+ * Get the path of the server socket
+ * $XDG_RUNTIME_DIR/slowertext.sock, or a private directory in /tmp
+ * @return Socket path, empty if no safe location exists
+ */
+std::string Server::socket_path() {
+    const char* runtime_dir = getenv("XDG_RUNTIME_DIR");
+    if (runtime_dir && runtime_dir[0] == '/') {
+        return std::string(runtime_dir) + "/slowertext.sock";
+    }
+
+    // Anyone could have created the directory first; only use our own
+    std::string directory = "/tmp/slowertext-" + std::to_string(getuid());
+    mkdir(directory.c_str(), 0700);
+    struct stat info;
+    if (lstat(directory.c_str(), &info) != 0 || !S_ISDIR(info.st_mode) || info.st_uid != getuid() ||
+        (info.st_mode & 077) != 0) {
+        return "";
+    }
+    return directory + "/server.sock";
+}
+
+/**
+ * Fill in a socket address
+ * @param path Socket path
+ * @param address Address to fill
+ * @return False if the path is too long
+ */
+static bool make_address(const std::string& path, struct sockaddr_un& address) {
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    memcpy(address.sun_path, path.c_str(), path.size());
+    return true;
+}
+
+/**
+ * Connect to the server socket
+ * @param path Socket path
+ * @return Connected socket, or -1 if no server is listening
+ */
+static int connect_server(const std::string& path) {
+    struct sockaddr_un address;
+    if (!make_address(path, address)) {
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Read exactly the requested number of bytes
+ * @param fd Source descriptor
+ * @param data Destination
+ * @param length Bytes to read
+ * @return False on error or end of stream
+ */
+static bool read_exact(int fd, char* data, size_t length) {
+    while (length > 0) {
+        ssize_t count = read(fd, data, length);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return false;
+        }
+        data += count;
+        length -= static_cast<size_t>(count);
+    }
+    return true;
+}
+
+/**
+ * Send a one-byte reply
+ * @param fd Client socket
+ * @param reply Reply code
+ */
+static void send_reply(int fd, char reply) {
+    ssize_t ignored = write(fd, &reply, 1);
+    (void)ignored;
+}
+
+/**
+ * Send a request, passing this process's terminal for an attach
+ * @param fd Server socket
+ * @param command Request command
+ * @param payload File names following the header
+ * @return True if sent
+ */
+static bool send_request(int fd, ServerCommand command, const std::string& payload) {
+    ServerRequest request;
+    memcpy(request.magic, REQUEST_MAGIC, sizeof(request.magic));
+    request.command = command;
+    request.length = static_cast<unsigned int>(payload.size());
+
+    struct iovec iov;
+    iov.iov_base = &request;
+    iov.iov_len = sizeof(request);
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+
+    alignas(struct cmsghdr) char control[CMSG_SPACE(2 * sizeof(int))];
+    if (command == SERVER_ATTACH) {
+        int terminal_fds[2] = {STDIN_FILENO, STDOUT_FILENO};
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+        header->cmsg_level = SOL_SOCKET;
+        header->cmsg_type = SCM_RIGHTS;
+        header->cmsg_len = CMSG_LEN(sizeof(terminal_fds));
+        memcpy(CMSG_DATA(header), terminal_fds, sizeof(terminal_fds));
+    }
+
+    if (sendmsg(fd, &message, 0) != static_cast<ssize_t>(sizeof(request))) {
+        return false;
+    }
+    size_t sent = 0;
+    while (sent < payload.size()) {
+        ssize_t count = write(fd, payload.data() + sent, payload.size() - sent);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return false;
+        }
+        sent += static_cast<size_t>(count);
+    }
+    return true;
+}
+
+/**
+ * Receive a request header and any passed descriptors
+ * @param fd Client socket
+ * @param request Receives the header
+ * @param fds Receives up to two descriptors, -1 where none was passed
+ * @return True if a well-formed header arrived
+ */
+static bool receive_request(int fd, ServerRequest& request, int fds[2]) {
+    fds[0] = -1;
+    fds[1] = -1;
+    struct iovec iov;
+    iov.iov_base = &request;
+    iov.iov_len = sizeof(request);
+    alignas(struct cmsghdr) char control[CMSG_SPACE(2 * sizeof(int))];
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    ssize_t count = recvmsg(fd, &message, MSG_CMSG_CLOEXEC);
+    if (count < 0) {
+        return false;
+    }
+    for (struct cmsghdr* header = CMSG_FIRSTHDR(&message); header; header = CMSG_NXTHDR(&message, header)) {
+        if (header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+        size_t passed = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        int* data = reinterpret_cast<int*>(CMSG_DATA(header));
+        for (size_t i = 0; i < passed; i++) {
+            if (i < 2 && fds[i] == -1) {
+                fds[i] = data[i];
+            } else {
+                close(data[i]);
+            }
+        }
+    }
+
+    // The header is tiny, but a stream socket may still split it
+    if (count > 0 && count < static_cast<ssize_t>(sizeof(request))) {
+        if (read_exact(fd, reinterpret_cast<char*>(&request) + count, sizeof(request) - count)) {
+            count = sizeof(request);
+        }
+    }
+    return count == static_cast<ssize_t>(sizeof(request)) &&
+           memcmp(request.magic, REQUEST_MAGIC, sizeof(request.magic)) == 0 &&
+           request.length <= MAX_REQUEST_LENGTH;
+}
+
+/**
+ * Point a standard descriptor at /dev/null
+ * @param fd Descriptor to replace
+ */
+static void redirect_to_null(int fd) {
+    int null_fd = open("/dev/null", O_RDWR);
+    if (null_fd >= 0) {
+        dup2(null_fd, fd);
+        close(null_fd);
+    }
+}
+
+/**
+ * Read the terminal size into the configuration
+ * @param config Editor configuration
+ */
+static void update_window_size(EditorConfig& config) {
+    if (terminal.get_window_size(&config.screen_rows, &config.screen_cols) == -1) {
+        config.screen_rows = 24;
+        config.screen_cols = 80;
+    }
+    config.screen_rows -= 2;  // Reserve space for status and message bars
+}
+
+/**
+ * Idle hook of a session
+ * Handles resize notices and the client going away, and turns away
+ * other clients while this one is attached.
+ * @param config Editor configuration
+ * @return True if the screen needs a refresh
+ */
+static bool session_idle(EditorConfig& config) {
+    struct pollfd fds[2];
+    fds[0].fd = session_fd;
+    fds[0].events = POLLIN;
+    fds[0].revents = 0;
+    fds[1].fd = listen_fd;
+    fds[1].events = POLLIN;
+    fds[1].revents = 0;
+    if (poll(fds, 2, 0) <= 0) {
+        return false;
+    }
+
+    if (fds[1].revents & POLLIN) {
+        int other = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (other >= 0) {
+            send_reply(other, REPLY_BUSY);
+            close(other);
+        }
+    }
+
+    bool redraw = false;
+    if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+        char messages[64];
+        ssize_t count = read(session_fd, messages, sizeof(messages));
+        if (count <= 0) {
+            // Client is gone; keep the buffers and wait for the next one
+            config.quit = true;
+            return false;
+        }
+        if (memchr(messages, CLIENT_RESIZE, static_cast<size_t>(count))) {
+            update_window_size(config);
+            redraw = true;
+        }
+    }
+    return redraw;
+}
+
+/**
+ * Run an editing session on a client's terminal
+ * @param config Editor configuration
+ * @param client_fd Client socket
+ * @param tty_fds Client stdin and stdout
+ * @param filenames Absolute paths of files to open
+ * @return False if the passed descriptors are not a terminal
+ */
+static bool run_session(EditorConfig& config, int client_fd, const int tty_fds[2],
+                        const std::vector<std::string>& filenames) {
+    if (!isatty(tty_fds[0]) || !isatty(tty_fds[1])) {
+        return false;
+    }
+    dup2(tty_fds[0], STDIN_FILENO);
+    dup2(tty_fds[1], STDOUT_FILENO);
+    session_fd = client_fd;
+
+    terminal.enable_raw_mode();
+    update_window_size(config);
+    int reloaded = buffer_list.refresh_stale();
+
+    // Files named by the client become buffers; ones already open are reused
+    int index = -1;
+    if (!filenames.empty()) {
+        buffer_list.open_files(filenames);
+        index = buffer_list.open(filenames[0]);
+    } else if (!windows_ready) {
+        index = buffer_list.open("");
+    }
+    if (!windows_ready) {
+        window_manager.init(buffer_list.get(index).buffer);
+        windows_ready = true;
+    }
+    if (index >= 0) {
+        buffer_list.activate(index, window_manager.get_active(), config);
+    } else {
+        window_manager.load_cursor(config);
+    }
+
+    std::string message = "Attached: " + std::to_string(buffer_list.count()) + " buffers";
+    if (reloaded > 0) {
+        message += ", " + std::to_string(reloaded) + " reloaded from disk";
+    }
+    set_status_message(message);
+    config.quit = false;
+    config.mode = INSERT_MODE;
+    window_manager.invalidate();
+
+    InputHandler::run_loop(config, session_idle);
+
+    // Hand the terminal back the way the client gave it
+    window_manager.store_cursor(config);
+    struct termios settings;
+    if (tcgetattr(STDIN_FILENO, &settings) == 0) {
+        terminal.clear_screen();
+        terminal.set_cursor_position(0, 0);
+        terminal.show_cursor();
+        terminal.disable_raw_mode();
+    } else {
+        terminal.abandon_raw_mode();
+    }
+    redirect_to_null(STDIN_FILENO);
+    redirect_to_null(STDOUT_FILENO);
+    session_fd = -1;
+    config.quit = false;
+    return true;
+}
+
+/**
+ * Serve one client connection
+ * @param config Editor configuration
+ * @param client_fd Accepted socket
+ * @return True if the server should exit
+ */
+static bool handle_client(EditorConfig& config, int client_fd) {
+    // The accept loop serves one client at a time, so one that connects
+    // and sends nothing must not stall it
+    struct timeval timeout;
+    timeout.tv_sec = REQUEST_TIMEOUT_MS / 1000;
+    timeout.tv_usec = (REQUEST_TIMEOUT_MS % 1000) * 1000;
+    setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    ServerRequest request;
+    int tty_fds[2];
+    bool valid = receive_request(client_fd, request, tty_fds);
+    std::string payload(valid ? request.length : 0, '\0');
+    if (valid && !payload.empty()) {
+        valid = read_exact(client_fd, &payload[0], payload.size());
+    }
+
+    bool stop = false;
+    if (!valid) {
+        send_reply(client_fd, REPLY_ERROR);
+    } else if (request.command == SERVER_STOP) {
+        stop = buffer_list.first_modified() < 0;
+        send_reply(client_fd, stop ? REPLY_STOPPED : REPLY_MODIFIED);
+    } else if (request.command == SERVER_ATTACH) {
+        std::vector<std::string> filenames;
+        size_t start = 0;
+        for (size_t end; (end = payload.find('\0', start)) != std::string::npos; start = end + 1) {
+            filenames.push_back(payload.substr(start, end - start));
+        }
+        bool ran = tty_fds[0] >= 0 && tty_fds[1] >= 0 && run_session(config, client_fd, tty_fds, filenames);
+        send_reply(client_fd, ran ? REPLY_DONE : REPLY_ERROR);
+    } else {
+        send_reply(client_fd, REPLY_ERROR);
+    }
+
+    for (int fd : tty_fds) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+    close(client_fd);
+    return stop;
+}
+
+/**
+ * Make a path absolute against the working directory
+ * Clients and the server run in different directories, so buffers are
+ * always named by absolute path.
+ * @param name File name from the command line
+ * @return Absolute path
+ */
+static std::string absolute_path(const std::string& name) {
+    if (!name.empty() && name[0] == '/') {
+        return name;
+    }
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd))) {
+        return name;
+    }
+    return std::string(cwd) + "/" + name;
+}
+
+/**
+ * Start the server in the background and serve clients until stopped
+ * The socket is bound before forking, so a client started right after
+ * --daemon returns finds it.
+ * @param config Editor configuration, already loaded
+ * @param filenames Files to load before the first client attaches
+ * @return Exit status
+ */
+int Server::serve(EditorConfig& config, const std::vector<std::string>& filenames) {
+    std::string path = socket_path();
+    struct sockaddr_un address;
+    if (!make_address(path, address)) {
+        std::cerr << "Error: No usable socket path for the server\n";
+        return 1;
+    }
+    int probe = connect_server(path);
+    if (probe >= 0) {
+        close(probe);
+        std::cerr << "Error: A server is already running at " << path << "\n";
+        return 1;
+    }
+
+    // Nothing answered, so any socket file left there is stale
+    unlink(path.c_str());
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0 || bind(listen_fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0 ||
+        listen(listen_fd, 4) != 0) {
+        std::cerr << "Error: Cannot listen on " << path << ": " << strerror(errno) << "\n";
+        return 1;
+    }
+    chmod(path.c_str(), 0600);
+    std::cerr << "Server listening on " << path << "\n";
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        std::cerr << "Error: Cannot start server: " << strerror(errno) << "\n";
+        unlink(path.c_str());
+        return 1;
+    }
+    if (pid > 0) {
+        _exit(0);
+    }
+    setsid();
+    redirect_to_null(STDIN_FILENO);
+    redirect_to_null(STDOUT_FILENO);
+    redirect_to_null(STDERR_FILENO);
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGHUP, SIG_IGN);
+    ConfigManager::watch_config();
+
+    // Stored under the same absolute names clients send
+    if (!filenames.empty()) {
+        std::vector<std::string> paths;
+        for (const std::string& name : filenames) {
+            paths.push_back(absolute_path(name));
+        }
+        buffer_list.open_files(paths);
+    }
+
+    for (;;) {
+        struct pollfd pfd;
+        pfd.fd = listen_fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        int ready = poll(&pfd, 1, 1000);
+        ConfigManager::poll_changes(config);
+        if (ready <= 0) {
+            continue;
+        }
+        int client_fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client_fd >= 0 && handle_client(config, client_fd)) {
+            break;
+        }
+    }
+
+    close(listen_fd);
+    unlink(path.c_str());
+    return 0;
+}
+
+/**
+ * Note a resize of the client terminal
+ * @param sig Signal number
+ */
+static void note_resize(int sig) {
+    (void)sig;
+    resize_pending = 1;
+}
+
+/**
+ * Print what a reply byte means
+ * @param reply Reply from the server
+ * @return Exit status
+ */
+static int report_reply(char reply) {
+    switch (reply) {
+        case REPLY_DONE:
+        case REPLY_STOPPED:
+            return 0;
+        case REPLY_BUSY:
+            std::cerr << "Error: Server is busy with another client\n";
+            return 1;
+        case REPLY_MODIFIED:
+            std::cerr << "Error: Server has unsaved buffers; attach and save them first\n";
+            return 1;
+        default:
+            std::cerr << "Error: Server rejected the request\n";
+            return 1;
+    }
+}
+
+/**
+ * Attach this terminal to the running server
+ * The client only waits: the server reads and writes the terminal
+ * itself. Resizes are forwarded, since the server is not in the
+ * terminal's session and gets no SIGWINCH.
+ * @param filenames Files to open as buffers
+ * @return Exit status
+ */
+int Server::attach(const std::vector<std::string>& filenames) {
+    if (!isatty(STDIN_FILENO) || !isatty(STDOUT_FILENO)) {
+        std::cerr << "Error: --attach needs a terminal\n";
+        return 1;
+    }
+    std::string path = socket_path();
+    int fd = connect_server(path);
+    if (fd < 0) {
+        std::cerr << "Error: No server running (start one with --daemon)\n";
+        return 1;
+    }
+
+    std::string payload;
+    for (const std::string& name : filenames) {
+        payload += absolute_path(name);
+        payload += '\0';
+    }
+
+    // SIGWINCH is only taken inside ppoll, so none is lost between checks
+    sigset_t resize_mask;
+    sigset_t wait_mask;
+    sigemptyset(&resize_mask);
+    sigaddset(&resize_mask, SIGWINCH);
+    sigprocmask(SIG_BLOCK, &resize_mask, &wait_mask);
+    sigdelset(&wait_mask, SIGWINCH);
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = note_resize;
+    sigaction(SIGWINCH, &action, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+
+    if (!send_request(fd, SERVER_ATTACH, payload)) {
+        std::cerr << "Error: Cannot reach the server\n";
+        close(fd);
+        return 1;
+    }
+
+    for (;;) {
+        struct pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        int ready = ppoll(&pfd, 1, nullptr, &wait_mask);
+        if (ready < 0 && errno == EINTR) {
+            if (resize_pending) {
+                resize_pending = 0;
+                send_reply(fd, CLIENT_RESIZE);
+            }
+            continue;
+        }
+        char reply = REPLY_ERROR;
+        bool answered = ready > 0 && read_exact(fd, &reply, 1);
+        close(fd);
+        if (!answered) {
+            std::cerr << "Error: Server closed the connection\n";
+            return 1;
+        }
+        return report_reply(reply);
+    }
+}
+
+/**
+ * Ask the running server to exit
+ * @return Exit status
+ */
+int Server::stop() {
+    int fd = connect_server(socket_path());
+    if (fd < 0) {
+        std::cerr << "Error: No server running\n";
+        return 1;
+    }
+    char reply = REPLY_ERROR;
+    bool answered = send_request(fd, SERVER_STOP, "") && read_exact(fd, &reply, 1);
+    close(fd);
+    if (!answered) {
+        std::cerr << "Error: Server closed the connection\n";
+        return 1;
+    }
+    return report_reply(reply);
+}
+
+/**
+ * Check whether a client session is running in this process
+ * @return True inside a server session
+ */
+bool Server::is_attached() {
+    return session_fd >= 0;
+}
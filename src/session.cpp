@@ -0,0 +1,291 @@
+#include "../include/slowertext.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fcntl.h>
+#include <fstream>
+#include <sstream>
+
+/*
+ * Session file format, one record per line:
+ *   F <file>               file the editor was started with
+ *   S <usec> <rows> <cols> terminal size, logged when it changes
+ *   K <usec> <hex bytes>   raw input bytes of one key
+ * Times are microseconds since recording started.
+ */
+
+// Open session log while recording
+static FILE* record_file = nullptr;
+static std::chrono::steady_clock::time_point record_start;
+static int recorded_rows = -1;
+static int recorded_cols = -1;
+
+// Upper bounds (microseconds) of the latency histogram buckets
+static const double LATENCY_BUCKETS[] = {50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000};
+static const int LATENCY_BUCKET_COUNT = sizeof(LATENCY_BUCKETS) / sizeof(LATENCY_BUCKETS[0]);
+
+/**
+ * Flush and close the session log at exit
+ */
+static void finish_recording() {
+    if (record_file) {
+        fclose(record_file);
+        record_file = nullptr;
+    }
+}
+
+/**
+ * Start logging keys to a session file
+ * @param path Session file to create
+ * @param files Files the editor was started with
+ * @return True if the file could be created
+ */
+bool Session::start_recording(const std::string& path, const std::vector<std::string>& files) {
+    record_file = fopen(path.c_str(), "w");
+    if (!record_file) {
+        return false;
+    }
+    fprintf(record_file, "# slowertext session 1\n");
+    for (const std::string& file : files) {
+        fprintf(record_file, "F %s\n", file.c_str());
+    }
+    fflush(record_file);
+    record_start = std::chrono::steady_clock::now();
+    atexit(finish_recording);
+    return true;
+}
+
+/**
+ * Check whether keys are being recorded
+ * @return True while recording
+ */
+bool Session::is_recording() {
+    return record_file != nullptr;
+}
+
+/**
+ * Log one key
+ * Flushed right away so a session survives a crash or kill
+ * @param bytes Raw input bytes of the key
+ * @param rows Terminal rows
+ * @param cols Terminal columns
+ */
+void Session::record_key(const std::string& bytes, int rows, int cols) {
+    if (!record_file) {
+        return;
+    }
+
+    long long usec = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - record_start).count();
+    if (rows != recorded_rows || cols != recorded_cols) {
+        fprintf(record_file, "S %lld %d %d\n", usec, rows, cols);
+        recorded_rows = rows;
+        recorded_cols = cols;
+    }
+
+    fprintf(record_file, "K %lld ", usec);
+    for (char c : bytes) {
+        fprintf(record_file, "%02x", static_cast<unsigned char>(c));
+    }
+    fputc('\n', record_file);
+    fflush(record_file);
+}
+
+/**
+ * One key read back from a session file
+ */
+struct ReplayKey {
+    std::string bytes;               // Raw input bytes
+    long long usec;                  // Time recorded
+    int rows;                        // Terminal rows when pressed
+    int cols;                        // Terminal columns when pressed
+};
+
+/**
+ * Decode a hex string
+ * @param hex Hex digits
+ * @return Decoded bytes
+ */
+static std::string decode_hex(const std::string& hex) {
+    std::string bytes;
+    for (size_t i = 0; i + 1 < hex.size(); i += 2) {
+        bytes += static_cast<char>(std::stoi(hex.substr(i, 2), nullptr, 16));
+    }
+    return bytes;
+}
+
+/**
+ * Show key bytes in readable form
+ * @param bytes Raw input bytes
+ * @return Printable description such as ^[[A or 'x'
+ */
+static std::string describe_key(const std::string& bytes) {
+    std::string text;
+    for (char c : bytes) {
+        unsigned char byte = static_cast<unsigned char>(c);
+        if (byte < 32) {
+            text += '^';
+            text += static_cast<char>(byte + 64);
+        } else if (byte == 127) {
+            text += "^?";
+        } else {
+            text += c;
+        }
+    }
+    return text;
+}
+
+/**
+ * Replay a recorded session and print latency statistics
+ * Each key is fed through process_keypress and followed by a screen
+ * refresh into a fake terminal (/dev/null at the recorded window size);
+ * latency is measured from key arrival to the frame being written.
+ * Saves are discarded so replay never modifies files.
+ * @param config Editor configuration
+ * @param path Session file
+ * @param files Files to open, empty to use the recorded ones
+ * @return Process exit status
+ */
+int Session::replay(EditorConfig& config, const std::string& path, const std::vector<std::string>& files) {
+    std::ifstream input(path);
+    if (!input.is_open()) {
+        fprintf(stderr, "slowertext: cannot read session %s\n", path.c_str());
+        return 2;
+    }
+
+    // Parse the whole session first so file I/O stays out of the timings
+    std::vector<std::string> recorded_files;
+    std::vector<ReplayKey> keys;
+    int rows = 24;
+    int cols = 80;
+    std::string line;
+    while (std::getline(input, line)) {
+        if (line.size() < 2 || line[0] == '#') {
+            continue;
+        }
+        std::istringstream fields(line.substr(2));
+        if (line[0] == 'F') {
+            recorded_files.push_back(line.substr(2));
+        } else if (line[0] == 'S') {
+            long long usec;
+            fields >> usec >> rows >> cols;
+        } else if (line[0] == 'K') {
+            ReplayKey key;
+            std::string hex;
+            fields >> key.usec >> hex;
+            key.bytes = decode_hex(hex);
+            key.rows = rows;
+            key.cols = cols;
+            keys.push_back(key);
+        }
+    }
+
+    const std::vector<std::string>& open_list = files.empty() ? recorded_files : files;
+    if (open_list.empty()) {
+        buffer_list.open("");
+    } else {
+        buffer_list.open_files(open_list);
+    }
+    window_manager.init(buffer_list.get(0).buffer);
+    buffer_list.activate(0, window_manager.get_active(), config);
+
+    // The fake terminal: frames are written and counted, never shown
+    int sink = open("/dev/null", O_WRONLY);
+    Renderer::set_output(sink);
+    FileManager::set_dry_run(true);
+    config.screen_rows = (keys.empty() ? rows : keys.front().rows) - 2;
+    config.screen_cols = keys.empty() ? cols : keys.front().cols;
+    Renderer::refresh_screen(config);
+
+    unsigned long start_writes = 0;
+    unsigned long start_bytes = 0;
+    Renderer::get_output_stats(start_writes, start_bytes);
+    std::vector<double> latencies;
+    std::vector<std::pair<double, size_t>> slowest;
+    auto replay_start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < keys.size() && !config.quit; i++) {
+        const ReplayKey& key = keys[i];
+        if (key.rows - 2 != config.screen_rows || key.cols != config.screen_cols) {
+            // Resize as the SIGWINCH handler would
+            config.screen_rows = key.rows - 2;
+            config.screen_cols = key.cols;
+        }
+
+        auto started = std::chrono::steady_clock::now();
+        InputHandler::set_script_input(key.bytes);
+        while (!config.quit && InputHandler::wait_for_input(0)) {
+            InputHandler::process_keypress(config, *window_manager.get_active().buffer);
+        }
+        search_state.poll(config);
+        column_view.poll();
+        Renderer::refresh_screen(config);
+        double usec = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - started).count();
+
+        latencies.push_back(usec);
+        slowest.push_back(std::make_pair(usec, i));
+    }
+
+    double total_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - replay_start).count();
+    unsigned long writes = 0;
+    unsigned long bytes = 0;
+    Renderer::get_output_stats(writes, bytes);
+    writes -= start_writes;
+    bytes -= start_bytes;
+    Renderer::set_output(STDOUT_FILENO);
+    close(sink);
+
+    if (latencies.empty()) {
+        printf("Session %s has no keys\n", path.c_str());
+        return 0;
+    }
+
+    std::vector<double> sorted = latencies;
+    std::sort(sorted.begin(), sorted.end());
+    auto percentile = [&sorted](double percent) {
+        size_t rank = static_cast<size_t>(percent / 100.0 * static_cast<double>(sorted.size()) + 0.5);
+        return sorted[std::min(std::max(rank, static_cast<size_t>(1)), sorted.size()) - 1];
+    };
+
+    printf("Replayed %zu keys from %s in %.1f ms\n", latencies.size(), path.c_str(), total_ms);
+    printf("Input-to-frame latency: p50 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+           percentile(50) / 1000.0, percentile(99) / 1000.0, sorted.back() / 1000.0);
+    printf("Frames: %zu, write calls: %lu, bytes written: %lu (%.0f per frame)\n",
+           latencies.size(), writes, bytes, static_cast<double>(bytes) / static_cast<double>(latencies.size()));
+
+    // Histogram of per-key latency
+    std::vector<size_t> counts(LATENCY_BUCKET_COUNT + 1, 0);
+    for (double usec : latencies) {
+        int bucket = 0;
+        while (bucket < LATENCY_BUCKET_COUNT && usec >= LATENCY_BUCKETS[bucket]) {
+            bucket++;
+        }
+        counts[bucket]++;
+    }
+    size_t peak = *std::max_element(counts.begin(), counts.end());
+    printf("\nLatency histogram:\n");
+    for (int bucket = 0; bucket <= LATENCY_BUCKET_COUNT; bucket++) {
+        char label[32];
+        if (bucket < LATENCY_BUCKET_COUNT) {
+            snprintf(label, sizeof(label), "< %g ms", LATENCY_BUCKETS[bucket] / 1000.0);
+        } else {
+            snprintf(label, sizeof(label), ">= %g ms", LATENCY_BUCKETS[LATENCY_BUCKET_COUNT - 1] / 1000.0);
+        }
+        int width = peak ? static_cast<int>(40 * counts[bucket] / peak) : 0;
+        printf("  %10s |%-40s| %zu\n", label, std::string(static_cast<size_t>(width), '#').c_str(), counts[bucket]);
+    }
+
+    // Slowest keys point at what to reproduce
+    size_t shown = std::min(slowest.size(), static_cast<size_t>(5));
+    std::partial_sort(slowest.begin(), slowest.begin() + shown, slowest.end(),
+                      [](const std::pair<double, size_t>& a, const std::pair<double, size_t>& b) {
+                          return a.first > b.first;
+                      });
+    printf("\nSlowest keys:\n");
+    for (size_t i = 0; i < shown; i++) {
+        const ReplayKey& key = keys[slowest[i].second];
+        printf("  #%-6zu %-8s at %8.3f s  %.3f ms\n", slowest[i].second + 1, describe_key(key.bytes).c_str(),
+               static_cast<double>(key.usec) / 1e6, slowest[i].first / 1000.0);
+    }
+    return 0;
+}
@@ -0,0 +1,68 @@
+#include "../include/slowertext.h"
+#include <cstdio>
+
+// Phases recorded so far; names are string literals
+static const int MAX_PHASES = 32;
+static const char* phase_names[MAX_PHASES];
+static unsigned long long phase_ends[MAX_PHASES];
+static int phase_count = 0;
+static bool profiling = false;
+static bool reported = false;
+static bool finished = false;
+
+/**
+ * Start collecting phase timings
+ */
+void StartupProfile::enable() {
+    profiling = true;
+}
+
+/**
+ * End the current startup phase
+ * Phases are also recorded as trace spans.
+ * @param name Phase name, a string literal
+ */
+void StartupProfile::phase(const char* name) {
+    unsigned long long now = Trace::now();
+    if (finished) {
+        Trace::record(TRACE_STARTUP_PHASE, now, 0, 0, 0, name);
+        return;
+    }
+    unsigned long long start = phase_count > 0 ? phase_ends[phase_count - 1] : 0;
+    Trace::record(TRACE_STARTUP_PHASE, start, now - start, 0, 0, name);
+    if (!profiling || phase_count == MAX_PHASES) {
+        return;
+    }
+    phase_names[phase_count] = name;
+    phase_ends[phase_count] = now;
+    phase_count++;
+}
+
+/**
+ * Stop collecting; later phases are traced as instants
+ * Keeps config reloads after startup out of the report.
+ */
+void StartupProfile::finish() {
+    finished = true;
+}
+
+/**
+ * Print the phase timings to stderr, once
+ * Called after the terminal is restored so the report stays visible.
+ */
+void StartupProfile::report() {
+    if (!profiling || reported || phase_count == 0) {
+        return;
+    }
+    reported = true;
+
+    unsigned long long total = phase_ends[phase_count - 1];
+    fprintf(stderr, "Startup profile (%.3f ms since process start):\n", static_cast<double>(total) / 1e6);
+    unsigned long long start = 0;
+    for (int i = 0; i < phase_count; i++) {
+        unsigned long long elapsed = phase_ends[i] - start;
+        fprintf(stderr, "  %-20s %9.3f ms  %5.1f%%\n", phase_names[i], static_cast<double>(elapsed) / 1e6,
+                total ? 100.0 * static_cast<double>(elapsed) / static_cast<double>(total) : 0.0);
+        start = phase_ends[i];
+    }
+}
@@ -0,0 +1,348 @@
+#include "../include/slowertext.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <regex>
+
+// Ranges smaller than this are not worth splitting across threads
+static const int MIN_LINES_PER_WORKER = 4096;
+
+/**
+ * Check whether a pattern contains regex metacharacters
+ * @param pattern Pattern to check
+ * @return True if the pattern matches only itself
+ */
+static bool is_literal_pattern(const std::string& pattern) {
+    return pattern.find_first_of(".^$*+?()[]{}|\\") == std::string::npos;
+}
+
+/**
+ * Translate a vi-style replacement into std::regex format syntax
+ * & and \0 insert the whole match, \1-\9 insert groups, \& is a literal &
+ * @param replacement Replacement as typed
+ * @return Replacement for std::match_results::format
+ */
+static std::string to_regex_format(const std::string& replacement) {
+    std::string format;
+    for (size_t i = 0; i < replacement.size(); i++) {
+        char c = replacement[i];
+        if (c == '\\' && i + 1 < replacement.size()) {
+            char next = replacement[++i];
+            if (next >= '0' && next <= '9') {
+                format += (next == '0') ? std::string("$&") : std::string("$") + next;
+            } else if (next == 't') {
+                format += '\t';
+            } else {
+                format += next;  // \& \\ \/ become literal characters
+            }
+        } else if (c == '&') {
+            format += "$&";
+        } else if (c == '$') {
+            format += "$$";
+        } else {
+            format += c;
+        }
+    }
+    return format;
+}
+
+/**
+ * Translate a vi-style replacement for literal patterns
+ * & and \0 insert the matched text, other escapes are literal
+ * @param replacement Replacement as typed
+ * @param pattern Literal pattern (the whole match)
+ * @return Expanded replacement text
+ */
+static std::string expand_literal_replacement(const std::string& replacement, const std::string& pattern) {
+    std::string text;
+    for (size_t i = 0; i < replacement.size(); i++) {
+        char c = replacement[i];
+        if (c == '\\' && i + 1 < replacement.size()) {
+            char next = replacement[++i];
+            text += (next == '0') ? pattern : (next == 't') ? std::string("\t") : std::string(1, next);
+        } else if (c == '&') {
+            text += pattern;
+        } else {
+            text += c;
+        }
+    }
+    return text;
+}
+
+/**
+ * Parse a substitution command of the form s/pattern/replacement/flags
+ * Any punctuation may serve as delimiter; it can be escaped with \
+ * @param command Command text starting at the 's'
+ * @param pattern Receives the pattern
+ * @param replacement Receives the replacement
+ * @param flags Receives the flags
+ * @return True if the command is well formed
+ */
+bool Substitution::parse(const std::string& command, std::string& pattern,
+                         std::string& replacement, std::string& flags) {
+    if (command.size() < 2 || command[0] != 's' || isalnum(static_cast<unsigned char>(command[1])) ||
+        command[1] == ' ' || command[1] == '\\') {
+        return false;
+    }
+
+    char delimiter = command[1];
+    std::string* parts[3] = {&pattern, &replacement, &flags};
+    int part = 0;
+    pattern.clear();
+    replacement.clear();
+    flags.clear();
+
+    for (size_t i = 2; i < command.size(); i++) {
+        char c = command[i];
+        if (part < 2 && c == '\\' && i + 1 < command.size() && command[i + 1] == delimiter) {
+            // Escaped delimiter stands for itself
+            *parts[part] += delimiter;
+            i++;
+        } else if (part < 2 && c == '\\' && i + 1 < command.size()) {
+            *parts[part] += c;
+            *parts[part] += command[++i];
+        } else if (part < 2 && c == delimiter) {
+            part++;
+        } else {
+            *parts[part] += c;
+        }
+    }
+
+    for (char flag : flags) {
+        if (flag != 'g' && flag != 'i') {
+            return false;
+        }
+    }
+    return !pattern.empty();
+}
+
+/**
+ * Compute replacements for a slice of lines
+ * @param lines Buffer lines
+ * @param rows Rows to visit, or null to visit rows first..last directly
+ * @param first First index of the slice
+ * @param last Index after the slice
+ * @param plan Parsed substitution
+ * @param cancel Set to stop early
+ * @param out Receives changed lines in order
+ * @param matched Receives number of matches
+ */
+static void substitute_slice(const std::vector<Line>& lines, const std::vector<int>* rows, int first, int last,
+                             const SubstitutePlan& plan, const std::atomic<bool>& cancel,
+                             std::vector<LineChange>& out, long& matched) {
+    matched = 0;
+
+    if (plan.literal) {
+        const std::string& needle = plan.pattern;
+        for (int i = first; i < last; i++) {
+            if ((i & 255) == 0 && cancel) {
+                return;
+            }
+            int y = rows ? (*rows)[i] : i;
+            const Line& line = lines[y];
+            size_t pos = SearchState::find_literal(line.data(), line.size(), needle.data(), needle.size());
+            if (pos == std::string::npos) {
+                continue;
+            }
+
+            std::string result;
+            result.reserve(line.size() + plan.replacement.size());
+            size_t from = 0;
+            do {
+                result.append(line.data() + from, pos);
+                result += plan.replacement;
+                from += pos + needle.size();
+                matched++;
+                if (!plan.global) {
+                    break;
+                }
+                pos = SearchState::find_literal(line.data() + from, line.size() - from, needle.data(), needle.size());
+            } while (pos != std::string::npos);
+            result.append(line.data() + from, line.size() - from);
+            out.push_back({y, std::move(result)});
+        }
+        return;
+    }
+
+    // Each worker compiles its own regex so no state is shared
+    std::regex::flag_type syntax = std::regex::ECMAScript | std::regex::optimize;
+    if (plan.ignore_case) {
+        syntax |= std::regex::icase;
+    }
+    std::regex re(plan.pattern, syntax);
+
+    for (int i = first; i < last; i++) {
+        if ((i & 255) == 0 && cancel) {
+            return;
+        }
+        int y = rows ? (*rows)[i] : i;
+        const Line& line = lines[y];
+        std::cregex_iterator it(line.begin(), line.end(), re);
+        std::cregex_iterator end;
+        if (it == end) {
+            continue;
+        }
+
+        std::string result;
+        const char* tail = line.begin();
+        for (; it != end; ++it) {
+            const std::cmatch& match = *it;
+            result.append(tail, match[0].first);
+            result += match.format(plan.replacement);
+            tail = match[0].second;
+            matched++;
+            if (!plan.global) {
+                break;
+            }
+        }
+        result.append(tail, line.end());
+        out.push_back({y, std::move(result)});
+    }
+}
+
+/**
+ * Run a substitution over a line range on worker threads
+ * The range is partitioned into contiguous slices; each worker collects
+ * its replacements separately and the results are committed as one
+ * buffer transaction (one undo record, one redraw)
+ * @param buffer Buffer to modify
+ * @param first First row
+ * @param last Last row (inclusive)
+ * @param plan Parsed substitution
+ * @param should_cancel Polled on the calling thread while workers run
+ * @return Counts and timing of the run
+ */
+SubstituteResult Substitution::run(Buffer& buffer, int first, int last, const SubstitutePlan& plan,
+                                   bool (*should_cancel)()) {
+    first = std::max(first, 0);
+    last = std::min(last, buffer.get_line_count() - 1);
+    if (first > last) {
+        SubstituteResult result = {0, 0, 0.0, false};
+        return result;
+    }
+    return run_slices(buffer, nullptr, first, last + 1, plan, should_cancel);
+}
+
+/**
+ * Run a substitution over selected rows on worker threads
+ * @param buffer Buffer to modify
+ * @param rows Rows to visit in ascending order
+ * @param plan Parsed substitution
+ * @param should_cancel Polled on the calling thread while workers run
+ * @return Counts and timing of the run
+ */
+SubstituteResult Substitution::run_rows(Buffer& buffer, const std::vector<int>& rows, const SubstitutePlan& plan,
+                                        bool (*should_cancel)()) {
+    return run_slices(buffer, &rows, 0, static_cast<int>(rows.size()), plan, should_cancel);
+}
+
+/**
+ * Partition work across threads and commit the collected changes
+ * @param buffer Buffer to modify
+ * @param rows Rows to visit, or null for a contiguous row range
+ * @param first First index (row, or position in rows)
+ * @param end Index after the last one
+ * @param plan Parsed substitution
+ * @param should_cancel Polled on the calling thread while workers run
+ * @return Counts and timing of the run
+ */
+SubstituteResult Substitution::run_slices(Buffer& buffer, const std::vector<int>* rows, int first, int end,
+                                          const SubstitutePlan& plan, bool (*should_cancel)()) {
+    auto started = std::chrono::steady_clock::now();
+    SubstituteResult result = {0, 0, 0.0, false};
+    if (first >= end) {
+        return result;
+    }
+
+    // Validate the regex up front so errors are reported, not thrown in workers
+    if (!plan.literal) {
+        std::regex check(plan.pattern, std::regex::ECMAScript);
+        (void)check;
+    }
+
+    int total = end - first;
+    int worker_count = static_cast<int>(std::thread::hardware_concurrency());
+    if (worker_count < 1) worker_count = 1;
+    worker_count = std::max(1, std::min(worker_count, total / MIN_LINES_PER_WORKER));
+
+    const std::vector<Line>& lines = buffer.get_lines();
+    std::vector<std::vector<LineChange>> changes(worker_count);
+    std::vector<long> matched(worker_count, 0);
+    std::atomic<bool> cancel(false);
+    int finished = 0;
+    std::mutex finished_mutex;
+    std::condition_variable finished_cv;
+    std::vector<std::thread> workers;
+
+    for (int w = 0; w < worker_count; w++) {
+        int slice_first = first + static_cast<int>(static_cast<long>(total) * w / worker_count);
+        int slice_last = first + static_cast<int>(static_cast<long>(total) * (w + 1) / worker_count);
+        workers.emplace_back([&, w, slice_first, slice_last]() {
+            {
+                TraceSpan span(TRACE_SUBSTITUTE_SLICE);
+                span.a = slice_first;
+                substitute_slice(lines, rows, slice_first, slice_last, plan, cancel, changes[w], matched[w]);
+                span.b = matched[w];
+            }
+            std::lock_guard<std::mutex> lock(finished_mutex);
+            finished++;
+            finished_cv.notify_one();
+        });
+    }
+
+    // Keep watching for cancellation while the workers run
+    {
+        std::unique_lock<std::mutex> lock(finished_mutex);
+        while (!finished_cv.wait_for(lock, std::chrono::milliseconds(20),
+                                     [&]() { return finished == worker_count; })) {
+            if (should_cancel && should_cancel()) {
+                cancel = true;
+                break;
+            }
+        }
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    if (cancel) {
+        result.cancelled = true;
+    } else {
+        // Slices are in line order, so concatenation keeps changes sorted
+        std::vector<LineChange> all;
+        for (std::vector<LineChange>& slice : changes) {
+            if (all.empty()) {
+                all.swap(slice);
+            } else {
+                all.insert(all.end(), std::make_move_iterator(slice.begin()), std::make_move_iterator(slice.end()));
+            }
+        }
+        for (long count : matched) {
+            result.matched += count;
+        }
+        result.lines_changed = static_cast<long>(all.size());
+        buffer.apply_line_changes(all);
+    }
+
+    result.elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+    return result;
+}
+
+/**
+ * Build a substitution plan from parsed command parts
+ * @param pattern Pattern text
+ * @param replacement Replacement text as typed
+ * @param flags Flags (g = all matches in line, i = ignore case)
+ * @return Plan ready for run()
+ */
+SubstitutePlan Substitution::make_plan(const std::string& pattern, const std::string& replacement,
+                                       const std::string& flags) {
+    SubstitutePlan plan;
+    plan.global = flags.find('g') != std::string::npos;
+    plan.ignore_case = flags.find('i') != std::string::npos;
+    plan.literal = !plan.ignore_case && is_literal_pattern(pattern);
+    plan.pattern = pattern;
+    plan.replacement = plan.literal ? expand_literal_replacement(replacement, pattern)
+                                    : to_regex_format(replacement);
+    return plan;
+}
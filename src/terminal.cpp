@@ -7,10 +7,10 @@
 
 /**
  * Terminal constructor
- * Enables raw mode for character-by-character input
+ * Raw mode is enabled by init_editor() for interactive sessions only, so
+ * headless runs never touch the TTY
  */
-Terminal::Terminal() {
-    enable_raw_mode();
+Terminal::Terminal() : raw_enabled(false) {
 }
 
 /**
@@ -18,6 +18,9 @@ Terminal::Terminal() {
  * Restores original terminal settings and cleans up display
  */
 Terminal::~Terminal() {
+    if (!raw_enabled) {
+        return;
+    }
     disable_raw_mode();
     clear_screen();
     set_cursor_position(0, 0);
@@ -59,18 +62,32 @@ void Terminal::enable_raw_mode() {
         perror("tcsetattr");
         exit(1);
     }
+    raw_enabled = true;
 }
 
 /**
  * Disable raw mode and restore original terminal settings
  */
 void Terminal::disable_raw_mode() {
+    if (!raw_enabled) {
+        return;
+    }
+    raw_enabled = false;
     if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &orig_termios) == -1) {
         perror("tcsetattr");
         exit(1);
     }
 }
 
+/**
+ * Forget raw mode without restoring settings
+ * Used by the server when a client's terminal has gone away, where
+ * restoring would fail.
+ */
+void Terminal::abandon_raw_mode() {
+    raw_enabled = false;
+}
+
 /**
  * Get terminal window size
  * @param rows Pointer to store number of rows
@@ -0,0 +1,260 @@
+#include "../include/slowertext.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+/*
+ * Ring of trace records. Writers claim a ticket with one fetch_add and
+ * publish the slot with a sequence number (odd while writing, even when
+ * complete), so a reader can tell finished records from ones being
+ * overwritten without any lock.
+ */
+static const unsigned long long TRACE_CAPACITY = 1 << 15;
+
+struct TraceSlot {
+    std::atomic<unsigned long long> sequence;
+    TraceRecord record;
+};
+
+static TraceSlot trace_ring[TRACE_CAPACITY];
+static std::atomic<unsigned long long> trace_head(0);
+static std::atomic<unsigned long long> trace_floor(0);  // First ticket kept after clear()
+static std::atomic<bool> trace_enabled(true);
+static std::atomic<unsigned int> next_thread_id(0);
+static const std::chrono::steady_clock::time_point trace_start = std::chrono::steady_clock::now();
+static std::string exit_dump_path;
+
+/**
+ * Names shown in the trace viewer, with the meaning of the payload values
+ */
+struct TraceEventInfo {
+    const char* name;
+    const char* a_name;              // nullptr if unused
+    const char* b_name;              // nullptr if unused
+};
+
+static const TraceEventInfo EVENT_INFO[TRACE_EVENT_COUNT] = {
+    {"config_load", "values", "snapshot"},
+    {"config_value", "line", nullptr},
+    {"config_error", nullptr, nullptr},
+    {"frame", "bytes", nullptr},
+    {"key", "code", nullptr},
+    {"command", nullptr, nullptr},
+    {"file_load", "lines", nullptr},
+    {"file_save", "lines", nullptr},
+    {"search_scan", "matches", nullptr},
+    {"substitute_slice", "first_row", "matches"},
+    {"startup_phase", nullptr, nullptr},
+    {"buffer_compact", "reclaimed", nullptr},
+    {"sort_slice", "first_row", "rows"},
+    {"filter", "written", "read"},
+    {"diff", "rows", "hunks"},
+    {"column_sample", "rows", "columns"},
+};
+
+/**
+ * Small id of the calling thread, assigned on first use
+ * @return Thread id, 1 for the first thread that records
+ */
+static unsigned int current_thread_id() {
+    thread_local unsigned int id = next_thread_id.fetch_add(1, std::memory_order_relaxed) + 1;
+    return id;
+}
+
+/**
+ * Current trace timestamp
+ * @return Nanoseconds since the process started
+ */
+unsigned long long Trace::now() {
+    return static_cast<unsigned long long>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - trace_start).count());
+}
+
+/**
+ * Record an event
+ * @param event Event identifier
+ * @param start Start timestamp from now()
+ * @param duration Span length in nanoseconds, 0 for an instant event
+ * @param a First payload value
+ * @param b Second payload value
+ * @param text Text payload or nullptr
+ */
+void Trace::record(TraceEvent event, unsigned long long start, unsigned long long duration,
+                   long long a, long long b, const char* text) {
+    if (!trace_enabled.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    unsigned long long ticket = trace_head.fetch_add(1, std::memory_order_relaxed);
+    TraceSlot& slot = trace_ring[ticket & (TRACE_CAPACITY - 1)];
+    slot.sequence.store(2 * ticket + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    TraceRecord& record = slot.record;
+    record.timestamp = start;
+    record.duration = duration;
+    record.a = a;
+    record.b = b;
+    record.event = static_cast<unsigned int>(event);
+    record.thread = current_thread_id();
+    size_t length = 0;
+    if (text) {
+        while (length + 1 < sizeof(record.text) && text[length]) {
+            record.text[length] = text[length];
+            length++;
+        }
+        // Do not cut a UTF-8 sequence in half
+        while (text[length] && length > 0 && (static_cast<unsigned char>(text[length]) & 0xC0) == 0x80) {
+            length--;
+        }
+    }
+    record.text[length] = '\0';
+
+    slot.sequence.store(2 * ticket + 2, std::memory_order_release);
+}
+
+/**
+ * Record an instant event
+ * @param event Event identifier
+ * @param a First payload value
+ * @param b Second payload value
+ * @param text Text payload or nullptr
+ */
+void Trace::instant(TraceEvent event, long long a, long long b, const char* text) {
+    record(event, now(), 0, a, b, text);
+}
+
+/**
+ * Enable or disable recording
+ * @param enabled Whether events are recorded
+ */
+void Trace::set_enabled(bool enabled) {
+    trace_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+/**
+ * Check whether events are recorded
+ * @return True if enabled
+ */
+bool Trace::is_enabled() {
+    return trace_enabled.load(std::memory_order_relaxed);
+}
+
+/**
+ * Drop all recorded events
+ * Only moves the start of the dump window; slots are overwritten lazily.
+ */
+void Trace::clear() {
+    trace_floor.store(trace_head.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+/**
+ * Write a string as a JSON string literal
+ * @param out Output file
+ * @param text NUL-terminated text
+ */
+static void write_json_string(FILE* out, const char* text) {
+    fputc('"', out);
+    for (const char* c = text; *c; c++) {
+        unsigned char byte = static_cast<unsigned char>(*c);
+        if (byte == '"' || byte == '\\') {
+            fputc('\\', out);
+            fputc(byte, out);
+        } else if (byte < 32) {
+            fprintf(out, "\\u%04x", byte);
+        } else {
+            fputc(byte, out);
+        }
+    }
+    fputc('"', out);
+}
+
+/**
+ * Write the recorded events as Chrome trace-event JSON
+ * Records still being written or already overwritten are skipped.
+ * @param path Output file
+ * @return Number of events written, -1 if the file could not be written
+ */
+long Trace::dump(const std::string& path) {
+    FILE* out = fopen(path.c_str(), "w");
+    if (!out) {
+        return -1;
+    }
+
+    unsigned long long head = trace_head.load(std::memory_order_acquire);
+    unsigned long long first = head > TRACE_CAPACITY ? head - TRACE_CAPACITY : 0;
+    first = std::max(first, trace_floor.load(std::memory_order_relaxed));
+    long written = 0;
+    int pid = static_cast<int>(getpid());
+
+    fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    fprintf(out, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":1,\"args\":{\"name\":\"slowertext\"}}", pid);
+    for (unsigned long long ticket = first; ticket < head; ticket++) {
+        TraceSlot& slot = trace_ring[ticket & (TRACE_CAPACITY - 1)];
+        unsigned long long sequence = slot.sequence.load(std::memory_order_acquire);
+        if (sequence != 2 * ticket + 2) {
+            continue;
+        }
+        TraceRecord record;
+        memcpy(&record, &slot.record, sizeof(record));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) != sequence || record.event >= TRACE_EVENT_COUNT) {
+            continue;
+        }
+        record.text[sizeof(record.text) - 1] = '\0';
+
+        const TraceEventInfo& info = EVENT_INFO[record.event];
+        fprintf(out, ",\n{\"name\":\"%s\",\"cat\":\"slowertext\",\"pid\":%d,\"tid\":%u,\"ts\":%.3f",
+                info.name, pid, record.thread, static_cast<double>(record.timestamp) / 1000.0);
+        if (record.duration > 0) {
+            fprintf(out, ",\"ph\":\"X\",\"dur\":%.3f", static_cast<double>(record.duration) / 1000.0);
+        } else {
+            fprintf(out, ",\"ph\":\"i\",\"s\":\"t\"");
+        }
+        fprintf(out, ",\"args\":{");
+        const char* separator = "";
+        if (info.a_name) {
+            fprintf(out, "\"%s\":%lld", info.a_name, record.a);
+            separator = ",";
+        }
+        if (info.b_name) {
+            fprintf(out, "%s\"%s\":%lld", separator, info.b_name, record.b);
+            separator = ",";
+        }
+        if (record.text[0]) {
+            fprintf(out, "%s\"text\":", separator);
+            write_json_string(out, record.text);
+        }
+        fprintf(out, "}}");
+        written++;
+    }
+    fprintf(out, "\n]}\n");
+
+    bool ok = !ferror(out);
+    if (fclose(out) != 0 || !ok) {
+        return -1;
+    }
+    return written;
+}
+
+/**
+ * Write the exit dump
+ */
+static void dump_at_exit() {
+    if (!exit_dump_path.empty()) {
+        Trace::dump(exit_dump_path);
+    }
+}
+
+/**
+ * Dump the trace to a file when the process exits
+ * @param path Output file, empty to disable
+ */
+void Trace::set_exit_dump(const std::string& path) {
+    static bool registered = false;
+    exit_dump_path = path;
+    if (!registered && !path.empty()) {
+        atexit(dump_at_exit);
+        registered = true;
+    }
+}
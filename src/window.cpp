@@ -0,0 +1,378 @@
+#include "../include/slowertext.h"
+
+// Smallest window that a split may produce (text rows / columns)
+static const int MIN_WINDOW_ROWS = 1;
+static const int MIN_WINDOW_COLS = 10;
+
+/**
+ * Create a window over a buffer with cursor at the top of the file
+ * @param buffer Buffer to show
+ * @return New window, marked dirty
+ */
+static std::unique_ptr<Window> make_window(std::shared_ptr<Buffer> buffer) {
+    std::unique_ptr<Window> window(new Window());
+    window->buffer = buffer;
+    window->cursor_x = 0;
+    window->cursor_y = 0;
+    window->row_offset = 0;
+    window->col_offset = 0;
+    window->cursor_row = 0;
+    window->cursor_col = 0;
+    window->top = 0;
+    window->left = 0;
+    window->rows = 0;
+    window->cols = 0;
+    window->dirty = true;
+    window->drawn_version = 0;
+    window->drawn_row_offset = -1;
+    window->drawn_col_offset = -1;
+    window->drawn_cursor_y = -1;
+    window->drawn_folds = 0;
+    window->drawn_cursors = 0;
+    window->drawn_visual = false;
+    window->drawn_diff = 0;
+    window->drawn_columns = 0;
+    window->drawn_search = 0;
+    window->drawn_status = StatusKey();
+    window->drawn_status.cols = -1;
+    return window;
+}
+
+/**
+ * Create a leaf layout node for a window
+ * @param window Window held by the leaf
+ * @param parent Parent node
+ * @return New leaf node
+ */
+static std::unique_ptr<LayoutNode> make_leaf(Window* window, LayoutNode* parent) {
+    std::unique_ptr<LayoutNode> node(new LayoutNode());
+    node->split = LayoutNode::LEAF;
+    node->window = window;
+    node->parent = parent;
+    return node;
+}
+
+/**
+ * WindowManager constructor
+ * The manager stays empty until init() is called
+ */
+WindowManager::WindowManager()
+    : active(nullptr), layout_rows(0), layout_cols(0), layout_changed(true) {
+}
+
+/**
+ * Create the initial full-screen window
+ * @param buffer Buffer to show
+ */
+void WindowManager::init(std::shared_ptr<Buffer> buffer) {
+    windows.clear();
+    windows.push_back(make_window(buffer));
+    active = windows.back().get();
+    root = make_leaf(active, nullptr);
+    layout_changed = true;
+}
+
+/**
+ * Find the leaf node holding a window
+ * @param node Subtree to search
+ * @param window Window to find
+ * @return Leaf node, or null if not found
+ */
+LayoutNode* WindowManager::find_leaf(LayoutNode* node, const Window* window) const {
+    if (!node) {
+        return nullptr;
+    }
+    if (node->split == LayoutNode::LEAF) {
+        return node->window == window ? node : nullptr;
+    }
+    LayoutNode* found = find_leaf(node->first.get(), window);
+    return found ? found : find_leaf(node->second.get(), window);
+}
+
+/**
+ * Get the top-left window of a subtree
+ * @param node Subtree root
+ * @return First window in layout order
+ */
+Window* WindowManager::first_window(LayoutNode* node) const {
+    while (node && node->split != LayoutNode::LEAF) {
+        node = node->first.get();
+    }
+    return node ? node->window : nullptr;
+}
+
+/**
+ * Split the active window
+ * The new window shows the same buffer with the same cursor and takes
+ * the top (or left) half, receiving focus
+ * @param vertical True for side-by-side, false for stacked
+ * @return True if the split fit on screen
+ */
+bool WindowManager::split(bool vertical) {
+    if (!active) {
+        return false;
+    }
+
+    // Refuse splits that would leave a window too small to use
+    if (vertical && active->cols < 2 * MIN_WINDOW_COLS + 1) {
+        return false;
+    }
+    if (!vertical && active->rows + 1 < 2 * (MIN_WINDOW_ROWS + 1)) {
+        return false;
+    }
+
+    LayoutNode* leaf = find_leaf(root.get(), active);
+    if (!leaf) {
+        return false;
+    }
+
+    // New window starts as a copy of the active view
+    std::unique_ptr<Window> window = make_window(active->buffer);
+    window->cursor_x = active->cursor_x;
+    window->cursor_y = active->cursor_y;
+    window->row_offset = active->row_offset;
+    window->col_offset = active->col_offset;
+    Window* created = window.get();
+    windows.push_back(std::move(window));
+
+    // Turn the leaf into a split node with the new window first
+    Window* old_window = leaf->window;
+    leaf->split = vertical ? LayoutNode::VERTICAL : LayoutNode::HORIZONTAL;
+    leaf->window = nullptr;
+    leaf->first = make_leaf(created, leaf);
+    leaf->second = make_leaf(old_window, leaf);
+
+    active = created;
+    layout_changed = true;
+    return true;
+}
+
+/**
+ * Close the active window
+ * Its sibling subtree takes over the freed area
+ * @return False if it is the last window
+ */
+bool WindowManager::close_active() {
+    if (!active || windows.size() <= 1) {
+        return false;
+    }
+
+    LayoutNode* leaf = find_leaf(root.get(), active);
+    if (!leaf || !leaf->parent) {
+        return false;
+    }
+
+    // Replace the parent split with the remaining sibling
+    LayoutNode* parent = leaf->parent;
+    std::unique_ptr<LayoutNode> sibling = (parent->first.get() == leaf) ?
+        std::move(parent->second) : std::move(parent->first);
+    sibling->parent = parent->parent;
+
+    Window* closed = active;
+    active = first_window(sibling.get());
+
+    if (!parent->parent) {
+        root = std::move(sibling);
+    } else if (parent->parent->first.get() == parent) {
+        parent->parent->first = std::move(sibling);
+    } else {
+        parent->parent->second = std::move(sibling);
+    }
+
+    for (auto it = windows.begin(); it != windows.end(); ++it) {
+        if (it->get() == closed) {
+            windows.erase(it);
+            break;
+        }
+    }
+
+    layout_changed = true;
+    return true;
+}
+
+/**
+ * Close every window except the active one
+ */
+void WindowManager::only() {
+    if (!active || windows.size() <= 1) {
+        return;
+    }
+
+    for (auto it = windows.begin(); it != windows.end(); ) {
+        if (it->get() != active) {
+            it = windows.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    root = make_leaf(active, nullptr);
+    layout_changed = true;
+}
+
+/**
+ * Move focus to the next or previous window in layout order
+ * @param direction 1 for next, -1 for previous
+ */
+void WindowManager::cycle(int direction) {
+    if (windows.size() <= 1) {
+        return;
+    }
+
+    // Collect leaves in layout order (top-left to bottom-right)
+    std::vector<Window*> order;
+    std::vector<LayoutNode*> stack;
+    stack.push_back(root.get());
+    while (!stack.empty()) {
+        LayoutNode* node = stack.back();
+        stack.pop_back();
+        if (node->split == LayoutNode::LEAF) {
+            order.push_back(node->window);
+        } else {
+            stack.push_back(node->second.get());
+            stack.push_back(node->first.get());
+        }
+    }
+
+    int count = static_cast<int>(order.size());
+    for (int i = 0; i < count; i++) {
+        if (order[i] == active) {
+            active = order[((i + direction) % count + count) % count];
+            break;
+        }
+    }
+
+    // Focus change alters status line and cursor row highlighting
+    for (auto& window : windows) {
+        window->dirty = true;
+    }
+}
+
+/**
+ * Move focus to a window
+ * @param window Window to focus, ignored if it is not open
+ */
+void WindowManager::focus(Window* window) {
+    for (auto& open : windows) {
+        if (open.get() == window) {
+            active = window;
+        }
+        open->dirty = true;
+    }
+}
+
+/**
+ * Copy cursor and scroll state from config into the active window
+ * @param config Editor configuration
+ */
+void WindowManager::store_cursor(const EditorConfig& config) {
+    if (!active) {
+        return;
+    }
+    active->cursor_x = config.cursor_x;
+    active->cursor_y = config.cursor_y;
+    active->row_offset = config.row_offset;
+    active->col_offset = config.col_offset;
+}
+
+/**
+ * Copy cursor and scroll state of the active window into config
+ * @param config Editor configuration
+ */
+void WindowManager::load_cursor(EditorConfig& config) const {
+    if (!active) {
+        return;
+    }
+    config.cursor_x = active->cursor_x;
+    config.cursor_y = active->cursor_y;
+    config.row_offset = active->row_offset;
+    config.col_offset = active->col_offset;
+    if (active->buffer) {
+        config.filename = active->buffer->get_filename();
+        config.modified = active->buffer->is_modified();
+    }
+}
+
+/**
+ * Assign screen rectangles to a layout subtree
+ * Each leaf area includes one status line below its text rows, and
+ * side-by-side windows are separated by a one-column bar
+ * @param node Subtree root
+ * @param top First screen row
+ * @param left First screen column
+ * @param rows Height including status lines
+ * @param cols Width
+ */
+void WindowManager::layout_node(LayoutNode* node, int top, int left, int rows, int cols) {
+    if (node->split == LayoutNode::LEAF) {
+        Window* window = node->window;
+        window->top = top;
+        window->left = left;
+        window->rows = rows > 1 ? rows - 1 : 0;
+        window->cols = cols > 0 ? cols : 0;
+        window->dirty = true;
+        return;
+    }
+
+    if (node->split == LayoutNode::HORIZONTAL) {
+        int first_rows = rows / 2;
+        layout_node(node->first.get(), top, left, first_rows, cols);
+        layout_node(node->second.get(), top + first_rows, left, rows - first_rows, cols);
+    } else {
+        int first_cols = (cols - 1) / 2;
+        layout_node(node->first.get(), top, left, rows, first_cols);
+        separators.push_back({top, left + first_cols, rows});
+        layout_node(node->second.get(), top, left + first_cols + 1, rows, cols - first_cols - 1);
+    }
+}
+
+/**
+ * Recompute window rectangles if the screen size or layout changed
+ * @param rows Rows available for windows (text and status lines)
+ * @param cols Columns available for windows
+ * @return True if the layout changed and a full redraw is needed
+ */
+bool WindowManager::update_layout(int rows, int cols) {
+    if (!layout_changed && rows == layout_rows && cols == layout_cols) {
+        return false;
+    }
+
+    separators.clear();
+    if (root) {
+        layout_node(root.get(), 0, 0, rows, cols);
+    }
+    layout_rows = rows;
+    layout_cols = cols;
+    layout_changed = false;
+    return true;
+}
+
+/**
+ * Force a full redraw on next refresh
+ */
+void WindowManager::invalidate() {
+    layout_changed = true;
+}
+
+/**
+ * Get the window with focus
+ * @return Active window
+ */
+Window& WindowManager::get_active() {
+    return *active;
+}
+
+/**
+ * Get all windows in creation order
+ * @return Const reference to windows
+ */
+const std::vector<std::unique_ptr<Window>>& WindowManager::get_windows() const {
+    return windows;
+}
+
+/**
+ * Get vertical separators of the current layout
+ * @return Const reference to separators
+ */
+const std::vector<WindowSeparator>& WindowManager::get_separators() const {
+    return separators;
+}